@@ -14,6 +14,7 @@
 #include <command.h>
 #include <cpu_func.h>
 #include <irq_func.h>
+#include <job.h>
 #include <asm/cache.h>
 #include <asm/system.h>
 #include <asm/secure.h>
@@ -46,6 +47,10 @@ int cleanup_before_linux(void)
 
 	board_cleanup_before_linux();
 
+	/* The OS starts the secondary CPUs itself */
+	if (CONFIG_IS_ENABLED(JOB))
+		job_stop();
+
 	disable_interrupts();
 
 	/*
@@ -0,0 +1,228 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Running jobs on secondary CPUs started with PSCI
+ *
+ * Each CPU listed in /cpus, apart from the boot CPU, is started with CPU_ON
+ * at job_secondary_entry. It takes on the boot CPU's page tables, then waits
+ * for an event (SEV) and runs queued jobs. Before the OS starts, the CPUs are
+ * turned off again with CPU_OFF, so that the OS can start them itself.
+ */
+
+#define LOG_CATEGORY	LOGC_BOOT
+
+#include <common.h>
+#include <cpu_func.h>
+#include <dm.h>
+#include <job.h>
+#include <log.h>
+#include <malloc.h>
+#include <time.h>
+#include <asm/cache.h>
+#include <asm/global_data.h>
+#include <asm/system.h>
+#include <linux/build_bug.h>
+#include <linux/psci.h>
+#include <linux/sizes.h>
+#include "job_arm.h"
+
+DECLARE_GLOBAL_DATA_PTR;
+
+/* Stack for each secondary CPU */
+#define JOB_CPU_STACK_SIZE	SZ_32K
+
+/* Time allowed for a CPU to start, or to turn off */
+#define JOB_CPU_TIMEOUT_MS	1000
+
+/* The MPIDR affinity fields */
+#define MPIDR_AFF_MASK		0xff00ffffffUL
+
+static struct job_arm_cpu *job_cpus;
+static int job_ncpus;
+static int job_stopping;
+
+void job_secondary_main(struct job_arm_cpu *cpu)
+{
+	__atomic_store_n(&cpu->running, 1, __ATOMIC_RELEASE);
+	while (!__atomic_load_n(&job_stopping, __ATOMIC_ACQUIRE)) {
+		job_run_queue();
+		asm volatile("wfe");
+	}
+
+	__atomic_store_n(&cpu->running, 0, __ATOMIC_RELEASE);
+	invoke_psci_fn(PSCI_0_2_FN_CPU_OFF, 0, 0, 0);
+}
+
+/* Copy the boot CPU's translation settings, for job_secondary_entry */
+static void job_save_regs(struct job_arm_cpu *cpu)
+{
+	u64 vbar, mair, tcr, ttbr0, el;
+
+	BUILD_BUG_ON(offsetof(struct job_arm_cpu, sctlr) != JOB_CPU_SCTLR);
+	BUILD_BUG_ON(offsetof(struct job_arm_cpu, el) != JOB_CPU_EL);
+
+	asm volatile("mrs %0, CurrentEL" : "=r" (el));
+	if (current_el() == 2) {
+		asm volatile("mrs %0, vbar_el2" : "=r" (vbar));
+		asm volatile("mrs %0, mair_el2" : "=r" (mair));
+		asm volatile("mrs %0, tcr_el2" : "=r" (tcr));
+		asm volatile("mrs %0, ttbr0_el2" : "=r" (ttbr0));
+	} else {
+		asm volatile("mrs %0, vbar_el1" : "=r" (vbar));
+		asm volatile("mrs %0, mair_el1" : "=r" (mair));
+		asm volatile("mrs %0, tcr_el1" : "=r" (tcr));
+		asm volatile("mrs %0, ttbr0_el1" : "=r" (ttbr0));
+	}
+	cpu->vbar = vbar;
+	cpu->mair = mair;
+	cpu->tcr = tcr;
+	cpu->ttbr0 = ttbr0;
+	cpu->sctlr = get_sctlr();
+	cpu->el = el;
+	cpu->gd = (ulong)gd;
+}
+
+static int job_read_mpidr(ofnode node, u64 *mpidrp)
+{
+	const fdt32_t *reg;
+	int len;
+
+	reg = ofnode_read_prop(node, "reg", &len);
+	if (!reg)
+		return -ENOENT;
+	if (len == sizeof(u64))
+		*mpidrp = (u64)fdt32_to_cpu(reg[0]) << 32 |
+			fdt32_to_cpu(reg[1]);
+	else if (len == sizeof(u32))
+		*mpidrp = fdt32_to_cpu(reg[0]);
+	else
+		return -EINVAL;
+
+	return 0;
+}
+
+static int job_start_cpu(struct job_arm_cpu *cpu)
+{
+	ulong start;
+	long ret;
+
+	cpu->stack = memalign(16, JOB_CPU_STACK_SIZE);
+	if (!cpu->stack)
+		return -ENOMEM;
+	cpu->sp = (ulong)cpu->stack + JOB_CPU_STACK_SIZE;
+	job_save_regs(cpu);
+
+	/* The CPU reads its settings, code and page tables with caches off */
+	flush_dcache_all();
+	ret = invoke_psci_fn(PSCI_0_2_FN64_CPU_ON, cpu->mpidr,
+			     (ulong)job_secondary_entry, (ulong)cpu);
+	if (ret != PSCI_RET_SUCCESS) {
+		log_debug("CPU %llx: CPU_ON failed (err=%ld)\n", cpu->mpidr,
+			  ret);
+		goto err;
+	}
+
+	start = get_timer(0);
+	while (!__atomic_load_n(&cpu->running, __ATOMIC_ACQUIRE)) {
+		if (get_timer(start) > JOB_CPU_TIMEOUT_MS) {
+			/*
+			 * It may still turn up later and run jobs, so its
+			 * stack and slot are kept
+			 */
+			log_warning("CPU %llx did not start\n", cpu->mpidr);
+			return -ETIMEDOUT;
+		}
+	}
+
+	return 0;
+
+err:
+	free(cpu->stack);
+
+	return -EIO;
+}
+
+int job_arch_init(void)
+{
+	struct udevice *dev;
+	ofnode node, cpus;
+	u64 mpidr, self;
+	int ret;
+
+	/* PSCI is provided by firmware at a higher exception level */
+	if (current_el() == 3)
+		return 0;
+	if (uclass_get_device_by_driver(UCLASS_FIRMWARE, DM_DRIVER_GET(psci),
+					&dev))
+		return 0;
+
+	cpus = ofnode_path("/cpus");
+	if (!ofnode_valid(cpus))
+		return -EINVAL;
+
+	job_cpus = memalign(ARCH_DMA_MINALIGN,
+			    CONFIG_JOB_MAX_WORKERS * sizeof(*job_cpus));
+	if (!job_cpus)
+		return -ENOMEM;
+	memset(job_cpus, '\0', CONFIG_JOB_MAX_WORKERS * sizeof(*job_cpus));
+
+	self = read_mpidr() & MPIDR_AFF_MASK;
+	ofnode_for_each_subnode(node, cpus) {
+		struct job_arm_cpu *cpu = &job_cpus[job_ncpus];
+		const char *type;
+
+		if (job_ncpus == CONFIG_JOB_MAX_WORKERS)
+			break;
+		type = ofnode_read_string(node, "device_type");
+		if (!type || strcmp(type, "cpu") || !ofnode_is_enabled(node) ||
+		    job_read_mpidr(node, &mpidr) || mpidr == self)
+			continue;
+
+		cpu->mpidr = mpidr;
+		ret = job_start_cpu(cpu);
+		if (!ret || ret == -ETIMEDOUT)
+			job_ncpus++;
+
+		/*
+		 * A CPU which was slow to start is still counted, so that
+		 * job_arch_stop() waits for it to turn off before the OS
+		 * starts. Something is wrong though, so start no more.
+		 */
+		if (ret == -ETIMEDOUT)
+			break;
+	}
+
+	return job_ncpus;
+}
+
+void job_arch_kick(void)
+{
+	dsb();
+	asm volatile("sev");
+}
+
+void job_arch_stop(void)
+{
+	ulong start;
+	long ret;
+	int i;
+
+	__atomic_store_n(&job_stopping, 1, __ATOMIC_RELEASE);
+	job_arch_kick();
+
+	for (i = 0; i < job_ncpus; i++) {
+		struct job_arm_cpu *cpu = &job_cpus[i];
+
+		start = get_timer(0);
+		do {
+			ret = invoke_psci_fn(PSCI_0_2_FN64_AFFINITY_INFO,
+					     cpu->mpidr, 0, 0);
+			if (ret == PSCI_0_2_AFFINITY_LEVEL_OFF)
+				break;
+		} while (get_timer(start) < JOB_CPU_TIMEOUT_MS);
+		if (ret != PSCI_0_2_AFFINITY_LEVEL_OFF)
+			log_warning("CPU %llx did not turn off\n", cpu->mpidr);
+		else
+			free(cpu->stack);
+	}
+	job_ncpus = 0;
+}
@@ -0,0 +1,59 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * State shared between job.c and job_entry.S
+ */
+
+#ifndef __ARMV8_JOB_ARM_H
+#define __ARMV8_JOB_ARM_H
+
+/* Offsets of the fields of struct job_arm_cpu used by job_entry.S */
+#define JOB_CPU_SP	0
+#define JOB_CPU_GD	8
+#define JOB_CPU_VBAR	16
+#define JOB_CPU_MAIR	24
+#define JOB_CPU_TCR	32
+#define JOB_CPU_TTBR0	40
+#define JOB_CPU_SCTLR	48
+#define JOB_CPU_EL	56
+
+#ifndef __ASSEMBLY__
+
+/**
+ * struct job_arm_cpu - a secondary CPU which runs jobs
+ *
+ * The CPU starts with its MMU and caches off, so the first fields are read
+ * from memory by job_secondary_entry, which sets the CPU up to match the boot
+ * CPU. This is cache-line aligned so it can be flushed on its own.
+ *
+ * @sp: Initial stack pointer
+ * @gd: Global data pointer
+ * @vbar: Exception vector base
+ * @mair: Memory attributes
+ * @tcr: Translation control
+ * @ttbr0: Page-table base
+ * @sctlr: System control, with the MMU and caches on
+ * @el: CurrentEL value of the boot CPU
+ * @mpidr: Affinity of the CPU, as used by PSCI
+ * @running: true while the CPU is running jobs, cleared before it turns off
+ * @stack: Stack allocated for the CPU
+ */
+struct job_arm_cpu {
+	u64 sp;
+	u64 gd;
+	u64 vbar;
+	u64 mair;
+	u64 tcr;
+	u64 ttbr0;
+	u64 sctlr;
+	u64 el;
+	u64 mpidr;
+	int running;
+	void *stack;
+} __aligned(ARCH_DMA_MINALIGN);
+
+void job_secondary_entry(void);
+void job_secondary_main(struct job_arm_cpu *cpu);
+
+#endif /* __ASSEMBLY__ */
+
+#endif
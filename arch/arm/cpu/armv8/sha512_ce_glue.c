@@ -0,0 +1,40 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * sha512_ce_glue.c - SHA-384/SHA-512 secure hash using ARMv8 Crypto Extensions
+ */
+
+#include <common.h>
+#include <u-boot/sha512.h>
+
+#define ID_AA64ISAR0_EL1_SHA2_SHIFT	12
+#define ID_AA64ISAR0_EL1_SHA2_SHA512	2
+
+extern void sha512_armv8_ce_process(uint64_t state[8], uint8_t const *src,
+				    uint32_t blocks);
+
+/*
+ * The SHA-512 instructions are optional from ARMv8.2 on, so check for them
+ * each time rather than trusting the build configuration. The ID register
+ * read is cheap next to hashing even a single block.
+ */
+static bool sha512_ce_supported(void)
+{
+	u64 isar0;
+
+	asm volatile("mrs %0, id_aa64isar0_el1" : "=r" (isar0));
+
+	return ((isar0 >> ID_AA64ISAR0_EL1_SHA2_SHIFT) & 0xf) >=
+		ID_AA64ISAR0_EL1_SHA2_SHA512;
+}
+
+void sha512_process(sha512_context *ctx, const unsigned char *data,
+		    unsigned int blocks)
+{
+	if (!blocks)
+		return;
+
+	if (sha512_ce_supported())
+		sha512_armv8_ce_process(ctx->state, data, blocks);
+	else
+		sha512_process_generic(ctx, data, blocks);
+}
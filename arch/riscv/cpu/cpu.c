@@ -31,6 +31,10 @@ u32 available_harts_lock = 1;
 #endif
 #endif
 
+#if CONFIG_IS_ENABLED(RISCV_ISA_ZBB)
+int riscv_has_zbb __section(".data");
+#endif
+
 static inline bool supports_extension(char ext)
 {
 #ifdef CONFIG_CPU
@@ -60,6 +64,41 @@ static inline bool supports_extension(char ext)
 #endif /* CONFIG_CPU */
 }
 
+#if CONFIG_IS_ENABLED(RISCV_ISA_ZBB)
+/**
+ * supports_isa_ext() - Check for a multi-letter ISA extension
+ *
+ * Multi-letter extensions follow the single-letter ones in "riscv,isa", each
+ * starting with an underscore, e.g. "rv64imafdc_zicsr_zbb".
+ *
+ * @ext: Name of the extension, in lower case
+ * Return: true if the boot hart has the extension
+ */
+static bool supports_isa_ext(const char *ext)
+{
+#ifdef CONFIG_CPU
+	int len = strlen(ext);
+	struct udevice *dev;
+	const char *isa;
+
+	uclass_find_first_device(UCLASS_CPU, &dev);
+	if (!dev)
+		return false;
+	isa = dev_read_string(dev, "riscv,isa");
+	if (!isa)
+		return false;
+	while ((isa = strchr(isa, '_'))) {
+		isa++;
+		if (!strncmp(isa, ext, len) &&
+		    (isa[len] == '_' || isa[len] == '\0'))
+			return true;
+	}
+#endif
+
+	return false;
+}
+#endif
+
 static int riscv_cpu_probe(void)
 {
 #ifdef CONFIG_CPU
@@ -93,6 +132,10 @@ int riscv_cpu_setup(void *ctx, struct event *event)
 	if (ret)
 		return ret;
 
+#if CONFIG_IS_ENABLED(RISCV_ISA_ZBB)
+	riscv_has_zbb = supports_isa_ext("zbb");
+#endif
+
 	/* Enable FPU */
 	if (supports_extension('d') || supports_extension('f')) {
 		csr_set(MODE_PREFIX(status), MSTATUS_FS);
@@ -40,4 +40,23 @@ extern void *memmove(void *, const void *, __kernel_size_t);
 #endif
 extern void *memset(void *, int, __kernel_size_t);
 
+#if CONFIG_IS_ENABLED(RISCV_ISA_ZBB)
+/* Set when the "riscv,isa" string of the boot hart includes Zbb */
+extern int riscv_has_zbb;
+
+#define __HAVE_ARCH_WORD_HAS_ZERO
+static inline unsigned long word_has_zero(unsigned long val)
+{
+	unsigned long res;
+
+	if (!riscv_has_zbb)
+		return (val - ~0UL / 0xff) & ~val & (~0UL / 0xff * 0x80);
+
+	/* orc.b sets each non-zero byte to 0xff and leaves zero bytes alone */
+	asm (".insn i 0x13, 0x5, %0, %1, 0x287" : "=r" (res) : "r" (val));
+
+	return ~res;
+}
+#endif
+
 #endif /* __ASM_RISCV_STRING_H */
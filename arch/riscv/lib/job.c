@@ -0,0 +1,54 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Running jobs on secondary harts
+ *
+ * Secondary harts wait in secondary_hart_loop for an IPI. Each time a job is
+ * queued they are sent to job_run_queue(), returning to the loop once the
+ * queue is empty.
+ */
+
+#include <common.h>
+#include <dm.h>
+#include <job.h>
+#include <asm/global_data.h>
+#include <asm/smp.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+static void riscv_job_worker(ulong hart, ulong arg0, ulong arg1)
+{
+	job_run_queue();
+}
+
+int job_arch_init(void)
+{
+	ofnode node, cpus;
+	int count = 0;
+	u32 reg;
+
+	cpus = ofnode_path("/cpus");
+	if (!ofnode_valid(cpus))
+		return -EINVAL;
+
+	/* Count the harts which smp_call_function() sends IPIs to */
+	ofnode_for_each_subnode(node, cpus) {
+		if (!ofnode_is_enabled(node))
+			continue;
+		if (ofnode_read_u32(node, "reg", &reg))
+			continue;
+		if (reg == gd->arch.boot_hart || reg >= CONFIG_NR_CPUS)
+			continue;
+#if !CONFIG_IS_ENABLED(XIP) && defined(CONFIG_AVAILABLE_HARTS)
+		if (!(gd->arch.available_harts & (1 << reg)))
+			continue;
+#endif
+		count++;
+	}
+
+	return count;
+}
+
+void job_arch_kick(void)
+{
+	smp_call_function((ulong)riscv_job_worker, 0, 0, 0);
+}
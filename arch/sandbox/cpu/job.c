@@ -0,0 +1,42 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Running jobs on host threads, standing in for secondary CPUs
+ */
+
+#include <common.h>
+#include <errno.h>
+#include <job.h>
+#include <os.h>
+
+/* Posted once for each job queued */
+static void *job_sem;
+
+static void sandbox_job_worker(void *arg)
+{
+	while (1) {
+		os_sem_wait(job_sem);
+		job_run_queue();
+	}
+}
+
+int job_arch_init(void)
+{
+	int ret = 0;
+	int i;
+
+	job_sem = os_sem_create();
+	if (!job_sem)
+		return -ENOMEM;
+	for (i = 0; i < CONFIG_JOB_MAX_WORKERS; i++) {
+		ret = os_thread_start(sandbox_job_worker, NULL);
+		if (ret)
+			break;
+	}
+
+	return i ? i : ret;
+}
+
+void job_arch_kick(void)
+{
+	os_sem_post(job_sem);
+}
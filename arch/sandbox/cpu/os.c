@@ -10,6 +10,7 @@
 #include <fcntl.h>
 #include <pthread.h>
 #include <getopt.h>
+#include <semaphore.h>
 #include <setjmp.h>
 #include <signal.h>
 #include <stdarg.h>
@@ -433,6 +434,73 @@ void os_usleep(unsigned long usec)
 	usleep(usec);
 }
 
+struct os_thread {
+	void (*func)(void *arg);
+	void *arg;
+};
+
+static void *os_thread_run(void *data)
+{
+	struct os_thread thread = *(struct os_thread *)data;
+	sigset_t set;
+
+	os_free(data);
+
+	/* Leave signals to the main thread */
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+	thread.func(thread.arg);
+
+	return NULL;
+}
+
+int os_thread_start(void (*func)(void *arg), void *arg)
+{
+	struct os_thread *thread;
+	pthread_t id;
+	int ret;
+
+	thread = os_malloc(sizeof(*thread));
+	if (!thread)
+		return -ENOMEM;
+	thread->func = func;
+	thread->arg = arg;
+	ret = pthread_create(&id, NULL, os_thread_run, thread);
+	if (ret) {
+		os_free(thread);
+		return -ret;
+	}
+	pthread_detach(id);
+
+	return 0;
+}
+
+void *os_sem_create(void)
+{
+	sem_t *sem;
+
+	sem = os_malloc(sizeof(*sem));
+	if (!sem)
+		return NULL;
+	if (sem_init(sem, 0, 0)) {
+		os_free(sem);
+		return NULL;
+	}
+
+	return sem;
+}
+
+void os_sem_wait(void *sem)
+{
+	while (sem_wait(sem) && errno == EINTR)
+		;
+}
+
+void os_sem_post(void *sem)
+{
+	sem_post(sem);
+}
+
 uint64_t __attribute__((no_instrument_function)) os_get_nsec(void)
 {
 #if defined(CLOCK_MONOTONIC) && defined(_POSIX_MONOTONIC_CLOCK)
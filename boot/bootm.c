@@ -65,12 +65,14 @@ static void boot_start_lmb(struct bootm_headers *images)
 }
 #else
 #define lmb_reserve(lmb, base, size)
+#define lmb_uninit(lmb)
 static inline void boot_start_lmb(struct bootm_headers *images) { }
 #endif
 
 static int bootm_start(struct cmd_tbl *cmdtp, int flag, int argc,
 		       char *const argv[])
 {
+	lmb_uninit(&images.lmb);
 	memset((void *)&images, 0, sizeof(images));
 	images.verify = env_get_yesno("verify");
 
@@ -397,6 +399,48 @@ static int handle_decomp_error(int comp_type, size_t uncomp_size,
 #endif
 
 #ifndef USE_HOSTCC
+#if CONFIG_IS_ENABLED(BOOTM_DECOMP_STREAM)
+/**
+ * bootm_decomp_stream() - decompress the OS image a chunk at a time
+ *
+ * @images:	Images information
+ * @load:	Destination load address in U-Boot memory
+ * @load_buf:	Place to decompress to
+ * @image_buf:	Compressed image
+ * @load_end:	Returns the end of the decompressed image
+ * Return: 0 if OK, -ENOSYS if the image cannot be decompressed in chunks,
+ *	other -ve on error
+ */
+static int bootm_decomp_stream(struct bootm_headers *images, ulong load,
+			       void *load_buf, const void *image_buf,
+			       ulong *load_end)
+{
+	struct image_info *os = &images->os;
+	struct image_decomp_stream ds;
+	ulong pos, chunk;
+	int ret, err;
+
+	*load_end = load;
+	ret = image_decomp_stream_start(&ds, os->comp, os->type, load_buf,
+					CONFIG_SYS_BOOTM_LEN);
+	if (ret)
+		return ret;
+
+	for (pos = 0; pos < os->image_len && !ret; pos += chunk) {
+		chunk = min(os->image_len - pos,
+			    (ulong)CONFIG_BOOTM_DECOMP_CHUNK);
+		ret = image_decomp_stream_write(&ds, image_buf + pos, chunk);
+		schedule();
+	}
+	err = image_decomp_stream_finish(&ds);
+	if (!ret)
+		ret = err;
+	*load_end = load + ds.len;
+
+	return ret;
+}
+#endif
+
 static int bootm_load_os(struct bootm_headers *images, int boot_progress)
 {
 	struct image_info os = images->os;
@@ -413,9 +457,14 @@ static int bootm_load_os(struct bootm_headers *images, int boot_progress)
 
 	load_buf = map_sysmem(load, 0);
 	image_buf = map_sysmem(os.image_start, image_len);
-	err = image_decomp(os.comp, load, os.image_start, os.type,
-			   load_buf, image_buf, image_len,
-			   CONFIG_SYS_BOOTM_LEN, &load_end);
+	err = -ENOSYS;
+#if CONFIG_IS_ENABLED(BOOTM_DECOMP_STREAM)
+	err = bootm_decomp_stream(images, load, load_buf, image_buf, &load_end);
+#endif
+	if (err == -ENOSYS)
+		err = image_decomp(os.comp, load, os.image_start, os.type,
+				   load_buf, image_buf, image_len,
+				   CONFIG_SYS_BOOTM_LEN, &load_end);
 	if (err) {
 		err = handle_decomp_error(os.comp, load_end - load,
 					  CONFIG_SYS_BOOTM_LEN, err);
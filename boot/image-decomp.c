@@ -0,0 +1,355 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Decompressing an image in chunks, for callers which do not have all of the
+ * compressed data at once
+ */
+
+#include <common.h>
+#include <image.h>
+#include <log.h>
+#include <malloc.h>
+#include <asm/unaligned.h>
+#include <linux/zstd.h>
+#include <u-boot/lz4.h>
+#include <u-boot/zlib.h>
+
+/* gzip header flags */
+#define HEAD_CRC		2
+#define EXTRA_FIELD		4
+#define ORIG_NAME		8
+#define COMMENT			0x10
+#define RESERVED		0xe0
+#define DEFLATED		8
+
+/**
+ * enum stream_state - what the next piece of compressed data holds
+ *
+ * Apart from @GZIP_DATA, each state consumes a fixed number of bytes, given
+ * by struct decomp_priv->need
+ */
+enum stream_state {
+	GZIP_HEADER,
+	GZIP_EXTRA_LEN,
+	GZIP_SKIP,
+	GZIP_STRING,
+	GZIP_DATA,
+
+	LZ4_UNIT,
+
+	ZSTD_UNIT,
+};
+
+/**
+ * struct decomp_priv - private state of a stream
+ *
+ * @state:	What the next compressed data holds
+ * @need:	Number of bytes needed for @state
+ * @done:	true once the end of the compressed stream is seen
+ * @bounce:	Holds the first part of a unit which is split between writes
+ * @bounce_size: Size of @bounce
+ * @bounce_len:	Number of bytes in @bounce
+ */
+struct decomp_priv {
+	enum stream_state state;
+	ulong need;
+	bool done;
+	u8 *bounce;
+	ulong bounce_size;
+	ulong bounce_len;
+	union {
+		struct {
+			z_stream zs;
+			u8 flags;
+		} gzip;
+		struct lz4_frame lz4;
+		struct zstd_dctx *zstd;
+	};
+};
+
+bool image_decomp_stream_supported(int comp)
+{
+	switch (comp) {
+	case IH_COMP_GZIP:
+		return CONFIG_IS_ENABLED(GZIP);
+	case IH_COMP_LZ4:
+		return CONFIG_IS_ENABLED(LZ4);
+	case IH_COMP_ZSTD:
+		return CONFIG_IS_ENABLED(ZSTD);
+	}
+
+	return false;
+}
+
+int image_decomp_stream_start(struct image_decomp_stream *ds, int comp,
+			      int type, void *load_buf, ulong unc_len)
+{
+	struct decomp_priv *priv;
+	int ret = -ENOMEM;
+
+	if (!image_decomp_stream_supported(comp))
+		return -ENOSYS;
+
+	priv = calloc(1, sizeof(*priv));
+	if (!priv)
+		return -ENOMEM;
+
+	switch (comp) {
+#if CONFIG_IS_ENABLED(GZIP)
+	case IH_COMP_GZIP:
+		priv->state = GZIP_HEADER;
+		priv->need = 10;
+		priv->gzip.zs.zalloc = gzalloc;
+		priv->gzip.zs.zfree = gzfree;
+		if (inflateInit2(&priv->gzip.zs, -MAX_WBITS) != Z_OK)
+			goto err_priv;
+		break;
+#endif
+#if CONFIG_IS_ENABLED(LZ4)
+	case IH_COMP_LZ4:
+		priv->state = LZ4_UNIT;
+		lz4_frame_start(&priv->lz4);
+		priv->need = priv->lz4.need;
+		break;
+#endif
+#if CONFIG_IS_ENABLED(ZSTD)
+	case IH_COMP_ZSTD:
+		priv->state = ZSTD_UNIT;
+		priv->zstd = zstd_get_dctx();
+		if (!priv->zstd)
+			goto err_priv;
+		if (ZSTD_isError(ZSTD_decompressBegin(priv->zstd->dctx)))
+			goto err_dctx;
+		priv->need = ZSTD_nextSrcSizeToDecompress(priv->zstd->dctx);
+		break;
+#endif
+	default:
+		ret = -ENOSYS;
+		goto err_priv;
+	}
+
+	ds->comp = comp;
+	ds->buf = load_buf;
+	ds->size = unc_len;
+	ds->len = 0;
+	ds->priv = priv;
+	printf("   Uncompressing %s\n", genimg_get_type_name(type));
+
+	return 0;
+
+#if CONFIG_IS_ENABLED(ZSTD)
+err_dctx:
+	zstd_put_dctx(priv->zstd);
+#endif
+err_priv:
+	free(priv);
+
+	return ret;
+}
+
+#if CONFIG_IS_ENABLED(GZIP)
+static void gzip_next_field(struct decomp_priv *priv)
+{
+	u8 flags = priv->gzip.flags;
+
+	if (flags & EXTRA_FIELD) {
+		priv->state = GZIP_EXTRA_LEN;
+		priv->need = 2;
+	} else if (flags & (ORIG_NAME | COMMENT)) {
+		priv->state = GZIP_STRING;
+		priv->need = 1;
+	} else if (flags & HEAD_CRC) {
+		priv->gzip.flags &= ~HEAD_CRC;
+		priv->state = GZIP_SKIP;
+		priv->need = 2;
+	} else {
+		priv->state = GZIP_DATA;
+		priv->need = 0;
+	}
+}
+
+static int gzip_data(struct image_decomp_stream *ds, const u8 *data,
+		     ulong len)
+{
+	struct decomp_priv *priv = ds->priv;
+	z_stream *zs = &priv->gzip.zs;
+	int r;
+
+	zs->next_in = (u8 *)data;
+	zs->avail_in = len;
+	zs->next_out = ds->buf + ds->len;
+	zs->avail_out = ds->size - ds->len;
+	r = inflate(zs, Z_NO_FLUSH);
+	ds->len = zs->next_out - (u8 *)ds->buf;
+	if (r == Z_STREAM_END) {
+		/* The CRC and size which follow are not checked */
+		priv->done = true;
+		return 0;
+	}
+
+	/* inflate() only stops with input left if the output is full */
+	if (r == Z_OK && zs->avail_in)
+		return -ENOSPC;
+	if (r != Z_OK) {
+		log_debug("inflate() returned %d\n", r);
+		return -EPROTO;
+	}
+
+	return 0;
+}
+#endif
+
+static int decomp_unit(struct image_decomp_stream *ds, const u8 *unit)
+{
+	struct decomp_priv *priv = ds->priv;
+	ulong __maybe_unused space = ds->size - ds->len;
+	void __maybe_unused *out = ds->buf + ds->len;
+
+	switch (priv->state) {
+#if CONFIG_IS_ENABLED(GZIP)
+	case GZIP_HEADER:
+		if (unit[2] != DEFLATED || (unit[3] & RESERVED)) {
+			puts("Error: Bad gzipped data\n");
+			return -EINVAL;
+		}
+		priv->gzip.flags = unit[3];
+		gzip_next_field(priv);
+		break;
+	case GZIP_EXTRA_LEN:
+		priv->gzip.flags &= ~EXTRA_FIELD;
+		priv->state = GZIP_SKIP;
+		priv->need = get_unaligned_le16(unit);
+		if (!priv->need)
+			gzip_next_field(priv);
+		break;
+	case GZIP_SKIP:
+		gzip_next_field(priv);
+		break;
+	case GZIP_STRING:
+		if (!*unit) {
+			/* The name comes before the comment */
+			if (priv->gzip.flags & ORIG_NAME)
+				priv->gzip.flags &= ~ORIG_NAME;
+			else
+				priv->gzip.flags &= ~COMMENT;
+			gzip_next_field(priv);
+		}
+		break;
+#endif
+#if CONFIG_IS_ENABLED(LZ4)
+	case LZ4_UNIT: {
+		int size;
+
+		size = lz4_frame_unit(&priv->lz4, unit, out, space);
+		if (size == -ENOBUFS)
+			return -ENOSPC;
+		if (size < 0)
+			return size;
+		ds->len += size;
+
+		/* The content checksum which may follow is not checked */
+		priv->need = priv->lz4.need;
+		if (!priv->need)
+			priv->done = true;
+		break;
+	}
+#endif
+#if CONFIG_IS_ENABLED(ZSTD)
+	case ZSTD_UNIT: {
+		size_t ret;
+
+		/* Earlier output stays in place, so serves as the window */
+		ret = ZSTD_decompressContinue(priv->zstd->dctx, out, space, unit,
+					      priv->need);
+		if (ZSTD_isError(ret)) {
+			if (ZSTD_getErrorCode(ret) == ZSTD_error_dstSize_tooSmall)
+				return -ENOSPC;
+			log_debug("zstd error %d\n", ZSTD_getErrorCode(ret));
+			return -EPROTO;
+		}
+		ds->len += ret;
+		priv->need = ZSTD_nextSrcSizeToDecompress(priv->zstd->dctx);
+		if (!priv->need)
+			priv->done = true;
+		break;
+	}
+#endif
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+int image_decomp_stream_write(struct image_decomp_stream *ds,
+			      const void *data, ulong len)
+{
+	struct decomp_priv *priv = ds->priv;
+	const u8 *ptr = data;
+	int ret;
+
+	while (len && !priv->done) {
+		ulong need = priv->need;
+		const u8 *unit;
+
+#if CONFIG_IS_ENABLED(GZIP)
+		if (priv->state == GZIP_DATA)
+			return gzip_data(ds, ptr, len);
+#endif
+
+		if (!priv->bounce_len && len >= need) {
+			/* Use the unit where it is */
+			unit = ptr;
+			ptr += need;
+			len -= need;
+		} else {
+			ulong copy = min(need - priv->bounce_len, len);
+
+			if (need > priv->bounce_size) {
+				u8 *bounce = realloc(priv->bounce, need);
+
+				if (!bounce)
+					return -ENOMEM;
+				priv->bounce = bounce;
+				priv->bounce_size = need;
+			}
+			memcpy(priv->bounce + priv->bounce_len, ptr, copy);
+			priv->bounce_len += copy;
+			ptr += copy;
+			len -= copy;
+			if (priv->bounce_len < need)
+				break;
+			unit = priv->bounce;
+			priv->bounce_len = 0;
+		}
+
+		ret = decomp_unit(ds, unit);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+int image_decomp_stream_finish(struct image_decomp_stream *ds)
+{
+	struct decomp_priv *priv = ds->priv;
+	bool done = priv->done;
+
+	switch (ds->comp) {
+#if CONFIG_IS_ENABLED(GZIP)
+	case IH_COMP_GZIP:
+		inflateEnd(&priv->gzip.zs);
+		break;
+#endif
+#if CONFIG_IS_ENABLED(ZSTD)
+	case IH_COMP_ZSTD:
+		zstd_put_dctx(priv->zstd);
+		break;
+#endif
+	}
+	free(priv->bounce);
+	free(priv);
+	ds->priv = NULL;
+
+	return done ? 0 : -EINVAL;
+}
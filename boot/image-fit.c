@@ -25,6 +25,7 @@
 #include <asm/io.h>
 #include <malloc.h>
 #include <memalign.h>
+#include <job.h>
 #include <asm/global_data.h>
 #ifdef CONFIG_DM_HASH
 #include <dm.h>
@@ -1294,8 +1295,121 @@ int calculate_hash(const void *data, int data_len, const char *name,
 	return 0;
 }
 
+#if !defined(USE_HOSTCC) && !defined(CONFIG_DM_HASH) && CONFIG_IS_ENABLED(JOB)
+/* Most hash subnodes of an image which are worked out on secondary CPUs */
+#define FIT_HASH_JOBS	4
+
+/**
+ * struct fit_hash_job - a hash subnode being worked out on another CPU
+ *
+ * @jh: Job doing the hashing
+ * @noffset: Offset of the hash subnode
+ * @running: true until job_hash_finish() has been called for @jh
+ */
+struct fit_hash_job {
+	struct job_hash jh;
+	int noffset;
+	bool running;
+};
+
+/*
+ * Start working out the hash subnodes of an image on the secondary CPUs, so
+ * that they are hashed while this CPU checks the signatures. Returns the
+ * number of jobs started. Any other subnodes are hashed as usual.
+ */
+static int fit_image_start_hashes(const void *fit, int image_noffset,
+				  const void *data, size_t size,
+				  struct fit_hash_job *jobs)
+{
+	int noffset, ignore, count = 0;
+	const char *algo;
+
+	if (!job_workers())
+		return 0;
+	fdt_for_each_subnode(noffset, fit, image_noffset) {
+		const char *name = fit_get_name(fit, noffset, NULL);
+		struct fit_hash_job *fj = &jobs[count];
+
+		if (count == FIT_HASH_JOBS)
+			break;
+		if (strncmp(name, FIT_HASH_NODENAME,
+			    strlen(FIT_HASH_NODENAME)) ||
+		    fit_image_hash_get_algo(fit, noffset, &algo))
+			continue;
+		fit_image_hash_get_ignore(fit, noffset, &ignore);
+		if (ignore || job_hash_start(&fj->jh, algo, data, size))
+			continue;
+		fj->noffset = noffset;
+		fj->running = true;
+		count++;
+	}
+
+	return count;
+}
+
+/*
+ * Get the value worked out by a job for a hash subnode. Returns -ENOENT if no
+ * job was started for it.
+ */
+static int fit_image_job_value(struct fit_hash_job *jobs, int count,
+			       int noffset, uint8_t *value, int *value_lenp)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		struct fit_hash_job *fj = &jobs[i];
+
+		if (fj->noffset != noffset || !fj->running)
+			continue;
+		fj->running = false;
+		*value_lenp = fj->jh.algo->digest_size;
+
+		return job_hash_finish(&fj->jh, value, FIT_MAX_HASH_LEN);
+	}
+
+	return -ENOENT;
+}
+
+/* Wait for any jobs whose values were not needed, e.g. after an error */
+static void fit_image_end_hashes(struct fit_hash_job *jobs, int count)
+{
+	uint8_t value[FIT_MAX_HASH_LEN];
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (jobs[i].running)
+			job_hash_finish(&jobs[i].jh, value, sizeof(value));
+		jobs[i].running = false;
+	}
+}
+#else
+#define FIT_HASH_JOBS	1
+
+struct fit_hash_job {
+	int noffset;
+};
+
+static int fit_image_start_hashes(const void *fit, int image_noffset,
+				  const void *data, size_t size,
+				  struct fit_hash_job *jobs)
+{
+	return 0;
+}
+
+static int fit_image_job_value(struct fit_hash_job *jobs, int count,
+			       int noffset, uint8_t *value, int *value_lenp)
+{
+	return -ENOENT;
+}
+
+static void fit_image_end_hashes(struct fit_hash_job *jobs, int count)
+{
+}
+#endif
+
 static int fit_image_check_hash(const void *fit, int noffset, const void *data,
-				size_t size, char **err_msgp)
+				size_t size, struct fit_hash_job *jobs,
+				int njobs, char **err_msgp)
 {
 	ALLOC_CACHE_ALIGN_BUFFER(uint8_t, value, FIT_MAX_HASH_LEN);
 	int value_len;
@@ -1303,6 +1417,7 @@ static int fit_image_check_hash(const void *fit, int noffset, const void *data,
 	uint8_t *fit_value;
 	int fit_value_len;
 	int ignore;
+	int ret;
 
 	*err_msgp = NULL;
 
@@ -1326,7 +1441,13 @@ static int fit_image_check_hash(const void *fit, int noffset, const void *data,
 		return -1;
 	}
 
-	if (calculate_hash(data, size, algo, value, &value_len)) {
+	ret = fit_image_job_value(jobs, njobs, noffset, value, &value_len);
+	if (ret && ret != -ENOENT) {
+		*err_msgp = "Can't calculate hash";
+		return -1;
+	}
+	if (ret == -ENOENT &&
+	    calculate_hash(data, size, algo, value, &value_len)) {
 		*err_msgp = "Unsupported hash algorithm";
 		return -1;
 	}
@@ -1346,11 +1467,15 @@ int fit_image_verify_with_data(const void *fit, int image_noffset,
 			       const void *key_blob, const void *data,
 			       size_t size)
 {
+	struct fit_hash_job jobs[FIT_HASH_JOBS];
 	int		noffset = 0;
 	char		*err_msg = "";
 	int verify_all = 1;
+	int njobs;
 	int ret;
 
+	njobs = fit_image_start_hashes(fit, image_noffset, data, size, jobs);
+
 	/* Verify all required signatures */
 	if (FIT_IMAGE_ENABLE_VERIFY &&
 	    fit_image_verify_required_sigs(fit, image_noffset, data, size,
@@ -1371,7 +1496,7 @@ int fit_image_verify_with_data(const void *fit, int image_noffset,
 		if (!strncmp(name, FIT_HASH_NODENAME,
 			     strlen(FIT_HASH_NODENAME))) {
 			if (fit_image_check_hash(fit, noffset, data, size,
-						 &err_msg))
+						 jobs, njobs, &err_msg))
 				goto error;
 			puts("+ ");
 		} else if (FIT_IMAGE_ENABLE_VERIFY && verify_all &&
@@ -1397,10 +1522,12 @@ int fit_image_verify_with_data(const void *fit, int image_noffset,
 		err_msg = "Corrupted or truncated tree";
 		goto error;
 	}
+	fit_image_end_hashes(jobs, njobs);
 
 	return 1;
 
 error:
+	fit_image_end_hashes(jobs, njobs);
 	printf(" error!\n%s for '%s' hash node in '%s' image node\n",
 	       err_msg, fit_get_name(fit, noffset, NULL),
 	       fit_get_name(fit, image_noffset, NULL));
@@ -1450,6 +1577,163 @@ err:
 	return 0;
 }
 
+#ifndef USE_HOSTCC
+/* Check whether verifying an image involves a signature as well as hashes */
+static bool fit_image_needs_sig(const void *fit, int image_noffset,
+				const void *key_blob)
+{
+	const char *required;
+	int noffset;
+
+	if (!FIT_IMAGE_ENABLE_VERIFY)
+		return false;
+
+	fdt_for_each_subnode(noffset, fit, image_noffset) {
+		if (!strncmp(fit_get_name(fit, noffset, NULL), FIT_SIG_NODENAME,
+			     strlen(FIT_SIG_NODENAME)))
+			return true;
+	}
+
+	if (!key_blob)
+		return false;
+	noffset = fdt_subnode_offset(key_blob, 0, FIT_SIG_NODENAME);
+	if (noffset < 0)
+		return false;
+	fdt_for_each_subnode(noffset, key_blob, noffset) {
+		required = fdt_getprop(key_blob, noffset, FIT_KEY_REQUIRED,
+				       NULL);
+		if (required && !strcmp(required, "image"))
+			return true;
+	}
+
+	return false;
+}
+
+int fit_image_verify_start(struct fit_verify_ctx *vctx, const void *fit,
+			   int image_noffset, const void *key_blob)
+{
+	struct hash_algo *algo;
+	const char *algo_name;
+	int noffset;
+	int ignore;
+	int ret;
+
+	vctx->fit = fit;
+	vctx->image_noffset = image_noffset;
+	vctx->count = 0;
+
+	/* The hash uclass has no progressive interface */
+	if (IS_ENABLED(CONFIG_DM_HASH) ||
+	    fit_image_needs_sig(fit, image_noffset, key_blob))
+		return -ENOSYS;
+
+	fdt_for_each_subnode(noffset, fit, image_noffset) {
+		if (strncmp(fit_get_name(fit, noffset, NULL),
+			    FIT_HASH_NODENAME, strlen(FIT_HASH_NODENAME)))
+			continue;
+
+		/* Leave anything unusual to fit_image_verify_with_data() */
+		if (fit_image_hash_get_algo(fit, noffset, &algo_name) ||
+		    hash_progressive_lookup_algo(algo_name, &algo) ||
+		    vctx->count == FIT_VERIFY_MAX_HASHES) {
+			ret = -ENOSYS;
+			goto err;
+		}
+
+		fit_image_hash_get_ignore(fit, noffset, &ignore);
+		if (ignore)
+			continue;
+
+		ret = algo->hash_init(algo, &vctx->hashes[vctx->count].ctx);
+		if (ret)
+			goto err;
+		vctx->hashes[vctx->count].noffset = noffset;
+		vctx->hashes[vctx->count].algo = algo;
+		vctx->count++;
+	}
+
+	return 0;
+
+err:
+	fit_image_verify_abort(vctx);
+	return ret;
+}
+
+void fit_image_verify_update(struct fit_verify_ctx *vctx, const void *data,
+			     size_t size)
+{
+	int i;
+
+	for (i = 0; i < vctx->count; i++)
+		vctx->hashes[i].algo->hash_update(vctx->hashes[i].algo,
+						  vctx->hashes[i].ctx, data,
+						  size, 0);
+}
+
+int fit_image_verify_finish(struct fit_verify_ctx *vctx)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(uint8_t, value, FIT_MAX_HASH_LEN);
+	const void *fit = vctx->fit;
+	char *err_msg = NULL;
+	int err_noffset = 0;
+	uint8_t *fit_value;
+	int fit_value_len;
+	int noffset;
+	int i;
+
+	/* Finish every hash, even after an error, to release the contexts */
+	for (i = 0; i < vctx->count; i++) {
+		struct hash_algo *algo = vctx->hashes[i].algo;
+		char *msg = NULL;
+
+		noffset = vctx->hashes[i].noffset;
+		if (algo->hash_finish(algo, vctx->hashes[i].ctx, value,
+				      FIT_MAX_HASH_LEN))
+			msg = "Unsupported hash algorithm";
+		if (err_msg)
+			continue;
+
+		printf("%s", algo->name);
+		if (!msg && fit_image_hash_get_value(fit, noffset, &fit_value,
+						     &fit_value_len))
+			msg = "Can't get hash value property";
+		if (!msg && algo->digest_size != fit_value_len)
+			msg = "Bad hash value len";
+		if (!msg && memcmp(value, fit_value, fit_value_len))
+			msg = "Bad hash value";
+
+		if (msg) {
+			err_msg = msg;
+			err_noffset = noffset;
+		} else {
+			puts("+ ");
+		}
+	}
+	vctx->count = 0;
+
+	if (err_msg) {
+		printf(" error!\n%s for '%s' hash node in '%s' image node\n",
+		       err_msg, fit_get_name(fit, err_noffset, NULL),
+		       fit_get_name(fit, vctx->image_noffset, NULL));
+		return 0;
+	}
+
+	return 1;
+}
+
+void fit_image_verify_abort(struct fit_verify_ctx *vctx)
+{
+	ALLOC_CACHE_ALIGN_BUFFER(uint8_t, value, FIT_MAX_HASH_LEN);
+	int i;
+
+	for (i = 0; i < vctx->count; i++)
+		vctx->hashes[i].algo->hash_finish(vctx->hashes[i].algo,
+						  vctx->hashes[i].ctx, value,
+						  FIT_MAX_HASH_LEN);
+	vctx->count = 0;
+}
+#endif /* !USE_HOSTCC */
+
 /**
  * fit_all_image_verify - verify data integrity for all images
  * @fit: pointer to the FIT format image header
@@ -161,6 +161,7 @@ static ulong load_serial(long offset)
 		type = srec_decode(record, &binlen, &addr, binbuf);
 
 		if (type < 0) {
+			lmb_uninit(&lmb);
 			return (~0);		/* Invalid S-Record		*/
 		}
 
@@ -176,6 +177,7 @@ static ulong load_serial(long offset)
 			rc = flash_write((char *)binbuf,store_addr,binlen);
 			if (rc != 0) {
 				flash_perror(rc);
+				lmb_uninit(&lmb);
 				return (~0);
 			}
 		    } else
@@ -185,6 +187,7 @@ static ulong load_serial(long offset)
 			if (ret) {
 				printf("\nCannot overwrite reserved area (%08lx..%08lx)\n",
 					store_addr, store_addr + binlen);
+				lmb_uninit(&lmb);
 				return ret;
 			}
 			memcpy((char *)(store_addr), binbuf, binlen);
@@ -208,6 +211,7 @@ static ulong load_serial(long offset)
 		    );
 		    flush_cache(start_addr, size);
 		    env_set_hex("filesize", size);
+		    lmb_uninit(&lmb);
 		    return (addr);
 		case SREC_START:
 		    break;
@@ -220,6 +224,7 @@ static ulong load_serial(long offset)
 		}
 	}
 
+	lmb_uninit(&lmb);
 	return (~0);			/* Download aborted		*/
 }
 
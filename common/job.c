@@ -0,0 +1,310 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Running self-contained jobs on secondary CPUs
+ *
+ * Jobs are kept in a single queue, protected by a spinlock. The boot CPU adds
+ * jobs and any CPU with nothing to do takes them off.
+ */
+
+#define LOG_CATEGORY	LOGC_BOOT
+
+#include <common.h>
+#include <hash.h>
+#include <job.h>
+#include <log.h>
+#include <asm/cache.h>
+#include <asm/global_data.h>
+#include <linux/kernel.h>
+#include <linux/sizes.h>
+#include <u-boot/lz4.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+/* Regions smaller than this are not worth splitting between CPUs */
+#define JOB_MEM_MIN_SPLIT	SZ_256K
+
+/* Each part of a split region starts on a cache-line boundary */
+#define JOB_MEM_ALIGN		ARCH_DMA_MINALIGN
+
+/*
+ * Hash functions take an unsigned int length, so larger regions are hashed
+ * in pieces
+ */
+#define JOB_HASH_MAX_UPDATE	SZ_1G
+
+/**
+ * struct job_mem - a job which fills or copies part of a region
+ *
+ * @job: Job doing the work
+ * @dst: Destination
+ * @src: Source, or NULL to fill with @c
+ * @c: Byte value to fill with
+ * @len: Number of bytes to fill or copy
+ */
+struct job_mem {
+	struct job job;
+	void *dst;
+	const void *src;
+	int c;
+	size_t len;
+};
+
+/* The queue, and the number of secondary CPUs (-1 if not started yet) */
+static struct job *job_head;
+static struct job *job_tail;
+static int job_lock_val;
+static int job_nworkers = -1;
+
+__weak int job_arch_init(void)
+{
+	return 0;
+}
+
+__weak void job_arch_kick(void)
+{
+}
+
+__weak void job_arch_stop(void)
+{
+}
+
+static void job_lock(void)
+{
+	while (__atomic_exchange_n(&job_lock_val, 1, __ATOMIC_ACQUIRE)) {
+		while (__atomic_load_n(&job_lock_val, __ATOMIC_RELAXED))
+			;
+	}
+}
+
+static void job_unlock(void)
+{
+	__atomic_store_n(&job_lock_val, 0, __ATOMIC_RELEASE);
+}
+
+static void job_run(struct job *job)
+{
+	job->ret = job->func(job);
+	__atomic_store_n(&job->done, 1, __ATOMIC_RELEASE);
+}
+
+/* Run the job at the head of the queue, returning false if there is none */
+static bool job_run_one(void)
+{
+	struct job *job;
+
+	job_lock();
+	job = job_head;
+	if (job) {
+		job_head = job->next;
+		if (!job_head)
+			job_tail = NULL;
+	}
+	job_unlock();
+	if (!job)
+		return false;
+	job_run(job);
+
+	return true;
+}
+
+void job_init(struct job *job, int (*func)(struct job *job), void *priv)
+{
+	memset(job, '\0', sizeof(*job));
+	job->func = func;
+	job->priv = priv;
+}
+
+int job_workers(void)
+{
+	if (job_nworkers < 0) {
+		int ret;
+
+		/* Secondary CPUs need the relocated code and data */
+		if (!(gd->flags & GD_FLG_RELOC))
+			return 0;
+		ret = job_arch_init();
+		if (ret < 0)
+			log_warning("Cannot start secondary CPUs (err=%d)\n", ret);
+		job_nworkers = max(ret, 0);
+		log_debug("%d secondary CPUs for jobs\n", job_nworkers);
+	}
+
+	return job_nworkers;
+}
+
+void job_submit(struct job *job)
+{
+	job->done = 0;
+	job->next = NULL;
+	if (!job_workers()) {
+		job_run(job);
+		return;
+	}
+
+	job_lock();
+	if (job_tail)
+		job_tail->next = job;
+	else
+		job_head = job;
+	job_tail = job;
+	job_unlock();
+	job_arch_kick();
+}
+
+int job_wait(struct job *job)
+{
+	while (!__atomic_load_n(&job->done, __ATOMIC_ACQUIRE))
+		job_run_one();
+
+	return job->ret;
+}
+
+void job_run_queue(void)
+{
+	while (job_run_one())
+		;
+}
+
+void job_stop(void)
+{
+	if (job_nworkers <= 0)
+		return;
+
+	/* Anything still queued is run here */
+	job_run_queue();
+	job_arch_stop();
+	job_nworkers = 0;
+}
+
+static int job_mem_run(struct job *job)
+{
+	struct job_mem *jm = container_of(job, struct job_mem, job);
+
+	if (jm->src)
+		memcpy(jm->dst, jm->src, jm->len);
+	else
+		memset(jm->dst, jm->c, jm->len);
+
+	return 0;
+}
+
+/* Split a fill or copy into one part per CPU */
+static void job_mem(void *dst, const void *src, int c, size_t n)
+{
+	struct job_mem jobs[CONFIG_JOB_MAX_WORKERS + 1];
+	size_t part, offset;
+	int count, i;
+
+	count = min(job_workers(), CONFIG_JOB_MAX_WORKERS) + 1;
+	if (count == 1 || n < JOB_MEM_MIN_SPLIT) {
+		if (src)
+			memcpy(dst, src, n);
+		else
+			memset(dst, c, n);
+		return;
+	}
+
+	part = ALIGN(DIV_ROUND_UP(n, count), JOB_MEM_ALIGN);
+	for (i = 0, offset = 0; offset < n; i++, offset += part) {
+		struct job_mem *jm = &jobs[i];
+
+		job_init(&jm->job, job_mem_run, NULL);
+		jm->dst = dst + offset;
+		jm->src = src ? src + offset : NULL;
+		jm->c = c;
+		jm->len = min(part, n - offset);
+		job_submit(&jm->job);
+	}
+	count = i;
+	for (i = 0; i < count; i++)
+		job_wait(&jobs[i].job);
+}
+
+void job_memset(void *s, int c, size_t n)
+{
+	job_mem(s, NULL, c, n);
+}
+
+void job_memcpy(void *dst, const void *src, size_t n)
+{
+	job_mem(dst, src, 0, n);
+}
+
+static int job_hash_run(struct job *job)
+{
+	struct job_hash *jh = container_of(job, struct job_hash, job);
+	struct hash_algo *algo = jh->algo;
+	const u8 *data = jh->data;
+	size_t left = jh->len;
+	int ret;
+
+	do {
+		uint len = min_t(size_t, left, JOB_HASH_MAX_UPDATE);
+
+		left -= len;
+		ret = algo->hash_update(algo, jh->ctx, data, len, !left);
+		if (ret)
+			return ret;
+		data += len;
+	} while (left);
+
+	return 0;
+}
+
+int job_hash_start(struct job_hash *jh, const char *algo_name,
+		   const void *data, size_t len)
+{
+	int ret;
+
+	ret = hash_progressive_lookup_algo(algo_name, &jh->algo);
+	if (ret)
+		return ret;
+	ret = jh->algo->hash_init(jh->algo, &jh->ctx);
+	if (ret)
+		return ret;
+	jh->data = data;
+	jh->len = len;
+	job_init(&jh->job, job_hash_run, NULL);
+
+	/* A hashing engine is a single device, so keep it on this CPU */
+	if (IS_ENABLED(CONFIG_SHA_PROG_HW_ACCEL))
+		job_run(&jh->job);
+	else
+		job_submit(&jh->job);
+
+	return 0;
+}
+
+int job_hash_finish(struct job_hash *jh, void *output, int size)
+{
+	int ret, fret;
+
+	ret = job_wait(&jh->job);
+
+	/* This frees the context, so must always be called */
+	fret = jh->algo->hash_finish(jh->algo, jh->ctx, output, size);
+
+	return ret ? ret : fret;
+}
+
+#if CONFIG_IS_ENABLED(LZ4)
+static int job_lz4_run(struct job *job)
+{
+	struct job_lz4 *jl = container_of(job, struct job_lz4, job);
+
+	return LZ4_decompress_safe(jl->src, jl->dst,
+				   min_t(size_t, jl->src_len, INT_MAX),
+				   min_t(size_t, jl->dst_len, INT_MAX));
+}
+
+void job_lz4_start(struct job_lz4 *jl, const void *src, size_t src_len,
+		   void *dst, size_t dst_len)
+{
+	jl->src = src;
+	jl->src_len = src_len;
+	jl->dst = dst;
+	jl->dst_len = dst_len;
+	job_init(&jl->job, job_lz4_run, NULL);
+	job_submit(&jl->job);
+}
+#endif
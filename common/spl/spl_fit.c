@@ -28,6 +28,10 @@ DECLARE_GLOBAL_DATA_PTR;
 #define CONFIG_SYS_BOOTM_LEN	(64 << 20)
 #endif
 
+#ifndef CONFIG_SPL_FIT_VERIFY_CHUNK
+#define CONFIG_SPL_FIT_VERIFY_CHUNK	0
+#endif
+
 struct spl_fit_info {
 	const void *fit;	/* Pointer to a valid FIT blob */
 	size_t ext_data_offset;	/* Offset to FIT external data (end of FIT) */
@@ -218,6 +222,64 @@ static int get_aligned_image_size(struct spl_load_info *info, int data_size,
 	return (data_size + info->bl_len - 1) / info->bl_len;
 }
 
+/**
+ * spl_fit_read_verify() - read external image data, hashing it on the way
+ * @info:	points to information about the device to load data from
+ * @sector:	first sector to read
+ * @nr_sectors:	number of sectors to read
+ * @buf:	buffer to read into
+ * @overhead:	offset of the image data within the first sector
+ * @length:	length of the image data
+ * @fit:	pointer to the FIT
+ * @node:	offset of the DT node describing the image
+ *
+ * Reading in chunks and hashing each one while it is still in the cache
+ * avoids a second pass over the whole image once it has been loaded.
+ *
+ * Return:	0 if the image was read and verified, -ENOSYS if the image
+ *		cannot be verified this way (nothing has been read), -EIO on
+ *		read error or -EPERM if verification failed
+ */
+static int spl_fit_read_verify(struct spl_load_info *info, ulong sector,
+			       ulong nr_sectors, void *buf, ulong overhead,
+			       ulong length, const void *fit, int node)
+{
+	ulong unit = info->filename ? 1 : info->bl_len;
+	struct fit_verify_ctx vctx;
+	ulong done, count, chunk;
+	ulong start, end;
+	int ret;
+
+	chunk = max(CONFIG_SPL_FIT_VERIFY_CHUNK / unit, 1UL);
+	if (chunk >= nr_sectors)
+		return -ENOSYS;
+	ret = fit_image_verify_start(&vctx, fit, node, gd_fdt_blob());
+	if (ret)
+		return ret;
+
+	printf("## Checking hash(es) for Image %s ... ",
+	       fit_get_name(fit, node, NULL));
+	for (done = 0; done < nr_sectors; done += count) {
+		count = min(nr_sectors - done, chunk);
+		if (info->read(info, sector + done, count,
+			       buf + done * unit) != count) {
+			fit_image_verify_abort(&vctx);
+			return -EIO;
+		}
+
+		/* Hash only the part of this chunk which holds image data */
+		start = max(done * unit, overhead);
+		end = min((done + count) * unit, overhead + length);
+		if (end > start)
+			fit_image_verify_update(&vctx, buf + start, end - start);
+	}
+	if (!fit_image_verify_finish(&vctx))
+		return -EPERM;
+	puts("OK\n");
+
+	return 0;
+}
+
 /**
  * spl_load_fit_image(): load the image described in a certain FIT node
  * @info:	points to information about the device to load data from
@@ -249,6 +311,8 @@ static int spl_load_fit_image(struct spl_load_info *info, ulong sector,
 	const void *data;
 	const void *fit = ctx->fit;
 	bool external_data = false;
+	bool verified = false;
+	int ret;
 
 	if (IS_ENABLED(CONFIG_SPL_FPGA) ||
 	    (IS_ENABLED(CONFIG_SPL_OS_BOOT) && IS_ENABLED(CONFIG_SPL_GZIP))) {
@@ -281,6 +345,7 @@ static int spl_load_fit_image(struct spl_load_info *info, ulong sector,
 
 	if (external_data) {
 		void *src_ptr;
+		ulong first;
 
 		/* External data */
 		if (fit_image_get_data_size(fit, node, &len))
@@ -299,10 +364,23 @@ static int spl_load_fit_image(struct spl_load_info *info, ulong sector,
 		overhead = get_aligned_image_overhead(info, offset);
 		nr_sectors = get_aligned_image_size(info, length, offset);
 
-		if (info->read(info,
-			       sector + get_aligned_image_offset(info, offset),
-			       nr_sectors, src_ptr) != nr_sectors)
-			return -EIO;
+		first = sector + get_aligned_image_offset(info, offset);
+
+		ret = -ENOSYS;
+		if (CONFIG_IS_ENABLED(FIT_SIGNATURE) &&
+		    CONFIG_SPL_FIT_VERIFY_CHUNK)
+			ret = spl_fit_read_verify(info, first, nr_sectors,
+						  src_ptr, overhead, length,
+						  fit, node);
+		if (ret == -ENOSYS) {
+			if (info->read(info, first, nr_sectors,
+				       src_ptr) != nr_sectors)
+				return -EIO;
+		} else if (ret) {
+			return ret;
+		} else {
+			verified = true;
+		}
 
 		debug("External data: dst=%p, offset=%x, size=%lx\n",
 		      src_ptr, offset, (unsigned long)length);
@@ -318,7 +396,7 @@ static int spl_load_fit_image(struct spl_load_info *info, ulong sector,
 		src = (void *)data;	/* cast away const */
 	}
 
-	if (CONFIG_IS_ENABLED(FIT_SIGNATURE)) {
+	if (CONFIG_IS_ENABLED(FIT_SIGNATURE) && !verified) {
 		printf("## Checking hash(es) for Image %s ... ",
 		       fit_get_name(fit, node, NULL));
 		if (!fit_image_verify_with_data(fit, node, gd_fdt_blob(), src,
@@ -76,6 +76,7 @@ static struct blk_desc usb_dev_desc[USB_MAX_STOR_DEV];
 #endif
 
 struct us_data;
+struct uas_cmd;
 typedef int (*trans_cmnd)(struct scsi_cmd *cb, struct us_data *data);
 typedef int (*trans_reset)(struct us_data *data);
 
@@ -102,6 +103,13 @@ struct us_data {
 	trans_reset	transport_reset;	/* reset routine */
 	trans_cmnd	transport;		/* transport routine */
 	unsigned short	max_xfer_blk;		/* maximum transfer blocks */
+#if CONFIG_IS_ENABLED(USB_STORAGE_UAS)
+	unsigned char	ep_cmd;			/* UAS command out endpoint */
+	unsigned char	ep_status;		/* UAS status in endpoint */
+	unsigned char	num_streams;		/* UAS streams, 0 if none */
+	unsigned char	sense[18];		/* UAS sense from last error */
+	struct uas_cmd	*uas_cmds;		/* UAS commands, by tag - 1 */
+#endif
 };
 
 #if !CONFIG_IS_ENABLED(BLK)
@@ -176,6 +184,10 @@ static unsigned int usb_get_max_lun(struct us_data *us)
 {
 	int len;
 	ALLOC_CACHE_ALIGN_BUFFER(unsigned char, result, 1);
+
+	/* UAS has no such request, so only the first LUN is used */
+	if (us->protocol == US_PR_UAS)
+		return 0;
 	len = usb_control_msg(us->pusb_dev,
 			      usb_rcvctrlpipe(us->pusb_dev, 0),
 			      US_BBB_GET_MAX_LUN,
@@ -719,6 +731,69 @@ static int usb_stor_BBB_clear_endpt_stall(struct us_data *us, __u8 endpt)
 			       endpt, NULL, 0, USB_CNTL_TIMEOUT * 5);
 }
 
+#if CONFIG_IS_ENABLED(DM_USB)
+/*
+ * Queue the DATA and STATUS phases together, so that the controller moves
+ * straight from one to the other without waiting for us in between.
+ *
+ * Returns 1 if both phases are done, 0 if only the DATA phase is (the CSW is
+ * then read as usual), -ENOSYS if the controller cannot queue transfers, or
+ * another -ve value if the DATA phase failed, with the device status set.
+ */
+static int usb_stor_BBB_queue(struct scsi_cmd *srb, struct us_data *us,
+			      unsigned int pipe, struct umass_bbb_csw *csw,
+			      int *data_actlen)
+{
+	struct usb_device *udev = us->pusb_dev;
+	struct usb_xfer data = {
+		.pipe = pipe,
+		.buffer = srb->pdata,
+		.length = srb->datalen,
+	};
+	struct usb_xfer status = {
+		.pipe = usb_rcvbulkpipe(udev, us->ep_in),
+		.buffer = csw,
+		.length = UMASS_BBB_CSW_SIZE,
+	};
+	bool queued;
+	int ret;
+
+	ret = usb_bulk_submit(udev, &data);
+	if (ret)
+		return ret;
+	/* If there is no room for the CSW yet, it is read afterwards */
+	queued = !usb_bulk_submit(udev, &status);
+
+	ret = usb_bulk_wait(udev, &data, USB_TIMEOUT_MS(pipe));
+	udev->status = data.status;
+	udev->act_len = data.act_len;
+	*data_actlen = data.act_len;
+	if (ret < 0) {
+		/* Drop the CSW read, which is redone after error recovery */
+		if (queued && !status.complete)
+			usb_bulk_wait(udev, &status, 0);
+		return ret;
+	}
+	if (!queued)
+		return 0;
+
+	ret = usb_bulk_wait(udev, &status, USB_TIMEOUT_MS(status.pipe));
+	udev->status = status.status;
+	udev->act_len = status.act_len;
+	if (ret < 0)
+		return 0;
+
+	return 1;
+}
+#else
+static int usb_stor_BBB_queue(struct scsi_cmd *srb, struct us_data *us,
+			      unsigned int pipe, struct umass_bbb_csw *csw,
+			      int *data_actlen)
+{
+	return -ENOSYS;
+}
+#endif
+
 static int usb_stor_BBB_transport(struct scsi_cmd *srb, struct us_data *us)
 {
 	int result, retry;
@@ -757,8 +832,11 @@ static int usb_stor_BBB_transport(struct scsi_cmd *srb, struct us_data *us)
 	else
 		pipe = pipeout;
 
-	result = usb_bulk_msg(us->pusb_dev, pipe, srb->pdata, srb->datalen,
-			      &data_actlen, USB_CNTL_TIMEOUT * 5);
+	result = usb_stor_BBB_queue(srb, us, pipe, csw, &data_actlen);
+	if (result == -ENOSYS)
+		result = usb_bulk_msg(us->pusb_dev, pipe, srb->pdata,
+				      srb->datalen, &data_actlen,
+				      USB_CNTL_TIMEOUT * 5);
 	/* special handling of STALL in DATA phase */
 	if ((result < 0) && (us->pusb_dev->status & USB_ST_STALLED)) {
 		debug("DATA:stall\n");
@@ -780,6 +858,11 @@ static int usb_stor_BBB_transport(struct scsi_cmd *srb, struct us_data *us)
 		printf("pdata[%d] %#x ", index, srb->pdata[index]);
 	printf("\n");
 #endif
+	/* the CSW may have been read along with the data */
+	if (result > 0) {
+		result = 0;
+		goto csw;
+	}
 	/* STATUS phase + error handling */
 st:
 	retry = 0;
@@ -804,6 +887,7 @@ again:
 		usb_stor_BBB_reset(us);
 		return USB_STOR_TRANSPORT_FAILED;
 	}
+csw:
 #ifdef BBB_XPORT_TRACE
 	ptr = (unsigned char *)csw;
 	for (index = 0; index < UMASS_BBB_CSW_SIZE; index++)
@@ -973,6 +1057,9 @@ static void usb_stor_set_max_xfer_blk(struct usb_device *udev,
 	 * Windows 7 limiting transfers to 128 sectors for both USB2 and USB3
 	 * and Apple Mac OS X 10.11 limiting transfers to 256 sectors for USB2
 	 * and 2048 for USB3 devices.
+	 *
+	 * The same limit applies to USB3 devices unless a board whose devices
+	 * are known to cope raises CONFIG_USB_STORAGE_SUPERSPEED_MAX_BLK.
 	 */
 	unsigned short blk = 240;
 
@@ -980,6 +1067,11 @@ static void usb_stor_set_max_xfer_blk(struct usb_device *udev,
 	size_t size;
 	int ret;
 
+#ifdef CONFIG_USB_STORAGE_SUPERSPEED_MAX_BLK
+	if (udev->speed >= USB_SPEED_SUPER)
+		blk = CONFIG_USB_STORAGE_SUPERSPEED_MAX_BLK;
+#endif
+
 	ret = usb_get_max_xfer_size(udev, (size_t *)&size);
 	if ((ret >= 0) && (size < blk * 512))
 		blk = size / 512;
@@ -1081,11 +1173,11 @@ static int usb_read_capacity(struct scsi_cmd *srb, struct us_data *ss)
 	return -1;
 }
 
-static int usb_read_10(struct scsi_cmd *srb, struct us_data *ss,
-		       unsigned long start, unsigned short blocks)
+static void usb_setup_rw_10(struct scsi_cmd *srb, unsigned char opcode,
+			    unsigned long start, unsigned short blocks)
 {
 	memset(&srb->cmd[0], 0, 12);
-	srb->cmd[0] = SCSI_READ10;
+	srb->cmd[0] = opcode;
 	srb->cmd[1] = srb->lun << 5;
 	srb->cmd[2] = ((unsigned char) (start >> 24)) & 0xff;
 	srb->cmd[3] = ((unsigned char) (start >> 16)) & 0xff;
@@ -1094,6 +1186,12 @@ static int usb_read_10(struct scsi_cmd *srb, struct us_data *ss,
 	srb->cmd[7] = ((unsigned char) (blocks >> 8)) & 0xff;
 	srb->cmd[8] = (unsigned char) blocks & 0xff;
 	srb->cmdlen = 12;
+}
+
+static int usb_read_10(struct scsi_cmd *srb, struct us_data *ss,
+		       unsigned long start, unsigned short blocks)
+{
+	usb_setup_rw_10(srb, SCSI_READ10, start, blocks);
 	debug("read10: start %lx blocks %x\n", start, blocks);
 	return ss->transport(srb, ss);
 }
@@ -1101,20 +1199,368 @@ static int usb_read_10(struct scsi_cmd *srb, struct us_data *ss,
 static int usb_write_10(struct scsi_cmd *srb, struct us_data *ss,
 			unsigned long start, unsigned short blocks)
 {
-	memset(&srb->cmd[0], 0, 12);
-	srb->cmd[0] = SCSI_WRITE10;
-	srb->cmd[1] = srb->lun << 5;
-	srb->cmd[2] = ((unsigned char) (start >> 24)) & 0xff;
-	srb->cmd[3] = ((unsigned char) (start >> 16)) & 0xff;
-	srb->cmd[4] = ((unsigned char) (start >> 8)) & 0xff;
-	srb->cmd[5] = ((unsigned char) (start)) & 0xff;
-	srb->cmd[7] = ((unsigned char) (blocks >> 8)) & 0xff;
-	srb->cmd[8] = (unsigned char) blocks & 0xff;
-	srb->cmdlen = 12;
+	usb_setup_rw_10(srb, SCSI_WRITE10, start, blocks);
 	debug("write10: start %lx blocks %x\n", start, blocks);
 	return ss->transport(srb, ss);
 }
 
+#if CONFIG_IS_ENABLED(USB_STORAGE_UAS)
+/* Number of UAS commands which can be outstanding, each on its own stream */
+#define UAS_MAX_CMDS	4
+
+/**
+ * struct uas_cmd - a UAS command, perhaps outstanding
+ *
+ * @srb:	SCSI command, with its data buffer
+ * @tag:	Tag of the command, which is also its stream if there are any
+ * @data_queued: true if @data has been queued
+ * @cmd:	Transfer of @iu on the command pipe
+ * @data:	Transfer of the data, if any
+ * @status:	Transfer of @sense on the status pipe
+ * @iu:		Command IU sent to the device
+ * @sense:	Sense IU (or READ READY / WRITE READY) from the device
+ */
+struct uas_cmd {
+	struct scsi_cmd *srb;
+	unsigned int tag;
+	bool data_queued;
+	struct usb_xfer cmd;
+	struct usb_xfer data;
+	struct usb_xfer status;
+	struct uas_command_iu iu __aligned(ARCH_DMA_MINALIGN);
+	struct uas_sense_iu sense __aligned(ARCH_DMA_MINALIGN);
+};
+
+static int usb_stor_UAS_reset(struct us_data *us)
+{
+	struct usb_device *udev = us->pusb_dev;
+
+	usb_clear_halt(udev, usb_sndbulkpipe(udev, us->ep_cmd));
+	usb_clear_halt(udev, usb_rcvbulkpipe(udev, us->ep_status));
+	usb_clear_halt(udev, usb_rcvbulkpipe(udev, us->ep_in));
+	usb_clear_halt(udev, usb_sndbulkpipe(udev, us->ep_out));
+
+	return 0;
+}
+
+/*
+ * Give up everything queued on the UAS pipes, for all outstanding commands,
+ * then clear any halts
+ */
+static void usb_stor_UAS_abort(struct us_data *us)
+{
+	struct usb_device *udev = us->pusb_dev;
+
+	usb_bulk_cancel(udev, usb_sndbulkpipe(udev, us->ep_cmd));
+	usb_bulk_cancel(udev, usb_rcvbulkpipe(udev, us->ep_status));
+	usb_bulk_cancel(udev, usb_rcvbulkpipe(udev, us->ep_in));
+	usb_bulk_cancel(udev, usb_sndbulkpipe(udev, us->ep_out));
+	usb_stor_UAS_reset(us);
+}
+
+/*
+ * Queue the transfers for a command, the command IU last so that the device
+ * finds the others ready. Without streams the data is only queued once the
+ * device asks for it. On error, all outstanding commands are given up.
+ */
+static int usb_stor_UAS_submit(struct us_data *us, struct uas_cmd *uc)
+{
+	struct usb_device *udev = us->pusb_dev;
+	struct scsi_cmd *srb = uc->srb;
+	unsigned int stream = us->num_streams ? uc->tag : 0;
+	int ret;
+
+	memset(&uc->iu, '\0', sizeof(uc->iu));
+	uc->iu.iu_id = UAS_IU_COMMAND;
+	uc->iu.tag = cpu_to_be16(uc->tag);
+	uc->iu.lun[1] = srb->lun;
+	memcpy(uc->iu.cdb, srb->cmd, min_t(int, srb->cmdlen,
+					   sizeof(uc->iu.cdb)));
+
+	memset(&uc->cmd, '\0', sizeof(uc->cmd));
+	uc->cmd.pipe = usb_sndbulkpipe(udev, us->ep_cmd);
+	uc->cmd.buffer = &uc->iu;
+	uc->cmd.length = sizeof(uc->iu);
+
+	memset(&uc->status, '\0', sizeof(uc->status));
+	uc->status.pipe = usb_rcvbulkpipe(udev, us->ep_status);
+	uc->status.stream = stream;
+	uc->status.buffer = &uc->sense;
+	uc->status.length = sizeof(uc->sense);
+
+	memset(&uc->data, '\0', sizeof(uc->data));
+	if (US_DIRECTION(srb->cmd[0]))
+		uc->data.pipe = usb_rcvbulkpipe(udev, us->ep_in);
+	else
+		uc->data.pipe = usb_sndbulkpipe(udev, us->ep_out);
+	uc->data.stream = stream;
+	uc->data.buffer = srb->pdata;
+	uc->data.length = srb->datalen;
+	uc->data_queued = false;
+
+	ret = usb_bulk_submit(udev, &uc->status);
+	if (!ret && srb->datalen && stream) {
+		ret = usb_bulk_submit(udev, &uc->data);
+		uc->data_queued = !ret;
+	}
+	if (!ret)
+		ret = usb_bulk_submit(udev, &uc->cmd);
+	if (ret)
+		usb_stor_UAS_abort(us);
+
+	return ret;
+}
+
+/*
+ * Wait for a command to finish, keeping its sense data if it failed. If a
+ * transfer fails, all outstanding commands are given up, so there is nothing
+ * left to wait for, and USB_STOR_TRANSPORT_ERROR is returned.
+ */
+static int usb_stor_UAS_finish(struct us_data *us, struct uas_cmd *uc)
+{
+	struct usb_device *udev = us->pusb_dev;
+	struct uas_sense_iu *siu = &uc->sense;
+	int ret, data_ret = 0;
+
+	ret = usb_bulk_wait(udev, &uc->cmd, USB_TIMEOUT_MS(uc->cmd.pipe));
+	if (ret >= 0)
+		ret = usb_bulk_wait(udev, &uc->status,
+				    USB_TIMEOUT_MS(uc->status.pipe));
+
+	/* Without streams, the device says when it is ready for the data */
+	if (ret > 0 && uc->srb->datalen && !uc->data_queued &&
+	    (siu->iu_id == UAS_IU_READ_READY ||
+	     siu->iu_id == UAS_IU_WRITE_READY)) {
+		ret = usb_bulk_submit(udev, &uc->data);
+		if (!ret) {
+			uc->data_queued = true;
+			ret = usb_bulk_submit(udev, &uc->status);
+		}
+		if (!ret)
+			ret = usb_bulk_wait(udev, &uc->status,
+					    USB_TIMEOUT_MS(uc->status.pipe));
+	}
+	if (ret >= 0 && uc->data_queued)
+		data_ret = usb_bulk_wait(udev, &uc->data,
+					 USB_TIMEOUT_MS(uc->data.pipe));
+	if (ret < 0 || data_ret < 0) {
+		debug("UAS transfer failed, status %lx\n", udev->status);
+		usb_stor_UAS_abort(us);
+		return USB_STOR_TRANSPORT_ERROR;
+	}
+	if (ret < UAS_SENSE_IU_HDR_SIZE || siu->iu_id != UAS_IU_SENSE ||
+	    be16_to_cpu(siu->tag) != uc->tag) {
+		debug("UAS bad status IU %x, tag %x\n", siu->iu_id,
+		      be16_to_cpu(siu->tag));
+		return USB_STOR_TRANSPORT_FAILED;
+	}
+	if (siu->status) {
+		memset(us->sense, '\0', sizeof(us->sense));
+		memcpy(us->sense, siu->sense,
+		       min_t(int, be16_to_cpu(siu->len), sizeof(us->sense)));
+		debug("UAS status %x, sense %02x %02x\n", siu->status,
+		      us->sense[2], us->sense[12]);
+		return USB_STOR_TRANSPORT_FAILED;
+	}
+
+	return USB_STOR_TRANSPORT_GOOD;
+}
+
+static int usb_stor_UAS_transport(struct scsi_cmd *srb, struct us_data *us)
+{
+	struct uas_cmd *uc = &us->uas_cmds[0];
+
+	/* The sense data came with the status of the command which failed */
+	if (srb->cmd[0] == SCSI_REQ_SENSE) {
+		memcpy(srb->pdata, us->sense,
+		       min_t(ulong, srb->datalen, sizeof(us->sense)));
+		memset(us->sense, '\0', sizeof(us->sense));
+		return USB_STOR_TRANSPORT_GOOD;
+	}
+
+	uc->srb = srb;
+	uc->tag = 1;
+	if (usb_stor_UAS_submit(us, uc))
+		return USB_STOR_TRANSPORT_FAILED;
+
+	return usb_stor_UAS_finish(us, uc);
+}
+
+/*
+ * Read or write with a command outstanding on each stream, so that the device
+ * has the next one to hand when it finishes a transfer. This stops at the
+ * first error, giving up the commands still outstanding, and returns the
+ * number of blocks done before it, leaving the rest to be retried one command
+ * at a time.
+ */
+static lbaint_t usb_stor_UAS_rw(struct us_data *us, struct blk_desc *block_dev,
+				lbaint_t start, lbaint_t blkcnt,
+				uintptr_t buf_addr, bool write)
+{
+	struct scsi_cmd srbs[UAS_MAX_CMDS];
+	unsigned short blocks[UAS_MAX_CMDS];
+	int num = us->num_streams;
+	int first = 0, count = 0;
+	lbaint_t queued = 0, done = 0;
+
+	if (us->protocol != US_PR_UAS || num < 2)
+		return 0;
+
+	while (count || queued < blkcnt) {
+		struct uas_cmd *uc;
+		int i, ret;
+
+		if (queued < blkcnt && count < num) {
+			i = (first + count) % num;
+			uc = &us->uas_cmds[i];
+			blocks[i] = min_t(lbaint_t, blkcnt - queued,
+					  us->max_xfer_blk);
+			srbs[i].lun = block_dev->lun;
+			usb_setup_rw_10(&srbs[i], write ? SCSI_WRITE10 :
+					SCSI_READ10, start + queued, blocks[i]);
+			srbs[i].pdata = (unsigned char *)buf_addr +
+				queued * block_dev->blksz;
+			srbs[i].datalen = blocks[i] * block_dev->blksz;
+			uc->srb = &srbs[i];
+			uc->tag = i + 1;
+			if (usb_stor_UAS_submit(us, uc))
+				break;
+			queued += blocks[i];
+			count++;
+			continue;
+		}
+
+		/* Wait for the oldest command, then send another */
+		uc = &us->uas_cmds[first];
+		ret = usb_stor_UAS_finish(us, uc);
+		if (ret != USB_STOR_TRANSPORT_GOOD) {
+			/* After a transfer error they are given up already */
+			if (ret != USB_STOR_TRANSPORT_ERROR && count > 1)
+				usb_stor_UAS_abort(us);
+			break;
+		}
+		done += blocks[first];
+		first = (first + 1) % num;
+		count--;
+	}
+	return done;
+}
+
+/*
+ * Look for a UAS alternate setting of the interface and select it, setting up
+ * streams if the controller has them. The Pipe Usage descriptors, which say
+ * what each endpoint is for, are not kept by usb_parse_config() so the
+ * configuration descriptor is read again here.
+ */
+static int usb_stor_UAS_probe(struct usb_device *udev,
+			      struct usb_interface *iface, struct us_data *us)
+{
+	u8 pipes[UAS_DATA_OUT_PIPE_ID + 1];
+	int ifnum = iface->desc.bInterfaceNumber;
+	int len, pos, ret, alt = -1;
+	u8 eps[3], ep = 0;
+	u8 *buf;
+
+	len = usb_get_configuration_len(udev, udev->configno);
+	if (len < 0)
+		return len;
+	buf = malloc_cache_aligned(len);
+	if (!buf)
+		return -ENOMEM;
+	ret = usb_get_configuration_no(udev, udev->configno, buf, len);
+	if (ret < len) {
+		free(buf);
+		return -EIO;
+	}
+
+	memset(pipes, '\0', sizeof(pipes));
+	for (pos = 0; pos + 2 <= len && buf[pos] >= 2 &&
+	     pos + buf[pos] <= len; pos += buf[pos]) {
+		struct usb_interface_descriptor *ifd = (void *)&buf[pos];
+		struct usb_pipe_usage_descriptor *pud = (void *)&buf[pos];
+
+		switch (buf[pos + 1]) {
+		case USB_DT_INTERFACE:
+			if (alt >= 0 || buf[pos] < USB_DT_INTERFACE_SIZE)
+				goto done;
+			if (ifd->bInterfaceNumber == ifnum &&
+			    ifd->bInterfaceSubClass == US_SC_SCSI &&
+			    ifd->bInterfaceProtocol == US_PR_UAS)
+				alt = ifd->bAlternateSetting;
+			break;
+		case USB_DT_ENDPOINT:
+			ep = ((struct usb_endpoint_descriptor *)ifd)->
+				bEndpointAddress;
+			break;
+		case USB_DT_PIPE_USAGE:
+			if (alt >= 0 && buf[pos] >= USB_DT_PIPE_USAGE_SIZE &&
+			    pud->bPipeID >= UAS_CMD_PIPE_ID &&
+			    pud->bPipeID <= UAS_DATA_OUT_PIPE_ID)
+				pipes[pud->bPipeID] = ep;
+			break;
+		}
+	}
+done:
+	free(buf);
+	if (alt < 0 || !pipes[UAS_CMD_PIPE_ID] || !pipes[UAS_STATUS_PIPE_ID] ||
+	    !pipes[UAS_DATA_IN_PIPE_ID] || !pipes[UAS_DATA_OUT_PIPE_ID])
+		return -ENOENT;
+
+	/* The IUs are read and written by DMA */
+	us->uas_cmds = memalign(ARCH_DMA_MINALIGN,
+				UAS_MAX_CMDS * sizeof(*us->uas_cmds));
+	if (!us->uas_cmds)
+		return -ENOMEM;
+
+	ret = usb_set_interface(udev, ifnum, alt);
+	if (ret)
+		goto err;
+
+	/* SuperSpeed devices only run UAS with streams, slower ones without */
+	eps[0] = pipes[UAS_STATUS_PIPE_ID];
+	eps[1] = pipes[UAS_DATA_IN_PIPE_ID];
+	eps[2] = pipes[UAS_DATA_OUT_PIPE_ID];
+	ret = usb_alloc_streams(udev, ifnum, eps, ARRAY_SIZE(eps),
+				UAS_MAX_CMDS);
+	if (ret < 0 && udev->speed >= USB_SPEED_SUPER) {
+		debug("UAS needs streams, err=%d\n", ret);
+		usb_set_interface(udev, ifnum, 0);
+		goto err;
+	}
+
+	us->num_streams = max(ret, 0);
+	us->ep_cmd = pipes[UAS_CMD_PIPE_ID] & USB_ENDPOINT_NUMBER_MASK;
+	us->ep_status = pipes[UAS_STATUS_PIPE_ID] & USB_ENDPOINT_NUMBER_MASK;
+	us->ep_in = pipes[UAS_DATA_IN_PIPE_ID] & USB_ENDPOINT_NUMBER_MASK;
+	us->ep_out = pipes[UAS_DATA_OUT_PIPE_ID] & USB_ENDPOINT_NUMBER_MASK;
+	us->subclass = US_SC_SCSI;
+	us->protocol = US_PR_UAS;
+	us->transport = usb_stor_UAS_transport;
+	us->transport_reset = usb_stor_UAS_reset;
+
+	return 0;
+
+err:
+	free(us->uas_cmds);
+	us->uas_cmds = NULL;
+
+	return ret;
+}
+#else
+static lbaint_t usb_stor_UAS_rw(struct us_data *us, struct blk_desc *block_dev,
+				lbaint_t start, lbaint_t blkcnt,
+				uintptr_t buf_addr, bool write)
+{
+	return 0;
+}
+
+static int usb_stor_UAS_probe(struct usb_device *udev,
+			      struct usb_interface *iface, struct us_data *us)
+{
+	return -ENOSYS;
+}
+#endif
+
 
 #ifdef CONFIG_USB_BIN_FIXUP
 /*
@@ -1147,9 +1593,9 @@ static unsigned long usb_stor_read(struct blk_desc *block_dev, lbaint_t blknr,
 				   lbaint_t blkcnt, void *buffer)
 #endif
 {
-	lbaint_t start, blks;
+	lbaint_t start, blks, done;
 	uintptr_t buf_addr;
-	unsigned short smallblks;
+	unsigned short smallblks = 0;
 	struct usb_device *udev;
 	struct us_data *ss;
 	int retry;
@@ -1185,7 +1631,13 @@ static unsigned long usb_stor_read(struct blk_desc *block_dev, lbaint_t blknr,
 	debug("\nusb_read: dev %d startblk " LBAF ", blccnt " LBAF " buffer %lx\n",
 	      block_dev->devnum, start, blks, buf_addr);
 
-	do {
+	/* With UAS streams, several commands can be outstanding at once */
+	done = usb_stor_UAS_rw(ss, block_dev, start, blks, buf_addr, false);
+	start += done;
+	blks -= done;
+	buf_addr += done * block_dev->blksz;
+
+	while (blks != 0) {
 		/* XXX need some comment here */
 		retry = 2;
 		srb->pdata = (unsigned char *)buf_addr;
@@ -1210,7 +1662,7 @@ retry_it:
 		start += smallblks;
 		blks -= smallblks;
 		buf_addr += srb->datalen;
-	} while (blks != 0);
+	}
 
 	debug("usb_read: end startblk " LBAF ", blccnt %x buffer %lx\n",
 	      start, smallblks, buf_addr);
@@ -1230,9 +1682,9 @@ static unsigned long usb_stor_write(struct blk_desc *block_dev, lbaint_t blknr,
 				    lbaint_t blkcnt, const void *buffer)
 #endif
 {
-	lbaint_t start, blks;
+	lbaint_t start, blks, done;
 	uintptr_t buf_addr;
-	unsigned short smallblks;
+	unsigned short smallblks = 0;
 	struct usb_device *udev;
 	struct us_data *ss;
 	int retry;
@@ -1270,7 +1722,13 @@ static unsigned long usb_stor_write(struct blk_desc *block_dev, lbaint_t blknr,
 	debug("\nusb_write: dev %d startblk " LBAF ", blccnt " LBAF " buffer %lx\n",
 	      block_dev->devnum, start, blks, buf_addr);
 
-	do {
+	/* With UAS streams, several commands can be outstanding at once */
+	done = usb_stor_UAS_rw(ss, block_dev, start, blks, buf_addr, true);
+	start += done;
+	blks -= done;
+	buf_addr += done * block_dev->blksz;
+
+	while (blks != 0) {
 		/* If write fails retry for max retry count else
 		 * return with number of blocks written successfully.
 		 */
@@ -1297,7 +1755,7 @@ retry_it:
 		start += smallblks;
 		blks -= smallblks;
 		buf_addr += srb->datalen;
-	} while (blks != 0);
+	}
 
 	debug("usb_write: end startblk " LBAF ", blccnt %x buffer %lx\n",
 	      start, smallblks, buf_addr);
@@ -1331,6 +1789,10 @@ int usb_storage_probe(struct usb_device *dev, unsigned int ifnum,
 		return 0;
 	}
 
+#if CONFIG_IS_ENABLED(USB_STORAGE_UAS)
+	/* A device found again by a rescan starts afresh */
+	free(ss->uas_cmds);
+#endif
 	memset(ss, 0, sizeof(struct us_data));
 
 	/* At this point, we know we've got a live one */
@@ -1344,6 +1806,12 @@ int usb_storage_probe(struct usb_device *dev, unsigned int ifnum,
 	ss->subclass = iface->desc.bInterfaceSubClass;
 	ss->protocol = iface->desc.bInterfaceProtocol;
 
+	/* Use UAS if the device has it, else the protocol of the interface */
+	if (!usb_stor_UAS_probe(dev, iface, ss)) {
+		debug("Transport: UAS\n");
+		goto found;
+	}
+
 	/* set the handler pointers based on the protocol */
 	debug("Transport: ");
 	switch (ss->protocol) {
@@ -1426,6 +1894,7 @@ int usb_storage_probe(struct usb_device *dev, unsigned int ifnum,
 		dev->irq_handle = usb_stor_irq;
 	}
 
+found:
 	/* Set the maximum transfer size per host controller setting */
 	usb_stor_set_max_xfer_blk(dev, ss);
 
@@ -1533,6 +2002,18 @@ static int usb_mass_storage_probe(struct udevice *dev)
 	return ret;
 }
 
+static int usb_mass_storage_remove(struct udevice *dev)
+{
+#if CONFIG_IS_ENABLED(BLK) && CONFIG_IS_ENABLED(USB_STORAGE_UAS)
+	struct us_data *us = dev_get_plat(dev);
+
+	free(us->uas_cmds);
+	us->uas_cmds = NULL;
+#endif
+
+	return 0;
+}
+
 static const struct udevice_id usb_mass_storage_ids[] = {
 	{ .compatible = "usb-mass-storage" },
 	{ }
@@ -1543,6 +2024,7 @@ U_BOOT_DRIVER(usb_mass_storage) = {
 	.id	= UCLASS_MASS_STORAGE,
 	.of_match = usb_mass_storage_ids,
 	.probe = usb_mass_storage_probe,
+	.remove = usb_mass_storage_remove,
 #if CONFIG_IS_ENABLED(BLK)
 	.plat_auto	= sizeof(struct us_data),
 #endif
@@ -174,8 +174,9 @@ unsigned long disk_blk_read(struct udevice *dev, lbaint_t start,
 	struct blk_desc *desc;
 	const struct blk_ops *ops;
 	struct disk_part *part;
-	lbaint_t start_in_disk;
+	lbaint_t start_in_disk, end, ra_cnt;
 	ulong blks_read;
+	void *ra_buf;
 
 	desc = dev_get_blk(dev);
 	if (!desc)
@@ -186,14 +187,25 @@ unsigned long disk_blk_read(struct udevice *dev, lbaint_t start,
 		return -ENOSYS;
 
 	start_in_disk = start;
+	end = desc->lba;
 	if (device_get_uclass_id(dev) == UCLASS_PARTITION) {
 		part = dev_get_uclass_plat(dev);
 		start_in_disk += part->gpt_part_info.start;
+		end = part->gpt_part_info.size;
 	}
 
 	if (blkcache_read(desc->uclass_id, desc->devnum, start_in_disk, blkcnt,
 			  desc->blksz, buffer))
 		return blkcnt;
+	ra_buf = blkcache_readahead(desc->uclass_id, desc->devnum,
+				    start_in_disk, blkcnt, desc->blksz, &ra_cnt);
+	if (ra_buf && start + ra_cnt <= end &&
+	    ops->read(dev, start, ra_cnt, ra_buf) == ra_cnt) {
+		blkcache_fill(desc->uclass_id, desc->devnum, start_in_disk,
+			      ra_cnt, desc->blksz, ra_buf);
+		memcpy(buffer, ra_buf, blkcnt * desc->blksz);
+		return blkcnt;
+	}
 	blks_read = ops->read(dev, start, blkcnt, buffer);
 	if (blks_read == blkcnt)
 		blkcache_fill(desc->uclass_id, desc->devnum, start_in_disk,
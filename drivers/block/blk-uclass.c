@@ -12,10 +12,18 @@
 #include <log.h>
 #include <malloc.h>
 #include <part.h>
+#include <time.h>
 #include <dm/device-internal.h>
 #include <dm/lists.h>
 #include <dm/uclass-internal.h>
 #include <linux/err.h>
+#include <linux/sizes.h>
+
+/* Size of each request issued by blk_read_queued() */
+#define BLK_QUEUE_CHUNK_SIZE	SZ_1M
+
+/* Time to wait for a queued request to make progress */
+#define BLK_REQ_TIMEOUT_MS	10000
 
 static struct {
 	enum uclass_id id;
@@ -449,6 +457,8 @@ long blk_read(struct udevice *dev, lbaint_t start, lbaint_t blkcnt, void *buf)
 	struct blk_desc *desc = dev_get_uclass_plat(dev);
 	const struct blk_ops *ops = blk_get_ops(dev);
 	ulong blks_read;
+	lbaint_t ra_cnt;
+	void *ra_buf;
 
 	if (!ops->read)
 		return -ENOSYS;
@@ -456,6 +466,17 @@ long blk_read(struct udevice *dev, lbaint_t start, lbaint_t blkcnt, void *buf)
 	if (blkcache_read(desc->uclass_id, desc->devnum,
 			  start, blkcnt, desc->blksz, buf))
 		return blkcnt;
+	if (ops->submit && blkcnt * desc->blksz > BLK_QUEUE_CHUNK_SIZE)
+		return blk_read_queued(dev, start, blkcnt, buf);
+	ra_buf = blkcache_readahead(desc->uclass_id, desc->devnum, start,
+				    blkcnt, desc->blksz, &ra_cnt);
+	if (ra_buf && start + ra_cnt <= desc->lba &&
+	    ops->read(dev, start, ra_cnt, ra_buf) == ra_cnt) {
+		blkcache_fill(desc->uclass_id, desc->devnum, start, ra_cnt,
+			      desc->blksz, ra_buf);
+		memcpy(buf, ra_buf, blkcnt * desc->blksz);
+		return blkcnt;
+	}
 	blks_read = ops->read(dev, start, blkcnt, buf);
 	if (blks_read == blkcnt)
 		blkcache_fill(desc->uclass_id, desc->devnum, start, blkcnt,
@@ -491,6 +512,209 @@ long blk_erase(struct udevice *dev, lbaint_t start, lbaint_t blkcnt)
 	return ops->erase(dev, start, blkcnt);
 }
 
+long blk_write_zeroes(struct udevice *dev, lbaint_t start, lbaint_t blkcnt)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	const struct blk_ops *ops = blk_get_ops(dev);
+	long ret;
+
+	if (!ops->write_zeroes)
+		return -ENOSYS;
+
+	blkcache_invalidate(desc->uclass_id, desc->devnum);
+
+	ret = ops->write_zeroes(dev, start, blkcnt);
+	if (!IS_ERR_VALUE(ret) && ret != blkcnt)
+		return -EIO;
+
+	return ret;
+}
+
+int blk_submit(struct udevice *dev, struct blk_req *req)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	const struct blk_ops *ops = blk_get_ops(dev);
+
+	req->result = 0;
+	req->complete = false;
+	if (!ops->submit) {
+		if (req->op == BLK_REQ_WRITE)
+			req->result = blk_write(dev, req->start, req->blkcnt,
+						req->buffer);
+		else
+			req->result = blk_read(dev, req->start, req->blkcnt,
+					       req->buffer);
+		req->complete = true;
+
+		return 0;
+	}
+
+	if (req->op == BLK_REQ_WRITE) {
+		blkcache_invalidate(desc->uclass_id, desc->devnum);
+	} else if (blkcache_read(desc->uclass_id, desc->devnum, req->start,
+				 req->blkcnt, desc->blksz, req->buffer)) {
+		req->result = req->blkcnt;
+		req->complete = true;
+
+		return 0;
+	}
+
+	return ops->submit(dev, req);
+}
+
+int blk_poll(struct udevice *dev)
+{
+	const struct blk_ops *ops = blk_get_ops(dev);
+
+	if (!ops->poll)
+		return 0;
+
+	return ops->poll(dev);
+}
+
+long blk_wait(struct udevice *dev, struct blk_req *req)
+{
+	ulong start = get_timer(0);
+	int ret;
+
+	while (!req->complete) {
+		ret = blk_poll(dev);
+		if (ret > 0)
+			start = get_timer(0);
+		else if (!ret && get_timer(start) > BLK_REQ_TIMEOUT_MS)
+			ret = -ETIMEDOUT;
+		if (ret < 0) {
+			blk_cancel(dev, req);
+			return ret;
+		}
+	}
+
+	return req->result;
+}
+
+int blk_cancel(struct udevice *dev, struct blk_req *req)
+{
+	const struct blk_ops *ops = blk_get_ops(dev);
+	int ret;
+
+	if (req->complete)
+		return 0;
+	if (!ops->cancel)
+		return -ENOSYS;
+	ret = ops->cancel(dev, req);
+	if (ret) {
+		log_debug("cannot cancel request (err=%d)\n", ret);
+		return ret;
+	}
+	req->result = -ECANCELED;
+	req->complete = true;
+
+	return 0;
+}
+
+long blk_read_queued(struct udevice *dev, lbaint_t start, lbaint_t blkcnt,
+		     void *buffer)
+{
+	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	struct blk_req reqs[CONFIG_BLK_QUEUE_DEPTH];
+	bool busy[CONFIG_BLK_QUEUE_DEPTH] = { };
+	lbaint_t chunk, next = 0, good = blkcnt;
+	int i, ret, inflight = 0;
+	ulong progress;
+	long err = 0;
+
+	chunk = max(BLK_QUEUE_CHUNK_SIZE / desc->blksz, 1UL);
+	progress = get_timer(0);
+	while (inflight || next < good) {
+		/* keep the device queue full */
+		for (i = 0; i < ARRAY_SIZE(reqs) && next < good; i++) {
+			struct blk_req *req = &reqs[i];
+
+			if (busy[i])
+				continue;
+			req->op = BLK_REQ_READ;
+			req->start = start + next;
+			req->blkcnt = min(chunk, blkcnt - next);
+			req->buffer = buffer + next * desc->blksz;
+			ret = blk_submit(dev, req);
+			if (ret == -EBUSY)
+				break;
+			if (ret) {
+				err = ret;
+				good = next;
+				break;
+			}
+			busy[i] = true;
+			inflight++;
+			next += req->blkcnt;
+		}
+
+		if (!inflight && next < good) {
+			long n;
+
+			/*
+			 * The device is busy with requests from elsewhere, so
+			 * polling would never finish any of ours. Read the
+			 * rest directly instead.
+			 */
+			log_debug("device busy, reading synchronously\n");
+			n = blk_get_ops(dev)->read(dev, start + next,
+						   good - next,
+						   buffer + next * desc->blksz);
+			if (n < 0) {
+				err = n;
+				n = 0;
+			}
+			good = next + min_t(lbaint_t, n, good - next);
+			break;
+		}
+
+		ret = blk_poll(dev);
+		if (ret < 0) {
+			log_debug("poll failed (err=%d)\n", ret);
+			err = ret;
+			break;
+		}
+
+		/* retire finished requests, noting the first failure */
+		for (i = 0; i < ARRAY_SIZE(reqs); i++) {
+			struct blk_req *req = &reqs[i];
+
+			if (!busy[i] || !req->complete)
+				continue;
+			busy[i] = false;
+			inflight--;
+			progress = get_timer(0);
+			if (req->result != req->blkcnt) {
+				if (req->result < 0 && !err)
+					err = req->result;
+				good = min_t(lbaint_t, good,
+					     req->start - start +
+					     max(req->result, 0L));
+			}
+		}
+
+		if (get_timer(progress) > BLK_REQ_TIMEOUT_MS) {
+			log_debug("timeout with %d requests in flight\n",
+				  inflight);
+			err = -ETIMEDOUT;
+			break;
+		}
+	}
+
+	if (inflight) {
+		/* the requests are on our stack, so the device must drop them */
+		for (i = 0; i < ARRAY_SIZE(reqs); i++) {
+			if (busy[i] && blk_cancel(dev, &reqs[i]))
+				log_err("request %d still queued\n", i);
+		}
+
+		return err;
+	}
+
+	return good ? good : err;
+}
+
 ulong blk_dread(struct blk_desc *desc, lbaint_t start, lbaint_t blkcnt,
 		void *buffer)
 {
@@ -508,6 +732,11 @@ ulong blk_derase(struct blk_desc *desc, lbaint_t start, lbaint_t blkcnt)
 	return blk_erase(desc->bdev, start, blkcnt);
 }
 
+long blk_dwrite_zeroes(struct blk_desc *desc, lbaint_t start, lbaint_t blkcnt)
+{
+	return blk_write_zeroes(desc->bdev, start, blkcnt);
+}
+
 int blk_get_from_parent(struct udevice *parent, struct udevice **devp)
 {
 	struct udevice *dev;
@@ -8,32 +8,87 @@
 #include <blk.h>
 #include <log.h>
 #include <malloc.h>
+#include <memalign.h>
 #include <part.h>
 #include <asm/global_data.h>
+#include <linux/build_bug.h>
 #include <linux/ctype.h>
 #include <linux/list.h>
+#include <linux/log2.h>
 
 #ifdef CONFIG_NEEDS_MANUAL_RELOC
 DECLARE_GLOBAL_DATA_PTR;
 #endif
 
+/* Number of back-to-back sequential reads before read-ahead kicks in */
+#define BLKCACHE_SEQ_THRESHOLD	2
+
+/**
+ * struct block_cache_node - a cached window of blocks
+ *
+ * The blocks of each device are divided into aligned windows of
+ * max_blocks_per_entry blocks. A node caches a contiguous run of blocks
+ * within one window, so a read which spans several windows is served from
+ * several nodes.
+ *
+ * @lh:		Entry in the device's LRU list, most recently used first
+ * @hn:		Entry in the device's hash table
+ * @window:	Window number (block number >> block_shift)
+ * @first:	First valid block, relative to the start of the window
+ * @last:	One past the last valid block, relative to the window
+ * @cache:	Data for the whole window
+ */
 struct block_cache_node {
+	struct list_head lh;
+	struct hlist_node hn;
+	lbaint_t window;
+	unsigned int first;
+	unsigned int last;
+	char *cache;
+};
+
+/**
+ * struct block_cache_dev - cache state for one block device
+ *
+ * @lh:		Entry in block_cache
+ * @iftype:	uclass_id_x for type of device
+ * @devnum:	Device index of particular type
+ * @blksz:	Size in bytes of each block
+ * @lru:	Cached nodes, most recently used first
+ * @hash:	Hash buckets of cached nodes, indexed by window number
+ * @hash_mask:	Number of hash buckets - 1
+ * @entries:	Number of cached nodes
+ * @next:	Block following the most recent read, to detect sequential access
+ * @seq:	Number of sequential reads seen in a row
+ * @ra_blocks:	Current read-ahead size, which grows while access is sequential
+ * @ra_buf:	Buffer for read-ahead, max_readahead blocks
+ */
+struct block_cache_dev {
 	struct list_head lh;
 	int iftype;
 	int devnum;
-	lbaint_t start;
-	lbaint_t blkcnt;
 	unsigned long blksz;
-	char *cache;
+	struct list_head lru;
+	struct hlist_head *hash;
+	unsigned int hash_mask;
+	unsigned int entries;
+	lbaint_t next;
+	unsigned int seq;
+	lbaint_t ra_blocks;
+	char *ra_buf;
 };
 
 static LIST_HEAD(block_cache);
 
 static struct block_cache_stats _stats = {
-	.max_blocks_per_entry = 8,
-	.max_entries = 32
+	.max_blocks_per_entry = CONFIG_BLOCK_CACHE_BLOCKS,
+	.max_entries = CONFIG_BLOCK_CACHE_ENTRIES,
+	.max_readahead = CONFIG_BLOCK_CACHE_READAHEAD,
 };
 
+/* log2 of max_blocks_per_entry */
+static unsigned int block_shift = ilog2(CONFIG_BLOCK_CACHE_BLOCKS);
+
 #ifdef CONFIG_NEEDS_MANUAL_RELOC
 int blkcache_init(void)
 {
@@ -46,140 +101,361 @@ int blkcache_init(void)
 }
 #endif
 
-static struct block_cache_node *cache_find(int iftype, int devnum,
-					   lbaint_t start, lbaint_t blkcnt,
-					   unsigned long blksz)
+/* Largest read which is placed in the cache; bigger reads bypass it */
+static lbaint_t cache_max_extent(void)
+{
+	return max(_stats.max_blocks_per_entry, _stats.max_readahead);
+}
+
+static void cache_dev_flush(struct block_cache_dev *cdev)
+{
+	struct block_cache_node *node, *n;
+
+	list_for_each_entry_safe(node, n, &cdev->lru, lh) {
+		list_del(&node->lh);
+		free(node->cache);
+		free(node);
+	}
+	memset(cdev->hash, '\0', (cdev->hash_mask + 1) * sizeof(*cdev->hash));
+	_stats.entries -= cdev->entries;
+	cdev->entries = 0;
+}
+
+static void cache_dev_free(struct block_cache_dev *cdev)
+{
+	cache_dev_flush(cdev);
+	list_del(&cdev->lh);
+	free(cdev->ra_buf);
+	free(cdev->hash);
+	free(cdev);
+}
+
+static struct block_cache_dev *cache_dev_find(int iftype, int devnum)
+{
+	struct block_cache_dev *cdev;
+
+	list_for_each_entry(cdev, &block_cache, lh)
+		if (cdev->iftype == iftype && cdev->devnum == devnum) {
+			if (block_cache.next != &cdev->lh)
+				list_move(&cdev->lh, &block_cache);
+			return cdev;
+		}
+
+	return NULL;
+}
+
+static struct block_cache_dev *cache_dev_get(int iftype, int devnum,
+					     unsigned long blksz)
+{
+	struct block_cache_dev *cdev;
+	unsigned int buckets;
+
+	cdev = cache_dev_find(iftype, devnum);
+	if (cdev) {
+		/* the device was reconfigured without an invalidate */
+		if (cdev->blksz != blksz) {
+			cache_dev_flush(cdev);
+			free(cdev->ra_buf);
+			cdev->ra_buf = NULL;
+			cdev->blksz = blksz;
+		}
+		return cdev;
+	}
+
+	cdev = calloc(1, sizeof(*cdev));
+	if (!cdev)
+		return NULL;
+	buckets = __roundup_pow_of_two(max(_stats.max_entries, 1U));
+	cdev->hash = calloc(buckets, sizeof(*cdev->hash));
+	if (!cdev->hash) {
+		free(cdev);
+		return NULL;
+	}
+	cdev->hash_mask = buckets - 1;
+	cdev->iftype = iftype;
+	cdev->devnum = devnum;
+	cdev->blksz = blksz;
+	INIT_LIST_HEAD(&cdev->lru);
+	list_add(&cdev->lh, &block_cache);
+
+	return cdev;
+}
+
+static struct hlist_head *cache_bucket(struct block_cache_dev *cdev,
+				       lbaint_t window)
+{
+	return &cdev->hash[window & cdev->hash_mask];
+}
+
+static struct block_cache_node *cache_find(struct block_cache_dev *cdev,
+					   lbaint_t window)
 {
 	struct block_cache_node *node;
+	struct hlist_node *pos;
 
-	list_for_each_entry(node, &block_cache, lh)
-		if ((node->iftype == iftype) &&
-		    (node->devnum == devnum) &&
-		    (node->blksz == blksz) &&
-		    (node->start <= start) &&
-		    (node->start + node->blkcnt >= start + blkcnt)) {
-			if (block_cache.next != &node->lh) {
-				/* maintain MRU ordering */
-				list_del(&node->lh);
-				list_add(&node->lh, &block_cache);
-			}
+	hlist_for_each_entry(node, pos, cache_bucket(cdev, window), hn)
+		if (node->window == window)
 			return node;
+
+	return NULL;
+}
+
+static struct block_cache_node *cache_alloc(struct block_cache_dev *cdev,
+					    lbaint_t window)
+{
+	struct block_cache_node *node;
+
+	if (cdev->entries >= _stats.max_entries) {
+		/* recycle the LRU node of this device */
+		node = list_last_entry(&cdev->lru, struct block_cache_node, lh);
+		debug("drop: window " LBAFU "\n", node->window);
+		hlist_del(&node->hn);
+	} else {
+		node = malloc(sizeof(*node));
+		if (!node)
+			return NULL;
+		node->cache = malloc(cdev->blksz << block_shift);
+		if (!node->cache) {
+			free(node);
+			return NULL;
 		}
-	return 0;
+		list_add(&node->lh, &cdev->lru);
+		cdev->entries++;
+		_stats.entries++;
+	}
+	node->window = window;
+	hlist_add_head(&node->hn, cache_bucket(cdev, window));
+
+	return node;
+}
+
+/*
+ * Track the position of the last read so that sequential access can be
+ * spotted. Read-ahead restarts from its minimum size after a seek.
+ */
+static void cache_note_read(struct block_cache_dev *cdev, lbaint_t start,
+			    lbaint_t blkcnt)
+{
+	if (start == cdev->next) {
+		cdev->seq++;
+	} else {
+		cdev->seq = 0;
+		cdev->ra_blocks = 0;
+	}
+	cdev->next = start + blkcnt;
 }
 
 int blkcache_read(int iftype, int devnum,
 		  lbaint_t start, lbaint_t blkcnt,
 		  unsigned long blksz, void *buffer)
 {
-	struct block_cache_node *node = cache_find(iftype, devnum, start,
-						   blkcnt, blksz);
-	if (node) {
-		const char *src = node->cache + (start - node->start) * blksz;
-		memcpy(buffer, src, blksz * blkcnt);
-		debug("hit: start " LBAF ", count " LBAFU "\n",
-		      start, blkcnt);
-		++_stats.hits;
-		return 1;
+	const lbaint_t mask = _stats.max_blocks_per_entry - 1;
+	struct block_cache_dev *cdev;
+	struct block_cache_node *node;
+	lbaint_t blk, end = start + blkcnt;
+	char *dst = buffer;
+	unsigned int off, n;
+
+	cdev = cache_dev_find(iftype, devnum);
+	if (!cdev || cdev->blksz != blksz || !cdev->entries ||
+	    blkcnt > cache_max_extent())
+		goto miss;
+
+	/* the whole range must be present before anything is copied */
+	for (blk = start; blk < end; blk += n) {
+		off = blk & mask;
+		n = min(end - blk, (lbaint_t)_stats.max_blocks_per_entry - off);
+		node = cache_find(cdev, blk >> block_shift);
+		if (!node || off < node->first || off + n > node->last)
+			goto miss;
 	}
 
+	for (blk = start; blk < end; blk += n) {
+		off = blk & mask;
+		n = min(end - blk, (lbaint_t)_stats.max_blocks_per_entry - off);
+		node = cache_find(cdev, blk >> block_shift);
+		memcpy(dst, node->cache + off * blksz, n * blksz);
+		dst += n * blksz;
+		if (cdev->lru.next != &node->lh)
+			list_move(&node->lh, &cdev->lru);
+	}
+	cache_note_read(cdev, start, blkcnt);
+
+	debug("hit: start " LBAF ", count " LBAFU "\n",
+	      start, blkcnt);
+	++_stats.hits;
+	return 1;
+
+miss:
 	debug("miss: start " LBAF ", count " LBAFU "\n",
 	      start, blkcnt);
 	++_stats.misses;
 	return 0;
 }
 
+void *blkcache_readahead(int iftype, int devnum,
+			 lbaint_t start, lbaint_t blkcnt,
+			 unsigned long blksz, lbaint_t *countp)
+{
+	struct block_cache_dev *cdev;
+	lbaint_t count;
+
+	if (!_stats.max_readahead || !_stats.max_entries)
+		return NULL;
+
+	cdev = cache_dev_get(iftype, devnum, blksz);
+	if (!cdev)
+		return NULL;
+	cache_note_read(cdev, start, blkcnt);
+	if (cdev->seq < BLKCACHE_SEQ_THRESHOLD ||
+	    blkcnt >= _stats.max_readahead)
+		return NULL;
+
+	/* double the read-ahead each time it is used, up to the limit */
+	if (cdev->ra_blocks)
+		cdev->ra_blocks *= 2;
+	else
+		cdev->ra_blocks = max(blkcnt * 4,
+				      (lbaint_t)_stats.max_blocks_per_entry);
+	cdev->ra_blocks = min(cdev->ra_blocks,
+			      (lbaint_t)_stats.max_readahead);
+	count = max(cdev->ra_blocks, blkcnt);
+	if (count == blkcnt)
+		return NULL;
+
+	if (!cdev->ra_buf) {
+		cdev->ra_buf = malloc_cache_aligned(_stats.max_readahead *
+						    blksz);
+		if (!cdev->ra_buf)
+			return NULL;
+	}
+
+	debug("readahead: start " LBAF ", count " LBAFU "\n",
+	      start, count);
+	++_stats.readaheads;
+	_stats.readahead_blocks += count - blkcnt;
+	*countp = count;
+
+	return cdev->ra_buf;
+}
+
 void blkcache_fill(int iftype, int devnum,
 		   lbaint_t start, lbaint_t blkcnt,
 		   unsigned long blksz, void const *buffer)
 {
-	lbaint_t bytes;
+	const lbaint_t mask = _stats.max_blocks_per_entry - 1;
+	struct block_cache_dev *cdev;
 	struct block_cache_node *node;
+	lbaint_t blk, end = start + blkcnt;
+	const char *src = buffer;
+	unsigned int off, n;
 
 	/* don't cache big stuff */
-	if (blkcnt > _stats.max_blocks_per_entry)
+	if (blkcnt > cache_max_extent())
 		return;
 
 	if (_stats.max_entries == 0)
 		return;
 
-	bytes = blksz * blkcnt;
-	if (_stats.max_entries <= _stats.entries) {
-		/* pop LRU */
-		node = (struct block_cache_node *)block_cache.prev;
-		list_del(&node->lh);
-		_stats.entries--;
-		debug("drop: start " LBAF ", count " LBAFU "\n",
-		      node->start, node->blkcnt);
-		if (node->blkcnt * node->blksz < bytes) {
-			free(node->cache);
-			node->cache = 0;
-		}
-	} else {
-		node = malloc(sizeof(*node));
-		if (!node)
-			return;
-		node->cache = 0;
-	}
-
-	if (!node->cache) {
-		node->cache = malloc(bytes);
-		if (!node->cache) {
-			free(node);
-			return;
-		}
-	}
+	cdev = cache_dev_get(iftype, devnum, blksz);
+	if (!cdev)
+		return;
 
 	debug("fill: start " LBAF ", count " LBAFU "\n",
 	      start, blkcnt);
 
-	node->iftype = iftype;
-	node->devnum = devnum;
-	node->start = start;
-	node->blkcnt = blkcnt;
-	node->blksz = blksz;
-	memcpy(node->cache, buffer, bytes);
-	list_add(&node->lh, &block_cache);
-	_stats.entries++;
+	for (blk = start; blk < end; blk += n, src += n * blksz) {
+		off = blk & mask;
+		n = min(end - blk, (lbaint_t)_stats.max_blocks_per_entry - off);
+		node = cache_find(cdev, blk >> block_shift);
+		if (node && off <= node->last && off + n >= node->first) {
+			/* extend the valid run, which stays contiguous */
+			node->first = min(node->first, off);
+			node->last = max(node->last, off + n);
+		} else {
+			if (!node) {
+				node = cache_alloc(cdev, blk >> block_shift);
+				if (!node)
+					return;
+			}
+			node->first = off;
+			node->last = off + n;
+		}
+		memcpy(node->cache + off * blksz, src, n * blksz);
+		if (cdev->lru.next != &node->lh)
+			list_move(&node->lh, &cdev->lru);
+	}
 }
 
 void blkcache_invalidate(int iftype, int devnum)
 {
-	struct list_head *entry, *n;
-	struct block_cache_node *node;
+	struct block_cache_dev *cdev;
 
-	list_for_each_safe(entry, n, &block_cache) {
-		node = (struct block_cache_node *)entry;
-		if ((node->iftype == iftype) &&
-		    (node->devnum == devnum)) {
-			list_del(entry);
-			free(node->cache);
-			free(node);
-			--_stats.entries;
-		}
-	}
+	cdev = cache_dev_find(iftype, devnum);
+	if (cdev)
+		cache_dev_free(cdev);
+}
+
+static void blkcache_flush_all(void)
+{
+	struct block_cache_dev *cdev, *n;
+
+	list_for_each_entry_safe(cdev, n, &block_cache, lh)
+		cache_dev_free(cdev);
+}
+
+/* Read-ahead must leave room in the cache for what was already there */
+static unsigned int blkcache_clamp_readahead(unsigned int blocks)
+{
+	return min(blocks,
+		   _stats.max_blocks_per_entry * _stats.max_entries / 2);
 }
 
 void blkcache_configure(unsigned blocks, unsigned entries)
 {
-	struct block_cache_node *node;
+	unsigned int readahead;
+
+	/* block_shift starts out as the log2 of this */
+	BUILD_BUG_ON_NOT_POWER_OF_2(CONFIG_BLOCK_CACHE_BLOCKS);
+
+	/* windows are addressed by shifting, so round to a power of two */
+	if (blocks)
+		blocks = __rounddown_pow_of_two(blocks);
+	else
+		entries = 0;
+
+	/* read-ahead goes back to its default, like the other settings */
+	readahead = min_t(unsigned int, CONFIG_BLOCK_CACHE_READAHEAD,
+			  blocks * entries / 2);
 	if ((blocks != _stats.max_blocks_per_entry) ||
-	    (entries != _stats.max_entries)) {
+	    (entries != _stats.max_entries) ||
+	    (readahead > _stats.max_readahead)) {
 		/* invalidate cache */
-		while (!list_empty(&block_cache)) {
-			node = (struct block_cache_node *)block_cache.next;
-			list_del(&node->lh);
-			free(node->cache);
-			free(node);
-		}
+		blkcache_flush_all();
 		_stats.entries = 0;
 	}
 
 	_stats.max_blocks_per_entry = blocks;
 	_stats.max_entries = entries;
+	_stats.max_readahead = readahead;
+	if (blocks)
+		block_shift = ilog2(blocks);
 
 	_stats.hits = 0;
 	_stats.misses = 0;
+	_stats.readaheads = 0;
+	_stats.readahead_blocks = 0;
+}
+
+void blkcache_configure_readahead(unsigned blocks)
+{
+	blocks = blkcache_clamp_readahead(blocks);
+	if (blocks > _stats.max_readahead) {
+		/* read-ahead buffers are sized for the old limit */
+		blkcache_flush_all();
+		_stats.entries = 0;
+	}
+	_stats.max_readahead = blocks;
 }
 
 void blkcache_stats(struct block_cache_stats *stats)
@@ -187,4 +463,6 @@ void blkcache_stats(struct block_cache_stats *stats)
 	memcpy(stats, &_stats, sizeof(*stats));
 	_stats.hits = 0;
 	_stats.misses = 0;
+	_stats.readaheads = 0;
+	_stats.readahead_blocks = 0;
 }
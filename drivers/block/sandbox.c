@@ -7,6 +7,7 @@
 #include <blk.h>
 #include <dm.h>
 #include <fdtdec.h>
+#include <log.h>
 #include <part.h>
 #include <os.h>
 #include <malloc.h>
@@ -89,6 +90,61 @@ static unsigned long host_block_write(struct blk_desc *block_dev,
 }
 
 #ifdef CONFIG_BLK
+/*
+ * Queued requests are held until the next poll, so that callers see several
+ * of them in flight as they would with real hardware
+ */
+static int host_block_submit(struct udevice *dev, struct blk_req *req)
+{
+	struct host_block_dev *host_dev = dev_get_plat(dev);
+
+	if (host_dev->queued == SANDBOX_HOST_QUEUE_DEPTH)
+		return -EBUSY;
+	host_dev->queue[host_dev->queued++] = req;
+
+	return 0;
+}
+
+static int host_block_poll(struct udevice *dev)
+{
+	struct host_block_dev *host_dev = dev_get_plat(dev);
+	int i, count = host_dev->queued;
+
+	for (i = 0; i < count; i++) {
+		struct blk_req *req = host_dev->queue[i];
+
+		if (req->op == BLK_REQ_WRITE)
+			req->result = host_block_write(dev, req->start,
+						       req->blkcnt,
+						       req->buffer);
+		else
+			req->result = host_block_read(dev, req->start,
+						      req->blkcnt,
+						      req->buffer);
+		req->complete = true;
+	}
+	host_dev->queued = 0;
+
+	return count;
+}
+
+static int host_block_cancel(struct udevice *dev, struct blk_req *req)
+{
+	struct host_block_dev *host_dev = dev_get_plat(dev);
+	int i;
+
+	for (i = 0; i < host_dev->queued; i++) {
+		if (host_dev->queue[i] == req) {
+			host_dev->queued--;
+			memmove(&host_dev->queue[i], &host_dev->queue[i + 1],
+				(host_dev->queued - i) * sizeof(req));
+			return 0;
+		}
+	}
+
+	return -ENOENT;
+}
+
 int host_dev_bind(int devnum, char *filename, bool removable)
 {
 	struct host_block_dev *host_dev;
@@ -243,6 +299,10 @@ int sandbox_host_unbind(struct udevice *dev)
 
 	/* Data validity is checked in host_dev_bind() */
 	host_dev = dev_get_plat(dev);
+	if (host_dev->queued) {
+		log_err("%d requests still queued\n", host_dev->queued);
+		return -EBUSY;
+	}
 	os_close(host_dev->fd);
 
 	return 0;
@@ -251,6 +311,9 @@ int sandbox_host_unbind(struct udevice *dev)
 static const struct blk_ops sandbox_host_blk_ops = {
 	.read	= host_block_read,
 	.write	= host_block_write,
+	.submit	= host_block_submit,
+	.poll	= host_block_poll,
+	.cancel	= host_block_cancel,
 };
 
 U_BOOT_DRIVER(sandbox_host_blk) = {
@@ -0,0 +1,359 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Index of devices and phandles in the control devicetree
+ */
+
+#define LOG_CATEGORY	LOGC_DM
+
+#include <common.h>
+#include <dm.h>
+#include <log.h>
+#include <malloc.h>
+#include <asm/global_data.h>
+#include <dm/node_index.h>
+#include <dm/of_access.h>
+#include <linux/libfdt.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+/* Initial number of device hash buckets; the table doubles as it fills */
+#define DEV_HASH_BITS		6
+
+/**
+ * struct phandle_entry - entry in the phandle table
+ *
+ * @phandle:	Phandle of the node, 0 if the entry is empty
+ * @node:	Node with that phandle
+ */
+struct phandle_entry {
+	uint phandle;
+	ofnode node;
+};
+
+/**
+ * struct dm_node_index - index of the control devicetree
+ *
+ * @devs:	Hash buckets of devices by node, chained through
+ *		udevice->node_next in the order the devices were bound
+ * @dev_bits:	log2 of the number of buckets in @devs
+ * @dev_count:	Number of devices in @devs
+ * @phandles:	Open-addressed hash table of phandles, or NULL if not built
+ * @ph_bits:	log2 of the number of entries in @phandles
+ * @ph_blob:	Flat tree that @phandles was built from
+ * @ph_root:	Live tree that @phandles was built from
+ */
+struct dm_node_index {
+	struct udevice **devs;
+	uint dev_bits;
+	uint dev_count;
+	struct phandle_entry *phandles;
+	uint ph_bits;
+	const void *ph_blob;
+	struct device_node *ph_root;
+};
+
+static uint node_index_hash(ulong key, uint bits)
+{
+	u32 val = key;
+
+	/* Live-tree nodes are pointers, so fold in the upper bits too */
+	if (sizeof(key) > sizeof(u32))
+		val ^= (u64)key >> 32;
+
+	return (val * 0x61c88647) >> (32 - bits);
+}
+
+static uint dev_hash(ofnode node, uint bits)
+{
+	return node_index_hash(node.of_offset, bits);
+}
+
+static void dev_hash_insert(struct udevice **devs, uint bits,
+			    struct udevice *dev)
+{
+	struct udevice **linkp = &devs[dev_hash(dev_ofnode(dev), bits)];
+
+	/* Keep bind order so that lookups match a search of the uclass */
+	while (*linkp)
+		linkp = &(*linkp)->node_next;
+	dev->node_next = NULL;
+	*linkp = dev;
+}
+
+static int dev_hash_resize(struct dm_node_index *idx, uint bits)
+{
+	struct udevice **devs;
+	uint i;
+
+	devs = calloc(1U << bits, sizeof(*devs));
+	if (!devs)
+		return -ENOMEM;
+	for (i = 0; i < 1U << idx->dev_bits; i++) {
+		struct udevice *dev, *next;
+
+		for (dev = idx->devs[i]; dev; dev = next) {
+			next = dev->node_next;
+			dev_hash_insert(devs, bits, dev);
+		}
+	}
+	free(idx->devs);
+	idx->devs = devs;
+	idx->dev_bits = bits;
+
+	return 0;
+}
+
+static int phandle_build(struct dm_node_index *idx);
+
+int dm_node_index_init(void)
+{
+	struct dm_node_index *idx = gd->dm_node_index;
+
+	/* Pre-relocation malloc() space is too precious */
+	if (!(gd->flags & GD_FLG_RELOC))
+		return 0;
+
+	/* Any devices in an old index have been thrown away */
+	if (idx) {
+		free(idx->devs);
+		free(idx->phandles);
+	} else {
+		idx = malloc(sizeof(*idx));
+		if (!idx)
+			return -ENOMEM;
+	}
+	memset(idx, '\0', sizeof(*idx));
+	idx->dev_bits = DEV_HASH_BITS;
+	idx->devs = calloc(1U << idx->dev_bits, sizeof(*idx->devs));
+	if (!idx->devs) {
+		free(idx);
+		gd->dm_node_index = NULL;
+		return -ENOMEM;
+	}
+	gd->dm_node_index = idx;
+
+	/*
+	 * Nearly every boot looks up phandles, so build the table now rather
+	 * than on first use. If this fails it is tried again then.
+	 */
+	if (of_live_active() || gd->fdt_blob)
+		phandle_build(idx);
+
+	return 0;
+}
+
+void dm_node_index_uninit(void)
+{
+	struct dm_node_index *idx = gd->dm_node_index;
+
+	if (!idx)
+		return;
+	free(idx->devs);
+	free(idx->phandles);
+	free(idx);
+	gd->dm_node_index = NULL;
+}
+
+void dm_node_index_add_dev(struct udevice *dev)
+{
+	struct dm_node_index *idx = gd->dm_node_index;
+
+	if (!idx || !ofnode_valid(dev_ofnode(dev)))
+		return;
+
+	/* If the table cannot grow, the chains just get longer */
+	if (idx->dev_count >= 1U << idx->dev_bits)
+		dev_hash_resize(idx, idx->dev_bits + 1);
+	dev_hash_insert(idx->devs, idx->dev_bits, dev);
+	idx->dev_count++;
+}
+
+static bool dev_chain_remove(struct dm_node_index *idx,
+			     struct udevice **linkp, struct udevice *dev)
+{
+	for (; *linkp; linkp = &(*linkp)->node_next) {
+		if (*linkp == dev) {
+			*linkp = dev->node_next;
+			dev->node_next = NULL;
+			idx->dev_count--;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void dm_node_index_remove_dev(struct udevice *dev)
+{
+	struct dm_node_index *idx = gd->dm_node_index;
+	struct udevice **linkp;
+	uint i;
+
+	if (!idx || !ofnode_valid(dev_ofnode(dev)))
+		return;
+
+	linkp = &idx->devs[dev_hash(dev_ofnode(dev), idx->dev_bits)];
+	if (!dev_chain_remove(idx, linkp, dev)) {
+		/* The node was changed after binding, so look everywhere */
+		for (i = 0; i < 1U << idx->dev_bits; i++) {
+			if (dev_chain_remove(idx, &idx->devs[i], dev))
+				break;
+		}
+	}
+
+	/* Give back the space once most devices have gone */
+	if (idx->dev_bits > DEV_HASH_BITS &&
+	    idx->dev_count < 1U << (idx->dev_bits - 2))
+		dev_hash_resize(idx, idx->dev_bits - 1);
+}
+
+void dm_node_index_move_dev(struct udevice *dev)
+{
+	dm_node_index_remove_dev(dev);
+	dm_node_index_add_dev(dev);
+}
+
+int dm_node_index_find_dev(enum uclass_id id, ofnode node,
+			   struct udevice **devp)
+{
+	struct dm_node_index *idx = gd->dm_node_index;
+	struct udevice *dev;
+
+	if (!idx)
+		return -ENOSYS;
+
+	dev = idx->devs[dev_hash(node, idx->dev_bits)];
+	for (; dev; dev = dev->node_next) {
+		if (ofnode_equal(dev_ofnode(dev), node) &&
+		    dev->uclass->uc_drv->id == id) {
+			*devp = dev;
+			return 0;
+		}
+	}
+
+	return -ENODEV;
+}
+
+static void phandle_insert(struct dm_node_index *idx, uint phandle,
+			   ofnode node)
+{
+	uint mask = (1U << idx->ph_bits) - 1;
+	uint i = node_index_hash(phandle, idx->ph_bits);
+
+	while (idx->phandles[i].phandle && idx->phandles[i].phandle != phandle)
+		i = (i + 1) & mask;
+	idx->phandles[i].phandle = phandle;
+	idx->phandles[i].node = node;
+}
+
+/**
+ * phandle_scan() - Go through all nodes with a phandle
+ *
+ * @idx:	Index to add the phandles to, or NULL to just count them
+ * Return: number of nodes with a phandle
+ */
+static uint phandle_scan(struct dm_node_index *idx)
+{
+	uint count = 0;
+
+	if (of_live_active()) {
+		struct device_node *np;
+
+		for_each_of_allnodes(np) {
+			if (!np->phandle)
+				continue;
+			if (idx)
+				phandle_insert(idx, np->phandle,
+					       np_to_ofnode(np));
+			count++;
+		}
+	} else {
+		const void *blob = gd->fdt_blob;
+		int offset;
+
+		for (offset = fdt_next_node(blob, -1, NULL); offset >= 0;
+		     offset = fdt_next_node(blob, offset, NULL)) {
+			uint phandle = fdt_get_phandle(blob, offset);
+
+			if (!phandle)
+				continue;
+			if (idx)
+				phandle_insert(idx, phandle,
+					       offset_to_ofnode(offset));
+			count++;
+		}
+	}
+
+	return count;
+}
+
+static int phandle_build(struct dm_node_index *idx)
+{
+	uint bits = 4;
+	uint count;
+
+	count = phandle_scan(NULL);
+	while (1U << bits < count * 2)
+		bits++;
+
+	free(idx->phandles);
+	idx->phandles = calloc(1U << bits, sizeof(*idx->phandles));
+	if (!idx->phandles)
+		return -ENOMEM;
+	idx->ph_bits = bits;
+	idx->ph_blob = gd->fdt_blob;
+	idx->ph_root = gd_of_root();
+	phandle_scan(idx);
+	log_debug("%u phandles, table size %u\n", count, 1U << bits);
+
+	return 0;
+}
+
+/* Check that @node still has @phandle, in case the tree has changed */
+static bool phandle_check(ofnode node, uint phandle)
+{
+	if (ofnode_is_np(node))
+		return ofnode_to_np(node)->phandle == phandle;
+
+	return fdt_get_phandle(gd->fdt_blob, ofnode_to_offset(node)) ==
+		phandle;
+}
+
+static ofnode phandle_lookup(struct dm_node_index *idx, uint phandle)
+{
+	uint mask = (1U << idx->ph_bits) - 1;
+	uint i = node_index_hash(phandle, idx->ph_bits);
+
+	for (; idx->phandles[i].phandle; i = (i + 1) & mask) {
+		if (idx->phandles[i].phandle == phandle)
+			return idx->phandles[i].node;
+	}
+
+	return ofnode_null();
+}
+
+int dm_node_index_find_phandle(uint phandle, ofnode *nodep)
+{
+	struct dm_node_index *idx = gd->dm_node_index;
+	ofnode node;
+
+	if (!idx || !phandle || phandle == (uint)-1)
+		return -ENOSYS;
+
+	if (!idx->phandles || idx->ph_blob != gd->fdt_blob ||
+	    idx->ph_root != gd_of_root()) {
+		if (phandle_build(idx))
+			return -ENOSYS;
+	}
+
+	node = phandle_lookup(idx, phandle);
+	if (!ofnode_valid(node) || !phandle_check(node, phandle)) {
+		/* The tree has changed, so try again with a fresh table */
+		if (phandle_build(idx))
+			return -ENOSYS;
+		node = phandle_lookup(idx, phandle);
+	}
+	*nodep = node;
+
+	return 0;
+}
@@ -26,6 +26,7 @@
 #include <linux/bug.h>
 #include <linux/libfdt.h>
 #include <dm/of_access.h>
+#include <dm/node_index.h>
 #include <linux/ctype.h>
 #include <linux/err.h>
 #include <linux/ioport.h>
@@ -449,10 +450,15 @@ struct device_node *of_find_node_by_phandle(struct device_node *root,
 					    phandle handle)
 {
 	struct device_node *np;
+	ofnode node;
 
 	if (!handle)
 		return NULL;
 
+	if ((!root || root == gd_of_root()) && of_live_active() &&
+	    !dm_node_index_find_phandle(handle, &node))
+		return (struct device_node *)ofnode_to_np(node);
+
 	for_each_of_allnodes_from(root, np)
 		if (np->phandle == handle)
 			break;
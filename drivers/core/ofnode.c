@@ -15,6 +15,7 @@
 #include <linux/libfdt.h>
 #include <dm/of_access.h>
 #include <dm/of_addr.h>
+#include <dm/node_index.h>
 #include <dm/ofnode.h>
 #include <linux/err.h>
 #include <linux/ioport.h>
@@ -585,7 +586,7 @@ ofnode ofnode_get_by_phandle(uint phandle)
 
 	if (of_live_active())
 		node = np_to_ofnode(of_find_node_by_phandle(NULL, phandle));
-	else
+	else if (dm_node_index_find_phandle(phandle, &node))
 		node.of_offset = fdt_node_offset_by_phandle(gd->fdt_blob,
 							    phandle);
 
@@ -17,6 +17,7 @@
 #include <dm/device.h>
 #include <dm/device-internal.h>
 #include <dm/lists.h>
+#include <dm/node_index.h>
 #include <dm/uclass.h>
 #include <dm/uclass-internal.h>
 #include <dm/util.h>
@@ -394,10 +395,21 @@ int uclass_find_device_by_ofnode(enum uclass_id id, ofnode node,
 	if (ret)
 		return ret;
 
+	ret = dm_node_index_find_dev(id, node, devp);
+	if (!ret)
+		goto done;
+
+	/*
+	 * A device's node may be set after it is bound, e.g. by
+	 * mtd_set_ofnode(), which the index does not see. So search anyway,
+	 * and index the device under its new node if it turns up.
+	 */
+	ret = 0;
 	uclass_foreach_dev(dev, uc) {
 		log(LOGC_DM, LOGL_DEBUG_CONTENT, "      - checking %s\n",
 		    dev->name);
 		if (ofnode_equal(dev_ofnode(dev), node)) {
+			dm_node_index_move_dev(dev);
 			*devp = dev;
 			goto done;
 		}
@@ -410,29 +422,41 @@ done:
 	return ret;
 }
 
-#if CONFIG_IS_ENABLED(OF_REAL)
-int uclass_find_device_by_phandle(enum uclass_id id, struct udevice *parent,
-				  const char *name, struct udevice **devp)
+#if CONFIG_IS_ENABLED(OF_CONTROL)
+/**
+ * uclass_find_device_by_phandle_id() - Find a device by its node's phandle
+ *
+ * This does not probe the device.
+ *
+ * @id: ID of uclass to look in
+ * @phandle_id: Phandle of the device's node
+ * @devp: Returns the device found
+ * Return: 0 if found, -ENODEV if not, other -ve on error
+ */
+static int uclass_find_device_by_phandle_id(enum uclass_id id, uint phandle_id,
+					    struct udevice **devp)
 {
 	struct udevice *dev;
 	struct uclass *uc;
-	int find_phandle;
+	ofnode node;
 	int ret;
 
-	*devp = NULL;
-	find_phandle = dev_read_u32_default(parent, name, -1);
-	if (find_phandle <= 0)
-		return -ENOENT;
 	ret = uclass_get(id, &uc);
 	if (ret)
 		return ret;
 
+	if (!dm_node_index_find_phandle(phandle_id, &node)) {
+		if (!ofnode_valid(node))
+			return -ENODEV;
+		return uclass_find_device_by_ofnode(id, node, devp);
+	}
+
 	uclass_foreach_dev(dev, uc) {
 		uint phandle;
 
 		phandle = dev_read_phandle(dev);
 
-		if (phandle == find_phandle) {
+		if (phandle == phandle_id) {
 			*devp = dev;
 			return 0;
 		}
@@ -442,6 +466,21 @@ int uclass_find_device_by_phandle(enum uclass_id id, struct udevice *parent,
 }
 #endif
 
+#if CONFIG_IS_ENABLED(OF_REAL)
+int uclass_find_device_by_phandle(enum uclass_id id, struct udevice *parent,
+				  const char *name, struct udevice **devp)
+{
+	int find_phandle;
+
+	*devp = NULL;
+	find_phandle = dev_read_u32_default(parent, name, -1);
+	if (find_phandle <= 0)
+		return -ENOENT;
+
+	return uclass_find_device_by_phandle_id(id, find_phandle, devp);
+}
+#endif
+
 int uclass_get_device_by_driver(enum uclass_id id,
 				const struct driver *find_drv,
 				struct udevice **devp)
@@ -540,26 +579,11 @@ int uclass_get_device_by_phandle_id(enum uclass_id id, uint phandle_id,
 				    struct udevice **devp)
 {
 	struct udevice *dev;
-	struct uclass *uc;
 	int ret;
 
 	*devp = NULL;
-	ret = uclass_get(id, &uc);
-	if (ret)
-		return ret;
-
-	uclass_foreach_dev(dev, uc) {
-		uint phandle;
-
-		phandle = dev_read_phandle(dev);
-
-		if (phandle == phandle_id) {
-			*devp = dev;
-			return uclass_get_device_tail(dev, ret, devp);
-		}
-	}
-
-	return -ENODEV;
+	ret = uclass_find_device_by_phandle_id(id, phandle_id, &dev);
+	return uclass_get_device_tail(dev, ret, devp);
 }
 
 int uclass_get_device_by_phandle(enum uclass_id id, struct udevice *parent,
@@ -694,6 +718,7 @@ int uclass_bind_device(struct udevice *dev)
 
 	uc = dev->uclass;
 	list_add_tail(&dev->uclass_node, &uc->dev_head);
+	dm_node_index_add_dev(dev);
 
 	if (dev->parent) {
 		struct uclass_driver *uc_drv = dev->parent->uclass->uc_drv;
@@ -708,6 +733,7 @@ int uclass_bind_device(struct udevice *dev)
 	return 0;
 err:
 	/* There is no need to undo the parent's post_bind call */
+	dm_node_index_remove_dev(dev);
 	list_del(&dev->uclass_node);
 
 	return ret;
@@ -731,6 +757,7 @@ int uclass_pre_unbind_device(struct udevice *dev)
 
 int uclass_unbind_device(struct udevice *dev)
 {
+	dm_node_index_remove_dev(dev);
 	list_del(&dev->uclass_node);
 
 	return 0;
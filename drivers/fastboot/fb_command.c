@@ -28,6 +28,38 @@ static u32 fastboot_bytes_received;
  */
 static u32 fastboot_bytes_expected;
 
+/**
+ * fastboot_buf_used - number of bytes of the current download in the buffer
+ *
+ * This is fastboot_bytes_received unless the download is being streamed.
+ */
+static u32 fastboot_buf_used;
+
+/**
+ * fastboot_data_error - response for a download which failed part way
+ *
+ * If this is set, the rest of the current download is discarded as it arrives
+ * and this is the response once it is all there.
+ */
+static char fastboot_data_error[FASTBOOT_RESPONSE_LEN];
+
+#if CONFIG_IS_ENABLED(FASTBOOT_CMD_OEM_STREAM)
+/**
+ * fastboot_stream_part - partition the next download is streamed to, if any
+ */
+static char fastboot_stream_part[PART_NAME_LEN];
+
+/**
+ * fastboot_streaming - the current download is being written as it arrives
+ */
+static bool fastboot_streaming;
+
+/**
+ * fastboot_streamed - partition the last download was written to, if any
+ */
+static char fastboot_streamed[PART_NAME_LEN];
+#endif
+
 static void okay(char *, char *);
 static void getvar(char *, char *);
 static void download(char *, char *);
@@ -47,6 +79,9 @@ static void oem_partconf(char *, char *);
 #if CONFIG_IS_ENABLED(FASTBOOT_CMD_OEM_BOOTBUS)
 static void oem_bootbus(char *, char *);
 #endif
+#if CONFIG_IS_ENABLED(FASTBOOT_CMD_OEM_STREAM)
+static void oem_stream(char *, char *);
+#endif
 
 #if CONFIG_IS_ENABLED(FASTBOOT_UUU_SUPPORT)
 static void run_ucmd(char *, char *);
@@ -121,6 +156,12 @@ static const struct {
 		.dispatch = oem_bootbus,
 	},
 #endif
+#if CONFIG_IS_ENABLED(FASTBOOT_CMD_OEM_STREAM)
+	[FASTBOOT_COMMAND_OEM_STREAM] = {
+		.command = "oem stream",
+		.dispatch = oem_stream,
+	},
+#endif
 #if CONFIG_IS_ENABLED(FASTBOOT_UUU_SUPPORT)
 	[FASTBOOT_COMMAND_UCMD] = {
 		.command = "UCmd",
@@ -192,6 +233,44 @@ static void getvar(char *cmd_parameter, char *response)
 	fastboot_getvar(cmd_parameter, response);
 }
 
+/**
+ * fastboot_data_abort() - Give up on the current download
+ *
+ * Any data still to come is refused. A download which was to be streamed uses
+ * up the partition given by "oem stream", as one which completes does.
+ */
+static void fastboot_data_abort(void)
+{
+	fastboot_bytes_expected = 0;
+	fastboot_bytes_received = 0;
+	fastboot_buf_used = 0;
+	fastboot_data_error[0] = '\0';
+#if CONFIG_IS_ENABLED(FASTBOOT_CMD_OEM_STREAM)
+	fastboot_streaming = false;
+	fastboot_stream_part[0] = '\0';
+#endif
+}
+
+/**
+ * fastboot_data_discard() - Drop the rest of the current download
+ *
+ * The host goes on sending the data it announced and only then reads a
+ * response, so the rest is counted but thrown away. The failure is reported
+ * by fastboot_data_complete().
+ *
+ * @response: Pointer to fastboot response buffer, holding the failure. This
+ *	is cleared.
+ */
+static void fastboot_data_discard(char *response)
+{
+	strlcpy(fastboot_data_error, response, sizeof(fastboot_data_error));
+	*response = '\0';
+	fastboot_buf_used = 0;
+#if CONFIG_IS_ENABLED(FASTBOOT_CMD_OEM_STREAM)
+	fastboot_streaming = false;
+#endif
+}
+
 /**
  * fastboot_download() - Start a download transfer from the client
  *
@@ -207,11 +286,28 @@ static void download(char *cmd_parameter, char *response)
 		return;
 	}
 	fastboot_bytes_received = 0;
+	fastboot_buf_used = 0;
+	fastboot_data_error[0] = '\0';
 	fastboot_bytes_expected = hextoul(cmd_parameter, &tmp);
 	if (fastboot_bytes_expected == 0) {
 		fastboot_fail("Expected nonzero image size", response);
 		return;
 	}
+#if CONFIG_IS_ENABLED(FASTBOOT_CMD_OEM_STREAM)
+	fastboot_streamed[0] = '\0';
+	fastboot_streaming = false;
+	if (fastboot_stream_part[0]) {
+		if (fastboot_mmc_stream_start(fastboot_stream_part, response)) {
+			fastboot_data_abort();
+			return;
+		}
+		fastboot_streaming = true;
+		printf("Starting download of %d bytes to '%s'\n",
+		       fastboot_bytes_expected, fastboot_stream_part);
+		fastboot_response("DATA", response, "%s", cmd_parameter);
+		return;
+	}
+#endif
 	/*
 	 * Nothing to download yet. Response is of the form:
 	 * [DATA|FAIL]$cmd_parameter
@@ -237,6 +333,49 @@ u32 fastboot_data_remaining(void)
 	return fastboot_bytes_expected - fastboot_bytes_received;
 }
 
+/**
+ * fastboot_data_next() - Get where the next downloaded data goes
+ *
+ * @usedp: Returns the number of bytes in the download buffer before that place
+ * @spacep: Returns the number of bytes of space in the buffer from that place
+ * Return: Place in the download buffer where the next data goes
+ */
+void *fastboot_data_next(u32 *usedp, u32 *spacep)
+{
+	*usedp = fastboot_buf_used;
+	*spacep = fastboot_buf_size - fastboot_buf_used;
+
+	return fastboot_buf_addr + fastboot_buf_used;
+}
+
+#if CONFIG_IS_ENABLED(FASTBOOT_CMD_OEM_STREAM)
+/**
+ * fastboot_stream_flush() - Write what has been downloaded so far
+ *
+ * @response: Pointer to fastboot response buffer, written on error
+ *
+ * Anything which cannot be written yet, such as part of a block, is moved to
+ * the start of the buffer, ahead of the data still to come. If the write fails
+ * the rest of the download is discarded, since the partition no longer holds a
+ * whole image.
+ */
+static void fastboot_stream_flush(char *response)
+{
+	bool last = fastboot_bytes_received == fastboot_bytes_expected;
+	int used;
+
+	used = fastboot_mmc_stream_write(fastboot_buf_addr, fastboot_buf_used,
+					 last, response);
+	if (used < 0) {
+		fastboot_data_discard(response);
+		return;
+	}
+	fastboot_buf_used -= used;
+	memmove(fastboot_buf_addr, fastboot_buf_addr + used,
+		fastboot_buf_used);
+}
+#endif
+
 /**
  * fastboot_data_download() - Copy image data to fastboot_buf_addr.
  *
@@ -244,9 +383,16 @@ u32 fastboot_data_remaining(void)
  * @fastboot_data_len: Length of received fastboot data
  * @response: Pointer to fastboot response buffer
  *
- * Copies image data from fastboot_data to fastboot_buf_addr. Writes to
- * response. fastboot_bytes_received is updated to indicate the number
- * of bytes that have been transferred.
+ * Copies image data from fastboot_data to fastboot_buf_addr, unless it was
+ * received there already. Writes to response. fastboot_bytes_received is
+ * updated to indicate the number of bytes that have been transferred.
+ *
+ * If the download is being streamed, what is in the buffer is written to the
+ * partition once the buffer is half full, and at the end of the download.
+ *
+ * If the data does not fit the download, it is refused. If it cannot be
+ * stored, the rest of the download is discarded and the failure is reported
+ * once it has all arrived.
  *
  * On completion sets image_size and ${filesize} to the total size of the
  * downloaded image.
@@ -263,11 +409,21 @@ void fastboot_data_download(const void *fastboot_data,
 	    fastboot_bytes_expected) {
 		fastboot_fail("Received invalid data length",
 			      response);
+		fastboot_data_abort();
 		return;
 	}
+	if (!fastboot_data_error[0] &&
+	    fastboot_buf_used + fastboot_data_len > fastboot_buf_size) {
+		fastboot_fail("Download buffer full", response);
+		fastboot_data_discard(response);
+	}
 	/* Download data to fastboot_buf_addr */
-	memcpy(fastboot_buf_addr + fastboot_bytes_received,
-	       fastboot_data, fastboot_data_len);
+	if (!fastboot_data_error[0]) {
+		if (fastboot_data != fastboot_buf_addr + fastboot_buf_used)
+			memmove(fastboot_buf_addr + fastboot_buf_used,
+				fastboot_data, fastboot_data_len);
+		fastboot_buf_used += fastboot_data_len;
+	}
 
 	pre_dot_num = fastboot_bytes_received / BYTES_PER_DOT;
 	fastboot_bytes_received += fastboot_data_len;
@@ -279,6 +435,13 @@ void fastboot_data_download(const void *fastboot_data,
 			putc('\n');
 	}
 	*response = '\0';
+
+#if CONFIG_IS_ENABLED(FASTBOOT_CMD_OEM_STREAM)
+	if (fastboot_streaming &&
+	    (fastboot_buf_used >= fastboot_buf_size / 2 ||
+	     fastboot_bytes_received == fastboot_bytes_expected))
+		fastboot_stream_flush(response);
+#endif
 }
 
 /**
@@ -287,9 +450,19 @@ void fastboot_data_download(const void *fastboot_data,
  * @response: Pointer to fastboot response buffer
  *
  * Set image_size and ${filesize} to the total size of the downloaded image.
+ * If the download failed part way, the failure is the response instead.
  */
 void fastboot_data_complete(char *response)
 {
+	if (fastboot_data_error[0]) {
+		strcpy(response, fastboot_data_error);
+		printf("\ndownload of %d bytes failed\n",
+		       fastboot_bytes_received);
+		image_size = 0;
+		fastboot_data_abort();
+		return;
+	}
+
 	/* Download complete. Respond with "OKAY" */
 	fastboot_okay(NULL, response);
 	printf("\ndownloading of %d bytes finished\n", fastboot_bytes_received);
@@ -297,6 +470,16 @@ void fastboot_data_complete(char *response)
 	env_set_hex("filesize", image_size);
 	fastboot_bytes_expected = 0;
 	fastboot_bytes_received = 0;
+	fastboot_buf_used = 0;
+#if CONFIG_IS_ENABLED(FASTBOOT_CMD_OEM_STREAM)
+	/* The image is on the partition, not in the buffer */
+	if (fastboot_streaming) {
+		image_size = 0;
+		strcpy(fastboot_streamed, fastboot_stream_part);
+	}
+	fastboot_streaming = false;
+	fastboot_stream_part[0] = '\0';
+#endif
 }
 
 #if CONFIG_IS_ENABLED(FASTBOOT_FLASH)
@@ -311,6 +494,24 @@ void fastboot_data_complete(char *response)
  */
 static void flash(char *cmd_parameter, char *response)
 {
+#if CONFIG_IS_ENABLED(FASTBOOT_CMD_OEM_STREAM)
+	/* Nothing has been written yet, so refuse before the download starts */
+	if (fastboot_stream_part[0] &&
+	    (!cmd_parameter || strcmp(cmd_parameter, fastboot_stream_part))) {
+		fastboot_stream_part[0] = '\0';
+		fastboot_fail("next download is for another partition",
+			      response);
+		return;
+	}
+	if (fastboot_streamed[0]) {
+		if (!cmd_parameter || strcmp(cmd_parameter, fastboot_streamed))
+			fastboot_fail("image was written to another partition",
+				      response);
+		else
+			fastboot_okay(NULL, response);
+		return;
+	}
+#endif
 #if CONFIG_IS_ENABLED(FASTBOOT_FLASH_MMC)
 	fastboot_mmc_flash_write(cmd_parameter, fastboot_buf_addr, image_size,
 				 response);
@@ -513,3 +714,31 @@ static void oem_bootbus(char *cmd_parameter, char *response)
 		fastboot_okay(NULL, response);
 }
 #endif
+
+#if CONFIG_IS_ENABLED(FASTBOOT_CMD_OEM_STREAM)
+/**
+ * oem_stream() - Write the next download to a partition as it arrives
+ *
+ * This applies to one download only, whether it completes or fails. A "flash"
+ * command for another partition before then cancels it.
+ *
+ * @cmd_parameter: Partition to write to, or NULL to cancel streaming
+ * @response: Pointer to fastboot response buffer
+ */
+static void oem_stream(char *cmd_parameter, char *response)
+{
+	if (!cmd_parameter || !*cmd_parameter) {
+		fastboot_stream_part[0] = '\0';
+		fastboot_okay(NULL, response);
+		return;
+	}
+	if (strlen(cmd_parameter) >= sizeof(fastboot_stream_part)) {
+		fastboot_fail("partition name too long", response);
+		return;
+	}
+	strcpy(fastboot_stream_part, cmd_parameter);
+	printf("The next download is written to '%s' as it arrives\n",
+	       fastboot_stream_part);
+	fastboot_okay(NULL, response);
+}
+#endif
@@ -13,9 +13,11 @@
 #include <image-sparse.h>
 #include <image.h>
 #include <log.h>
+#include <malloc.h>
 #include <part.h>
 #include <mmc.h>
 #include <div64.h>
+#include <asm/cache.h>
 #include <linux/compat.h>
 #include <android_image.h>
 
@@ -167,6 +169,17 @@ static lbaint_t fb_mmc_sparse_reserve(struct sparse_storage *info,
 	return blkcnt;
 }
 
+static lbaint_t fb_mmc_sparse_zero(struct sparse_storage *info,
+		lbaint_t blk, lbaint_t blkcnt)
+{
+	struct fb_mmc_sparse *sparse = info->priv;
+
+	if (fastboot_progress_callback)
+		fastboot_progress_callback("erasing");
+
+	return blk_dwrite_zeroes(sparse->dev_desc, blk, blkcnt);
+}
+
 static void write_raw_image(struct blk_desc *dev_desc,
 			    struct disk_partition *info, const char *part_name,
 			    void *buffer, u32 download_bytes, char *response)
@@ -616,6 +629,7 @@ void fastboot_mmc_flash_write(const char *cmd, void *download_buffer,
 		sparse.size = info.size;
 		sparse.write = fb_mmc_sparse_write;
 		sparse.reserve = fb_mmc_sparse_reserve;
+		sparse.zero = fb_mmc_sparse_zero;
 		sparse.mssg = fastboot_fail;
 
 		printf("Flashing sparse image at offset " LBAFU "\n",
@@ -632,6 +646,177 @@ void fastboot_mmc_flash_write(const char *cmd, void *download_buffer,
 	}
 }
 
+#if CONFIG_IS_ENABLED(FASTBOOT_CMD_OEM_STREAM)
+/**
+ * struct fb_mmc_stream - a download being written as it arrives
+ *
+ * @dev_desc: Device being written
+ * @info: Partition being written
+ * @sparse_priv: Private data for @sparse
+ * @sparse: Storage used for a sparse image
+ * @ss: State of a sparse image
+ * @started: true once the start of the image has been seen
+ * @is_sparse: true if the image is a sparse image, valid once @started
+ * @blk: Next block to write, for a raw image
+ */
+static struct fb_mmc_stream {
+	struct blk_desc *dev_desc;
+	struct disk_partition info;
+	struct fb_mmc_sparse sparse_priv;
+	struct sparse_storage sparse;
+	struct sparse_stream ss;
+	bool started;
+	bool is_sparse;
+	lbaint_t blk;
+} fb_stream;
+
+/* Targets which need the whole image, to check it or split it up */
+static bool fb_mmc_can_stream(const char *cmd)
+{
+#ifdef CONFIG_FASTBOOT_MMC_BOOT_SUPPORT
+	if (!strcmp(cmd, CONFIG_FASTBOOT_MMC_BOOT1_NAME) ||
+	    !strcmp(cmd, CONFIG_FASTBOOT_MMC_BOOT2_NAME))
+		return false;
+#endif
+#if CONFIG_IS_ENABLED(EFI_PARTITION)
+	if (!strcmp(cmd, CONFIG_FASTBOOT_GPT_NAME))
+		return false;
+#endif
+#if CONFIG_IS_ENABLED(DOS_PARTITION)
+	if (!strcmp(cmd, CONFIG_FASTBOOT_MBR_NAME))
+		return false;
+#endif
+#ifdef CONFIG_ANDROID_BOOT_IMAGE
+	if (!strncasecmp(cmd, "zimage", 6))
+		return false;
+#endif
+
+	return true;
+}
+
+int fastboot_mmc_stream_start(const char *cmd, char *response)
+{
+	struct fb_mmc_stream *fs = &fb_stream;
+
+	if (!fb_mmc_can_stream(cmd)) {
+		fastboot_fail("cannot stream to this partition", response);
+		return -EINVAL;
+	}
+
+	memset(fs, '\0', sizeof(*fs));
+#if CONFIG_IS_ENABLED(FASTBOOT_MMC_USER_SUPPORT)
+	if (!strcmp(cmd, CONFIG_FASTBOOT_MMC_USER_NAME)) {
+		fs->dev_desc = fastboot_mmc_get_dev(response);
+		if (!fs->dev_desc)
+			return -ENODEV;
+
+		strlcpy((char *)&fs->info.name, cmd, sizeof(fs->info.name));
+		fs->info.size = fs->dev_desc->lba;
+		fs->info.blksz = fs->dev_desc->blksz;
+	}
+#endif
+	if (!fs->info.name[0] &&
+	    fastboot_mmc_get_part_info(cmd, &fs->dev_desc, &fs->info,
+				       response) < 0)
+		return -ENOENT;
+	fs->blk = fs->info.start;
+
+	return 0;
+}
+
+/* Write the next part of a raw image, padding the last block if needed */
+static int fb_mmc_stream_raw(struct fb_mmc_stream *fs, const void *data,
+			     u32 len, bool last, char *response)
+{
+	struct disk_partition *info = &fs->info;
+	lbaint_t blkcnt = len / info->blksz;
+	u32 tail = len % info->blksz;
+	void *buf;
+
+	if (fs->blk + blkcnt + (last && tail) > info->start + info->size) {
+		pr_err("too large for partition: '%s'\n", info->name);
+		fastboot_fail("too large for partition", response);
+		return -ENOSPC;
+	}
+
+	if (blkcnt &&
+	    fb_mmc_blk_write(fs->dev_desc, fs->blk, blkcnt, data) != blkcnt)
+		goto err;
+	fs->blk += blkcnt;
+	if (!last || !tail)
+		return blkcnt * info->blksz;
+
+	buf = memalign(ARCH_DMA_MINALIGN, info->blksz);
+	if (!buf) {
+		fastboot_fail("out of memory", response);
+		return -ENOMEM;
+	}
+	memcpy(buf, data + blkcnt * info->blksz, tail);
+	memset(buf + tail, '\0', info->blksz - tail);
+	blkcnt = fb_mmc_blk_write(fs->dev_desc, fs->blk, 1, buf);
+	free(buf);
+	if (blkcnt != 1)
+		goto err;
+	fs->blk++;
+
+	return len;
+err:
+	pr_err("failed writing to device %d\n", fs->dev_desc->devnum);
+	fastboot_fail("failed writing to device", response);
+
+	return -EIO;
+}
+
+int fastboot_mmc_stream_write(const void *data, u32 len, bool last,
+			      char *response)
+{
+	struct fb_mmc_stream *fs = &fb_stream;
+	long used;
+
+	if (!fs->started) {
+		/* Wait for enough data to tell what kind of image this is */
+		if (len < sizeof(sparse_header_t) && !last)
+			return 0;
+		fs->started = true;
+		fs->is_sparse = len >= sizeof(sparse_header_t) &&
+			is_sparse_image((void *)data);
+		if (fs->is_sparse) {
+			fs->sparse_priv.dev_desc = fs->dev_desc;
+			fs->sparse.blksz = fs->info.blksz;
+			fs->sparse.start = fs->info.start;
+			fs->sparse.size = fs->info.size;
+			fs->sparse.write = fb_mmc_sparse_write;
+			fs->sparse.reserve = fb_mmc_sparse_reserve;
+			fs->sparse.zero = fb_mmc_sparse_zero;
+			fs->sparse.mssg = fastboot_fail;
+			fs->sparse.priv = &fs->sparse_priv;
+			sparse_stream_init(&fs->ss, &fs->sparse);
+			printf("Flashing sparse image at offset " LBAFU "\n",
+			       fs->sparse.start);
+		} else {
+			puts("Flashing Raw Image\n");
+		}
+	}
+
+	if (!fs->is_sparse) {
+		used = fb_mmc_stream_raw(fs, data, len, last, response);
+		if (used >= 0 && last)
+			printf("........ wrote " LBAFU " bytes to '%s'\n",
+			       (fs->blk - fs->info.start) * fs->info.blksz,
+			       fs->info.name);
+		return used;
+	}
+
+	used = sparse_stream_write(&fs->ss, data, len, response);
+	if (used < 0 || !last)
+		return used;
+	if (sparse_stream_finish(&fs->ss, (char *)fs->info.name, response))
+		return -EINVAL;
+
+	return len;
+}
+#endif
+
 /**
  * fastboot_mmc_flash_erase() - Erase eMMC for fastboot
  *
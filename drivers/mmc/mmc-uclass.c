@@ -523,6 +523,7 @@ static const struct blk_ops mmc_blk_ops = {
 #if CONFIG_IS_ENABLED(MMC_WRITE)
 	.write	= mmc_bwrite,
 	.erase	= mmc_berase,
+	.write_zeroes	= mmc_bwrite_zeroes,
 #endif
 	.select_hwpart	= mmc_select_hwpart,
 };
@@ -10,8 +10,10 @@
 #include <common.h>
 #include <blk.h>
 #include <dm.h>
+#include <malloc.h>
 #include <part.h>
 #include <div64.h>
+#include <asm/cache.h>
 #include <linux/math64.h>
 #include "mmc_private.h"
 
@@ -127,6 +129,64 @@ ulong mmc_berase(struct blk_desc *block_dev, lbaint_t start, lbaint_t blkcnt)
 	return blk;
 }
 
+#if CONFIG_IS_ENABLED(BLK)
+/* Check whether blocks read back as zeroes once they are erased */
+static bool mmc_erase_gives_zeroes(struct mmc *mmc)
+{
+	if (IS_SD(mmc))
+		return !(mmc->scr[0] & SD_DATA_STAT_AFTER_ERASE);
+
+	return mmc->ext_csd && !mmc->ext_csd[EXT_CSD_ERASED_MEM_CONT];
+}
+
+ulong mmc_bwrite_zeroes(struct udevice *dev, lbaint_t start, lbaint_t blkcnt)
+{
+	struct blk_desc *block_dev = dev_get_uclass_plat(dev);
+	struct mmc *mmc = find_mmc_device(block_dev->devnum);
+	lbaint_t first, end, head, tail, blks;
+	u32 rem;
+	void *zeroes;
+
+	if (!mmc)
+		return -ENODEV;
+	if (!mmc_erase_gives_zeroes(mmc))
+		return -EOPNOTSUPP;
+
+	/*
+	 * Only whole erase groups can be erased, so the blocks either side of
+	 * them are written. Erasing is not worth it for less than a group.
+	 */
+	div_u64_rem(start, mmc->erase_grp_size, &rem);
+	first = rem ? start + mmc->erase_grp_size - rem : start;
+	div_u64_rem(start + blkcnt, mmc->erase_grp_size, &rem);
+	end = start + blkcnt - rem;
+	if (first >= end)
+		return -EOPNOTSUPP;
+	head = first - start;
+	tail = start + blkcnt - end;
+
+	if (head || tail) {
+		zeroes = memalign(ARCH_DMA_MINALIGN,
+				  max(head, tail) * block_dev->blksz);
+		if (!zeroes)
+			return -ENOMEM;
+		memset(zeroes, '\0', max(head, tail) * block_dev->blksz);
+		blks = head ? mmc_bwrite(dev, start, head, zeroes) : 0;
+		if (blks == head && tail)
+			blks += mmc_bwrite(dev, end, tail, zeroes);
+		free(zeroes);
+		if (blks != head + tail)
+			return -EIO;
+	}
+
+	blks = mmc_berase(dev, first, end - first);
+	if (blks != end - first)
+		return -EIO;
+
+	return blkcnt;
+}
+#endif
+
 static ulong mmc_write_blocks(struct mmc *mmc, lbaint_t start,
 		lbaint_t blkcnt, const void *src)
 {
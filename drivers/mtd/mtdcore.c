@@ -169,6 +169,19 @@ bool mtd_dev_list_updated(void)
 	return false;
 }
 
+/* Bumped by anything which may change what is on any MTD device */
+static unsigned long mtd_write_count;
+
+unsigned long mtd_write_gen(void)
+{
+	return mtd_write_count;
+}
+
+void mtd_write_gen_bump(void)
+{
+	mtd_write_count++;
+}
+
 #ifndef __UBOOT__
 static LIST_HEAD(mtd_notifiers);
 
@@ -917,6 +930,7 @@ int mtd_erase(struct mtd_info *mtd, struct erase_info *instr)
 		instr->state = MTD_ERASE_DONE;
 		return 0;
 	}
+	mtd_write_count++;
 	return mtd->_erase(mtd, instr);
 }
 EXPORT_SYMBOL_GPL(mtd_erase);
@@ -1020,6 +1034,7 @@ int mtd_write(struct mtd_info *mtd, loff_t to, size_t len, size_t *retlen,
 		return -EROFS;
 	if (!len)
 		return 0;
+	mtd_write_count++;
 
 	if (!mtd->_write) {
 		struct mtd_oob_ops ops = {
@@ -1056,6 +1071,7 @@ int mtd_panic_write(struct mtd_info *mtd, loff_t to, size_t len, size_t *retlen,
 		return -EROFS;
 	if (!len)
 		return 0;
+	mtd_write_count++;
 	return mtd->_panic_write(mtd, to, len, retlen, buf);
 }
 EXPORT_SYMBOL_GPL(mtd_panic_write);
@@ -1143,6 +1159,7 @@ int mtd_write_oob(struct mtd_info *mtd, loff_t to,
 	/* Check the validity of a potential fallback on mtd->_write */
 	if (!mtd->_write_oob && (!mtd->_write || ops->oobbuf))
 		return -EOPNOTSUPP;
+	mtd_write_count++;
 
 	if (mtd->_write_oob)
 		return mtd->_write_oob(mtd, to, ops);
@@ -1660,6 +1677,7 @@ int mtd_block_markbad(struct mtd_info *mtd, loff_t ofs)
 		return -EINVAL;
 	if (!(mtd->flags & MTD_WRITEABLE))
 		return -EROFS;
+	mtd_write_count++;
 	return mtd->_block_markbad(mtd, ofs);
 }
 EXPORT_SYMBOL_GPL(mtd_block_markbad);
@@ -180,6 +180,10 @@ static int spi_flash_std_write(struct udevice *dev, u32 offset, size_t len,
 	struct mtd_info *mtd = &flash->mtd;
 	size_t retlen;
 
+	/* This does not go through mtd_write(), so count the change here */
+	if (CONFIG_IS_ENABLED(MTD))
+		mtd_write_gen_bump();
+
 	return mtd->_write(mtd, offset, len, &retlen, buf);
 }
 
@@ -198,6 +202,9 @@ static int spi_flash_std_erase(struct udevice *dev, u32 offset, size_t len)
 	instr.addr = offset;
 	instr.len = len;
 
+	if (CONFIG_IS_ENABLED(MTD))
+		mtd_write_gen_bump();
+
 	return mtd->_erase(mtd, &instr);
 }
 
@@ -802,6 +802,236 @@ out_unlock:
 	return err;
 }
 
+/**
+ * struct ubi_scan_peb - headers of a PEB found by the last scan.
+ * @checked: @bad is known
+ * @bad: the PEB is bad
+ * @read: the headers have been read
+ * @ec_err: what 'ubi_io_read_ec_hdr()' returned
+ * @vid_err: what 'ubi_io_read_vid_hdr()' returned
+ * @ech: the EC header
+ * @vidh: the VID header
+ */
+struct ubi_scan_peb {
+	bool checked;
+	bool bad;
+	bool read;
+	int ec_err;
+	int vid_err;
+	struct ubi_ec_hdr ech;
+	struct ubi_vid_hdr vidh;
+};
+
+/* Number of MTD devices whose headers are kept */
+#define UBI_SCAN_CACHE_MAX	4
+
+/**
+ * struct ubi_scan_cache - headers found by the last scan of an MTD device.
+ * @list: link in @scan_caches, most recently used first
+ * @name: name of the MTD device
+ * @size: size of the MTD device
+ * @vid_hdr_offset: VID header offset the device was attached with
+ * @peb_count: count of PEBs
+ * @write_gen: MTD write generation when the scan started
+ * @top_pnum: PEB with the highest sequence number, or -1 if none
+ * @top_sqnum: the sequence number of @top_pnum
+ * @pebs: headers of each PEB
+ */
+struct ubi_scan_cache {
+	struct list_head list;
+	char *name;
+	uint64_t size;
+	int vid_hdr_offset;
+	int peb_count;
+	unsigned long write_gen;
+	int top_pnum;
+	unsigned long long top_sqnum;
+	struct ubi_scan_peb *pebs;
+};
+
+/* Headers kept for each MTD device, and those used by the current scan */
+static LIST_HEAD(scan_caches);
+static struct ubi_scan_cache *scan_cur;
+
+static void scan_cache_drop(struct ubi_scan_cache *sc)
+{
+	list_del(&sc->list);
+	vfree(sc->pebs);
+	free(sc->name);
+	kfree(sc);
+}
+
+/* Check that the newest PEB found by the last scan has not been replaced */
+static bool scan_cache_check_top(struct ubi_device *ubi,
+				 struct ubi_scan_cache *sc)
+{
+	struct ubi_vid_hdr *vid_hdr;
+	bool ok;
+	int err;
+
+	if (sc->top_pnum < 0)
+		return true;
+
+	vid_hdr = ubi_zalloc_vid_hdr(ubi, GFP_KERNEL);
+	if (!vid_hdr)
+		return false;
+
+	err = ubi_io_read_vid_hdr(ubi, sc->top_pnum, vid_hdr, 0);
+	ok = (!err || err == UBI_IO_BITFLIPS) &&
+	     be64_to_cpu(vid_hdr->sqnum) == sc->top_sqnum;
+	ubi_free_vid_hdr(ubi, vid_hdr);
+
+	return ok;
+}
+
+/* Check whether the headers kept for an MTD device can be used again */
+static bool scan_cache_valid(struct ubi_device *ubi, struct ubi_scan_cache *sc)
+{
+	return sc->size == ubi->mtd->size &&
+	       sc->vid_hdr_offset == ubi->vid_hdr_offset &&
+	       sc->peb_count == ubi->peb_count &&
+	       scan_cache_check_top(ubi, sc);
+}
+
+/**
+ * scan_cache_start - get ready to scan an MTD device.
+ * @ubi: UBI device description object
+ *
+ * Headers are kept for the last few MTD devices scanned. Those for this
+ * device are used if nothing has changed it since. Anything written through
+ * the MTD layer makes all of them out of date, since the write generation is
+ * not kept per device. Otherwise space is allocated to keep the headers found
+ * by this scan, dropping those for the device used longest ago if needed. If
+ * there is not enough memory, everything is just read from flash.
+ */
+static void scan_cache_start(struct ubi_device *ubi)
+{
+	struct ubi_scan_cache *sc, *tmp, *found = NULL;
+	int count = 0;
+
+	scan_cur = NULL;
+	if (!IS_ENABLED(CONFIG_MTD_UBI_SCAN_CACHE))
+		return;
+
+	list_for_each_entry_safe(sc, tmp, &scan_caches, list) {
+		if (sc->write_gen != mtd_write_gen())
+			scan_cache_drop(sc);
+		else if (!strcmp(sc->name, ubi->mtd->name))
+			found = sc;
+		else
+			count++;
+	}
+	if (found) {
+		if (scan_cache_valid(ubi, found)) {
+			list_move(&found->list, &scan_caches);
+			scan_cur = found;
+			ubi_msg(ubi, "using headers found by the last scan");
+			return;
+		}
+		scan_cache_drop(found);
+	}
+	if (count >= UBI_SCAN_CACHE_MAX)
+		scan_cache_drop(list_last_entry(&scan_caches,
+						struct ubi_scan_cache, list));
+
+	sc = kzalloc(sizeof(*sc), GFP_KERNEL);
+	if (!sc)
+		return;
+	list_add(&sc->list, &scan_caches);
+	sc->pebs = vzalloc(ubi->peb_count * sizeof(*sc->pebs));
+	sc->name = strdup(ubi->mtd->name);
+	if (!sc->pebs || !sc->name) {
+		scan_cache_drop(sc);
+		return;
+	}
+	sc->size = ubi->mtd->size;
+	sc->vid_hdr_offset = ubi->vid_hdr_offset;
+	sc->peb_count = ubi->peb_count;
+	sc->write_gen = mtd_write_gen();
+	sc->top_pnum = -1;
+	scan_cur = sc;
+}
+
+/* Keep the headers only if the scan worked and nothing was written meanwhile */
+static void scan_cache_finish(int err)
+{
+	if (scan_cur && (err || scan_cur->write_gen != mtd_write_gen()))
+		scan_cache_drop(scan_cur);
+	scan_cur = NULL;
+}
+
+static struct ubi_scan_peb *scan_cache_peb(int pnum)
+{
+	if (!IS_ENABLED(CONFIG_MTD_UBI_SCAN_CACHE) || !scan_cur)
+		return NULL;
+
+	return &scan_cur->pebs[pnum];
+}
+
+/**
+ * scan_is_bad - check if a PEB is bad, as 'ubi_io_is_bad()'.
+ * @ubi: UBI device description object
+ * @pnum: the physical eraseblock number
+ */
+static int scan_is_bad(struct ubi_device *ubi, int pnum)
+{
+	struct ubi_scan_peb *sp = scan_cache_peb(pnum);
+	int err;
+
+	if (sp && sp->checked)
+		return sp->bad;
+
+	err = ubi_io_is_bad(ubi, pnum);
+	if (sp && err >= 0) {
+		sp->checked = true;
+		sp->bad = err;
+	}
+
+	return err;
+}
+
+/**
+ * scan_read_hdrs - read the headers of a PEB into @ech and @vidh.
+ * @ubi: UBI device description object
+ * @pnum: the physical eraseblock number
+ * @vid_err: returns the status of the VID header
+ *
+ * This returns the same as 'ubi_io_read_hdrs()', taking the headers from the
+ * last scan where they are known.
+ */
+static int scan_read_hdrs(struct ubi_device *ubi, int pnum, int *vid_err)
+{
+	struct ubi_scan_peb *sp = scan_cache_peb(pnum);
+	unsigned long long sqnum;
+	int err;
+
+	if (sp && sp->read) {
+		memcpy(ech, &sp->ech, UBI_EC_HDR_SIZE);
+		memcpy(vidh, &sp->vidh, UBI_VID_HDR_SIZE);
+		*vid_err = sp->vid_err;
+		return sp->ec_err;
+	}
+
+	err = ubi_io_read_hdrs(ubi, pnum, ech, vidh, vid_err, 0);
+	if (!sp || err < 0)
+		return err;
+
+	sp->read = true;
+	sp->ec_err = err;
+	sp->vid_err = *vid_err;
+	memcpy(&sp->ech, ech, UBI_EC_HDR_SIZE);
+	memcpy(&sp->vidh, vidh, UBI_VID_HDR_SIZE);
+	if (!*vid_err || *vid_err == UBI_IO_BITFLIPS) {
+		sqnum = be64_to_cpu(vidh->sqnum);
+		if (scan_cur->top_pnum < 0 || sqnum > scan_cur->top_sqnum) {
+			scan_cur->top_pnum = pnum;
+			scan_cur->top_sqnum = sqnum;
+		}
+	}
+
+	return err;
+}
+
 /**
  * scan_peb - scan and process UBI headers of a PEB.
  * @ubi: UBI device description object
@@ -819,12 +1049,12 @@ static int scan_peb(struct ubi_device *ubi, struct ubi_attach_info *ai,
 		    int pnum, int *vid, unsigned long long *sqnum)
 {
 	long long uninitialized_var(ec);
-	int err, bitflips = 0, vol_id = -1, ec_err = 0;
+	int err, bitflips = 0, vol_id = -1, ec_err = 0, vid_err = 0;
 
 	dbg_bld("scan PEB %d", pnum);
 
 	/* Skip bad physical eraseblocks */
-	err = ubi_io_is_bad(ubi, pnum);
+	err = scan_is_bad(ubi, pnum);
 	if (err < 0)
 		return err;
 	else if (err) {
@@ -832,7 +1062,8 @@ static int scan_peb(struct ubi_device *ubi, struct ubi_attach_info *ai,
 		return 0;
 	}
 
-	err = ubi_io_read_ec_hdr(ubi, pnum, ech, 0);
+	/* Both headers are read at once, the VID header is looked at below */
+	err = scan_read_hdrs(ubi, pnum, &vid_err);
 	if (err < 0)
 		return err;
 	switch (err) {
@@ -861,7 +1092,7 @@ static int scan_peb(struct ubi_device *ubi, struct ubi_attach_info *ai,
 		bitflips = 1;
 		break;
 	default:
-		ubi_err(ubi, "'ubi_io_read_ec_hdr()' returned unknown code %d",
+		ubi_err(ubi, "'ubi_io_read_hdrs()' returned unknown code %d",
 			err);
 		return -EINVAL;
 	}
@@ -915,7 +1146,7 @@ static int scan_peb(struct ubi_device *ubi, struct ubi_attach_info *ai,
 
 	/* OK, we've done with the EC header, let's look at the VID header */
 
-	err = ubi_io_read_vid_hdr(ubi, pnum, vidh, 0);
+	err = vid_err;
 	if (err < 0)
 		return err;
 	switch (err) {
@@ -1406,6 +1637,8 @@ int ubi_attach(struct ubi_device *ubi, int force_scan)
 	if (!ai)
 		return -ENOMEM;
 
+	scan_cache_start(ubi);
+
 #ifdef CONFIG_MTD_UBI_FASTMAP
 	/* On small flash devices we disable fastmap in any case. */
 	if ((int)mtd_div_by_eb(ubi->mtd->size, ubi->mtd) <= UBI_FM_MAX_START) {
@@ -1433,6 +1666,7 @@ int ubi_attach(struct ubi_device *ubi, int force_scan)
 #else
 	err = scan_all(ubi, ai, 0);
 #endif
+	scan_cache_finish(err);
 	if (err)
 		goto out_ai;
 
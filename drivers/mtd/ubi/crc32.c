@@ -25,9 +25,9 @@
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/compiler.h>
-#include <u-boot/crc.h>
 #endif
 #include <linux/types.h>
+#include <u-boot/crc.h>
 
 #include <asm/byteorder.h>
 
@@ -81,7 +81,10 @@ u32 crc32_le(u32 crc, unsigned char const *p, size_t len)
 
 u32 crc32_le(u32 crc, unsigned char const *p, size_t len)
 {
-# if CRC_LE_BITS == 8
+#ifdef CONFIG_ARM64_CRC32
+	/* lib/crc32.c uses the CRC32 instructions */
+	return crc32_no_comp(crc, p, len);
+#elif CRC_LE_BITS == 8
 	const u32      *b =(u32 *)p;
 	const u32      *tab = crc32table_le;
 
@@ -144,7 +147,7 @@ u32 crc32_le(u32 crc, unsigned char const *p, size_t len)
 		crc = (crc >> 2) ^ crc32table_le[crc & 3];
 	}
 	return crc;
-# endif
+#endif
 }
 #endif
 #ifndef __UBOOT__
@@ -96,6 +96,11 @@ static int self_check_vid_hdr(const struct ubi_device *ubi, int pnum,
 			      const struct ubi_vid_hdr *vid_hdr);
 static int self_check_write(struct ubi_device *ubi, const void *buf, int pnum,
 			    int offset, int len);
+static int check_ec_hdr(struct ubi_device *ubi, int pnum,
+			struct ubi_ec_hdr *ec_hdr, int verbose, int read_err);
+static int check_vid_hdr(struct ubi_device *ubi, int pnum,
+			 struct ubi_vid_hdr *vid_hdr, int verbose,
+			 int read_err);
 
 /**
  * ubi_io_read - read data from a physical eraseblock.
@@ -715,13 +720,33 @@ bad:
 int ubi_io_read_ec_hdr(struct ubi_device *ubi, int pnum,
 		       struct ubi_ec_hdr *ec_hdr, int verbose)
 {
-	int err, read_err;
-	uint32_t crc, magic, hdr_crc;
+	int read_err;
 
 	dbg_io("read EC header from PEB %d", pnum);
 	ubi_assert(pnum >= 0 && pnum < ubi->peb_count);
 
 	read_err = ubi_io_read(ubi, ec_hdr, pnum, 0, UBI_EC_HDR_SIZE);
+
+	return check_ec_hdr(ubi, pnum, ec_hdr, verbose, read_err);
+}
+
+/**
+ * check_ec_hdr - check an erase counter header which has been read.
+ * @ubi: UBI device description object
+ * @pnum: physical eraseblock the header was read from
+ * @ec_hdr: the erase counter header
+ * @verbose: be verbose if the header is corrupted or was not found
+ * @read_err: what 'ubi_io_read()' returned when reading the header
+ *
+ * This is the part of 'ubi_io_read_ec_hdr()' which looks at the header and
+ * returns the same codes.
+ */
+static int check_ec_hdr(struct ubi_device *ubi, int pnum,
+			struct ubi_ec_hdr *ec_hdr, int verbose, int read_err)
+{
+	int err;
+	uint32_t crc, magic, hdr_crc;
+
 	if (read_err) {
 		if (read_err != UBI_IO_BITFLIPS && !mtd_is_eccerr(read_err))
 			return read_err;
@@ -988,8 +1013,7 @@ bad:
 int ubi_io_read_vid_hdr(struct ubi_device *ubi, int pnum,
 			struct ubi_vid_hdr *vid_hdr, int verbose)
 {
-	int err, read_err;
-	uint32_t crc, magic, hdr_crc;
+	int read_err;
 	void *p;
 
 	dbg_io("read VID header from PEB %d", pnum);
@@ -998,6 +1022,28 @@ int ubi_io_read_vid_hdr(struct ubi_device *ubi, int pnum,
 	p = (char *)vid_hdr - ubi->vid_hdr_shift;
 	read_err = ubi_io_read(ubi, p, pnum, ubi->vid_hdr_aloffset,
 			  ubi->vid_hdr_alsize);
+
+	return check_vid_hdr(ubi, pnum, vid_hdr, verbose, read_err);
+}
+
+/**
+ * check_vid_hdr - check a volume identifier header which has been read.
+ * @ubi: UBI device description object
+ * @pnum: physical eraseblock the header was read from
+ * @vid_hdr: the volume identifier header
+ * @verbose: be verbose if the header is corrupted or wasn't found
+ * @read_err: what 'ubi_io_read()' returned when reading the header
+ *
+ * This is the part of 'ubi_io_read_vid_hdr()' which looks at the header and
+ * returns the same codes.
+ */
+static int check_vid_hdr(struct ubi_device *ubi, int pnum,
+			 struct ubi_vid_hdr *vid_hdr, int verbose,
+			 int read_err)
+{
+	int err;
+	uint32_t crc, magic, hdr_crc;
+
 	if (read_err && read_err != UBI_IO_BITFLIPS && !mtd_is_eccerr(read_err))
 		return read_err;
 
@@ -1054,6 +1100,63 @@ int ubi_io_read_vid_hdr(struct ubi_device *ubi, int pnum,
 	return read_err ? UBI_IO_BITFLIPS : 0;
 }
 
+/**
+ * ubi_io_read_hdrs - read and check both headers of a PEB at once.
+ * @ubi: UBI device description object
+ * @pnum: physical eraseblock number to read from
+ * @ec_hdr: a &struct ubi_ec_hdr object where to store the erase counter header
+ * @vid_hdr: a &struct ubi_vid_hdr object where to store the volume identifier
+ * header
+ * @vid_err: returns what 'ubi_io_read_vid_hdr()' would have returned
+ * @verbose: be verbose if a header is corrupted or was not found
+ *
+ * This function reads the start of physical eraseblock @pnum, up to the end of
+ * the VID header, with one MTD read. On NAND flash this means one page read,
+ * or one multi-page read, rather than a separate read for each header. It
+ * returns what 'ubi_io_read_ec_hdr()' would have returned. @vid_err is only
+ * set if the return value is not negative.
+ *
+ * If the read reports bit-flips or an ECC error, the headers are read again
+ * one at a time, so that each is given its own status.
+ */
+int ubi_io_read_hdrs(struct ubi_device *ubi, int pnum,
+		     struct ubi_ec_hdr *ec_hdr, struct ubi_vid_hdr *vid_hdr,
+		     int *vid_err, int verbose)
+{
+	int len = ubi->vid_hdr_aloffset + ubi->vid_hdr_alsize;
+	int read_err, err;
+
+	dbg_io("read EC and VID headers from PEB %d", pnum);
+	ubi_assert(pnum >= 0 && pnum < ubi->peb_count);
+
+	mutex_lock(&ubi->buf_mutex);
+	read_err = ubi_io_read(ubi, ubi->peb_buf, pnum, 0, len);
+	if (!read_err) {
+		memcpy(ec_hdr, ubi->peb_buf, UBI_EC_HDR_SIZE);
+		memcpy((char *)vid_hdr - ubi->vid_hdr_shift,
+		       ubi->peb_buf + ubi->vid_hdr_aloffset,
+		       ubi->vid_hdr_alsize);
+	}
+	mutex_unlock(&ubi->buf_mutex);
+
+	if (read_err) {
+		if (read_err != UBI_IO_BITFLIPS && !mtd_is_eccerr(read_err))
+			return read_err;
+
+		err = ubi_io_read_ec_hdr(ubi, pnum, ec_hdr, verbose);
+		if (err >= 0)
+			*vid_err = ubi_io_read_vid_hdr(ubi, pnum, vid_hdr,
+						       verbose);
+		return err;
+	}
+
+	err = check_ec_hdr(ubi, pnum, ec_hdr, verbose, 0);
+	if (err >= 0)
+		*vid_err = check_vid_hdr(ubi, pnum, vid_hdr, verbose, 0);
+
+	return err;
+}
+
 /**
  * ubi_io_write_vid_hdr - write a volume identifier header.
  * @ubi: UBI device description object
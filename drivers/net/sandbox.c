@@ -387,6 +387,25 @@ static int sb_eth_free_pkt(struct udevice *dev, uchar *packet, int length)
 	return 0;
 }
 
+static int sb_eth_recv_into(struct udevice *dev, int flags, uchar *buf,
+			    int size)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	uchar *packet;
+	int len;
+
+	len = sb_eth_recv(dev, flags, &packet);
+	if (len > size)
+		return -ENOSPC;
+	if (len) {
+		memcpy(buf, packet, len);
+		sb_eth_free_pkt(dev, packet, len);
+		priv->recv_into_count++;
+	}
+
+	return len;
+}
+
 static void sb_eth_stop(struct udevice *dev)
 {
 	debug("eth_sandbox: Stop\n");
@@ -408,6 +427,7 @@ static const struct eth_ops sb_eth_ops = {
 	.send			= sb_eth_send,
 	.recv			= sb_eth_recv,
 	.free_pkt		= sb_eth_free_pkt,
+	.recv_into		= sb_eth_recv_into,
 	.stop			= sb_eth_stop,
 	.write_hwaddr		= sb_eth_write_hwaddr,
 };
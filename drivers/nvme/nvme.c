@@ -17,7 +17,7 @@
 #include <linux/compat.h>
 #include "nvme.h"
 
-#define NVME_Q_DEPTH		2
+#define NVME_Q_DEPTH		64
 #define NVME_AQ_DEPTH		2
 #define NVME_SQ_SIZE(depth)	(depth * sizeof(struct nvme_command))
 #define NVME_CQ_SIZE(depth)	(depth * sizeof(struct nvme_completion))
@@ -25,7 +25,6 @@
 				      ARCH_DMA_MINALIGN)
 #define ADMIN_TIMEOUT		60
 #define IO_TIMEOUT		30
-#define MAX_PRP_POOL		512
 
 static int nvme_wait_csts(struct nvme_dev *dev, u32 mask, u32 val)
 {
@@ -44,8 +43,8 @@ static int nvme_wait_csts(struct nvme_dev *dev, u32 mask, u32 val)
 	return -ETIME;
 }
 
-static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp2,
-			   int total_len, u64 dma_addr)
+static int nvme_setup_prps(struct nvme_dev *dev, struct nvme_io_slot *slot,
+			   u64 *prp2, int total_len, u64 dma_addr)
 {
 	u32 page_size = dev->page_size;
 	int offset = dma_addr & (page_size - 1);
@@ -73,36 +72,37 @@ static int nvme_setup_prps(struct nvme_dev *dev, u64 *prp2,
 	nprps = DIV_ROUND_UP(length, page_size);
 	num_pages = DIV_ROUND_UP(nprps - 1, prps_per_page - 1);
 
-	if (nprps > dev->prp_entry_num) {
-		free(dev->prp_pool);
+	if (num_pages > slot->prp_pages) {
+		free(slot->prp_list);
 		/*
-		 * Always increase in increments of pages.  It doesn't waste
-		 * much memory and reduces the number of allocations.
+		 * The list is kept with the slot, so it is sized once for
+		 * the largest transfer seen
 		 */
-		dev->prp_pool = memalign(page_size, num_pages * page_size);
-		if (!dev->prp_pool) {
+		slot->prp_list = memalign(page_size, num_pages * page_size);
+		if (!slot->prp_list) {
+			slot->prp_pages = 0;
 			printf("Error: malloc prp_pool fail\n");
 			return -ENOMEM;
 		}
-		dev->prp_entry_num = num_pages * (prps_per_page - 1) + 1;
+		slot->prp_pages = num_pages;
 	}
 
-	prp_pool = dev->prp_pool;
+	prp_pool = slot->prp_list;
 	i = 0;
 	while (nprps) {
 		if ((i == (prps_per_page - 1)) && nprps > 1) {
 			*(prp_pool + i) = cpu_to_le64((ulong)prp_pool +
 					page_size);
 			i = 0;
-			prp_pool += page_size;
+			prp_pool += prps_per_page;
 		}
 		*(prp_pool + i++) = cpu_to_le64(dma_addr);
 		dma_addr += page_size;
 		nprps--;
 	}
-	*prp2 = (ulong)dev->prp_pool;
+	*prp2 = (ulong)slot->prp_list;
 
-	flush_dcache_range((ulong)dev->prp_pool, (ulong)dev->prp_pool +
+	flush_dcache_range((ulong)slot->prp_list, (ulong)slot->prp_list +
 			   num_pages * page_size);
 
 	return 0;
@@ -611,6 +611,7 @@ static int nvme_setup_io_queues(struct nvme_dev *dev)
 
 static int nvme_get_info_from_identify(struct nvme_dev *dev)
 {
+	struct nvme_ops *ops;
 	struct nvme_id_ctrl *ctrl;
 	int ret;
 	int shift = NVME_CAP_MPSMIN(dev->cap) + 12;
@@ -627,6 +628,10 @@ static int nvme_get_info_from_identify(struct nvme_dev *dev)
 
 	dev->nn = le32_to_cpu(ctrl->nn);
 	dev->vwc = ctrl->vwc;
+	/* controllers with their own submission scheme only take PRPs */
+	ops = (struct nvme_ops *)dev->udev->driver->ops;
+	dev->sgl = (le32_to_cpu(ctrl->sgls) & NVME_CTRL_SGLS_MASK) &&
+		!(ops && ops->submit_cmd);
 	memcpy(dev->serial, ctrl->sn, sizeof(ctrl->sn));
 	memcpy(dev->model, ctrl->mn, sizeof(ctrl->mn));
 	memcpy(dev->firmware_rev, ctrl->fr, sizeof(ctrl->fr));
@@ -727,65 +732,257 @@ static int nvme_blk_probe(struct udevice *udev)
 	return 0;
 }
 
-static ulong nvme_blk_rw(struct udevice *udev, lbaint_t blknr,
-			 lbaint_t blkcnt, void *buffer, bool read)
+/* Number of blocks which fit in a single read/write command */
+static u32 nvme_max_lbas(struct nvme_dev *dev, struct nvme_ns *ns)
+{
+	/* the command holds a 0-based, 16-bit block count */
+	return min(1U << (dev->max_transfer_shift - ns->lba_shift), 0x10000U);
+}
+
+static bool nvme_req_in_flight(struct nvme_dev *dev, struct blk_req *req)
+{
+	int i;
+
+	for (i = 0; i < dev->nr_slots; i++)
+		if (dev->slots[i].req == req && !dev->slots[i].cancelled)
+			return true;
+
+	return false;
+}
+
+/*
+ * A request is complete once none of its commands are left in a slot, and
+ * all of them have been issued (req->priv is set while issuing)
+ */
+static void nvme_req_check_done(struct nvme_dev *dev, struct blk_req *req)
+{
+	if (req->priv || nvme_req_in_flight(dev, req))
+		return;
+
+	if (!req->result)
+		req->result = req->blkcnt;
+	req->complete = true;
+}
+
+/**
+ * nvme_io_poll() - reap completed commands from the I/O queue
+ *
+ * @dev:	NVMe device
+ * Return: number of commands completed
+ */
+static int nvme_io_poll(struct nvme_dev *dev)
+{
+	struct nvme_queue *nvmeq = dev->queues[NVME_IO_Q];
+	struct nvme_ops *ops = (struct nvme_ops *)dev->udev->driver->ops;
+	u16 head = nvmeq->cq_head;
+	u16 phase = nvmeq->cq_phase;
+	struct nvme_io_slot *slot;
+	struct blk_req *req;
+	int count = 0;
+	u16 status, id;
+
+	for (;;) {
+		status = nvme_read_completion_status(nvmeq, head);
+		if ((status & 0x01) != phase)
+			break;
+		id = readw(&nvmeq->cqes[head].command_id);
+		if (++head == nvmeq->q_depth) {
+			head = 0;
+			phase = !phase;
+		}
+		if (id >= dev->nr_slots || !dev->slots[id].req) {
+			printf("ERROR: unexpected completion, id = %x\n", id);
+			continue;
+		}
+
+		slot = &dev->slots[id];
+		if (ops && ops->complete_cmd)
+			ops->complete_cmd(nvmeq, &slot->cmd);
+		req = slot->req;
+		slot->req = NULL;
+		dev->slots_busy--;
+		count++;
+		if (slot->cancelled) {
+			slot->cancelled = false;
+			continue;
+		}
+		if (req->op == BLK_REQ_READ)
+			invalidate_dcache_range(slot->buffer,
+						slot->buffer + slot->len);
+		status >>= 1;
+		if (status) {
+			printf("ERROR: status = %x, phase = %d, head = %d\n",
+			       status, phase, head);
+			req->result = -EIO;
+		}
+		nvme_req_check_done(dev, req);
+	}
+
+	if (count) {
+		writel(head, nvmeq->q_db + dev->db_stride);
+		nvmeq->cq_head = head;
+		nvmeq->cq_phase = phase;
+	}
+
+	return count;
+}
+
+/* Wait for a free slot on the I/O queue */
+static struct nvme_io_slot *nvme_get_slot(struct nvme_dev *dev, u16 *idp)
+{
+	ulong start_time = timer_get_us();
+	int i;
+
+	while (dev->slots_busy == dev->nr_slots) {
+		if (nvme_io_poll(dev))
+			start_time = timer_get_us();
+		else if (timer_get_us() - start_time >= IO_TIMEOUT * 100000)
+			return NULL;
+	}
+
+	for (i = 0; i < dev->nr_slots; i++) {
+		if (!dev->slots[i].req) {
+			*idp = i;
+			return &dev->slots[i];
+		}
+	}
+
+	return NULL;
+}
+
+static int nvme_issue_rw(struct nvme_dev *dev, struct nvme_ns *ns,
+			 struct blk_req *req, u64 slba, u32 lbas,
+			 uintptr_t buffer)
+{
+	struct nvme_io_slot *slot;
+	struct nvme_command *c;
+	u32 len = lbas << ns->lba_shift;
+	u64 prp2;
+	u16 id;
+
+	slot = nvme_get_slot(dev, &id);
+	if (!slot)
+		return -ETIMEDOUT;
+
+	c = &slot->cmd;
+	memset(c, '\0', sizeof(*c));
+	c->rw.opcode = req->op == BLK_REQ_READ ? nvme_cmd_read :
+		nvme_cmd_write;
+	c->rw.command_id = cpu_to_le16(id);
+	c->rw.nsid = cpu_to_le32(ns->ns_id);
+	c->rw.slba = cpu_to_le64(slba);
+	c->rw.length = cpu_to_le16(lbas - 1);
+	if (dev->sgl && !(buffer & 3)) {
+		/* one descriptor covers the whole contiguous buffer */
+		c->rw.flags = NVME_CMD_PSDT_SGL_METABUF;
+		c->rw.sgl.addr = cpu_to_le64(buffer);
+		c->rw.sgl.length = cpu_to_le32(len);
+		c->rw.sgl.type = NVME_SGL_FMT_DATA_DESC << 4;
+	} else {
+		if (nvme_setup_prps(dev, slot, &prp2, len, buffer))
+			return -EIO;
+		c->rw.prp1 = cpu_to_le64(buffer);
+		c->rw.prp2 = cpu_to_le64(prp2);
+	}
+
+	slot->req = req;
+	slot->buffer = buffer;
+	slot->len = len;
+	dev->slots_busy++;
+	nvme_submit_cmd(dev->queues[NVME_IO_Q], c);
+
+	return 0;
+}
+
+static int nvme_blk_submit(struct udevice *udev, struct blk_req *req)
 {
 	struct nvme_ns *ns = dev_get_priv(udev);
 	struct nvme_dev *dev = ns->dev;
-	struct nvme_command c;
 	struct blk_desc *desc = dev_get_uclass_plat(udev);
-	int status;
-	u64 prp2;
-	u64 total_len = blkcnt << desc->log2blksz;
-	u64 temp_len = total_len;
-	uintptr_t temp_buffer = (uintptr_t)buffer;
-
-	u64 slba = blknr;
-	u16 lbas = 1 << (dev->max_transfer_shift - ns->lba_shift);
-	u64 total_lbas = blkcnt;
-
-	flush_dcache_range((unsigned long)buffer,
-			   (unsigned long)buffer + total_len);
-
-	c.rw.opcode = read ? nvme_cmd_read : nvme_cmd_write;
-	c.rw.flags = 0;
-	c.rw.nsid = cpu_to_le32(ns->ns_id);
-	c.rw.control = 0;
-	c.rw.dsmgmt = 0;
-	c.rw.reftag = 0;
-	c.rw.apptag = 0;
-	c.rw.appmask = 0;
-	c.rw.metadata = 0;
+	u32 max_lbas = nvme_max_lbas(dev, ns);
+	uintptr_t buffer = (uintptr_t)req->buffer;
+	u64 total_lbas = req->blkcnt;
+	u64 slba = req->start;
+	u32 lbas;
+	int ret;
 
+	/*
+	 * Requests which fit are queued whole. Larger ones are issued as
+	 * slots become free, once the queue is idle.
+	 */
+	if (DIV_ROUND_UP(total_lbas, max_lbas) >
+	    dev->nr_slots - dev->slots_busy && dev->slots_busy)
+		return -EBUSY;
+
+	flush_dcache_range(buffer, buffer + (total_lbas << desc->log2blksz));
+	req->priv = req;
 	while (total_lbas) {
-		if (total_lbas < lbas) {
-			lbas = (u16)total_lbas;
-			total_lbas = 0;
-		} else {
-			total_lbas -= lbas;
+		lbas = min_t(u64, total_lbas, max_lbas);
+		ret = nvme_issue_rw(dev, ns, req, slba, lbas, buffer);
+		if (ret) {
+			req->result = ret;
+			break;
 		}
-
-		if (nvme_setup_prps(dev, &prp2,
-				    lbas << ns->lba_shift, temp_buffer))
-			return -EIO;
-		c.rw.slba = cpu_to_le64(slba);
+		total_lbas -= lbas;
 		slba += lbas;
-		c.rw.length = cpu_to_le16(lbas - 1);
-		c.rw.prp1 = cpu_to_le64(temp_buffer);
-		c.rw.prp2 = cpu_to_le64(prp2);
-		status = nvme_submit_sync_cmd(dev->queues[NVME_IO_Q],
-				&c, NULL, IO_TIMEOUT);
-		if (status)
-			break;
-		temp_len -= (u32)lbas << ns->lba_shift;
-		temp_buffer += lbas << ns->lba_shift;
+		buffer += lbas << ns->lba_shift;
+	}
+	req->priv = NULL;
+	nvme_req_check_done(dev, req);
+
+	return 0;
+}
+
+static int nvme_blk_poll(struct udevice *udev)
+{
+	struct nvme_ns *ns = dev_get_priv(udev);
+
+	return nvme_io_poll(ns->dev);
+}
+
+static int nvme_blk_cancel(struct udevice *udev, struct blk_req *req)
+{
+	struct nvme_ns *ns = dev_get_priv(udev);
+	struct nvme_dev *dev = ns->dev;
+	int i;
+
+	/* there is no abort, so just forget the request */
+	for (i = 0; i < dev->nr_slots; i++) {
+		if (dev->slots[i].req == req)
+			dev->slots[i].cancelled = true;
 	}
 
-	if (read)
-		invalidate_dcache_range((unsigned long)buffer,
-					(unsigned long)buffer + total_len);
+	return 0;
+}
+
+static ulong nvme_blk_rw(struct udevice *udev, lbaint_t blknr,
+			 lbaint_t blkcnt, void *buffer, bool read)
+{
+	struct nvme_ns *ns = dev_get_priv(udev);
+	struct blk_req req = {
+		.op	= read ? BLK_REQ_READ : BLK_REQ_WRITE,
+		.start	= blknr,
+		.blkcnt	= blkcnt,
+		.buffer	= buffer,
+	};
+	ulong start_time = timer_get_us();
+	int ret;
+
+	ret = nvme_blk_submit(udev, &req);
+	while (ret == -EBUSY || !req.complete) {
+		if (nvme_io_poll(ns->dev))
+			start_time = timer_get_us();
+		else if (timer_get_us() - start_time >= IO_TIMEOUT * 100000)
+			break;
+		if (ret == -EBUSY)
+			ret = nvme_blk_submit(udev, &req);
+	}
+	if (!req.complete) {
+		nvme_blk_cancel(udev, &req);
+		return -ETIMEDOUT;
+	}
 
-	return (total_len - temp_len) >> desc->log2blksz;
+	return req.result;
 }
 
 static ulong nvme_blk_read(struct udevice *udev, lbaint_t blknr,
@@ -803,6 +1000,9 @@ static ulong nvme_blk_write(struct udevice *udev, lbaint_t blknr,
 static const struct blk_ops nvme_blk_ops = {
 	.read	= nvme_blk_read,
 	.write	= nvme_blk_write,
+	.submit	= nvme_blk_submit,
+	.poll	= nvme_blk_poll,
+	.cancel	= nvme_blk_cancel,
 };
 
 U_BOOT_DRIVER(nvme_blk) = {
@@ -813,9 +1013,22 @@ U_BOOT_DRIVER(nvme_blk) = {
 	.priv_auto	= sizeof(struct nvme_ns),
 };
 
+static void nvme_free_slots(struct nvme_dev *dev)
+{
+	int i;
+
+	for (i = 0; i < dev->nr_slots; i++)
+		free(dev->slots[i].prp_list);
+	free(dev->slots);
+	dev->slots = NULL;
+	dev->nr_slots = 0;
+	dev->slots_busy = 0;
+}
+
 int nvme_init(struct udevice *udev)
 {
 	struct nvme_dev *ndev = dev_get_priv(udev);
+	struct nvme_ops *ops;
 	struct nvme_id_ns *id;
 	int ret;
 
@@ -844,19 +1057,24 @@ int nvme_init(struct udevice *udev)
 	if (ret)
 		goto free_queue;
 
-	/* Allocate after the page size is known */
-	ndev->prp_pool = memalign(ndev->page_size, MAX_PRP_POOL);
-	if (!ndev->prp_pool) {
-		ret = -ENOMEM;
-		printf("Error: %s: Out of memory!\n", udev->name);
-		goto free_nvme;
-	}
-	ndev->prp_entry_num = MAX_PRP_POOL >> 3;
-
 	ret = nvme_setup_io_queues(ndev);
 	if (ret)
 		goto free_queue;
 
+	/*
+	 * Keep one queue entry free so a full queue can be told from an
+	 * empty one. Controllers with their own submission scheme complete
+	 * commands strictly in order, so only allow one at a time there.
+	 */
+	ops = (struct nvme_ops *)udev->driver->ops;
+	ndev->nr_slots = ops && ops->submit_cmd ? 1 : ndev->q_depth - 1;
+	ndev->slots = calloc(ndev->nr_slots, sizeof(*ndev->slots));
+	if (!ndev->slots) {
+		ret = -ENOMEM;
+		printf("Error: %s: Out of memory!\n", udev->name);
+		goto free_queue;
+	}
+
 	nvme_get_info_from_identify(ndev);
 
 	/* Create a blk device for each namespace */
@@ -903,6 +1121,7 @@ int nvme_init(struct udevice *udev)
 
 free_id:
 	free(id);
+	nvme_free_slots(ndev);
 free_queue:
 	free((void *)ndev->queues);
 free_nvme:
@@ -917,8 +1136,14 @@ int nvme_shutdown(struct udevice *udev)
 	ret = nvme_shutdown_ctrl(ndev);
 	if (ret < 0) {
 		printf("Error: %s: Shutdown timed out!\n", udev->name);
-		return ret;
+		goto free_slots;
 	}
 
-	return nvme_disable_ctrl(ndev);
+	ret = nvme_disable_ctrl(ndev);
+
+free_slots:
+	/* no more commands are issued, so the slots can go */
+	nvme_free_slots(ndev);
+
+	return ret;
 }
@@ -235,6 +235,35 @@ struct nvme_common_command {
 	__le32			cdw10[6];
 };
 
+/*
+ * Scatter/gather list descriptor. When the controller supports SGLs, a
+ * single data block descriptor in the command can describe a contiguous
+ * buffer of any length, in place of PRP entries.
+ */
+struct nvme_sgl_desc {
+	__le64			addr;
+	__le32			length;
+	__u8			rsvd[3];
+	__u8			type;
+};
+
+enum {
+	NVME_SGL_FMT_DATA_DESC		= 0x00,
+	NVME_SGL_FMT_SEG_DESC		= 0x02,
+	NVME_SGL_FMT_LAST_SEG_DESC	= 0x03,
+};
+
+/* Data pointer type in the flags byte of a command */
+enum {
+	NVME_CMD_PSDT_PRP		= 0 << 6,
+	NVME_CMD_PSDT_SGL_METABUF	= 1 << 6,
+};
+
+/* SGL support field of the identify controller data */
+enum {
+	NVME_CTRL_SGLS_MASK		= 0x3,
+};
+
 struct nvme_rw_command {
 	__u8			opcode;
 	__u8			flags;
@@ -242,8 +271,13 @@ struct nvme_rw_command {
 	__le32			nsid;
 	__u64			rsvd2;
 	__le64			metadata;
-	__le64			prp1;
-	__le64			prp2;
+	union {
+		struct {
+			__le64	prp1;
+			__le64	prp2;
+		};
+		struct nvme_sgl_desc sgl;
+	};
 	__le64			slba;
 	__le16			length;
 	__le16			control;
@@ -618,8 +652,10 @@ struct nvme_dev {
 	u32 stripe_size;
 	u32 page_size;
 	u8 vwc;
-	u64 *prp_pool;
-	u32 prp_entry_num;
+	bool sgl;
+	struct nvme_io_slot *slots;
+	u32 nr_slots;
+	u32 slots_busy;
 	u32 nn;
 };
 
@@ -650,6 +686,23 @@ struct nvme_queue {
 	unsigned long cmdid_data[];
 };
 
+/*
+ * State of one command on the I/O queue. The slot index is used as the
+ * command ID, so completions can be matched to their request. Each slot has
+ * its own PRP list, so any number of data commands can be outstanding. A
+ * cancelled command keeps its slot until the controller completes it, but
+ * its request is no longer touched.
+ */
+struct nvme_io_slot {
+	struct blk_req *req;
+	bool cancelled;
+	struct nvme_command cmd;
+	ulong buffer;
+	u32 len;
+	u64 *prp_list;
+	u32 prp_pages;
+};
+
 /*
  * An NVM Express namespace is equivalent to a SCSI LUN.
  * Each namespace is operated as an independent "device".
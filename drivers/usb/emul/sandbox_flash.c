@@ -19,11 +19,19 @@
  * This driver emulates a flash stick using the UFI command specification and
  * the BBB (bulk/bulk/bulk) protocol. It supports only a single logical unit
  * number (LUN 0).
+ *
+ * With the sandbox,uas property it also offers USB Attached SCSI as alternate
+ * setting 1, with streams. Commands are still carried out one at a time, but
+ * the host may queue several.
  */
 
 enum {
 	SANDBOX_FLASH_EP_OUT		= 1,	/* endpoints */
 	SANDBOX_FLASH_EP_IN		= 2,
+	SANDBOX_FLASH_EP_UAS_CMD	= 3,
+	SANDBOX_FLASH_EP_UAS_STATUS	= 4,
+	SANDBOX_FLASH_EP_UAS_IN		= 5,
+	SANDBOX_FLASH_EP_UAS_OUT	= 6,
 	SANDBOX_FLASH_BLOCK_LEN		= 512,
 	SANDBOX_FLASH_BUF_SIZE		= 512,
 };
@@ -45,6 +53,10 @@ enum {
  * @fd:		File descriptor of backing file
  * @file_size:	Size of file in bytes
  * @status_buff:	Data buffer for outgoing status
+ * @alt:	Alternate setting in use, 1 for UAS
+ * @ready_sent:	true if READ READY or WRITE READY has been sent (UAS without
+ *		streams)
+ * @sense_iu:	Outgoing UAS status
  */
 struct sandbox_flash_priv {
 	struct scsi_emul_info eminfo;
@@ -52,10 +64,14 @@ struct sandbox_flash_priv {
 	u32 tag;
 	int fd;
 	struct umass_bbb_csw status;
+	int alt;
+	bool ready_sent;
+	struct uas_sense_iu sense_iu;
 };
 
 struct sandbox_flash_plat {
 	const char *pathname;
+	bool uas;
 	struct usb_string flash_strings[STRINGID_COUNT];
 };
 
@@ -131,6 +147,129 @@ static void *flash_desc_list[] = {
 	NULL,
 };
 
+static struct usb_config_descriptor flash_uas_config0 = {
+	.bLength		= sizeof(flash_uas_config0),
+	.bDescriptorType	= USB_DT_CONFIG,
+
+	/* wTotalLength is set up by usb-emul-uclass */
+	.bNumInterfaces		= 1,
+	.bConfigurationValue	= 0,
+	.iConfiguration		= 0,
+	.bmAttributes		= 1 << 7,
+	.bMaxPower		= 50,
+};
+
+static struct usb_interface_descriptor flash_uas_interface1 = {
+	.bLength		= sizeof(flash_uas_interface1),
+	.bDescriptorType	= USB_DT_INTERFACE,
+
+	.bInterfaceNumber	= 0,
+	.bAlternateSetting	= 1,
+	.bNumEndpoints		= 4,
+	.bInterfaceClass	= USB_CLASS_MASS_STORAGE,
+	.bInterfaceSubClass	= US_SC_SCSI,
+	.bInterfaceProtocol	= US_PR_UAS,
+	.iInterface		= 0,
+};
+
+static struct usb_endpoint_descriptor flash_uas_cmd_ep = {
+	.bLength		= USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType	= USB_DT_ENDPOINT,
+
+	.bEndpointAddress	= SANDBOX_FLASH_EP_UAS_CMD,
+	.bmAttributes		= USB_ENDPOINT_XFER_BULK,
+	.wMaxPacketSize		= __constant_cpu_to_le16(1024),
+	.bInterval		= 0,
+};
+
+static struct usb_pipe_usage_descriptor flash_uas_cmd_pipe = {
+	.bLength		= USB_DT_PIPE_USAGE_SIZE,
+	.bDescriptorType	= USB_DT_PIPE_USAGE,
+	.bPipeID		= UAS_CMD_PIPE_ID,
+};
+
+static struct usb_endpoint_descriptor flash_uas_status_ep = {
+	.bLength		= USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType	= USB_DT_ENDPOINT,
+
+	.bEndpointAddress	= SANDBOX_FLASH_EP_UAS_STATUS | USB_ENDPOINT_DIR_MASK,
+	.bmAttributes		= USB_ENDPOINT_XFER_BULK,
+	.wMaxPacketSize		= __constant_cpu_to_le16(1024),
+	.bInterval		= 0,
+};
+
+static struct usb_pipe_usage_descriptor flash_uas_status_pipe = {
+	.bLength		= USB_DT_PIPE_USAGE_SIZE,
+	.bDescriptorType	= USB_DT_PIPE_USAGE,
+	.bPipeID		= UAS_STATUS_PIPE_ID,
+};
+
+static struct usb_endpoint_descriptor flash_uas_in_ep = {
+	.bLength		= USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType	= USB_DT_ENDPOINT,
+
+	.bEndpointAddress	= SANDBOX_FLASH_EP_UAS_IN | USB_ENDPOINT_DIR_MASK,
+	.bmAttributes		= USB_ENDPOINT_XFER_BULK,
+	.wMaxPacketSize		= __constant_cpu_to_le16(1024),
+	.bInterval		= 0,
+};
+
+static struct usb_pipe_usage_descriptor flash_uas_in_pipe = {
+	.bLength		= USB_DT_PIPE_USAGE_SIZE,
+	.bDescriptorType	= USB_DT_PIPE_USAGE,
+	.bPipeID		= UAS_DATA_IN_PIPE_ID,
+};
+
+static struct usb_endpoint_descriptor flash_uas_out_ep = {
+	.bLength		= USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType	= USB_DT_ENDPOINT,
+
+	.bEndpointAddress	= SANDBOX_FLASH_EP_UAS_OUT,
+	.bmAttributes		= USB_ENDPOINT_XFER_BULK,
+	.wMaxPacketSize		= __constant_cpu_to_le16(1024),
+	.bInterval		= 0,
+};
+
+static struct usb_pipe_usage_descriptor flash_uas_out_pipe = {
+	.bLength		= USB_DT_PIPE_USAGE_SIZE,
+	.bDescriptorType	= USB_DT_PIPE_USAGE,
+	.bPipeID		= UAS_DATA_OUT_PIPE_ID,
+};
+
+/* Up to 16 streams on the status and data endpoints */
+static struct usb_ss_ep_comp_descriptor flash_uas_stream_comp = {
+	.bLength		= USB_DT_SS_EP_COMP_SIZE,
+	.bDescriptorType	= USB_DT_SS_ENDPOINT_COMP,
+	.bmAttributes		= 4,
+};
+
+static struct usb_ss_ep_comp_descriptor flash_uas_comp = {
+	.bLength		= USB_DT_SS_EP_COMP_SIZE,
+	.bDescriptorType	= USB_DT_SS_ENDPOINT_COMP,
+};
+
+static void *flash_uas_desc_list[] = {
+	&flash_device_desc,
+	&flash_uas_config0,
+	&flash_interface0,
+	&flash_endpoint0_out,
+	&flash_endpoint1_in,
+	&flash_uas_interface1,
+	&flash_uas_cmd_ep,
+	&flash_uas_comp,
+	&flash_uas_cmd_pipe,
+	&flash_uas_status_ep,
+	&flash_uas_stream_comp,
+	&flash_uas_status_pipe,
+	&flash_uas_in_ep,
+	&flash_uas_stream_comp,
+	&flash_uas_in_pipe,
+	&flash_uas_out_ep,
+	&flash_uas_stream_comp,
+	&flash_uas_out_pipe,
+	NULL,
+};
+
 static int sandbox_flash_control(struct udevice *dev, struct usb_device *udev,
 				 unsigned long pipe, void *buff, int len,
 				 struct devrequest *setup)
@@ -149,6 +288,15 @@ static int sandbox_flash_control(struct udevice *dev, struct usb_device *udev,
 			debug("request=%x\n", setup->request);
 			break;
 		}
+	} else if (pipe == usb_sndctrlpipe(udev, 0) &&
+		   setup->request == USB_REQ_SET_INTERFACE) {
+		struct sandbox_flash_plat *plat = dev_get_plat(dev);
+
+		if (setup->value > (plat->uas ? 1 : 0))
+			return -EINVAL;
+		priv->alt = setup->value;
+		priv->eminfo.phase = SCSIPH_START;
+		return 0;
 	}
 	debug("pipe=%lx\n", pipe);
 
@@ -204,6 +352,63 @@ static int handle_ufi_command(struct sandbox_flash_priv *priv, const void *buff,
 	return 0;
 }
 
+static int handle_data_out(struct sandbox_flash_priv *priv, const void *buff,
+			   int len)
+{
+	struct scsi_emul_info *info = &priv->eminfo;
+
+	if (!info->write_len)
+		return 0;
+	if (priv->fd != -1) {
+		ulong bytes_written;
+
+		bytes_written = os_write(priv->fd, buff, len);
+		log_debug("bytes_written=%lx", bytes_written);
+		if (bytes_written != len)
+			return -EIO;
+		info->write_len -= len / info->block_size;
+		if (!info->write_len)
+			info->phase = SCSIPH_STATUS;
+	} else {
+		if (info->alloc_len && len > info->alloc_len)
+			len = info->alloc_len;
+		if (len > SANDBOX_FLASH_BUF_SIZE)
+			len = SANDBOX_FLASH_BUF_SIZE;
+		memcpy(info->buff, buff, len);
+		info->phase = SCSIPH_STATUS;
+	}
+
+	return len;
+}
+
+static int handle_data_in(struct sandbox_flash_priv *priv, void *buff, int len)
+{
+	struct scsi_emul_info *info = &priv->eminfo;
+
+	if (info->read_len) {
+		ulong bytes_read;
+
+		if (priv->fd == -1)
+			return -EIO;
+
+		bytes_read = os_read(priv->fd, buff, len);
+		if (bytes_read != len)
+			return -EIO;
+		info->read_len -= len / info->block_size;
+		if (!info->read_len)
+			info->phase = SCSIPH_STATUS;
+	} else {
+		if (info->alloc_len && len > info->alloc_len)
+			len = info->alloc_len;
+		if (len > SANDBOX_FLASH_BUF_SIZE)
+			len = SANDBOX_FLASH_BUF_SIZE;
+		memcpy(buff, info->buff, len);
+		info->phase = SCSIPH_STATUS;
+	}
+
+	return len;
+}
+
 static int sandbox_flash_bulk(struct udevice *dev, struct usb_device *udev,
 			      unsigned long pipe, void *buff, int len)
 {
@@ -238,27 +443,7 @@ static int sandbox_flash_bulk(struct udevice *dev, struct usb_device *udev,
 				  info->write_len);
 			info->transfer_len = cbw->dCBWDataTransferLength;
 			priv->tag = cbw->dCBWTag;
-			if (!info->write_len)
-				return 0;
-			if (priv->fd != -1) {
-				ulong bytes_written;
-
-				bytes_written = os_write(priv->fd, buff, len);
-				log_debug("bytes_written=%lx", bytes_written);
-				if (bytes_written != len)
-					return -EIO;
-				info->write_len -= len / info->block_size;
-				if (!info->write_len)
-					info->phase = SCSIPH_STATUS;
-			} else {
-				if (info->alloc_len && len > info->alloc_len)
-					len = info->alloc_len;
-				if (len > SANDBOX_FLASH_BUF_SIZE)
-					len = SANDBOX_FLASH_BUF_SIZE;
-				memcpy(info->buff, buff, len);
-				info->phase = SCSIPH_STATUS;
-			}
-			return len;
+			return handle_data_out(priv, buff, len);
 		default:
 			break;
 		}
@@ -267,27 +452,7 @@ static int sandbox_flash_bulk(struct udevice *dev, struct usb_device *udev,
 		case SCSIPH_DATA:
 			debug("data in, len=%x, alloc_len=%x, info->read_len=%x\n",
 			      len, info->alloc_len, info->read_len);
-			if (info->read_len) {
-				ulong bytes_read;
-
-				if (priv->fd == -1)
-					return -EIO;
-
-				bytes_read = os_read(priv->fd, buff, len);
-				if (bytes_read != len)
-					return -EIO;
-				info->read_len -= len / info->block_size;
-				if (!info->read_len)
-					info->phase = SCSIPH_STATUS;
-			} else {
-				if (info->alloc_len && len > info->alloc_len)
-					len = info->alloc_len;
-				if (len > SANDBOX_FLASH_BUF_SIZE)
-					len = SANDBOX_FLASH_BUF_SIZE;
-				memcpy(buff, info->buff, len);
-				info->phase = SCSIPH_STATUS;
-			}
-			return len;
+			return handle_data_in(priv, buff, len);
 		case SCSIPH_STATUS:
 			debug("status in, len=%x\n", len);
 			if (len > sizeof(priv->status))
@@ -305,6 +470,121 @@ err:
 	return 0;
 }
 
+/* Sets up a CHECK CONDITION status with the given sense key and ASC */
+static void setup_uas_fail(struct sandbox_flash_priv *priv, int key, int asc)
+{
+	struct uas_sense_iu *siu = &priv->sense_iu;
+
+	siu->status = 0x02;
+	siu->len = cpu_to_be16(18);
+	siu->sense[0] = 0x70;
+	siu->sense[2] = key;
+	siu->sense[7] = 10;
+	siu->sense[12] = asc;
+	priv->eminfo.phase = SCSIPH_STATUS;
+}
+
+static int handle_uas_command(struct sandbox_flash_priv *priv,
+			      const struct uas_command_iu *iu, int len)
+{
+	struct scsi_emul_info *info = &priv->eminfo;
+	struct uas_sense_iu *siu = &priv->sense_iu;
+	int ret;
+
+	if (len != sizeof(*iu) || iu->iu_id != UAS_IU_COMMAND)
+		return -EPIPE;
+	info->alloc_len = 0;
+	info->read_len = 0;
+	info->write_len = 0;
+	info->transfer_len = 0;
+	priv->tag = be16_to_cpu(iu->tag);
+	priv->ready_sent = false;
+	memset(siu, '\0', sizeof(*siu));
+	siu->iu_id = UAS_IU_SENSE;
+	siu->tag = iu->tag;
+
+	ret = sb_scsi_emul_command(info, (const void *)iu->cdb,
+				   sizeof(iu->cdb));
+	if (ret < 0) {
+		/* Illegal request, invalid command operation code */
+		setup_uas_fail(priv, 0x05, 0x20);
+	} else if (ret && priv->fd == -1) {
+		/* Not ready, medium not present */
+		setup_uas_fail(priv, 0x02, 0x3a);
+	} else {
+		if (ret)
+			os_lseek(priv->fd, info->seek_block * info->block_size,
+				 OS_SEEK_SET);
+		info->phase = info->buff_used ? SCSIPH_DATA : SCSIPH_STATUS;
+	}
+
+	return len;
+}
+
+/*
+ * UAS transfers are held off with -EAGAIN until the current command gets to
+ * them, so that the host can queue the next command before this one is done.
+ * With streams, the stream of each data or status transfer is its tag.
+ */
+static int sandbox_flash_bulk_submit(struct udevice *dev,
+				     struct usb_device *udev,
+				     struct usb_xfer *xfer)
+{
+	struct sandbox_flash_priv *priv = dev_get_priv(dev);
+	struct scsi_emul_info *info = &priv->eminfo;
+	struct uas_sense_iu *siu = &priv->sense_iu;
+	int ep = usb_pipeendpoint(xfer->pipe);
+	int len;
+
+	if (priv->alt != 1)
+		return sandbox_flash_bulk(dev, udev, xfer->pipe, xfer->buffer,
+					  xfer->length);
+
+	debug("%s: dev=%s, ep=%x, stream=%x, len=%x, phase=%d\n", __func__,
+	      dev->name, ep, xfer->stream, xfer->length, info->phase);
+	if (ep == SANDBOX_FLASH_EP_UAS_CMD) {
+		if (info->phase != SCSIPH_START)
+			return -EAGAIN;
+		return handle_uas_command(priv, xfer->buffer, xfer->length);
+	}
+	if (xfer->stream && xfer->stream != priv->tag)
+		return -EAGAIN;
+
+	switch (ep) {
+	case SANDBOX_FLASH_EP_UAS_STATUS:
+		if (info->phase == SCSIPH_DATA && !xfer->stream &&
+		    !priv->ready_sent) {
+			struct uas_sense_iu *ready = xfer->buffer;
+
+			if (xfer->length < 4)
+				return -EIO;
+			ready->iu_id = info->write_len ? UAS_IU_WRITE_READY :
+				UAS_IU_READ_READY;
+			ready->rsvd1 = 0;
+			ready->tag = siu->tag;
+			priv->ready_sent = true;
+			return 4;
+		}
+		if (info->phase != SCSIPH_STATUS)
+			return -EAGAIN;
+		len = min_t(int, xfer->length,
+			    UAS_SENSE_IU_HDR_SIZE + be16_to_cpu(siu->len));
+		memcpy(xfer->buffer, siu, len);
+		info->phase = SCSIPH_START;
+		return len;
+	case SANDBOX_FLASH_EP_UAS_IN:
+		if (info->phase != SCSIPH_DATA || info->write_len)
+			return -EAGAIN;
+		return handle_data_in(priv, xfer->buffer, xfer->length);
+	case SANDBOX_FLASH_EP_UAS_OUT:
+		if (info->phase != SCSIPH_DATA || !info->write_len)
+			return -EAGAIN;
+		return handle_data_out(priv, xfer->buffer, xfer->length);
+	}
+
+	return -EPIPE;
+}
+
 static int sandbox_flash_of_to_plat(struct udevice *dev)
 {
 	struct sandbox_flash_plat *plat = dev_get_plat(dev);
@@ -327,7 +607,12 @@ static int sandbox_flash_bind(struct udevice *dev)
 	fs[2].id = STRINGID_SERIAL;
 	fs[2].s = dev->name;
 
-	return usb_emul_setup_device(dev, plat->flash_strings, flash_desc_list);
+	/* This is needed before of_to_plat(), to set up the descriptors */
+	plat->uas = dev_read_bool(dev, "sandbox,uas");
+
+	return usb_emul_setup_device(dev, plat->flash_strings,
+				     plat->uas ? flash_uas_desc_list :
+				     flash_desc_list);
 }
 
 static int sandbox_flash_probe(struct udevice *dev)
@@ -366,6 +651,7 @@ static int sandbox_flash_remove(struct udevice *dev)
 static const struct dm_usb_ops sandbox_usb_flash_ops = {
 	.control	= sandbox_flash_control,
 	.bulk		= sandbox_flash_bulk,
+	.bulk_submit	= sandbox_flash_bulk_submit,
 };
 
 static const struct udevice_id sandbox_usb_flash_ids[] = {
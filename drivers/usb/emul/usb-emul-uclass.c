@@ -246,6 +246,23 @@ int usb_emul_bulk(struct udevice *emul, struct usb_device *udev,
 	return ops->bulk(emul, udev, pipe, buffer, length);
 }
 
+int usb_emul_xfer(struct udevice *emul, struct usb_device *udev,
+		  struct usb_xfer *xfer)
+{
+	struct dm_usb_ops *ops = usb_get_emul_ops(emul);
+	int ret;
+
+	if (!ops->bulk_submit)
+		return usb_emul_bulk(emul, udev, xfer->pipe, xfer->buffer,
+				     xfer->length);
+	debug("%s: dev=%s\n", __func__, emul->name);
+	ret = device_probe(emul);
+	if (ret)
+		return ret;
+
+	return ops->bulk_submit(emul, udev, xfer);
+}
+
 int usb_emul_int(struct udevice *emul, struct usb_device *udev,
 		  unsigned long pipe, void *buffer, int length, int interval,
 		  bool nonblock)
@@ -17,8 +17,22 @@ struct sandbox_udc {
 
 struct sandbox_udc *this_controller;
 
+/* Number of bulk transfers which can be queued at once */
+#define SANDBOX_USB_MAX_QUEUED	16
+
+/**
+ * struct sandbox_usb_ctrl - private data for the sandbox USB controller
+ *
+ * @rootdev: Address of the root hub
+ * @queue: Bulk transfers queued by sandbox_bulk_submit(), oldest first
+ * @queue_udev: USB device for each entry in @queue
+ * @queued: Number of entries in @queue
+ */
 struct sandbox_usb_ctrl {
 	int rootdev;
+	struct usb_xfer *queue[SANDBOX_USB_MAX_QUEUED];
+	struct usb_device *queue_udev[SANDBOX_USB_MAX_QUEUED];
+	int queued;
 };
 
 static void usbmon_trace(struct udevice *bus, ulong pipe,
@@ -105,6 +119,155 @@ static int sandbox_submit_bulk(struct udevice *bus, struct usb_device *udev,
 	return ret;
 }
 
+static int sandbox_bulk_submit(struct udevice *bus, struct usb_device *udev,
+			       struct usb_xfer *xfer)
+{
+	struct sandbox_usb_ctrl *ctrl = dev_get_priv(bus);
+
+	debug("%s: bus=%s\n", __func__, bus->name);
+	if (ctrl->queued == SANDBOX_USB_MAX_QUEUED)
+		return -EBUSY;
+	ctrl->queue[ctrl->queued] = xfer;
+	ctrl->queue_udev[ctrl->queued] = udev;
+	ctrl->queued++;
+
+	return 0;
+}
+
+/* Checks whether two queued transfers are on the same endpoint */
+static bool sandbox_same_ep(struct sandbox_usb_ctrl *ctrl, int a, int b)
+{
+	struct usb_xfer *xa = ctrl->queue[a], *xb = ctrl->queue[b];
+
+	return ctrl->queue_udev[a] == ctrl->queue_udev[b] &&
+		usb_pipeendpoint(xa->pipe) == usb_pipeendpoint(xb->pipe) &&
+		usb_pipein(xa->pipe) == usb_pipein(xb->pipe);
+}
+
+/* Checks whether two queued transfers are on the same endpoint and stream */
+static bool sandbox_same_queue(struct sandbox_usb_ctrl *ctrl, int a, int b)
+{
+	return sandbox_same_ep(ctrl, a, b) &&
+		ctrl->queue[a]->stream == ctrl->queue[b]->stream;
+}
+
+/*
+ * Gives up the transfers queued after a failed one on the same endpoint, as
+ * the endpoint halts. Returns the number given up.
+ */
+static int sandbox_flush_ep(struct sandbox_usb_ctrl *ctrl, int failed)
+{
+	int i, count = 0;
+
+	for (i = failed + 1; i < ctrl->queued; i++) {
+		struct usb_xfer *xfer = ctrl->queue[i];
+
+		if (xfer->complete || !sandbox_same_ep(ctrl, failed, i))
+			continue;
+		xfer->status = USB_ST_NOT_PROC;
+		xfer->act_len = 0;
+		xfer->complete = true;
+		count++;
+	}
+
+	return count;
+}
+
+/*
+ * Transfers are carried out when polled, so that they finish in order. One
+ * which the emulator holds off stays queued, along with any after it on the
+ * same endpoint and stream. When one fails, the rest on its endpoint are given
+ * up.
+ */
+static int sandbox_bulk_poll(struct udevice *bus, struct usb_device *udev)
+{
+	struct sandbox_usb_ctrl *ctrl = dev_get_priv(bus);
+	struct udevice *emul;
+	int i, j, ret, keep = 0, done = 0;
+
+	for (i = 0; i < ctrl->queued; i++) {
+		struct usb_xfer *xfer = ctrl->queue[i];
+		struct usb_device *qdev = ctrl->queue_udev[i];
+
+		if (xfer->complete)
+			continue;
+		for (j = 0; j < keep; j++) {
+			if (sandbox_same_queue(ctrl, j, i))
+				break;
+		}
+		ret = -EAGAIN;
+		if (j == keep) {
+			ret = usb_emul_find(bus, xfer->pipe, qdev->portnr,
+					    &emul);
+			usbmon_trace(bus, xfer->pipe, NULL, emul);
+			if (!ret)
+				ret = usb_emul_xfer(emul, qdev, xfer);
+		}
+		if (ret == -EAGAIN) {
+			ctrl->queue[keep] = xfer;
+			ctrl->queue_udev[keep] = qdev;
+			keep++;
+			continue;
+		}
+		if (ret < 0) {
+			debug("ret=%d\n", ret);
+			xfer->status = ret == -EPIPE ? USB_ST_STALLED :
+				USB_ST_CRC_ERR;
+			xfer->act_len = 0;
+			done += sandbox_flush_ep(ctrl, i);
+		} else {
+			xfer->status = 0;
+			xfer->act_len = ret;
+		}
+		xfer->complete = true;
+		done++;
+	}
+	ctrl->queued = keep;
+
+	return done;
+}
+
+static int sandbox_bulk_cancel(struct udevice *bus, struct usb_device *udev,
+			       unsigned long pipe)
+{
+	struct sandbox_usb_ctrl *ctrl = dev_get_priv(bus);
+	int i, keep = 0;
+
+	for (i = 0; i < ctrl->queued; i++) {
+		struct usb_xfer *xfer = ctrl->queue[i];
+
+		if (ctrl->queue_udev[i] == udev &&
+		    usb_pipeendpoint(xfer->pipe) == usb_pipeendpoint(pipe) &&
+		    usb_pipein(xfer->pipe) == usb_pipein(pipe)) {
+			xfer->status = USB_ST_NAK_REC;
+			xfer->act_len = 0;
+			xfer->complete = true;
+			continue;
+		}
+		ctrl->queue[keep] = xfer;
+		ctrl->queue_udev[keep] = ctrl->queue_udev[i];
+		keep++;
+	}
+	ctrl->queued = keep;
+
+	return 0;
+}
+
+/* The emulators see the stream of each transfer, so any number will do */
+static int sandbox_alloc_streams(struct udevice *bus, struct usb_device *udev,
+				 int ifnum, const u8 *eps, int num_eps,
+				 int num_streams)
+{
+	int i;
+
+	for (i = 0; i < udev->config.no_of_if; i++) {
+		if (udev->config.if_desc[i].desc.bInterfaceNumber == ifnum)
+			return num_streams;
+	}
+
+	return -ENOENT;
+}
+
 static int sandbox_submit_int(struct udevice *bus, struct usb_device *udev,
 			      unsigned long pipe, void *buffer, int length,
 			      int interval, bool nonblock)
@@ -168,6 +331,10 @@ static int sandbox_usb_probe(struct udevice *dev)
 static const struct dm_usb_ops sandbox_usb_ops = {
 	.control	= sandbox_submit_control,
 	.bulk		= sandbox_submit_bulk,
+	.bulk_submit	= sandbox_bulk_submit,
+	.bulk_poll	= sandbox_bulk_poll,
+	.bulk_cancel	= sandbox_bulk_cancel,
+	.alloc_streams	= sandbox_alloc_streams,
 	.interrupt	= sandbox_submit_int,
 	.alloc_device	= sandbox_alloc_device,
 };
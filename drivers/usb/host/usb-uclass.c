@@ -13,6 +13,7 @@
 #include <errno.h>
 #include <log.h>
 #include <memalign.h>
+#include <time.h>
 #include <usb.h>
 #include <dm/device-internal.h>
 #include <dm/lists.h>
@@ -173,6 +174,83 @@ int usb_get_max_xfer_size(struct usb_device *udev, size_t *size)
 	return ops->get_max_xfer_size(bus, size);
 }
 
+int usb_bulk_submit(struct usb_device *udev, struct usb_xfer *xfer)
+{
+	struct udevice *bus = udev->controller_dev;
+	struct dm_usb_ops *ops = usb_get_ops(bus);
+
+	if (!ops->bulk_submit)
+		return -ENOSYS;
+	if (usb_pipetype(xfer->pipe) != PIPE_BULK)
+		return -EINVAL;
+
+	xfer->act_len = 0;
+	xfer->status = USB_ST_NOT_PROC;
+	xfer->complete = false;
+
+	return ops->bulk_submit(bus, udev, xfer);
+}
+
+int usb_bulk_poll(struct usb_device *udev)
+{
+	struct udevice *bus = udev->controller_dev;
+	struct dm_usb_ops *ops = usb_get_ops(bus);
+
+	if (!ops->bulk_poll)
+		return -ENOSYS;
+
+	return ops->bulk_poll(bus, udev);
+}
+
+int usb_bulk_wait(struct usb_device *udev, struct usb_xfer *xfer, int timeout)
+{
+	struct udevice *bus = udev->controller_dev;
+	struct dm_usb_ops *ops = usb_get_ops(bus);
+	ulong start = get_timer(0);
+	int ret;
+
+	while (!xfer->complete) {
+		ret = usb_bulk_poll(udev);
+		if (ret < 0)
+			return ret;
+		if (!xfer->complete && get_timer(start) > timeout) {
+			debug("%s: timeout on pipe %lx\n", __func__,
+			      xfer->pipe);
+			if (ops->bulk_cancel)
+				ops->bulk_cancel(bus, udev, xfer->pipe);
+			return -ETIMEDOUT;
+		}
+	}
+
+	return xfer->status ? -EIO : xfer->act_len;
+}
+
+int usb_bulk_cancel(struct usb_device *udev, unsigned long pipe)
+{
+	struct udevice *bus = udev->controller_dev;
+	struct dm_usb_ops *ops = usb_get_ops(bus);
+
+	if (!ops->bulk_cancel)
+		return -ENOSYS;
+
+	return ops->bulk_cancel(bus, udev, pipe);
+}
+
+int usb_alloc_streams(struct usb_device *udev, int ifnum, const u8 *eps,
+		      int num_eps, int num_streams)
+{
+	struct udevice *bus = udev->controller_dev;
+	struct dm_usb_ops *ops = usb_get_ops(bus);
+
+	if (!ops->alloc_streams)
+		return -ENOSYS;
+	if (num_eps < 1 || num_streams < 1)
+		return -EINVAL;
+
+	return ops->alloc_streams(bus, udev, ifnum, eps, num_eps,
+				  num_streams);
+}
+
 int usb_stop(void)
 {
 	struct udevice *bus;
@@ -116,6 +116,23 @@ static void xhci_scratchpad_free(struct xhci_ctrl *ctrl)
 	ctrl->scratchpad = NULL;
 }
 
+/**
+ * frees the stream context array and stream rings of an endpoint
+ *
+ * @param virt_ep	endpoint whose streams are to be freed
+ * Return: none
+ */
+void xhci_free_stream_rings(struct xhci_virt_ep *virt_ep)
+{
+	int i;
+
+	for (i = 1; i <= virt_ep->num_streams; i++)
+		xhci_ring_free(virt_ep->stream_rings[i]);
+	free(virt_ep->stream_ctx);
+	virt_ep->stream_ctx = NULL;
+	virt_ep->num_streams = 0;
+}
+
 /**
  * frees the "xhci_container_ctx" pointer passed
  *
@@ -151,9 +168,11 @@ static void xhci_free_virt_devices(struct xhci_ctrl *ctrl)
 
 		ctrl->dcbaa->dev_context_ptrs[slot_id] = 0;
 
-		for (i = 0; i < 31; ++i)
+		for (i = 0; i < 31; ++i) {
 			if (virt_dev->eps[i].ring)
 				xhci_ring_free(virt_dev->eps[i].ring);
+			xhci_free_stream_rings(&virt_dev->eps[i]);
+		}
 
 		if (virt_dev->in_ctx)
 			xhci_free_container_ctx(virt_dev->in_ctx);
@@ -497,6 +516,40 @@ int xhci_alloc_virt_device(struct xhci_ctrl *ctrl, unsigned int slot_id)
 	return 0;
 }
 
+/**
+ * Allocates a stream context array for an endpoint, with a transfer ring for
+ * each stream. Stream ID 0 is reserved, so its context is left empty. Any
+ * streams the endpoint had before are freed.
+ *
+ * @param ctrl		host controller data structure
+ * @param virt_ep	endpoint to set up
+ * @param num_ctxs	size of the stream context array, a power of two
+ * @param num_streams	number of streams, less than num_ctxs
+ * Return: none
+ */
+void xhci_alloc_stream_rings(struct xhci_ctrl *ctrl,
+			     struct xhci_virt_ep *virt_ep, unsigned int num_ctxs,
+			     unsigned int num_streams)
+{
+	struct xhci_ring *ring;
+	u64 trb_64;
+	int i;
+
+	xhci_free_stream_rings(virt_ep);
+	virt_ep->stream_ctx = xhci_malloc(num_ctxs *
+					  sizeof(struct xhci_stream_ctx));
+	for (i = 1; i <= num_streams; i++) {
+		ring = xhci_ring_alloc(ctrl, 1, true);
+		virt_ep->stream_rings[i] = ring;
+		trb_64 = xhci_virt_to_bus(ctrl, ring->enqueue);
+		virt_ep->stream_ctx[i].stream_ring = cpu_to_le64(trb_64 |
+				SCT_FOR_CTX(SCT_PRI_TR) | ring->cycle_state);
+	}
+	xhci_flush_cache((uintptr_t)virt_ep->stream_ctx,
+			 num_ctxs * sizeof(struct xhci_stream_ctx));
+	virt_ep->num_streams = num_streams;
+}
+
 /**
  * Allocates the necessary data structures
  * for XHCI host controller
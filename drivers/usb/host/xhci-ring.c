@@ -268,11 +268,12 @@ static int prepare_ring(struct xhci_ctrl *ctrl, struct xhci_ring *ep_ring,
  * @param ptr		Pointer address to write in the first two fields (opt.)
  * @param slot_id	Slot ID to encode in the flags field (opt.)
  * @param ep_index	Endpoint index to encode in the flags field (opt.)
+ * @param stream	Stream ID to encode in the status field (opt.)
  * @param cmd		Command type to enqueue
  * Return: none
  */
-void xhci_queue_command(struct xhci_ctrl *ctrl, u8 *ptr, u32 slot_id,
-			u32 ep_index, trb_type cmd)
+static void queue_command(struct xhci_ctrl *ctrl, u8 *ptr, u32 slot_id,
+			  u32 ep_index, u32 stream, trb_type cmd)
 {
 	u32 fields[4];
 	u64 val_64 = 0;
@@ -284,7 +285,7 @@ void xhci_queue_command(struct xhci_ctrl *ctrl, u8 *ptr, u32 slot_id,
 
 	fields[0] = lower_32_bits(val_64);
 	fields[1] = upper_32_bits(val_64);
-	fields[2] = 0;
+	fields[2] = STREAM_ID_FOR_TRB(stream);
 	fields[3] = TRB_TYPE(cmd) | SLOT_ID_FOR_TRB(slot_id) |
 		    ctrl->cmd_ring->cycle_state;
 
@@ -301,6 +302,22 @@ void xhci_queue_command(struct xhci_ctrl *ctrl, u8 *ptr, u32 slot_id,
 	xhci_writel(&ctrl->dba->doorbell[0], DB_VALUE_HOST);
 }
 
+/**
+ * Queues a command TRB for which no stream ID is needed
+ *
+ * @param ctrl		Host controller data structure
+ * @param ptr		Pointer address to write in the first two fields (opt.)
+ * @param slot_id	Slot ID to encode in the flags field (opt.)
+ * @param ep_index	Endpoint index to encode in the flags field (opt.)
+ * @param cmd		Command type to enqueue
+ * Return: none
+ */
+void xhci_queue_command(struct xhci_ctrl *ctrl, u8 *ptr, u32 slot_id,
+			u32 ep_index, trb_type cmd)
+{
+	queue_command(ctrl, ptr, slot_id, ep_index, 0, cmd);
+}
+
 /*
  * For xHCI 1.0 host controllers, TD size is the number of max packet sized
  * packets remaining in the TD (*not* including this TRB).
@@ -359,12 +376,13 @@ static u32 xhci_td_remainder(struct xhci_ctrl *ctrl, int transferred,
  *
  * @param udev		pointer to the USB device structure
  * @param ep_index	index of the endpoint
+ * @param stream	stream ID of the ring, 0 if the endpoint has no streams
  * @param start_cycle	cycle flag of the first TRB
  * @param start_trb	pionter to the first TRB
  * Return: none
  */
 static void giveback_first_trb(struct usb_device *udev, int ep_index,
-				int start_cycle,
+				unsigned int stream, int start_cycle,
 				struct xhci_generic_trb *start_trb)
 {
 	struct xhci_ctrl *ctrl = xhci_get_ctrl(udev);
@@ -382,7 +400,7 @@ static void giveback_first_trb(struct usb_device *udev, int ep_index,
 
 	/* Ringing EP doorbell here */
 	xhci_writel(&ctrl->dba->doorbell[udev->slot_id],
-				DB_VALUE(ep_index, 0));
+				DB_VALUE(ep_index, stream));
 
 	return;
 }
@@ -430,10 +448,13 @@ static int event_ready(struct xhci_ctrl *ctrl)
 	return 1;
 }
 
+static int xhci_td_event(struct xhci_ctrl *ctrl, union xhci_trb *event);
+
 /**
- * Waits for a specific type of event and returns it. Discards unexpected
- * events. Caller *must* call xhci_acknowledge_event() after it is finished
- * processing the event, and must not access the returned pointer afterwards.
+ * Waits for a specific type of event and returns it. Events for queued bulk
+ * transfers are handled on the way and other unexpected events are discarded.
+ * Caller *must* call xhci_acknowledge_event() after it is finished processing
+ * the event, and must not access the returned pointer afterwards.
  *
  * @param ctrl		Host controller data structure
  * @param expected	TRB type expected from Event TRB
@@ -451,6 +472,10 @@ union xhci_trb *xhci_wait_for_event(struct xhci_ctrl *ctrl, trb_type expected)
 			continue;
 
 		type = TRB_FIELD_TO_TYPE(le32_to_cpu(event->event_cmd.flags));
+		if (type == TRB_TRANSFER && xhci_td_event(ctrl, event) >= 0) {
+			xhci_acknowledge_event(ctrl);
+			continue;
+		}
 		if (type == expected)
 			return event;
 
@@ -481,14 +506,49 @@ union xhci_trb *xhci_wait_for_event(struct xhci_ctrl *ctrl, trb_type expected)
 	BUG();
 }
 
+/*
+ * Sets the xHC's dequeue pointer for an endpoint to our enqueue pointer,
+ * throwing away all unprocessed TRBs. An endpoint with streams has this done
+ * for each of its stream rings. Returns 0 if OK, -EIO if the xHC refused.
+ */
+static int set_deq(struct usb_device *udev, int ep_index)
+{
+	struct xhci_ctrl *ctrl = xhci_get_ctrl(udev);
+	struct xhci_virt_ep *virt_ep = &ctrl->devs[udev->slot_id]->eps[ep_index];
+	unsigned int stream = virt_ep->num_streams ? 1 : 0;
+	struct xhci_ring *ring;
+	union xhci_trb *event;
+	uintptr_t deq;
+	int comp, slot_id;
+
+	do {
+		ring = stream ? virt_ep->stream_rings[stream] : virt_ep->ring;
+		deq = (uintptr_t)ring->enqueue | ring->cycle_state;
+		if (stream)
+			deq |= SCT_FOR_CTX(SCT_PRI_TR);
+		queue_command(ctrl, (void *)deq, udev->slot_id, ep_index,
+			      stream, TRB_SET_DEQ);
+		event = xhci_wait_for_event(ctrl, TRB_COMPLETION);
+		slot_id = TRB_TO_SLOT_ID(le32_to_cpu(event->event_cmd.flags));
+		comp = GET_COMP_CODE(le32_to_cpu(event->event_cmd.status));
+		xhci_acknowledge_event(ctrl);
+		if (slot_id != udev->slot_id || comp != COMP_SUCCESS) {
+			printf("Set dequeue failed on EP %d stream %u (slot %d, code %d)\n",
+			       ep_index, stream, slot_id, comp);
+			return -EIO;
+		}
+	} while (stream && ++stream <= virt_ep->num_streams);
+
+	return 0;
+}
+
 /*
  * Send reset endpoint command for given endpoint. This recovers from a
  * halted endpoint (e.g. due to a stall error).
  */
-static void reset_ep(struct usb_device *udev, int ep_index)
+static int reset_ep(struct usb_device *udev, int ep_index)
 {
 	struct xhci_ctrl *ctrl = xhci_get_ctrl(udev);
-	struct xhci_ring *ring =  ctrl->devs[udev->slot_id]->eps[ep_index].ring;
 	union xhci_trb *event;
 	u32 field;
 
@@ -499,13 +559,7 @@ static void reset_ep(struct usb_device *udev, int ep_index)
 	BUG_ON(TRB_TO_SLOT_ID(field) != udev->slot_id);
 	xhci_acknowledge_event(ctrl);
 
-	xhci_queue_command(ctrl, (void *)((uintptr_t)ring->enqueue |
-		ring->cycle_state), udev->slot_id, ep_index, TRB_SET_DEQ);
-	event = xhci_wait_for_event(ctrl, TRB_COMPLETION);
-	BUG_ON(TRB_TO_SLOT_ID(le32_to_cpu(event->event_cmd.flags))
-		!= udev->slot_id || GET_COMP_CODE(le32_to_cpu(
-		event->event_cmd.status)) != COMP_SUCCESS);
-	xhci_acknowledge_event(ctrl);
+	return set_deq(udev, ep_index);
 }
 
 /*
@@ -513,81 +567,92 @@ static void reset_ep(struct usb_device *udev, int ep_index)
  * TRBs by setting the xHC's dequeue pointer to our enqueue pointer. The next
  * xhci_bulk_tx/xhci_ctrl_tx on this enpoint will add new transfers there and
  * ring the doorbell, causing this endpoint to start working again.
- * (Careful: This will BUG() when there was no transfer in progress. Shouldn't
- * happen in practice for current uses and is too complicated to fix right now.)
+ * Queued TDs which finish before the endpoint stops are completed as usual.
+ * Returns 0 if OK, -EIO if the endpoint could not be stopped.
  */
-static void abort_td(struct usb_device *udev, int ep_index)
+static int abort_td(struct usb_device *udev, int ep_index)
 {
 	struct xhci_ctrl *ctrl = xhci_get_ctrl(udev);
-	struct xhci_ring *ring =  ctrl->devs[udev->slot_id]->eps[ep_index].ring;
+	struct xhci_virt_ep *virt_ep = &ctrl->devs[udev->slot_id]->eps[ep_index];
 	union xhci_trb *event;
-	u32 field;
+	int comp;
 
 	xhci_queue_command(ctrl, NULL, udev->slot_id, ep_index, TRB_STOP_RING);
 
-	event = xhci_wait_for_event(ctrl, TRB_TRANSFER);
-	field = le32_to_cpu(event->trans_event.flags);
-	BUG_ON(TRB_TO_SLOT_ID(field) != udev->slot_id);
-	BUG_ON(TRB_TO_EP_INDEX(field) != ep_index);
-	BUG_ON(GET_COMP_CODE(le32_to_cpu(event->trans_event.transfer_len
-		!= COMP_STOP)));
-	xhci_acknowledge_event(ctrl);
-
+	/*
+	 * A transfer in progress gives a Stop event, but one which finished
+	 * first gives its usual event and an idle endpoint gives none. All of
+	 * these are dealt with by xhci_td_event() while waiting.
+	 */
 	event = xhci_wait_for_event(ctrl, TRB_COMPLETION);
 	BUG_ON(TRB_TO_SLOT_ID(le32_to_cpu(event->event_cmd.flags))
-		!= udev->slot_id || GET_COMP_CODE(le32_to_cpu(
-		event->event_cmd.status)) != COMP_SUCCESS);
+		!= udev->slot_id);
+	comp = GET_COMP_CODE(le32_to_cpu(event->event_cmd.status));
 	xhci_acknowledge_event(ctrl);
 
-	xhci_queue_command(ctrl, (void *)((uintptr_t)ring->enqueue |
-		ring->cycle_state), udev->slot_id, ep_index, TRB_SET_DEQ);
-	event = xhci_wait_for_event(ctrl, TRB_COMPLETION);
-	BUG_ON(TRB_TO_SLOT_ID(le32_to_cpu(event->event_cmd.flags))
-		!= udev->slot_id || GET_COMP_CODE(le32_to_cpu(
-		event->event_cmd.status)) != COMP_SUCCESS);
-	xhci_acknowledge_event(ctrl);
+	/* A transfer failed meanwhile, so recover_ep() resets the endpoint */
+	if (comp == COMP_CTX_STATE && (virt_ep->ep_state & EP_HALTED))
+		return 0;
+	if (comp != COMP_SUCCESS) {
+		printf("XHCI: could not stop endpoint %d (err=%d)\n", ep_index,
+		       comp);
+		return -EIO;
+	}
+
+	return set_deq(udev, ep_index);
 }
 
-static void record_transfer_result(struct usb_device *udev,
-				   union xhci_trb *event, int length)
+static void get_transfer_result(union xhci_trb *event, int length,
+				int *act_len, unsigned long *status)
 {
-	udev->act_len = min(length, length -
+	*act_len = min(length, length -
 		(int)EVENT_TRB_LEN(le32_to_cpu(event->trans_event.transfer_len)));
 
 	switch (GET_COMP_CODE(le32_to_cpu(event->trans_event.transfer_len))) {
 	case COMP_SUCCESS:
-		BUG_ON(udev->act_len != length);
+		BUG_ON(*act_len != length);
 		/* fallthrough */
 	case COMP_SHORT_TX:
-		udev->status = 0;
+		*status = 0;
 		break;
 	case COMP_STALL:
-		udev->status = USB_ST_STALLED;
+		*status = USB_ST_STALLED;
 		break;
 	case COMP_DB_ERR:
 	case COMP_TRB_ERR:
-		udev->status = USB_ST_BUF_ERR;
+		*status = USB_ST_BUF_ERR;
 		break;
 	case COMP_BABBLE:
-		udev->status = USB_ST_BABBLE_DET;
+		*status = USB_ST_BABBLE_DET;
 		break;
 	default:
-		udev->status = 0x80;  /* USB_ST_TOO_LAZY_TO_MAKE_A_NEW_MACRO */
+		*status = 0x80;  /* USB_ST_TOO_LAZY_TO_MAKE_A_NEW_MACRO */
 	}
 }
 
+static void record_transfer_result(struct usb_device *udev,
+				   union xhci_trb *event, int length)
+{
+	get_transfer_result(event, length, &udev->act_len, &udev->status);
+}
+
 /**** Bulk and Control transfer methods ****/
 /**
- * Queues up the BULK Request
+ * Queues the TRBs for a bulk transfer and passes them to the hardware
  *
  * @param udev		pointer to the USB device structure
  * @param pipe		contains the DIR_IN or OUT , devnum
+ * @param stream	stream ID, 0 if the endpoint has no streams
  * @param length	length of the buffer
  * @param buffer	buffer to be read/written based on the request
- * Return: returns 0 if successful else -1 on failure
+ * @param max_trbs	maximum number of TRBs the transfer may use
+ * @param last_trbp	returns the last TRB of the transfer
+ * Return: number of TRBs used, -EBUSY if more than max_trbs are needed,
+ *	   other -ve on failure
  */
-int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
-			int length, void *buffer)
+static int queue_bulk_td(struct usb_device *udev, unsigned long pipe,
+			 unsigned int stream, int length, void *buffer,
+			 int max_trbs, void **last_trbp)
 {
 	int num_trbs = 0;
 	struct xhci_generic_trb *start_trb;
@@ -601,7 +666,6 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 	struct xhci_virt_device *virt_dev;
 	struct xhci_ep_ctx *ep_ctx;
 	struct xhci_ring *ring;		/* EP transfer ring */
-	union xhci_trb *event;
 
 	int running_total, trb_buff_len;
 	bool more_trbs_coming = true;
@@ -610,13 +674,11 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 	int ret;
 	u32 trb_fields[4];
 	u64 val_64 = xhci_virt_to_bus(ctrl, buffer);
-	void *last_transfer_trb_addr;
-	int available_length;
+	int total_trbs;
 
 	debug("dev=%p, pipe=%lx, buffer=%p, length=%d\n",
 		udev, pipe, buffer, length);
 
-	available_length = length;
 	ep_index = usb_pipe_ep_index(pipe);
 	virt_dev = ctrl->devs[slot_id];
 
@@ -625,7 +687,10 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 
 	ep_ctx = xhci_get_ep_ctx(ctrl, virt_dev->out_ctx, ep_index);
 
-	ring = virt_dev->eps[ep_index].ring;
+	if (stream)
+		ring = virt_dev->eps[ep_index].stream_rings[stream];
+	else
+		ring = virt_dev->eps[ep_index].ring;
 	/*
 	 * How much data is (potentially) left before the 64KB boundary?
 	 * XHCI Spec puts restriction( TABLE 49 and 6.4.1 section of XHCI Spec)
@@ -649,6 +714,9 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 		num_trbs++;
 		running_total += TRB_MAX_BUFF_SIZE;
 	}
+	if (num_trbs > max_trbs)
+		return -EBUSY;
+	total_trbs = num_trbs;
 
 	/*
 	 * XXX: Calling routine prepare_ring() called in place of
@@ -730,7 +798,7 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 		trb_fields[2] = length_field;
 		trb_fields[3] = field | TRB_TYPE(TRB_NORMAL);
 
-		last_transfer_trb_addr = queue_trb(ctrl, ring, (num_trbs > 1), trb_fields);
+		*last_trbp = queue_trb(ctrl, ring, (num_trbs > 1), trb_fields);
 
 		--num_trbs;
 
@@ -741,7 +809,82 @@ int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 		trb_buff_len = min((length - running_total), TRB_MAX_BUFF_SIZE);
 	} while (running_total < length);
 
-	giveback_first_trb(udev, ep_index, start_cycle, start_trb);
+	giveback_first_trb(udev, ep_index, stream, start_cycle, start_trb);
+
+	return total_trbs;
+}
+
+/*
+ * Gets an endpoint going again after a queued transfer on it failed and the
+ * rest were given up. A halted endpoint is reset, which also drops their TRBs.
+ * If that fails, it is tried again before the next transfer.
+ */
+static int recover_ep(struct usb_device *udev, int ep_index)
+{
+	struct xhci_ctrl *ctrl = xhci_get_ctrl(udev);
+	struct xhci_virt_device *virt_dev = ctrl->devs[udev->slot_id];
+	struct xhci_ep_ctx *ep_ctx;
+	int ret;
+
+	xhci_inval_cache((uintptr_t)virt_dev->out_ctx->bytes,
+			 virt_dev->out_ctx->size);
+	ep_ctx = xhci_get_ep_ctx(ctrl, virt_dev->out_ctx, ep_index);
+	if ((le32_to_cpu(ep_ctx->ep_info) & EP_STATE_MASK) == EP_STATE_HALTED) {
+		ret = reset_ep(udev, ep_index);
+		if (ret)
+			return ret;
+	}
+	virt_dev->eps[ep_index].ep_state &= ~EP_HALTED;
+
+	return 0;
+}
+
+/**
+ * Queues up the BULK Request
+ *
+ * @param udev		pointer to the USB device structure
+ * @param pipe		contains the DIR_IN or OUT , devnum
+ * @param length	length of the buffer
+ * @param buffer	buffer to be read/written based on the request
+ * Return: returns 0 if successful else -1 on failure
+ */
+int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
+			int length, void *buffer)
+{
+	struct xhci_ctrl *ctrl = xhci_get_ctrl(udev);
+	int slot_id = udev->slot_id;
+	int ep_index = usb_pipe_ep_index(pipe);
+	struct xhci_virt_ep *virt_ep = &ctrl->devs[slot_id]->eps[ep_index];
+	union xhci_trb *event;
+	void *last_transfer_trb_addr;
+	int available_length = length;
+	unsigned long ts;
+	u32 field;
+	int ret;
+
+	/* Transfers on an endpoint with streams must be queued */
+	if (virt_ep->num_streams)
+		return -EINVAL;
+
+	/* Let transfers queued on this endpoint finish first */
+	ts = get_timer(0);
+	while (virt_ep->num_tds) {
+		if (get_timer(ts) > XHCI_TIMEOUT) {
+			xhci_bulk_cancel(udev, pipe);
+			break;
+		}
+		xhci_bulk_poll(ctrl);
+	}
+	if (virt_ep->ep_state & EP_HALTED) {
+		ret = recover_ep(udev, ep_index);
+		if (ret)
+			return ret;
+	}
+
+	ret = queue_bulk_td(udev, pipe, 0, length, buffer, INT_MAX,
+			    &last_transfer_trb_addr);
+	if (ret < 0)
+		return ret;
 
 again:
 	event = xhci_wait_for_event(ctrl, TRB_TRANSFER);
@@ -772,6 +915,249 @@ again:
 	return (udev->status != USB_ST_NOT_PROC) ? 0 : -1;
 }
 
+/* Completes the transfers still queued on an endpoint, with an error */
+static void flush_tds(struct xhci_virt_ep *virt_ep, unsigned long status)
+{
+	struct xhci_td *td;
+	int i;
+
+	for (i = 0; i < XHCI_MAX_QUEUED_TDS; i++) {
+		td = &virt_ep->tds[i];
+		if (!td->xfer)
+			continue;
+		td->xfer->act_len = 0;
+		td->xfer->status = status;
+		td->xfer->complete = true;
+		td->xfer = NULL;
+	}
+	virt_ep->td_first = 0;
+	virt_ep->num_tds = 0;
+	virt_ep->queued_trbs = 0;
+}
+
+/* Checks whether a TRB, given by its bus address, is on a ring */
+static bool ring_has_trb(struct xhci_ctrl *ctrl, struct xhci_ring *ring,
+			 u64 addr)
+{
+	struct xhci_segment *seg = ring->first_seg;
+	u64 start;
+
+	do {
+		start = xhci_virt_to_bus(ctrl, seg->trbs);
+		if (addr >= start && addr < start + SEGMENT_SIZE)
+			return true;
+		seg = seg->next;
+	} while (seg != ring->first_seg);
+
+	return false;
+}
+
+/*
+ * Finds the queued transfer which a transfer event is for. Without streams it
+ * is the oldest one. With streams, each transfer is on its own stream ring.
+ */
+static struct xhci_td *find_td(struct xhci_ctrl *ctrl,
+			       struct xhci_virt_ep *virt_ep, u64 addr)
+{
+	int i;
+
+	if (!virt_ep->num_tds)
+		return NULL;
+	if (!virt_ep->num_streams)
+		return &virt_ep->tds[virt_ep->td_first];
+
+	for (i = 1; i <= virt_ep->num_streams; i++) {
+		if (virt_ep->tds[i - 1].xfer &&
+		    ring_has_trb(ctrl, virt_ep->stream_rings[i], addr))
+			return &virt_ep->tds[i - 1];
+	}
+
+	return NULL;
+}
+
+/**
+ * Hands a transfer event to the queued bulk transfer it belongs to
+ *
+ * Transfers on an endpoint (or stream) finish in order. When a transfer fails
+ * the endpoint stops, so the rest are given up.
+ *
+ * @param ctrl	Host controller data structure
+ * @param event	Transfer event
+ * Return: 1 if a queued transfer finished, 0 if the event was for one which
+ *	   is still going, -ENOENT if it was not for a queued transfer
+ */
+static int xhci_td_event(struct xhci_ctrl *ctrl, union xhci_trb *event)
+{
+	u32 field = le32_to_cpu(event->trans_event.flags);
+	u32 len_field = le32_to_cpu(event->trans_event.transfer_len);
+	u64 addr = le64_to_cpu(event->trans_event.buffer);
+	int comp = GET_COMP_CODE(len_field);
+	struct xhci_virt_device *virt_dev;
+	struct xhci_virt_ep *virt_ep;
+	struct usb_xfer *xfer;
+	struct xhci_td *td;
+
+	virt_dev = ctrl->devs[TRB_TO_SLOT_ID(field)];
+	if (!virt_dev)
+		return -ENOENT;
+	virt_ep = &virt_dev->eps[TRB_TO_EP_INDEX(field)];
+
+	/* Stop events come from abort_td(), which gives up the TDs itself */
+	if (comp == COMP_STOP || comp == COMP_STOP_INVAL)
+		return 0;
+
+	td = find_td(ctrl, virt_ep, addr);
+	if (!td)
+		return -ENOENT;
+	xfer = td->xfer;
+	if (comp == COMP_SHORT_TX &&
+	    (uintptr_t)addr != (uintptr_t)xhci_virt_to_bus(ctrl, td->last_trb)) {
+		/* The last TRB gives another event when the TD is done */
+		td->avail -= (int)EVENT_TRB_LEN(len_field);
+		return 0;
+	}
+
+	get_transfer_result(event, td->avail, &xfer->act_len, &xfer->status);
+	if (usb_pipein(xfer->pipe))
+		xhci_inval_cache((uintptr_t)xfer->buffer, xfer->length);
+	xfer->complete = true;
+	td->xfer = NULL;
+	if (!virt_ep->num_streams)
+		virt_ep->td_first = (virt_ep->td_first + 1) %
+			XHCI_MAX_QUEUED_TDS;
+	virt_ep->num_tds--;
+	virt_ep->queued_trbs -= td->num_trbs;
+
+	if (xfer->status) {
+		flush_tds(virt_ep, USB_ST_NOT_PROC);
+		virt_ep->ep_state |= EP_HALTED;
+	}
+
+	return 1;
+}
+
+/**
+ * Queues a BULK transfer without waiting for it to finish
+ *
+ * @param udev	pointer to the USB device structure
+ * @param xfer	transfer to queue
+ * Return: 0 if queued, -EBUSY if the endpoint has no room for it yet,
+ *	   other -ve on failure
+ */
+int xhci_bulk_submit(struct usb_device *udev, struct usb_xfer *xfer)
+{
+	struct xhci_ctrl *ctrl = xhci_get_ctrl(udev);
+	int ep_index = usb_pipe_ep_index(xfer->pipe);
+	struct xhci_virt_ep *virt_ep;
+	struct xhci_td *td;
+	int ret;
+
+	debug("dev=%p, pipe=%lx, buffer=%p, length=%d\n", udev, xfer->pipe,
+	      xfer->buffer, xfer->length);
+
+	virt_ep = &ctrl->devs[udev->slot_id]->eps[ep_index];
+	if (!virt_ep->ring)
+		return -ENOENT;
+	if (virt_ep->ep_state & EP_HALTED) {
+		ret = recover_ep(udev, ep_index);
+		if (ret)
+			return ret;
+	}
+
+	if (virt_ep->num_streams) {
+		/* Each stream has a ring to itself, for one transfer */
+		if (!xfer->stream || xfer->stream > virt_ep->num_streams)
+			return -EINVAL;
+		td = &virt_ep->tds[xfer->stream - 1];
+		if (td->xfer)
+			return -EBUSY;
+		ret = queue_bulk_td(udev, xfer->pipe, xfer->stream,
+				    xfer->length, xfer->buffer,
+				    XHCI_MAX_RING_TRBS, &td->last_trb);
+		if (ret == -EBUSY)
+			return -EINVAL;
+	} else {
+		if (xfer->stream)
+			return -EINVAL;
+		if (virt_ep->num_tds == XHCI_MAX_QUEUED_TDS)
+			return -EBUSY;
+		td = &virt_ep->tds[(virt_ep->td_first + virt_ep->num_tds) %
+				   XHCI_MAX_QUEUED_TDS];
+		ret = queue_bulk_td(udev, xfer->pipe, 0, xfer->length,
+				    xfer->buffer,
+				    XHCI_MAX_RING_TRBS - virt_ep->queued_trbs,
+				    &td->last_trb);
+	}
+	if (ret == -EBUSY && !virt_ep->num_tds)
+		return -EINVAL;
+	if (ret < 0)
+		return ret;
+
+	td->xfer = xfer;
+	td->num_trbs = ret;
+	td->avail = xfer->length;
+	virt_ep->queued_trbs += ret;
+	virt_ep->num_tds++;
+
+	return 0;
+}
+
+/**
+ * Handles the events for queued BULK transfers which have finished
+ *
+ * @param ctrl	Host controller data structure
+ * Return: number of transfers which finished
+ */
+int xhci_bulk_poll(struct xhci_ctrl *ctrl)
+{
+	union xhci_trb *event;
+	trb_type type;
+	int done = 0;
+	int ret;
+
+	while (event_ready(ctrl)) {
+		event = ctrl->event_ring->dequeue;
+		type = TRB_FIELD_TO_TYPE(le32_to_cpu(event->event_cmd.flags));
+		ret = type == TRB_TRANSFER ? xhci_td_event(ctrl, event) :
+			-ENOENT;
+		if (ret > 0)
+			done++;
+		else if (ret < 0 && type != TRB_PORT_STATUS)
+			printf("Unexpected XHCI event TRB, skipping... "
+				"(%08x %08x %08x %08x)\n",
+				le32_to_cpu(event->generic.field[0]),
+				le32_to_cpu(event->generic.field[1]),
+				le32_to_cpu(event->generic.field[2]),
+				le32_to_cpu(event->generic.field[3]));
+		xhci_acknowledge_event(ctrl);
+	}
+
+	return done;
+}
+
+/**
+ * Stops an endpoint and gives up the BULK transfers queued on it
+ *
+ * @param udev	pointer to the USB device structure
+ * @param pipe	pipe for the endpoint
+ * Return: 0 if OK, -ve if the endpoint could not be stopped cleanly
+ */
+int xhci_bulk_cancel(struct usb_device *udev, unsigned long pipe)
+{
+	struct xhci_ctrl *ctrl = xhci_get_ctrl(udev);
+	int ep_index = usb_pipe_ep_index(pipe);
+	struct xhci_virt_ep *virt_ep = &ctrl->devs[udev->slot_id]->eps[ep_index];
+	int ret;
+
+	if (!virt_ep->num_tds)
+		return 0;
+
+	ret = abort_td(udev, ep_index);
+	flush_tds(virt_ep, USB_ST_NAK_REC);
+
+	return ret;
+}
+
 /**
  * Queues up the Control Transfer Request
  *
@@ -943,7 +1329,7 @@ int xhci_ctrl_tx(struct usb_device *udev, unsigned long pipe,
 
 	queue_trb(ctrl, ep_ring, false, trb_fields);
 
-	giveback_first_trb(udev, ep_index, start_cycle, start_trb);
+	giveback_first_trb(udev, ep_index, 0, start_cycle, start_trb);
 
 	event = xhci_wait_for_event(ctrl, TRB_TRANSFER);
 	if (!event)
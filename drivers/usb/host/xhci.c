@@ -36,6 +36,7 @@
 #include <linux/delay.h>
 #include <linux/errno.h>
 #include <linux/iopoll.h>
+#include <linux/log2.h>
 
 static struct descriptor {
 	struct usb_hub_descriptor hub;
@@ -443,6 +444,7 @@ static int xhci_configure_endpoints(struct usb_device *udev, bool ctx_change)
 	struct xhci_virt_device *virt_dev;
 	struct xhci_ctrl *ctrl = xhci_get_ctrl(udev);
 	union xhci_trb *event;
+	int comp;
 
 	virt_dev = ctrl->devs[udev->slot_id];
 	in_ctx = virt_dev->in_ctx;
@@ -453,8 +455,10 @@ static int xhci_configure_endpoints(struct usb_device *udev, bool ctx_change)
 	event = xhci_wait_for_event(ctrl, TRB_COMPLETION);
 	BUG_ON(TRB_TO_SLOT_ID(le32_to_cpu(event->event_cmd.flags))
 		!= udev->slot_id);
+	comp = GET_COMP_CODE(le32_to_cpu(event->event_cmd.status));
+	xhci_acknowledge_event(ctrl);
 
-	switch (GET_COMP_CODE(le32_to_cpu(event->event_cmd.status))) {
+	switch (comp) {
 	case COMP_SUCCESS:
 		debug("Successful %s command\n",
 			ctx_change ? "Evaluate Context" : "Configure Endpoint");
@@ -462,12 +466,10 @@ static int xhci_configure_endpoints(struct usb_device *udev, bool ctx_change)
 	default:
 		printf("ERROR: %s command returned completion code %d.\n",
 			ctx_change ? "Evaluate Context" : "Configure Endpoint",
-			GET_COMP_CODE(le32_to_cpu(event->event_cmd.status)));
+			comp);
 		return -EINVAL;
 	}
 
-	xhci_acknowledge_event(ctrl);
-
 	return 0;
 }
 
@@ -1288,6 +1290,125 @@ static int xhci_submit_bulk_msg(struct udevice *dev, struct usb_device *udev,
 	return _xhci_submit_bulk_msg(udev, pipe, buffer, length);
 }
 
+static int xhci_submit_bulk_queue(struct udevice *dev,
+				  struct usb_device *udev,
+				  struct usb_xfer *xfer)
+{
+	debug("%s: dev='%s', udev=%p\n", __func__, dev->name, udev);
+	return xhci_bulk_submit(udev, xfer);
+}
+
+static int xhci_poll_bulk_queue(struct udevice *dev, struct usb_device *udev)
+{
+	return xhci_bulk_poll(dev_get_priv(dev));
+}
+
+static int xhci_cancel_bulk_queue(struct udevice *dev,
+				  struct usb_device *udev, unsigned long pipe)
+{
+	debug("%s: dev='%s', udev=%p\n", __func__, dev->name, udev);
+	return xhci_bulk_cancel(udev, pipe);
+}
+
+/*
+ * Gives some bulk endpoints a stream context array, with a ring per stream,
+ * and passes them to the xHC again with a Configure Endpoint command. The
+ * number of streams is limited by the endpoints' companion descriptors and by
+ * the xHC.
+ */
+static int xhci_alloc_streams(struct udevice *dev, struct usb_device *udev,
+			      int ifnum, const u8 *eps, int num_eps,
+			      int num_streams)
+{
+	struct xhci_ctrl *ctrl = dev_get_priv(dev);
+	struct usb_interface *ifdesc = NULL;
+	int ep_index[USB_MAXENDPOINTS];
+	struct xhci_input_control_ctx *ctrl_ctx;
+	struct xhci_virt_device *virt_dev;
+	struct xhci_container_ctx *out_ctx;
+	struct xhci_container_ctx *in_ctx;
+	struct xhci_virt_ep *virt_ep;
+	struct xhci_ep_ctx *ep_ctx;
+	unsigned int num_ctxs, max_psa;
+	u32 ep_flags = 0;
+	int i, j, ret;
+
+	debug("%s: dev='%s', udev=%p\n", __func__, dev->name, udev);
+	max_psa = HCC_MAX_PSA(xhci_readl(&ctrl->hccr->cr_hccparams));
+	if (udev->speed < USB_SPEED_SUPER || max_psa < 4)
+		return -ENOSYS;
+	if (num_eps > USB_MAXENDPOINTS)
+		return -EINVAL;
+	for (i = 0; i < udev->config.no_of_if; i++) {
+		if (udev->config.if_desc[i].desc.bInterfaceNumber == ifnum) {
+			ifdesc = &udev->config.if_desc[i];
+			break;
+		}
+	}
+	if (!ifdesc)
+		return -ENOENT;
+
+	virt_dev = ctrl->devs[udev->slot_id];
+	num_streams = min(num_streams, XHCI_MAX_STREAMS);
+	for (i = 0; i < num_eps; i++) {
+		/* The last descriptor for an address is the one in use */
+		for (j = ifdesc->no_of_ep - 1; j >= 0; j--) {
+			if (ifdesc->ep_desc[j].bEndpointAddress == eps[i])
+				break;
+		}
+		if (j < 0 || !usb_endpoint_xfer_bulk(&ifdesc->ep_desc[j]))
+			return -EINVAL;
+		num_streams = min(num_streams, usb_ss_max_streams(
+					&ifdesc->ss_ep_comp_desc[j]));
+		ep_index[i] = xhci_get_ep_index(&ifdesc->ep_desc[j]);
+		if (virt_dev->eps[ep_index[i]].num_tds)
+			return -EBUSY;
+		ep_flags |= 1 << (ep_index[i] + 1);
+	}
+	if (!num_streams)
+		return -EINVAL;
+
+	/* Stream ID 0 is reserved, so there is one more context */
+	num_ctxs = min_t(unsigned int, roundup_pow_of_two(num_streams + 1),
+			 max_psa);
+	num_streams = min_t(int, num_streams, num_ctxs - 1);
+
+	out_ctx = virt_dev->out_ctx;
+	in_ctx = virt_dev->in_ctx;
+	xhci_inval_cache((uintptr_t)out_ctx->bytes, out_ctx->size);
+
+	/* Drop and add the endpoints again, to change their dequeue pointers */
+	ctrl_ctx = xhci_get_input_control_ctx(in_ctx);
+	ctrl_ctx->add_flags = cpu_to_le32(ep_flags);
+	ctrl_ctx->drop_flags = cpu_to_le32(ep_flags);
+	xhci_slot_copy(ctrl, in_ctx, out_ctx);
+
+	for (i = 0; i < num_eps; i++) {
+		virt_ep = &virt_dev->eps[ep_index[i]];
+		xhci_alloc_stream_rings(ctrl, virt_ep, num_ctxs, num_streams);
+		xhci_endpoint_copy(ctrl, in_ctx, out_ctx, ep_index[i]);
+		ep_ctx = xhci_get_ep_ctx(ctrl, in_ctx, ep_index[i]);
+		ep_ctx->ep_info &= cpu_to_le32(~EP_MAXPSTREAMS_MASK);
+		ep_ctx->ep_info |= cpu_to_le32(EP_MAXPSTREAMS(ilog2(num_ctxs) - 1) |
+					       EP_HAS_LSA);
+		ep_ctx->deq = cpu_to_le64(xhci_virt_to_bus(ctrl,
+							   virt_ep->stream_ctx));
+	}
+
+	ret = xhci_configure_endpoints(udev, false);
+	for (i = 0; i < num_eps; i++) {
+		virt_ep = &virt_dev->eps[ep_index[i]];
+		if (ret)
+			xhci_free_stream_rings(virt_ep);
+		else
+			virt_ep->ep_state |= EP_HAS_STREAMS;
+	}
+	if (ret)
+		return ret;
+
+	return num_streams;
+}
+
 static int xhci_submit_int_msg(struct udevice *dev, struct usb_device *udev,
 			       unsigned long pipe, void *buffer, int length,
 			       int interval, bool nonblock)
@@ -1378,7 +1499,7 @@ static int xhci_get_max_xfer_size(struct udevice *dev, size_t *size)
 	 * buffers referenced by transfer TRBs shall not span 64KB boundaries.
 	 * Hence the maximum number of TRBs we can use in one transfer is 62.
 	 */
-	*size = (TRBS_PER_SEGMENT - 2) * TRB_MAX_BUFF_SIZE;
+	*size = XHCI_MAX_RING_TRBS * TRB_MAX_BUFF_SIZE;
 
 	return 0;
 }
@@ -1433,6 +1554,10 @@ int xhci_deregister(struct udevice *dev)
 struct dm_usb_ops xhci_usb_ops = {
 	.control = xhci_submit_control_msg,
 	.bulk = xhci_submit_bulk_msg,
+	.bulk_submit = xhci_submit_bulk_queue,
+	.bulk_poll = xhci_poll_bulk_queue,
+	.bulk_cancel = xhci_cancel_bulk_queue,
+	.alloc_streams = xhci_alloc_streams,
 	.interrupt = xhci_submit_int_msg,
 	.alloc_device = xhci_alloc_device,
 	.update_hub_device = xhci_update_hub_device,
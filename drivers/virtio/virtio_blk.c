@@ -7,66 +7,305 @@
 #include <common.h>
 #include <blk.h>
 #include <dm.h>
+#include <malloc.h>
 #include <part.h>
+#include <time.h>
 #include <virtio_types.h>
 #include <virtio.h>
 #include <virtio_ring.h>
 #include "virtio_blk.h"
 
+#define VIRTIO_BLK_SECTOR_SIZE	512
+/* Give up if the device completes nothing for this long */
+#define VIRTIO_BLK_TIMEOUT_MS	10000
+
+/**
+ * struct virtio_blk_slot - a virtio-blk request which may be in the ring
+ *
+ * @out_hdr:	Request header, read by the device
+ * @status:	Request status, written by the device
+ * @req:	Block request this is part of, or NULL if the slot is free
+ * @cancelled:	true if @req was cancelled; the slot stays in use until the
+ *		device completes it, but @req is not touched again
+ */
+struct virtio_blk_slot {
+	struct virtio_blk_outhdr out_hdr;
+	u8 status;
+	struct blk_req *req;
+	bool cancelled;
+};
+
+/**
+ * struct virtio_blk_priv - private data for a virtio-blk device
+ *
+ * @vq:		Request virtqueue
+ * @seg_max:	Maximum number of data segments in a request
+ * @size_max:	Maximum size of a data segment in bytes
+ * @max_blocks:	Maximum number of sectors in a request
+ * @sg:		Scatter-gather list used to build a request
+ * @sgs:	Pointers to the entries of @sg, for virtqueue_add()
+ * @slots:	Request slots, one per ring entry
+ * @nr_slots:	Number of entries in @slots
+ * @slots_busy:	Number of @slots in use
+ */
 struct virtio_blk_priv {
 	struct virtqueue *vq;
+	u32 seg_max;
+	u32 size_max;
+	lbaint_t max_blocks;
+	struct virtio_sg *sg;
+	struct virtio_sg **sgs;
+	struct virtio_blk_slot *slots;
+	unsigned int nr_slots;
+	unsigned int slots_busy;
 };
 
-static ulong virtio_blk_do_req(struct udevice *dev, u64 sector,
-			       lbaint_t blkcnt, void *buffer, u32 type)
+static const u32 feature[] = {
+	VIRTIO_BLK_F_SIZE_MAX,
+	VIRTIO_BLK_F_SEG_MAX,
+};
+
+static bool virtio_blk_req_in_flight(struct virtio_blk_priv *priv,
+				     struct blk_req *req)
+{
+	unsigned int i;
+
+	for (i = 0; i < priv->nr_slots; i++)
+		if (priv->slots[i].req == req && !priv->slots[i].cancelled)
+			return true;
+
+	return false;
+}
+
+/*
+ * A request is complete once none of its parts are left in a slot, and
+ * all of them have been added (req->priv is set while adding)
+ */
+static void virtio_blk_req_check_done(struct virtio_blk_priv *priv,
+				      struct blk_req *req)
+{
+	if (req->priv || virtio_blk_req_in_flight(priv, req))
+		return;
+
+	if (!req->result)
+		req->result = req->blkcnt;
+	req->complete = true;
+}
+
+static int virtio_blk_poll(struct udevice *dev)
 {
 	struct virtio_blk_priv *priv = dev_get_priv(dev);
-	unsigned int num_out = 0, num_in = 0;
-	struct virtio_sg *sgs[3];
-	u8 status;
-	int ret;
+	struct virtio_blk_outhdr *out_hdr;
+	struct virtio_blk_slot *slot;
+	struct blk_req *req;
+	int count = 0;
 
-	struct virtio_blk_outhdr out_hdr = {
-		.type = cpu_to_virtio32(dev, type),
-		.sector = cpu_to_virtio64(dev, sector),
-	};
-	struct virtio_sg hdr_sg = { &out_hdr, sizeof(out_hdr) };
-	struct virtio_sg data_sg = { buffer, blkcnt * 512 };
-	struct virtio_sg status_sg = { &status, sizeof(status) };
+	while ((out_hdr = virtqueue_get_buf(priv->vq, NULL))) {
+		slot = container_of(out_hdr, struct virtio_blk_slot, out_hdr);
+		req = slot->req;
+		slot->req = NULL;
+		priv->slots_busy--;
+		count++;
+		if (slot->cancelled) {
+			slot->cancelled = false;
+			continue;
+		}
+		if (slot->status != VIRTIO_BLK_S_OK && !req->result)
+			req->result = -EIO;
+		virtio_blk_req_check_done(priv, req);
+	}
 
-	sgs[num_out++] = &hdr_sg;
+	return count;
+}
 
-	if (type & VIRTIO_BLK_T_OUT)
-		sgs[num_out++] = &data_sg;
-	else
-		sgs[num_out + num_in++] = &data_sg;
+/**
+ * virtio_blk_wait_progress() - kick the device and reap completed requests
+ *
+ * @dev:	virtio-blk device
+ * @start:	Time of the last progress, updated if anything completed
+ * Return: 0 if OK, -ETIMEDOUT if nothing has completed for too long
+ */
+static int virtio_blk_wait_progress(struct udevice *dev, ulong *start)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
 
-	sgs[num_out + num_in++] = &status_sg;
+	virtqueue_kick(priv->vq);
+	if (virtio_blk_poll(dev))
+		*start = get_timer(0);
+	else if (get_timer(*start) > VIRTIO_BLK_TIMEOUT_MS)
+		return -ETIMEDOUT;
 
-	ret = virtqueue_add(priv->vq, sgs, num_out, num_in);
-	if (ret)
+	return 0;
+}
+
+static int virtio_blk_cancel(struct udevice *dev, struct blk_req *req)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+	unsigned int i;
+
+	/* virtio-blk cannot abort a request, so just forget it */
+	for (i = 0; i < priv->nr_slots; i++)
+		if (priv->slots[i].req == req)
+			priv->slots[i].cancelled = true;
+
+	return 0;
+}
+
+static struct virtio_blk_slot *virtio_blk_get_slot(struct udevice *dev)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+	ulong start = get_timer(0);
+	unsigned int i;
+
+	for (;;) {
+		for (i = 0; i < priv->nr_slots; i++)
+			if (!priv->slots[i].req)
+				return &priv->slots[i];
+
+		/* Make sure the device sees what is queued, then reap it */
+		if (virtio_blk_wait_progress(dev, &start))
+			return NULL;
+	}
+}
+
+/**
+ * virtio_blk_add_req() - add one request to the ring, without kicking it
+ *
+ * The data buffer is split into segments of no more than size_max bytes.
+ *
+ * @dev:	virtio-blk device
+ * @req:	Block request this is part of
+ * @sector:	Start sector
+ * @blkcnt:	Number of sectors, no more than priv->max_blocks
+ * @buffer:	Data buffer
+ * Return: 0 if OK, -ve on error
+ */
+static int virtio_blk_add_req(struct udevice *dev, struct blk_req *req,
+			      u64 sector, lbaint_t blkcnt, void *buffer)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+	bool write = req->op == BLK_REQ_WRITE;
+	size_t len = blkcnt * VIRTIO_BLK_SECTOR_SIZE;
+	struct virtio_blk_slot *slot;
+	unsigned int n = 0, num_out;
+	ulong start;
+	size_t seg;
+	int ret;
+
+	slot = virtio_blk_get_slot(dev);
+	if (!slot)
+		return -ETIMEDOUT;
+	slot->out_hdr.type = cpu_to_virtio32(dev, write ? VIRTIO_BLK_T_OUT :
+					     VIRTIO_BLK_T_IN);
+	slot->out_hdr.ioprio = 0;
+	slot->out_hdr.sector = cpu_to_virtio64(dev, sector);
+	slot->req = req;
+
+	priv->sg[n].addr = &slot->out_hdr;
+	priv->sg[n++].length = sizeof(slot->out_hdr);
+	while (len) {
+		seg = min_t(size_t, len, priv->size_max);
+		priv->sg[n].addr = buffer;
+		priv->sg[n++].length = seg;
+		buffer += seg;
+		len -= seg;
+	}
+	num_out = write ? n : 1;
+	priv->sg[n].addr = &slot->status;
+	priv->sg[n++].length = sizeof(slot->status);
+
+	start = get_timer(0);
+	for (;;) {
+		ret = virtqueue_add(priv->vq, priv->sgs, num_out, n - num_out);
+		if (ret != -ENOSPC)
+			break;
+		/* The ring is full of earlier requests; wait for some */
+		ret = virtio_blk_wait_progress(dev, &start);
+		if (ret)
+			break;
+	}
+	if (ret) {
+		slot->req = NULL;
 		return ret;
+	}
+	priv->slots_busy++;
+
+	return 0;
+}
+
+static int virtio_blk_submit(struct udevice *dev, struct blk_req *req)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+	lbaint_t blkcnt = req->blkcnt;
+	void *buffer = req->buffer;
+	u64 sector = req->start;
+	lbaint_t cnt;
+	int ret;
+
+	/*
+	 * Requests which fit are queued whole. Larger ones are added as
+	 * slots become free, once the queue is idle.
+	 */
+	if (DIV_ROUND_UP(blkcnt, priv->max_blocks) >
+	    priv->nr_slots - priv->slots_busy && priv->slots_busy)
+		return -EBUSY;
 
+	req->priv = req;
+	while (blkcnt) {
+		cnt = min(blkcnt, priv->max_blocks);
+		ret = virtio_blk_add_req(dev, req, sector, cnt, buffer);
+		if (ret) {
+			req->result = ret;
+			break;
+		}
+		blkcnt -= cnt;
+		sector += cnt;
+		buffer += cnt * VIRTIO_BLK_SECTOR_SIZE;
+	}
+	req->priv = NULL;
 	virtqueue_kick(priv->vq);
+	virtio_blk_req_check_done(priv, req);
 
-	while (!virtqueue_get_buf(priv->vq, NULL))
-		;
+	return 0;
+}
+
+static ulong virtio_blk_rw(struct udevice *dev, lbaint_t start,
+			   lbaint_t blkcnt, void *buffer, enum blk_req_op op)
+{
+	struct blk_req req = {
+		.op	= op,
+		.start	= start,
+		.blkcnt	= blkcnt,
+		.buffer	= buffer,
+	};
+	ulong start_time = get_timer(0);
+	int ret;
+
+	ret = virtio_blk_submit(dev, &req);
+	while (ret == -EBUSY || (!ret && !req.complete)) {
+		if (virtio_blk_wait_progress(dev, &start_time)) {
+			/* the request is on our stack, so drop it */
+			virtio_blk_cancel(dev, &req);
+			return -ETIMEDOUT;
+		}
+		if (ret == -EBUSY)
+			ret = virtio_blk_submit(dev, &req);
+	}
 
-	return status == VIRTIO_BLK_S_OK ? blkcnt : -EIO;
+	return ret ? ret : req.result;
 }
 
 static ulong virtio_blk_read(struct udevice *dev, lbaint_t start,
 			     lbaint_t blkcnt, void *buffer)
 {
-	return virtio_blk_do_req(dev, start, blkcnt, buffer,
-				 VIRTIO_BLK_T_IN);
+	return virtio_blk_rw(dev, start, blkcnt, buffer, BLK_REQ_READ);
 }
 
 static ulong virtio_blk_write(struct udevice *dev, lbaint_t start,
 			      lbaint_t blkcnt, const void *buffer)
 {
-	return virtio_blk_do_req(dev, start, blkcnt, (void *)buffer,
-				 VIRTIO_BLK_T_OUT);
+	return virtio_blk_rw(dev, start, blkcnt, (void *)buffer,
+			     BLK_REQ_WRITE);
 }
 
 static int virtio_blk_bind(struct udevice *dev)
@@ -98,7 +337,8 @@ static int virtio_blk_bind(struct udevice *dev)
 	desc->bdev = dev;
 
 	/* Indicate what driver features we support */
-	virtio_driver_features_init(uc_priv, NULL, 0, NULL, 0);
+	virtio_driver_features_init(uc_priv, feature, ARRAY_SIZE(feature),
+				    NULL, 0);
 
 	return 0;
 }
@@ -107,6 +347,7 @@ static int virtio_blk_probe(struct udevice *dev)
 {
 	struct virtio_blk_priv *priv = dev_get_priv(dev);
 	struct blk_desc *desc = dev_get_uclass_plat(dev);
+	unsigned int i;
 	u64 cap;
 	int ret;
 
@@ -114,17 +355,72 @@ static int virtio_blk_probe(struct udevice *dev)
 	if (ret)
 		return ret;
 
-	desc->blksz = 512;
+	desc->blksz = VIRTIO_BLK_SECTOR_SIZE;
 	desc->log2blksz = 9;
 	virtio_cread(dev, struct virtio_blk_config, capacity, &cap);
 	desc->lba = cap;
 
+	/*
+	 * Without VIRTIO_BLK_F_SEG_MAX the data must be a single segment.
+	 * Without indirect descriptors, the header, data and status must also
+	 * fit in the ring together.
+	 */
+	priv->nr_slots = virtqueue_get_vring_size(priv->vq);
+	if (virtio_cread_feature(dev, VIRTIO_BLK_F_SEG_MAX,
+				 struct virtio_blk_config, seg_max,
+				 &priv->seg_max) || !priv->seg_max)
+		priv->seg_max = 1;
+	if (!priv->vq->indirect)
+		priv->seg_max = min(priv->seg_max, priv->nr_slots - 2);
+	if (virtio_cread_feature(dev, VIRTIO_BLK_F_SIZE_MAX,
+				 struct virtio_blk_config, size_max,
+				 &priv->size_max) || !priv->size_max)
+		priv->size_max = U32_MAX;
+	priv->max_blocks = max_t(u64, (u64)priv->seg_max * priv->size_max /
+				 VIRTIO_BLK_SECTOR_SIZE, 1);
+	debug("(%s): seg_max %u size_max %u max_blocks %lu\n", dev->name,
+	      priv->seg_max, priv->size_max, (ulong)priv->max_blocks);
+
+	priv->sg = calloc(priv->seg_max + 2, sizeof(*priv->sg));
+	priv->sgs = calloc(priv->seg_max + 2, sizeof(*priv->sgs));
+	priv->slots = calloc(priv->nr_slots, sizeof(*priv->slots));
+	if (!priv->sg || !priv->sgs || !priv->slots) {
+		ret = -ENOMEM;
+		goto err;
+	}
+	for (i = 0; i < priv->seg_max + 2; i++)
+		priv->sgs[i] = &priv->sg[i];
+
 	return 0;
+
+err:
+	free(priv->slots);
+	free(priv->sgs);
+	free(priv->sg);
+	virtio_del_vqs(dev);
+
+	return ret;
+}
+
+static int virtio_blk_remove(struct udevice *dev)
+{
+	struct virtio_blk_priv *priv = dev_get_priv(dev);
+	int ret;
+
+	ret = virtio_reset(dev);
+	free(priv->slots);
+	free(priv->sgs);
+	free(priv->sg);
+
+	return ret;
 }
 
 static const struct blk_ops virtio_blk_ops = {
 	.read	= virtio_blk_read,
 	.write	= virtio_blk_write,
+	.submit	= virtio_blk_submit,
+	.poll	= virtio_blk_poll,
+	.cancel	= virtio_blk_cancel,
 };
 
 U_BOOT_DRIVER(virtio_blk) = {
@@ -133,7 +429,7 @@ U_BOOT_DRIVER(virtio_blk) = {
 	.ops	= &virtio_blk_ops,
 	.bind	= virtio_blk_bind,
 	.probe	= virtio_blk_probe,
-	.remove	= virtio_reset,
+	.remove	= virtio_blk_remove,
 	.priv_auto	= sizeof(struct virtio_blk_priv),
 	.flags	= DM_FLAG_ACTIVE_DMA,
 };
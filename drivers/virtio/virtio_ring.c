@@ -36,10 +36,41 @@ static unsigned int virtqueue_attach_desc(struct virtqueue *vq, unsigned int i,
 	return desc_shadow->next;
 }
 
+/*
+ * Build an indirect descriptor table for a request, so that it only takes a
+ * single descriptor in the ring
+ */
+static struct vring_desc *virtqueue_alloc_indirect(struct virtqueue *vq,
+						   struct virtio_sg *sgs[],
+						   unsigned int out_sgs,
+						   unsigned int descs_used)
+{
+	struct vring_desc *desc;
+	unsigned int n;
+	u16 flags;
+
+	desc = memalign(VRING_DESC_ALIGN_SIZE, descs_used * sizeof(*desc));
+	if (!desc)
+		return NULL;
+
+	for (n = 0; n < descs_used; n++) {
+		flags = n < descs_used - 1 ? VRING_DESC_F_NEXT : 0;
+		if (n >= out_sgs)
+			flags |= VRING_DESC_F_WRITE;
+		desc[n].addr = cpu_to_virtio64(vq->vdev,
+					       (u64)(uintptr_t)sgs[n]->addr);
+		desc[n].len = cpu_to_virtio32(vq->vdev, sgs[n]->length);
+		desc[n].flags = cpu_to_virtio16(vq->vdev, flags);
+		desc[n].next = cpu_to_virtio16(vq->vdev, n + 1);
+	}
+
+	return desc;
+}
+
 int virtqueue_add(struct virtqueue *vq, struct virtio_sg *sgs[],
 		  unsigned int out_sgs, unsigned int in_sgs)
 {
-	struct vring_desc *desc;
+	struct vring_desc *desc, *indir_desc = NULL;
 	unsigned int descs_used = out_sgs + in_sgs;
 	unsigned int i, n, avail, uninitialized_var(prev);
 	int head;
@@ -51,6 +82,22 @@ int virtqueue_add(struct virtqueue *vq, struct virtio_sg *sgs[],
 	desc = vq->vring.desc;
 	i = head;
 
+	if (vq->indirect && descs_used > 1 && vq->num_free)
+		indir_desc = virtqueue_alloc_indirect(vq, sgs, out_sgs,
+						      descs_used);
+
+	if (indir_desc) {
+		struct virtio_sg indir_sg = {
+			indir_desc, descs_used * sizeof(struct vring_desc)
+		};
+
+		i = virtqueue_attach_desc(vq, i, &indir_sg,
+					  VRING_DESC_F_INDIRECT);
+		vq->vring_desc_shadow[head].indir_desc = indir_desc;
+		descs_used = 1;
+		goto added;
+	}
+
 	if (vq->num_free < descs_used) {
 		debug("Can't add buf len %i - avail = %i\n",
 		      descs_used, vq->num_free);
@@ -76,6 +123,7 @@ int virtqueue_add(struct virtqueue *vq, struct virtio_sg *sgs[],
 	vq->vring_desc_shadow[prev].flags &= ~VRING_DESC_F_NEXT;
 	desc[prev].flags = cpu_to_virtio16(vq->vdev, vq->vring_desc_shadow[prev].flags);
 
+added:
 	/* We're using some buffers from the free list. */
 	vq->num_free -= descs_used;
 
@@ -150,6 +198,10 @@ static void detach_buf(struct virtqueue *vq, unsigned int head)
 	/* Unmark the descriptor as the head of a chain. */
 	vq->vring_desc_shadow[head].chain_head = false;
 
+	/* An indirect table is private to its request */
+	free(vq->vring_desc_shadow[head].indir_desc);
+	vq->vring_desc_shadow[head].indir_desc = NULL;
+
 	/* Put back on free list: unmap first-level descriptors and find end */
 	i = head;
 
@@ -173,8 +225,10 @@ static inline bool more_used(const struct virtqueue *vq)
 
 void *virtqueue_get_buf(struct virtqueue *vq, unsigned int *len)
 {
+	struct vring_desc *indir_desc;
 	unsigned int i;
 	u16 last_used;
+	u64 addr;
 
 	if (!more_used(vq)) {
 		debug("(%s.%d): No more buffers in queue\n",
@@ -206,6 +260,13 @@ void *virtqueue_get_buf(struct virtqueue *vq, unsigned int *len)
 		return NULL;
 	}
 
+	/* Hand back the first buffer of the request, as for a direct chain */
+	indir_desc = vq->vring_desc_shadow[i].indir_desc;
+	if (indir_desc)
+		addr = virtio64_to_cpu(vq->vdev, indir_desc[0].addr);
+	else
+		addr = vq->vring_desc_shadow[i].addr;
+
 	detach_buf(vq, i);
 	vq->last_used_idx++;
 	/*
@@ -217,7 +278,7 @@ void *virtqueue_get_buf(struct virtqueue *vq, unsigned int *len)
 		virtio_store_mb(&vring_used_event(&vq->vring),
 				cpu_to_virtio16(vq->vdev, vq->last_used_idx));
 
-	return (void *)(uintptr_t)vq->vring_desc_shadow[i].addr;
+	return (void *)(uintptr_t)addr;
 }
 
 static struct virtqueue *__vring_new_virtqueue(unsigned int index,
@@ -252,6 +313,7 @@ static struct virtqueue *__vring_new_virtqueue(unsigned int index,
 	list_add_tail(&vq->list, &uc_priv->vqs);
 
 	vq->event = virtio_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX);
+	vq->indirect = virtio_has_feature(vdev, VIRTIO_RING_F_INDIRECT_DESC);
 
 	/* Tell other side not to bother us */
 	vq->avail_flags_shadow |= VRING_AVAIL_F_NO_INTERRUPT;
@@ -314,6 +376,10 @@ struct virtqueue *vring_create_virtqueue(unsigned int index, unsigned int num,
 
 void vring_del_virtqueue(struct virtqueue *vq)
 {
+	unsigned int i;
+
+	for (i = 0; i < vq->vring.num; i++)
+		free(vq->vring_desc_shadow[i].indir_desc);
 	free(vq->vring.desc);
 	free(vq->vring_desc_shadow);
 	list_del(&vq->list);
@@ -217,6 +217,9 @@ void put_ext4(uint64_t off, const void *buf, uint32_t size)
 		return;
 	}
 
+	/* Cached metadata may be stale once anything has been written */
+	ext_meta_invalidate();
+
 	if (remainder) {
 		blk_dread(fs->dev_desc, startblock, 1, sec_buf);
 		temp_ptr = sec_buf;
@@ -1573,6 +1576,7 @@ static int ext4fs_blockgroup
 	unsigned int blkoff, desc_per_blk;
 	int log2blksz = get_fs()->dev_desc->log2blksz;
 	int desc_size = get_fs()->gdsize;
+	char *buf;
 
 	if (desc_size == 0)
 		return 0;
@@ -1587,9 +1591,14 @@ static int ext4fs_blockgroup
 	debug("ext4fs read %d group descriptor (blkno %ld blkoff %u)\n",
 	      group, blkno, blkoff);
 
-	return ext4fs_devread((lbaint_t)blkno <<
-			      (LOG2_BLOCK_SIZE(data) - log2blksz),
-			      blkoff, desc_size, (char *)blkgrp);
+	buf = ext_meta_read((lbaint_t)blkno <<
+			    (LOG2_BLOCK_SIZE(data) - log2blksz),
+			    EXT2_BLOCK_SIZE(data));
+	if (!buf)
+		return 0;
+	memcpy(blkgrp, buf + blkoff, desc_size);
+
+	return 1;
 }
 
 int ext4fs_read_inode(struct ext2_data *data, int ino, struct ext2_inode *inode)
@@ -1601,6 +1610,7 @@ int ext4fs_read_inode(struct ext2_data *data, int ino, struct ext2_inode *inode)
 	int inodes_per_block, status;
 	long int blkno;
 	unsigned int blkoff;
+	char *buf;
 
 	/* Allocate blkgrp based on gdsize (for 64-bit support). */
 	blkgrp = zalloc(get_fs()->gdsize);
@@ -1632,16 +1642,77 @@ int ext4fs_read_inode(struct ext2_data *data, int ino, struct ext2_inode *inode)
 	/* Free blkgrp as it is no longer required. */
 	free(blkgrp);
 
-	/* Read the inode. */
-	status = ext4fs_devread((lbaint_t)blkno << (LOG2_BLOCK_SIZE(data) -
-				log2blksz), blkoff,
-				sizeof(struct ext2_inode), (char *)inode);
-	if (status == 0)
+	/* Read the inode, keeping its inode table block cached */
+	buf = ext_meta_read((lbaint_t)blkno << (LOG2_BLOCK_SIZE(data) -
+			    log2blksz), EXT2_BLOCK_SIZE(data));
+	if (!buf)
 		return 0;
+	memcpy(inode, buf + blkoff, sizeof(struct ext2_inode));
 
 	return 1;
 }
 
+/**
+ * read_allocated_extent() - map a run of file blocks to disk blocks
+ *
+ * @inode:	inode of a file which uses extents
+ * @fileblock:	first file block to map
+ * @count:	returns the number of blocks from @fileblock onwards which are
+ *		either contiguous on disk or all part of the same hole
+ * @cache:	view into the extent tree block cache, or NULL
+ * Return: disk block holding @fileblock, 0 for a hole, -ve on error
+ */
+long int read_allocated_extent(struct ext2_inode *inode, lbaint_t fileblock,
+			       lbaint_t *count, struct ext_block_cache *cache)
+{
+	struct ext4_extent_header *ext_block;
+	struct ext4_extent *extent;
+	struct ext_block_cache cd;
+	lbaint_t startblock, endblock;
+	unsigned long long start;
+	int log2_blksz;
+	int i;
+
+	log2_blksz = LOG2_BLOCK_SIZE(ext4fs_root)
+		- get_fs()->dev_desc->log2blksz;
+	*count = 1;
+	if (!cache) {
+		cache = &cd;
+		ext_cache_init(cache);
+	}
+
+	ext_block = ext4fs_get_extent_block(ext4fs_root, cache,
+					    (struct ext4_extent_header *)
+					    inode->b.blocks.dir_blocks,
+					    fileblock, log2_blksz);
+	if (!ext_block) {
+		printf("invalid extent block\n");
+		return -EINVAL;
+	}
+
+	extent = (struct ext4_extent *)(ext_block + 1);
+
+	for (i = 0; i < le16_to_cpu(ext_block->eh_entries); i++) {
+		startblock = le32_to_cpu(extent[i].ee_block);
+		endblock = startblock + le16_to_cpu(extent[i].ee_len);
+
+		if (startblock > fileblock) {
+			/* Sparse file, the hole ends where this extent starts */
+			*count = startblock - fileblock;
+			return 0;
+
+		} else if (fileblock < endblock) {
+			start = le16_to_cpu(extent[i].ee_start_hi);
+			start = (start << 32) +
+				le32_to_cpu(extent[i].ee_start_lo);
+			*count = endblock - fileblock;
+			return (fileblock - startblock) + start;
+		}
+	}
+
+	return 0;
+}
+
 long int read_allocated_block(struct ext2_inode *inode, int fileblock,
 			      struct ext_block_cache *cache)
 {
@@ -1652,62 +1723,15 @@ long int read_allocated_block(struct ext2_inode *inode, int fileblock,
 	long int rblock;
 	long int perblock_parent;
 	long int perblock_child;
-	unsigned long long start;
 	/* get the blocksize of the filesystem */
 	blksz = EXT2_BLOCK_SIZE(ext4fs_root);
 	log2_blksz = LOG2_BLOCK_SIZE(ext4fs_root)
 		- get_fs()->dev_desc->log2blksz;
 
 	if (le32_to_cpu(inode->flags) & EXT4_EXTENTS_FL) {
-		long int startblock, endblock;
-		struct ext_block_cache *c, cd;
-		struct ext4_extent_header *ext_block;
-		struct ext4_extent *extent;
-		int i;
-
-		if (cache) {
-			c = cache;
-		} else {
-			c = &cd;
-			ext_cache_init(c);
-		}
-		ext_block =
-			ext4fs_get_extent_block(ext4fs_root, c,
-						(struct ext4_extent_header *)
-						inode->b.blocks.dir_blocks,
-						fileblock, log2_blksz);
-		if (!ext_block) {
-			printf("invalid extent block\n");
-			if (!cache)
-				ext_cache_fini(c);
-			return -EINVAL;
-		}
-
-		extent = (struct ext4_extent *)(ext_block + 1);
-
-		for (i = 0; i < le16_to_cpu(ext_block->eh_entries); i++) {
-			startblock = le32_to_cpu(extent[i].ee_block);
-			endblock = startblock + le16_to_cpu(extent[i].ee_len);
-
-			if (startblock > fileblock) {
-				/* Sparse file */
-				if (!cache)
-					ext_cache_fini(c);
-				return 0;
+		lbaint_t count;
 
-			} else if (fileblock < endblock) {
-				start = le16_to_cpu(extent[i].ee_start_hi);
-				start = (start << 32) +
-					le32_to_cpu(extent[i].ee_start_lo);
-				if (!cache)
-					ext_cache_fini(c);
-				return (fileblock - startblock) + start;
-			}
-		}
-
-		if (!cache)
-			ext_cache_fini(c);
-		return 0;
+		return read_allocated_extent(inode, fileblock, &count, cache);
 	}
 
 	/* Direct blocks. */
@@ -2039,6 +2063,7 @@ void ext4fs_close(void)
 		ext4fs_root = NULL;
 	}
 
+	ext_meta_fini();
 	ext4fs_reinit_global();
 }
 
@@ -2368,6 +2393,9 @@ int ext4fs_mount(unsigned part_length)
 	struct ext2_data *data;
 	int status;
 	struct ext_filesystem *fs = get_fs();
+
+	/* Nothing cached may survive from another device or partition */
+	ext_meta_invalidate();
 	data = zalloc(SUPERBLOCK_SIZE);
 	if (!data)
 		return 0;
@@ -48,24 +48,28 @@ void ext4fs_free_node(struct ext2fs_node *node, struct ext2fs_node *currroot)
  * Taken from openmoko-kernel mailing list: By Andy green
  * Optimized read file API : collects and defers contiguous sector
  * reads into one potentially more efficient larger sequential read action
+ *
+ * Files using extents are mapped a whole extent at a time, so that each
+ * physically contiguous run costs one lookup and one device read.
  */
 int ext4fs_read_file(struct ext2fs_node *node, loff_t pos,
 		loff_t len, char *buf, loff_t *actread)
 {
 	struct ext_filesystem *fs = get_fs();
-	int i;
-	lbaint_t blockcnt;
+	lbaint_t i, count;
+	lbaint_t blockcnt, firstblock;
 	int log2blksz = fs->dev_desc->log2blksz;
 	int log2_fs_blocksize = LOG2_BLOCK_SIZE(node->data) - log2blksz;
 	int blocksize = (1 << (log2_fs_blocksize + log2blksz));
 	unsigned int filesize = le32_to_cpu(node->inode.size);
+	bool extents = le32_to_cpu(node->inode.flags) & EXT4_EXTENTS_FL;
+	lbaint_t max_count = INT_MAX >> (log2_fs_blocksize + log2blksz);
 	lbaint_t previous_block_number = -1;
 	lbaint_t delayed_start = 0;
 	lbaint_t delayed_extent = 0;
 	lbaint_t delayed_skipfirst = 0;
 	lbaint_t delayed_next = 0;
 	char *delayed_buf = NULL;
-	char *start_buf = buf;
 	short status;
 	struct ext_block_cache cache;
 
@@ -81,39 +85,44 @@ int ext4fs_read_file(struct ext2fs_node *node, loff_t pos,
 	}
 
 	blockcnt = lldiv(((len + pos) + blocksize - 1), blocksize);
+	firstblock = lldiv(pos, blocksize);
 
-	for (i = lldiv(pos, blocksize); i < blockcnt; i++) {
+	for (i = firstblock; i < blockcnt; i += count) {
 		long int blknr;
-		int blockoff = pos - (blocksize * i);
-		int blockend = blocksize;
+		loff_t blockend;
 		int skipfirst = 0;
-		blknr = read_allocated_block(&node->inode, i, &cache);
+
+		count = 1;
+		if (extents)
+			blknr = read_allocated_extent(&node->inode, i, &count,
+						      &cache);
+		else
+			blknr = read_allocated_block(&node->inode, i, &cache);
 		if (blknr < 0) {
 			ext_cache_fini(&cache);
 			return -1;
 		}
 
+		/* Keep each transfer within what ext4fs_devread() takes */
+		count = min(count, min(blockcnt - i, max_count));
 		blknr = blknr << log2_fs_blocksize;
+		blockend = (loff_t)blocksize * count;
 
 		/* Last block.  */
-		if (i == blockcnt - 1) {
-			blockend = (len + pos) - (blocksize * i);
-
-			/* The last portion is exactly blocksize. */
-			if (!blockend)
-				blockend = blocksize;
-		}
+		if (i + count == blockcnt)
+			blockend = (len + pos) - ((loff_t)blocksize * i);
 
 		/* First block. */
-		if (i == lldiv(pos, blocksize)) {
-			skipfirst = blockoff;
+		if (i == firstblock) {
+			skipfirst = pos - ((loff_t)blocksize * i);
 			blockend -= skipfirst;
 		}
 		if (blknr) {
 			int status;
 
 			if (previous_block_number != -1) {
-				if (delayed_next == blknr) {
+				if (delayed_next == blknr &&
+				    delayed_extent + blockend <= INT_MAX) {
 					delayed_extent += blockend;
 					delayed_next += blockend >> log2blksz;
 				} else {	/* spill */
@@ -143,8 +152,6 @@ int ext4fs_read_file(struct ext2fs_node *node, loff_t pos,
 					(blockend >> log2blksz);
 			}
 		} else {
-			int n;
-			int n_left;
 			if (previous_block_number != -1) {
 				/* spill */
 				status = ext4fs_devread(delayed_start,
@@ -157,14 +164,10 @@ int ext4fs_read_file(struct ext2fs_node *node, loff_t pos,
 				}
 				previous_block_number = -1;
 			}
-			/* Zero no more than `len' bytes. */
-			n = blocksize - skipfirst;
-			n_left = len - ( buf - start_buf );
-			if (n > n_left)
-				n = n_left;
-			memset(buf, 0, n);
+			/* Holes never go past the end of the read */
+			memset(buf, 0, blockend);
 		}
-		buf += blocksize - skipfirst;
+		buf += blockend;
 	}
 	if (previous_block_number != -1) {
 		/* spill */
@@ -274,6 +277,82 @@ int ext4fs_uuid(char *uuid_str)
 #endif
 }
 
+/*
+ * Metadata blocks (extent tree, group descriptors and inode tables) are kept
+ * in a small LRU cache for as long as the filesystem is mounted, so repeated
+ * lookups and reads do not go back to the device each time.
+ */
+#ifdef CONFIG_SPL_BUILD
+#define EXT_META_CACHE_BLOCKS	4
+#else
+#define EXT_META_CACHE_BLOCKS	32
+#endif
+
+struct ext_meta_block {
+	char *buf;
+	lbaint_t block;
+	int size;
+	bool valid;
+	ulong lru;
+};
+
+static struct ext_meta_block ext_meta_cache[EXT_META_CACHE_BLOCKS];
+static ulong ext_meta_seq;
+
+char *ext_meta_read(lbaint_t block, int size)
+{
+	struct ext_meta_block *ent, *victim = NULL;
+	int i;
+
+	for (i = 0; i < EXT_META_CACHE_BLOCKS; i++) {
+		ent = &ext_meta_cache[i];
+		if (ent->valid && ent->block == block && ent->size == size) {
+			ent->lru = ++ext_meta_seq;
+			return ent->buf;
+		}
+		if (!victim || (victim->valid && !ent->valid) ||
+		    (victim->valid == ent->valid && ent->lru < victim->lru))
+			victim = ent;
+	}
+
+	victim->valid = false;
+	if (victim->buf && victim->size != size) {
+		free(victim->buf);
+		victim->buf = NULL;
+	}
+	if (!victim->buf) {
+		victim->buf = memalign(ARCH_DMA_MINALIGN, size);
+		if (!victim->buf)
+			return NULL;
+		victim->size = size;
+	}
+	if (!ext4fs_devread(block, 0, size, victim->buf))
+		return NULL;
+	victim->block = block;
+	victim->valid = true;
+	victim->lru = ++ext_meta_seq;
+
+	return victim->buf;
+}
+
+void ext_meta_invalidate(void)
+{
+	int i;
+
+	for (i = 0; i < EXT_META_CACHE_BLOCKS; i++)
+		ext_meta_cache[i].valid = false;
+}
+
+void ext_meta_fini(void)
+{
+	int i;
+
+	for (i = 0; i < EXT_META_CACHE_BLOCKS; i++) {
+		free(ext_meta_cache[i].buf);
+		memset(&ext_meta_cache[i], 0, sizeof(ext_meta_cache[i]));
+	}
+}
+
 void ext_cache_init(struct ext_block_cache *cache)
 {
 	memset(cache, 0, sizeof(*cache));
@@ -281,21 +360,19 @@ void ext_cache_init(struct ext_block_cache *cache)
 
 void ext_cache_fini(struct ext_block_cache *cache)
 {
-	free(cache->buf);
+	/* The buffer belongs to the metadata cache */
 	ext_cache_init(cache);
 }
 
 int ext_cache_read(struct ext_block_cache *cache, lbaint_t block, int size)
 {
-	/* This could be more lenient, but this is simple and enough for now */
-	if (cache->buf && cache->block == block && cache->size == size)
-		return 1;
-	ext_cache_fini(cache);
-	cache->buf = memalign(ARCH_DMA_MINALIGN, size);
-	if (!cache->buf)
-		return 0;
-	if (!ext4fs_devread(block, 0, size, cache->buf)) {
-		ext_cache_fini(cache);
+	/*
+	 * Always go through the metadata cache: the block this view points
+	 * at may have been evicted since it was last read.
+	 */
+	cache->buf = ext_meta_read(block, size);
+	if (!cache->buf) {
+		ext_cache_init(cache);
 		return 0;
 	}
 	cache->block = block;
@@ -147,6 +147,7 @@ static void get_name(dir_entry *dirent, char *s_name)
 }
 
 static int flush_dirty_fat_buffer(fsdata *mydata);
+static int flush_fat_window(fsdata *mydata, fat_window *win);
 
 #if !CONFIG_IS_ENABLED(FAT_WRITE)
 /* Stub for read only operation */
@@ -155,8 +156,93 @@ int flush_dirty_fat_buffer(fsdata *mydata)
 	(void)(mydata);
 	return 0;
 }
+
+int flush_fat_window(fsdata *mydata, fat_window *win)
+{
+	(void)(mydata);
+	(void)(win);
+	return 0;
+}
 #endif
 
+/*
+ * Allocate the FAT window cache. Fall back to a single window if there is
+ * not enough memory for all of them.
+ * Return 0 on success, -1 otherwise.
+ */
+static int alloc_fatbuf(fsdata *mydata)
+{
+	int i;
+
+	mydata->fatbuf_windows = FATBUFWINDOWS;
+	mydata->fatbuf = malloc_cache_aligned(FATBUFSIZE * FATBUFWINDOWS);
+	if (!mydata->fatbuf && FATBUFWINDOWS > 1) {
+		mydata->fatbuf_windows = 1;
+		mydata->fatbuf = malloc_cache_aligned(FATBUFSIZE);
+	}
+	if (!mydata->fatbuf)
+		return -1;
+
+	for (i = 0; i < FATBUFWINDOWS; i++) {
+		mydata->fatwin[i].num = -1;
+		mydata->fatwin[i].dirty = 0;
+	}
+	mydata->fatbuf_seq = 0;
+
+	return 0;
+}
+
+static __u8 *fat_window_buf(fsdata *mydata, fat_window *win)
+{
+	return mydata->fatbuf + (win - mydata->fatwin) * FATBUFSIZE;
+}
+
+/*
+ * Get window 'bufnum' of the FAT into the cache, replacing the least
+ * recently used one if it is not there already.
+ * Return the window, or NULL on error.
+ */
+static fat_window *get_fat_window(fsdata *mydata, __u32 bufnum)
+{
+	fat_window *win, *victim = NULL;
+	__u32 getsize = FATBUFBLOCKS;
+	__u32 fatlength = mydata->fatlength;
+	__u32 startblock = bufnum * FATBUFBLOCKS;
+	int i;
+
+	for (i = 0; i < mydata->fatbuf_windows; i++) {
+		win = &mydata->fatwin[i];
+		if (win->num == bufnum) {
+			win->lru = ++mydata->fatbuf_seq;
+			return win;
+		}
+		if (!victim || (victim->num != -1 &&
+				(win->num == -1 || win->lru < victim->lru)))
+			victim = win;
+	}
+
+	/* Write back the evicted window to the disk */
+	if (flush_fat_window(mydata, victim) < 0)
+		return NULL;
+
+	/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
+	if (startblock + getsize > fatlength)
+		getsize = fatlength - startblock;
+
+	startblock += mydata->fat_sect;	/* Offset from start of disk */
+
+	/* Read a new block of FAT entries into the cache. */
+	victim->num = -1;
+	if (disk_read(startblock, getsize, fat_window_buf(mydata, victim)) < 0) {
+		debug("Error reading FAT blocks\n");
+		return NULL;
+	}
+	victim->num = bufnum;
+	victim->lru = ++mydata->fatbuf_seq;
+
+	return victim;
+}
+
 /*
  * Get the entry at index 'entry' in a FAT (12/16/32) table.
  * On failure 0x00 is returned.
@@ -166,6 +252,8 @@ static __u32 get_fatent(fsdata *mydata, __u32 entry)
 	__u32 bufnum;
 	__u32 offset, off8;
 	__u32 ret = 0x00;
+	fat_window *win;
+	__u8 *fatbuf;
 
 	if (CHECK_CLUST(entry, mydata->fatsize)) {
 		printf("Error: Invalid FAT entry: 0x%08x\n", entry);
@@ -194,42 +282,23 @@ static __u32 get_fatent(fsdata *mydata, __u32 entry)
 	debug("FAT%d: entry: 0x%08x = %d, offset: 0x%04x = %d\n",
 	       mydata->fatsize, entry, entry, offset, offset);
 
-	/* Read a new block of FAT entries into the cache. */
-	if (bufnum != mydata->fatbufnum) {
-		__u32 getsize = FATBUFBLOCKS;
-		__u8 *bufptr = mydata->fatbuf;
-		__u32 fatlength = mydata->fatlength;
-		__u32 startblock = bufnum * FATBUFBLOCKS;
-
-		/* Cap length if fatlength is not a multiple of FATBUFBLOCKS */
-		if (startblock + getsize > fatlength)
-			getsize = fatlength - startblock;
-
-		startblock += mydata->fat_sect;	/* Offset from start of disk */
-
-		/* Write back the fatbuf to the disk */
-		if (flush_dirty_fat_buffer(mydata) < 0)
-			return -1;
-
-		if (disk_read(startblock, getsize, bufptr) < 0) {
-			debug("Error reading FAT blocks\n");
-			return ret;
-		}
-		mydata->fatbufnum = bufnum;
-	}
+	win = get_fat_window(mydata, bufnum);
+	if (!win)
+		return ret;
+	fatbuf = fat_window_buf(mydata, win);
 
 	/* Get the actual entry from the table */
 	switch (mydata->fatsize) {
 	case 32:
-		ret = FAT2CPU32(((__u32 *) mydata->fatbuf)[offset]);
+		ret = FAT2CPU32(((__u32 *)fatbuf)[offset]);
 		break;
 	case 16:
-		ret = FAT2CPU16(((__u16 *) mydata->fatbuf)[offset]);
+		ret = FAT2CPU16(((__u16 *)fatbuf)[offset]);
 		break;
 	case 12:
 		off8 = (offset * 3) / 2;
 		/* fatbut + off8 may be unaligned, read in byte granularity */
-		ret = mydata->fatbuf[off8] + (mydata->fatbuf[off8 + 1] << 8);
+		ret = fatbuf[off8] + (fatbuf[off8 + 1] << 8);
 
 		if (offset & 0x1)
 			ret >>= 4;
@@ -241,6 +310,42 @@ static __u32 get_fatent(fsdata *mydata, __u32 entry)
 	return ret;
 }
 
+/**
+ * get_cluster_run() - find consecutive clusters in a cluster chain
+ *
+ * Follow the chain from 'clust' for as long as each cluster is followed by
+ * the next one on disk, so that the run can be transferred with a single
+ * disk access. The run stops once it holds 'size' bytes.
+ *
+ * @mydata:	file system description
+ * @clust:	first cluster of the run
+ * @size:	number of bytes wanted
+ * @next:	returns the FAT entry of the last cluster in the run,
+ *		i.e. the cluster which follows it in the chain
+ * Return:	number of clusters in the run, at least 1
+ */
+static __u32 get_cluster_run(fsdata *mydata, __u32 clust, loff_t size,
+			     __u32 *next)
+{
+	unsigned int bytesperclust = mydata->clust_size * mydata->sect_size;
+	loff_t actsize = bytesperclust;
+	__u32 count = 1;
+	__u32 newclust;
+
+	while (1) {
+		newclust = get_fatent(mydata, clust);
+		if (actsize >= size || newclust != clust + 1 ||
+		    CHECK_CLUST(newclust, mydata->fatsize))
+			break;
+		clust = newclust;
+		actsize += bytesperclust;
+		count++;
+	}
+	*next = newclust;
+
+	return count;
+}
+
 /*
  * Read at most 'size' bytes from the specified cluster into 'buffer'.
  * Return 0 on success, -1 otherwise.
@@ -325,7 +430,7 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 	loff_t filesize = FAT2CPU32(dentptr->size);
 	unsigned int bytesperclust = mydata->clust_size * mydata->sect_size;
 	__u32 curclust = START(dentptr);
-	__u32 endclust, newclust;
+	__u32 nclust, newclust;
 	loff_t actsize;
 
 	*gotsize = 0;
@@ -392,50 +497,27 @@ static int get_contents(fsdata *mydata, dir_entry *dentptr, loff_t pos,
 		}
 	}
 
-	actsize = bytesperclust;
-	endclust = curclust;
-
-	do {
-		/* search for consecutive clusters */
-		while (actsize < filesize) {
-			newclust = get_fatent(mydata, endclust);
-			if ((newclust - 1) != endclust)
-				goto getit;
-			if (CHECK_CLUST(newclust, mydata->fatsize)) {
-				debug("curclust: 0x%x\n", newclust);
-				printf("Invalid FAT entry\n");
-				return -1;
-			}
-			endclust = newclust;
-			actsize += bytesperclust;
-		}
-
-		/* get remaining bytes */
-		actsize = filesize;
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
+	while (1) {
+		/* read as many consecutive clusters as possible at once */
+		nclust = get_cluster_run(mydata, curclust, filesize, &newclust);
+		actsize = min(filesize, (loff_t)nclust * bytesperclust);
+		if (get_cluster(mydata, curclust, buffer, actsize) != 0) {
 			printf("Error reading cluster\n");
 			return -1;
 		}
 		*gotsize += actsize;
-		return 0;
-getit:
-		if (get_cluster(mydata, curclust, buffer, (int)actsize) != 0) {
-			printf("Error reading cluster\n");
-			return -1;
-		}
-		*gotsize += (int)actsize;
 		filesize -= actsize;
+		if (!filesize)
+			return 0;
 		buffer += actsize;
 
-		curclust = get_fatent(mydata, endclust);
+		curclust = newclust;
 		if (CHECK_CLUST(curclust, mydata->fatsize)) {
 			debug("curclust: 0x%x\n", curclust);
 			printf("Invalid FAT entry\n");
 			return -1;
 		}
-		actsize = bytesperclust;
-		endclust = curclust;
-	} while (1);
+	}
 }
 
 /*
@@ -623,10 +705,7 @@ static int get_fs_info(fsdata *mydata)
 		mydata->root_cluster = 0;
 	}
 
-	mydata->fatbufnum = -1;
-	mydata->fat_dirty = 0;
-	mydata->fatbuf = malloc_cache_aligned(FATBUFSIZE);
-	if (mydata->fatbuf == NULL) {
+	if (alloc_fatbuf(mydata)) {
 		debug("Error: allocating memory\n");
 		return -1;
 	}
@@ -93,15 +93,70 @@ static int sqfs_calc_n_blks(__le64 start, __le64 end, u64 *offset)
 	return DIV_ROUND_UP(table_size + *offset, ctxt.cur_dev->blksz);
 }
 
+/*
+ * Reads the fragment index table into the cache. It holds the position of each
+ * metadata block of fragment entries.
+ */
+static int sqfs_read_frag_index(void)
+{
+	struct squashfs_super_block *sblk = ctxt.sblk;
+	u64 start, n_blks, table_offset;
+	unsigned char *table;
+	int j, count;
+
+	if (ctxt.frag_index)
+		return 0;
+
+	count = DIV_ROUND_UP(get_unaligned_le32(&sblk->fragments),
+			     SQFS_MAX_ENTRIES);
+	start = get_unaligned_le64(&sblk->fragment_table_start) /
+		ctxt.cur_dev->blksz;
+	n_blks = sqfs_calc_n_blks(sblk->fragment_table_start,
+				  sblk->export_table_start,
+				  &table_offset);
+	if (table_offset + count * sizeof(u64) > n_blks * ctxt.cur_dev->blksz)
+		return -EINVAL;
+
+	/* Allocate a proper sized buffer to store the fragment index table */
+	table = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
+	if (!table)
+		return -ENOMEM;
+
+	if (sqfs_disk_read(start, n_blks, table) < 0) {
+		free(table);
+		return -EINVAL;
+	}
+
+	ctxt.frag_index = malloc(count * sizeof(u64));
+	ctxt.frag_entries = calloc(count, sizeof(*ctxt.frag_entries));
+	if (!ctxt.frag_index || !ctxt.frag_entries) {
+		free(ctxt.frag_index);
+		free(ctxt.frag_entries);
+		ctxt.frag_index = NULL;
+		ctxt.frag_entries = NULL;
+		free(table);
+		return -ENOMEM;
+	}
+
+	for (j = 0; j < count; j++)
+		ctxt.frag_index[j] = get_unaligned_le64(table + table_offset +
+							j * sizeof(u64));
+	ctxt.frag_index_count = count;
+	free(table);
+
+	return 0;
+}
+
 /*
  * Retrieves fragment block entry and returns true if the fragment block is
- * compressed
+ * compressed. Metadata blocks of fragment entries stay in the cache, since
+ * many small files usually share them.
  */
 static int sqfs_frag_lookup(u32 inode_fragment_index,
 			    struct squashfs_fragment_block_entry *e)
 {
 	u64 start, n_blks, src_len, table_offset, start_block;
-	unsigned char *metadata_buffer, *metadata, *table;
+	unsigned char *metadata_buffer, *metadata;
 	struct squashfs_fragment_block_entry *entries;
 	struct squashfs_super_block *sblk = ctxt.sblk;
 	unsigned long dest_len;
@@ -110,38 +165,25 @@ static int sqfs_frag_lookup(u32 inode_fragment_index,
 
 	metadata_buffer = NULL;
 	entries = NULL;
-	table = NULL;
 
 	if (inode_fragment_index >= get_unaligned_le32(&sblk->fragments))
 		return -EINVAL;
 
-	start = get_unaligned_le64(&sblk->fragment_table_start) /
-		ctxt.cur_dev->blksz;
-	n_blks = sqfs_calc_n_blks(sblk->fragment_table_start,
-				  sblk->export_table_start,
-				  &table_offset);
-
-	/* Allocate a proper sized buffer to store the fragment index table */
-	table = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
-	if (!table) {
-		ret = -ENOMEM;
-		goto out;
-	}
-
-	if (sqfs_disk_read(start, n_blks, table) < 0) {
-		ret = -EINVAL;
-		goto out;
-	}
+	ret = sqfs_read_frag_index();
+	if (ret)
+		return ret;
 
 	block = SQFS_FRAGMENT_INDEX(inode_fragment_index);
 	offset = SQFS_FRAGMENT_INDEX_OFFSET(inode_fragment_index);
 
+	if (ctxt.frag_entries[block])
+		goto found;
+
 	/*
 	 * Get the start offset of the metadata block that contains the right
 	 * fragment block entry
 	 */
-	start_block = get_unaligned_le64(table + table_offset + block *
-					 sizeof(u64));
+	start_block = ctxt.frag_index[block];
 
 	start = start_block / ctxt.cur_dev->blksz;
 	n_blks = sqfs_calc_n_blks(cpu_to_le64(start_block),
@@ -186,13 +228,90 @@ static int sqfs_frag_lookup(u32 inode_fragment_index,
 		memcpy(entries, metadata, SQFS_METADATA_SIZE(header));
 	}
 
-	*e = entries[offset];
+	ctxt.frag_entries[block] = entries;
+	entries = NULL;
+
+found:
+	*e = ctxt.frag_entries[block][offset];
 	ret = SQFS_COMPRESSED_BLOCK(e->size);
 
 out:
 	free(entries);
 	free(metadata_buffer);
-	free(table);
+
+	return ret;
+}
+
+/*
+ * Returns the decompressed contents of a fragment block. The last few are kept
+ * in the cache, as consecutive small files tend to share a fragment block.
+ */
+static int sqfs_get_fragment(struct squashfs_fragment_block_entry *fentry,
+			     bool comp, struct squashfs_frag_cache **fcp)
+{
+	u64 start, n_blks, table_size, table_offset;
+	struct squashfs_frag_cache *fc, *victim = NULL;
+	struct squashfs_super_block *sblk = ctxt.sblk;
+	unsigned long dest_len;
+	char *fragment;
+	int j, ret;
+
+	for (j = 0; j < SQFS_FRAG_CACHE_SIZE; j++) {
+		fc = &ctxt.frag_cache[j];
+		if (fc->start && fc->start == fentry->start) {
+			fc->lru = ++ctxt.frag_seq;
+			*fcp = fc;
+			return 0;
+		}
+		if (!victim || (victim->start && !fc->start) ||
+		    (!victim->start == !fc->start && fc->lru < victim->lru))
+			victim = fc;
+	}
+
+	dest_len = get_unaligned_le32(&sblk->block_size);
+	table_size = SQFS_BLOCK_SIZE(fentry->size);
+	if (!comp && table_size > dest_len)
+		return -EINVAL;
+
+	start = lldiv(fentry->start, ctxt.cur_dev->blksz);
+	table_offset = fentry->start - (start * ctxt.cur_dev->blksz);
+	n_blks = DIV_ROUND_UP(table_size + table_offset, ctxt.cur_dev->blksz);
+
+	fragment = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
+	if (!fragment)
+		return -ENOMEM;
+
+	ret = sqfs_disk_read(start, n_blks, fragment);
+	if (ret < 0)
+		goto out;
+
+	victim->start = 0;
+	if (!victim->buf) {
+		victim->buf = malloc(dest_len);
+		if (!victim->buf) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	if (comp) {
+		ret = sqfs_decompress(&ctxt, victim->buf, &dest_len,
+				      fragment + table_offset, table_size);
+		if (ret)
+			goto out;
+	} else {
+		memcpy(victim->buf, fragment + table_offset, table_size);
+		dest_len = table_size;
+	}
+
+	victim->start = fentry->start;
+	victim->size = dest_len;
+	victim->lru = ++ctxt.frag_seq;
+	*fcp = victim;
+	ret = 0;
+
+out:
+	free(fragment);
 
 	return ret;
 }
@@ -872,13 +991,82 @@ out:
 	return metablks_count;
 }
 
+static void sqfs_put_tables(struct squashfs_tables *tables)
+{
+	if (!tables || --tables->refcount)
+		return;
+
+	free(tables->inode_table);
+	free(tables->dir_table);
+	free(tables->pos_list);
+	free(tables);
+}
+
+/*
+ * The inode and directory tables are decompressed on first use and then kept
+ * in the cache, so opening further files does not read them again.
+ */
+static int sqfs_read_tables(void)
+{
+	struct squashfs_tables *tables;
+	int ret;
+
+	if (ctxt.tables)
+		return 0;
+
+	tables = calloc(1, sizeof(*tables));
+	if (!tables)
+		return -ENOMEM;
+	tables->refcount = 1;
+
+	ret = sqfs_read_inode_table(&tables->inode_table);
+	if (ret)
+		goto err;
+
+	tables->metablks_count = sqfs_read_directory_table(&tables->dir_table,
+							   &tables->pos_list);
+	if (tables->metablks_count < 1) {
+		ret = -EINVAL;
+		goto err;
+	}
+
+	ctxt.tables = tables;
+
+	return 0;
+err:
+	sqfs_put_tables(tables);
+
+	return ret;
+}
+
+static void sqfs_cache_free(void)
+{
+	int j;
+
+	sqfs_put_tables(ctxt.tables);
+	ctxt.tables = NULL;
+
+	for (j = 0; j < ctxt.frag_index_count; j++)
+		free(ctxt.frag_entries[j]);
+	free(ctxt.frag_entries);
+	free(ctxt.frag_index);
+	ctxt.frag_entries = NULL;
+	ctxt.frag_index = NULL;
+	ctxt.frag_index_count = 0;
+
+	for (j = 0; j < SQFS_FRAG_CACHE_SIZE; j++) {
+		free(ctxt.frag_cache[j].buf);
+		memset(&ctxt.frag_cache[j], 0, sizeof(ctxt.frag_cache[j]));
+	}
+
+	ctxt.cache_dev = NULL;
+}
+
 int sqfs_opendir(const char *filename, struct fs_dir_stream **dirsp)
 {
-	unsigned char *inode_table = NULL, *dir_table = NULL;
-	int j, token_count = 0, ret = 0, metablks_count;
+	int j, token_count = 0, ret = 0;
 	struct squashfs_dir_stream *dirs;
 	char **token_list = NULL, *path = NULL;
-	u32 *pos_list = NULL;
 
 	dirs = calloc(1, sizeof(*dirs));
 	if (!dirs)
@@ -891,18 +1079,12 @@ int sqfs_opendir(const char *filename, struct fs_dir_stream **dirsp)
 	dirs->inode_table = NULL;
 	dirs->dir_table = NULL;
 
-	ret = sqfs_read_inode_table(&inode_table);
+	ret = sqfs_read_tables();
 	if (ret) {
 		ret = -EINVAL;
 		goto out;
 	}
 
-	metablks_count = sqfs_read_directory_table(&dir_table, &pos_list);
-	if (metablks_count < 1) {
-		ret = -EINVAL;
-		goto out;
-	}
-
 	/* Tokenize filename */
 	token_count = sqfs_count_tokens(filename);
 	if (token_count < 0) {
@@ -930,10 +1112,11 @@ int sqfs_opendir(const char *filename, struct fs_dir_stream **dirsp)
 	 * ldir's (extended directory) size is greater than dir, so it works as
 	 * a general solution for the malloc size, since 'i' is a union.
 	 */
-	dirs->inode_table = inode_table;
-	dirs->dir_table = dir_table;
-	ret = sqfs_search_dir(dirs, token_list, token_count, pos_list,
-			      metablks_count);
+	dirs->inode_table = ctxt.tables->inode_table;
+	dirs->dir_table = ctxt.tables->dir_table;
+	ret = sqfs_search_dir(dirs, token_list, token_count,
+			      ctxt.tables->pos_list,
+			      ctxt.tables->metablks_count);
 	if (ret)
 		goto out;
 
@@ -951,18 +1134,19 @@ int sqfs_opendir(const char *filename, struct fs_dir_stream **dirsp)
 	dirs->entry = NULL;
 	dirs->table += SQFS_DIR_HEADER_SIZE;
 
+	/* The stream keeps using the tables after the filesystem is closed */
+	dirs->tables = ctxt.tables;
+	dirs->tables->refcount++;
+
 	*dirsp = (struct fs_dir_stream *)dirs;
 
 out:
 	for (j = 0; j < token_count; j++)
 		free(token_list[j]);
 	free(token_list);
-	free(pos_list);
 	free(path);
-	if (ret) {
-		free(inode_table);
+	if (ret)
 		free(dirs);
-	}
 
 	return ret;
 }
@@ -1103,6 +1287,16 @@ int sqfs_probe(struct blk_desc *fs_dev_desc, struct disk_partition *fs_partition
 
 	ctxt.sblk = sblk;
 
+	/* Anything cached must come from this very filesystem */
+	if (ctxt.cache_dev != fs_dev_desc ||
+	    ctxt.cache_part_start != fs_partition->start ||
+	    memcmp(&ctxt.cache_sblk, sblk, sizeof(*sblk))) {
+		sqfs_cache_free();
+		ctxt.cache_dev = fs_dev_desc;
+		ctxt.cache_part_start = fs_partition->start;
+		memcpy(&ctxt.cache_sblk, sblk, sizeof(*sblk));
+	}
+
 	ret = sqfs_decompressor_init(&ctxt);
 	if (ret) {
 		goto error;
@@ -1314,10 +1508,13 @@ static int sqfs_get_lregfile_info(struct squashfs_lreg_inode *lreg,
 int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 	      loff_t *actread)
 {
-	char *dir = NULL, *fragment_block, *datablock = NULL;
-	char *fragment = NULL, *file = NULL, *resolved, *data;
+	char *dir = NULL, *data_buffer = NULL, *datablock = NULL;
+	char *file = NULL, *resolved, *data;
 	u64 start, n_blks, table_size, data_offset, table_offset, sparse_size;
-	int ret, j, i_number, datablk_count = 0;
+	u64 batch_size, copy_size, data_blks = 0;
+	int ret, j, k, i_number, datablk_count = 0;
+	struct squashfs_frag_cache *fc;
+	u32 blksz;
 	struct squashfs_super_block *sblk = ctxt.sblk;
 	struct squashfs_fragment_block_entry frag_entry;
 	struct squashfs_file_info finfo = {0};
@@ -1434,139 +1631,125 @@ int sqfs_read(const char *filename, void *buf, loff_t offset, loff_t len,
 		len = finfo.size;
 	}
 
-	if (datablk_count) {
-		data_offset = finfo.start;
-		datablock = malloc(get_unaligned_le32(&sblk->block_size));
-		if (!datablock) {
-			ret = -ENOMEM;
-			goto out;
+	blksz = get_unaligned_le32(&sblk->block_size);
+	data_offset = finfo.start;
+
+	for (j = 0; j < datablk_count && *actread < len; j = k) {
+		/* This is a sparse block, there is nothing to load */
+		if (finfo.blk_sizes[j] == 0) {
+			sparse_size = min_t(u64, blksz, len - *actread);
+			memset(buf + *actread, 0, sparse_size);
+			*actread += sparse_size;
+			k = j + 1;
+			continue;
 		}
-	}
 
-	for (j = 0; j < datablk_count; j++) {
-		char *data_buffer;
+		/*
+		 * Data blocks follow each other on the device, so read as many
+		 * of those still needed as fit in one batch.
+		 */
+		batch_size = 0;
+		for (k = j; k < datablk_count && finfo.blk_sizes[k]; k++) {
+			table_size = SQFS_BLOCK_SIZE(finfo.blk_sizes[k]);
+			if (k > j && (batch_size + table_size > SQFS_DATA_BATCH_SIZE ||
+				      (u64)(k - j) * blksz >= len - *actread))
+				break;
+			batch_size += table_size;
+		}
 
 		start = lldiv(data_offset, ctxt.cur_dev->blksz);
-		table_size = SQFS_BLOCK_SIZE(finfo.blk_sizes[j]);
 		table_offset = data_offset - (start * ctxt.cur_dev->blksz);
-		n_blks = DIV_ROUND_UP(table_size + table_offset,
+		n_blks = DIV_ROUND_UP(batch_size + table_offset,
 				      ctxt.cur_dev->blksz);
 
-		/* Don't load any data for sparse blocks */
-		if (finfo.blk_sizes[j] == 0) {
-			n_blks = 0;
-			table_offset = 0;
-			data_buffer = NULL;
-			data = NULL;
-		} else {
-			data_buffer = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
-
+		if (n_blks > data_blks) {
+			free(data_buffer);
+			data_buffer = malloc_cache_aligned(n_blks *
+							   ctxt.cur_dev->blksz);
 			if (!data_buffer) {
 				ret = -ENOMEM;
 				goto out;
 			}
+			data_blks = n_blks;
+		}
 
-			ret = sqfs_disk_read(start, n_blks, data_buffer);
-			if (ret < 0) {
-				/*
-				 * Possible causes: too many data blocks or too large
-				 * SquashFS block size. Tip: re-compile the SquashFS
-				 * image with mksquashfs's -b <block_size> option.
-				 */
-				printf("Error: too many data blocks to be read.\n");
-				goto out;
-			}
-
-			data = data_buffer + table_offset;
+		ret = sqfs_disk_read(start, n_blks, data_buffer);
+		if (ret < 0) {
+			/*
+			 * Possible causes: too many data blocks or too large
+			 * SquashFS block size. Tip: re-compile the SquashFS
+			 * image with mksquashfs's -b <block_size> option.
+			 */
+			printf("Error: too many data blocks to be read.\n");
+			goto out;
 		}
 
-		/* Load the data */
-		if (finfo.blk_sizes[j] == 0) {
-			/* This is a sparse block */
-			sparse_size = get_unaligned_le32(&sblk->block_size);
-			if ((*actread + sparse_size) > len)
-				sparse_size = len - *actread;
-			memset(buf + *actread, 0, sparse_size);
-			*actread += sparse_size;
-		} else if (SQFS_COMPRESSED_BLOCK(finfo.blk_sizes[j])) {
-			dest_len = get_unaligned_le32(&sblk->block_size);
-			ret = sqfs_decompress(&ctxt, datablock, &dest_len,
-					      data, table_size);
-			if (ret)
-				goto out;
+		data = data_buffer + table_offset;
+		for (; j < k; j++) {
+			table_size = SQFS_BLOCK_SIZE(finfo.blk_sizes[j]);
+
+			if (!SQFS_COMPRESSED_BLOCK(finfo.blk_sizes[j])) {
+				copy_size = min_t(u64, table_size, len - *actread);
+				memcpy(buf + *actread, data, copy_size);
+			} else if (len - *actread >= blksz) {
+				/* Decompress straight into the caller's buffer */
+				dest_len = blksz;
+				ret = sqfs_decompress(&ctxt, buf + *actread,
+						      &dest_len, data,
+						      table_size);
+				if (ret)
+					goto out;
+				copy_size = dest_len;
+			} else {
+				/* Only the tail fits, go through a bounce buffer */
+				if (!datablock) {
+					datablock = malloc(blksz);
+					if (!datablock) {
+						ret = -ENOMEM;
+						goto out;
+					}
+				}
+
+				dest_len = blksz;
+				ret = sqfs_decompress(&ctxt, datablock,
+						      &dest_len, data,
+						      table_size);
+				if (ret)
+					goto out;
+				copy_size = min_t(u64, dest_len,
+						  len - *actread);
+				memcpy(buf + *actread, datablock, copy_size);
+			}
 
-			if ((*actread + dest_len) > len)
-				dest_len = len - *actread;
-			memcpy(buf + *actread, datablock, dest_len);
-			*actread += dest_len;
-		} else {
-			if ((*actread + table_size) > len)
-				table_size = len - *actread;
-			memcpy(buf + *actread, data, table_size);
-			*actread += table_size;
+			*actread += copy_size;
+			data += table_size;
+			data_offset += table_size;
 		}
-
-		data_offset += table_size;
-		free(data_buffer);
-		if (*actread >= len)
-			break;
 	}
 
 	/*
 	 * There is no need to continue if the file is not fragmented.
 	 */
-	if (!finfo.frag) {
+	if (!finfo.frag || *actread >= len) {
 		ret = 0;
 		goto out;
 	}
 
-	start = lldiv(frag_entry.start, ctxt.cur_dev->blksz);
-	table_size = SQFS_BLOCK_SIZE(frag_entry.size);
-	table_offset = frag_entry.start - (start * ctxt.cur_dev->blksz);
-	n_blks = DIV_ROUND_UP(table_size + table_offset, ctxt.cur_dev->blksz);
-
-	fragment = malloc_cache_aligned(n_blks * ctxt.cur_dev->blksz);
-
-	if (!fragment) {
-		ret = -ENOMEM;
+	/* File fragmented, its tail is part of a (cached) fragment block */
+	ret = sqfs_get_fragment(&frag_entry, finfo.comp, &fc);
+	if (ret)
 		goto out;
-	}
 
-	ret = sqfs_disk_read(start, n_blks, fragment);
-	if (ret < 0)
+	if (finfo.offset + (len - *actread) > fc->size) {
+		ret = -EINVAL;
 		goto out;
-
-	/* File compressed and fragmented */
-	if (finfo.frag && finfo.comp) {
-		dest_len = get_unaligned_le32(&sblk->block_size);
-		fragment_block = malloc(dest_len);
-		if (!fragment_block) {
-			ret = -ENOMEM;
-			goto out;
-		}
-
-		ret = sqfs_decompress(&ctxt, fragment_block, &dest_len,
-				      (void *)fragment  + table_offset,
-				      frag_entry.size);
-		if (ret) {
-			free(fragment_block);
-			goto out;
-		}
-
-		memcpy(buf + *actread, &fragment_block[finfo.offset], finfo.size - *actread);
-		*actread = finfo.size;
-
-		free(fragment_block);
-
-	} else if (finfo.frag && !finfo.comp) {
-		fragment_block = (void *)fragment + table_offset;
-
-		memcpy(buf + *actread, &fragment_block[finfo.offset], finfo.size - *actread);
-		*actread = finfo.size;
 	}
 
+	memcpy(buf + *actread, fc->buf + finfo.offset, len - *actread);
+	*actread = len;
+
 out:
-	free(fragment);
+	free(data_buffer);
 	free(datablock);
 	free(file);
 	free(dir);
@@ -1705,6 +1888,8 @@ free_strings:
 
 void sqfs_close(void)
 {
+	if (!IS_ENABLED(CONFIG_FS_SQUASHFS_KEEP_CACHE))
+		sqfs_cache_free();
 	sqfs_decompressor_cleanup(&ctxt);
 	free(ctxt.sblk);
 	ctxt.sblk = NULL;
@@ -1719,8 +1904,7 @@ void sqfs_closedir(struct fs_dir_stream *dirs)
 		return;
 
 	sqfs_dirs = (struct squashfs_dir_stream *)dirs;
-	free(sqfs_dirs->inode_table);
-	free(sqfs_dirs->dir_table);
+	sqfs_put_tables(sqfs_dirs->tables);
 	free(sqfs_dirs->dir_header);
 	free(sqfs_dirs);
 }
@@ -18,6 +18,10 @@
 #include <u-boot/zlib.h>
 #endif
 
+#if IS_ENABLED(CONFIG_LZ4)
+#include <u-boot/lz4.h>
+#endif
+
 #if IS_ENABLED(CONFIG_ZSTD)
 #include <linux/zstd.h>
 #endif
@@ -38,10 +42,14 @@ int sqfs_decompressor_init(struct squashfs_ctxt *ctxt)
 	case SQFS_COMP_ZLIB:
 		break;
 #endif
+#if IS_ENABLED(CONFIG_LZ4)
+	case SQFS_COMP_LZ4:
+		break;
+#endif
 #if IS_ENABLED(CONFIG_ZSTD)
 	case SQFS_COMP_ZSTD:
-		ctxt->zstd_workspace = malloc(ZSTD_DCtxWorkspaceBound());
-		if (!ctxt->zstd_workspace)
+		ctxt->zstd_dctx = zstd_get_dctx();
+		if (!ctxt->zstd_dctx)
 			return -ENOMEM;
 		break;
 #endif
@@ -66,9 +74,14 @@ void sqfs_decompressor_cleanup(struct squashfs_ctxt *ctxt)
 	case SQFS_COMP_ZLIB:
 		break;
 #endif
+#if IS_ENABLED(CONFIG_LZ4)
+	case SQFS_COMP_LZ4:
+		break;
+#endif
 #if IS_ENABLED(CONFIG_ZSTD)
 	case SQFS_COMP_ZSTD:
-		free(ctxt->zstd_workspace);
+		zstd_put_dctx(ctxt->zstd_dctx);
+		ctxt->zstd_dctx = NULL;
 		break;
 #endif
 	}
@@ -93,17 +106,21 @@ static void zlib_decompression_status(int ret)
 
 #if IS_ENABLED(CONFIG_ZSTD)
 static int sqfs_zstd_decompress(struct squashfs_ctxt *ctxt, void *dest,
-				unsigned long dest_len, void *source, u32 src_len)
+				unsigned long *dest_len, void *source,
+				u32 src_len)
 {
-	ZSTD_DCtx *ctx;
-	size_t wsize;
-	int ret;
+	size_t ret;
 
-	wsize = ZSTD_DCtxWorkspaceBound();
-	ctx = ZSTD_initDCtx(ctxt->zstd_workspace, wsize);
-	ret = ZSTD_decompressDCtx(ctx, dest, dest_len, source, src_len);
+	/* The context is reset for each frame, so is used as it is */
+	ret = ZSTD_decompressDCtx(ctxt->zstd_dctx->dctx, dest, *dest_len,
+				  source, src_len);
+	if (ZSTD_isError(ret)) {
+		printf("ZSTD Error code: %d\n", ZSTD_getErrorCode(ret));
+		return -EINVAL;
+	}
+	*dest_len = ret;
 
-	return ZSTD_isError(ret);
+	return 0;
 }
 #endif /* CONFIG_ZSTD */
 
@@ -136,13 +153,27 @@ int sqfs_decompress(struct squashfs_ctxt *ctxt, void *dest,
 
 		break;
 #endif
-#if IS_ENABLED(CONFIG_ZSTD)
-	case SQFS_COMP_ZSTD:
-		ret = sqfs_zstd_decompress(ctxt, dest, *dest_len, source, src_len);
-		if (ret) {
-			printf("ZSTD Error code: %d\n", ZSTD_getErrorCode(ret));
+#if IS_ENABLED(CONFIG_LZ4)
+	case SQFS_COMP_LZ4:
+		/* Squashfs stores plain LZ4 blocks, not frames */
+		ret = LZ4_decompress_safe(source, dest, src_len,
+					  min_t(unsigned long, *dest_len,
+						INT_MAX));
+		if (ret < 0) {
+			printf("LZ4 decompression failed. Error code: %d\n", ret);
 			return -EINVAL;
 		}
+		*dest_len = ret;
+		ret = 0;
+
+		break;
+#endif
+#if IS_ENABLED(CONFIG_ZSTD)
+	case SQFS_COMP_ZSTD:
+		ret = sqfs_zstd_decompress(ctxt, dest, dest_len, source,
+					   src_len);
+		if (ret)
+			return ret;
 
 		break;
 #endif
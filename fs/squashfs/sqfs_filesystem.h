@@ -29,6 +29,10 @@
 #define SQFS_EMPTY_FILE_SIZE 3
 #define SQFS_STOP_READDIR 1
 #define SQFS_EMPTY_DIR -1
+/* Number of decompressed fragment blocks kept in the cache */
+#define SQFS_FRAG_CACHE_SIZE 4
+/* Largest run of consecutive data blocks read from the device at once */
+#define SQFS_DATA_BATCH_SIZE (1024 * 1024)
 /*
  * A directory entry object has a fixed length of 8 bytes, corresponding to its
  * first four members, plus the size of the entry name, which is equal to
@@ -73,13 +77,50 @@ struct squashfs_super_block {
 	__le64 export_table_start;
 };
 
+/*
+ * Decompressed inode and directory tables. Directory streams outlive the
+ * mount they were opened in, so each holds a reference.
+ */
+struct squashfs_tables {
+	int refcount;
+	unsigned char *inode_table;
+	unsigned char *dir_table;
+	/* Positions of the directory table's metadata blocks */
+	u32 *pos_list;
+	int metablks_count;
+};
+
+struct squashfs_frag_cache {
+	/* Position of the fragment block on the device, 0 if unused */
+	u64 start;
+	/* Decompressed contents and their length */
+	char *buf;
+	unsigned long size;
+	ulong lru;
+};
+
 struct squashfs_ctxt {
 	struct disk_partition cur_part_info;
 	struct blk_desc *cur_dev;
 	struct squashfs_super_block *sblk;
 #if IS_ENABLED(CONFIG_ZSTD)
-	void *zstd_workspace;
+	struct zstd_dctx *zstd_dctx;
 #endif
+	/*
+	 * Decompressed metadata, filled on first use and kept until the
+	 * filesystem is closed (or, with CONFIG_FS_SQUASHFS_KEEP_CACHE, until
+	 * a different filesystem is probed).
+	 */
+	struct blk_desc *cache_dev;
+	lbaint_t cache_part_start;
+	struct squashfs_super_block cache_sblk;
+	struct squashfs_tables *tables;
+	/* Fragment index and the metadata blocks of fragment entries */
+	u64 *frag_index;
+	struct squashfs_fragment_block_entry **frag_entries;
+	int frag_index_count;
+	struct squashfs_frag_cache frag_cache[SQFS_FRAG_CACHE_SIZE];
+	ulong frag_seq;
 };
 
 struct squashfs_directory_index {
@@ -274,8 +315,9 @@ struct squashfs_dir_stream {
 	struct squashfs_ldir_inode i_ldir;
 	/*
 	 * References to the tables' beginnings. They are assigned in
-	 * sqfs_opendir() and freed in sqfs_closedir().
+	 * sqfs_opendir() and released in sqfs_closedir().
 	 */
+	struct squashfs_tables *tables;
 	unsigned char *inode_table;
 	unsigned char *dir_table;
 };
@@ -217,6 +217,10 @@ struct global_data {
 	 * @uclass_root_s.
 	 */
 	struct list_head *uclass_root;
+# if CONFIG_IS_ENABLED(DM_NODE_INDEX)
+	/** @dm_node_index: Index of devices by node and nodes by phandle */
+	struct dm_node_index *dm_node_index;
+# endif
 # if CONFIG_IS_ENABLED(OF_PLATDATA_DRIVER_RT)
 	/** @dm_driver_rt: Dynamic info about the driver */
 	struct driver_rt *dm_driver_rt;
@@ -127,6 +127,28 @@ int blkcache_read(int iftype, int dev,
 		  lbaint_t start, lbaint_t blkcnt,
 		  unsigned long blksz, void *buffer);
 
+/**
+ * blkcache_readahead() - decide whether a cache miss should read ahead
+ *
+ * This tracks the position of reads from each device. Once a few reads in a
+ * row are sequential, it returns a buffer into which the caller should read
+ * @countp blocks from @start, instead of just the @blkcnt blocks requested,
+ * then pass the result to blkcache_fill(). The read-ahead size doubles each
+ * time it is used, up to the configured limit.
+ *
+ * @param iftype - uclass_id_x for type of device
+ * @param dev - device index of particular type
+ * @param start - starting block number
+ * @param blkcnt - number of blocks requested
+ * @param blksz - size in bytes of each block
+ * @param countp - returns the number of blocks to read into the buffer
+ *
+ * Return: read-ahead buffer, or NULL to read only the requested blocks
+ */
+void *blkcache_readahead(int iftype, int dev,
+			 lbaint_t start, lbaint_t blkcnt,
+			 unsigned long blksz, lbaint_t *countp);
+
 /**
  * blkcache_fill() - make data read from a block device available
  * to the block cache
@@ -155,20 +177,36 @@ void blkcache_invalidate(int iftype, int dev);
 /**
  * blkcache_configure() - configure block cache
  *
+ * Each entry caches part of an aligned window of @blocks blocks, so @blocks
+ * is rounded down to a power of two. Read-ahead goes back to its default,
+ * CONFIG_BLOCK_CACHE_READAHEAD, within the limit for the new size.
+ *
  * @param blocks - maximum blocks per entry
- * @param entries - maximum entries in cache
+ * @param entries - maximum entries in cache, per device
  */
 void blkcache_configure(unsigned blocks, unsigned entries);
 
+/**
+ * blkcache_configure_readahead() - configure block cache read-ahead
+ *
+ * This is limited to half of the cache size for each device.
+ *
+ * @param blocks - maximum number of blocks to read ahead, 0 to disable
+ */
+void blkcache_configure_readahead(unsigned blocks);
+
 /*
  * statistics of the block cache
  */
 struct block_cache_stats {
 	unsigned hits;
 	unsigned misses;
-	unsigned entries; /* current entry count */
+	unsigned entries; /* current entry count, for all devices */
 	unsigned max_blocks_per_entry;
 	unsigned max_entries;
+	unsigned readaheads; /* number of reads extended by read-ahead */
+	unsigned readahead_blocks; /* blocks read beyond what was requested */
+	unsigned max_readahead;
 };
 
 /**
@@ -187,6 +225,13 @@ static inline int blkcache_read(int iftype, int dev,
 	return 0;
 }
 
+static inline void *blkcache_readahead(int iftype, int dev,
+				       lbaint_t start, lbaint_t blkcnt,
+				       unsigned long blksz, lbaint_t *countp)
+{
+	return NULL;
+}
+
 static inline void blkcache_fill(int iftype, int dev,
 				 lbaint_t start, lbaint_t blkcnt,
 				 unsigned long blksz, void const *buffer) {}
@@ -198,6 +243,43 @@ static inline void blkcache_invalidate(int iftype, int dev) {}
 #if CONFIG_IS_ENABLED(BLK)
 struct udevice;
 
+/**
+ * enum blk_req_op - operation performed by an asynchronous block request
+ *
+ * @BLK_REQ_READ: Read blocks into the buffer
+ * @BLK_REQ_WRITE: Write blocks from the buffer
+ */
+enum blk_req_op {
+	BLK_REQ_READ,
+	BLK_REQ_WRITE,
+};
+
+/**
+ * struct blk_req - an asynchronous block I/O request
+ *
+ * The caller fills in @op, @start, @blkcnt and @buffer, then passes the
+ * request to blk_submit(). The request and its buffer must stay valid until
+ * @complete is set, which happens inside blk_submit() or blk_poll().
+ *
+ * @op:		Operation to perform
+ * @start:	Start block number (0=first)
+ * @blkcnt:	Number of blocks to transfer
+ * @buffer:	Data buffer, the destination for reads, source for writes
+ * @result:	Number of blocks transferred, or -ve error number, valid once
+ *		@complete is set
+ * @complete:	true once the request has finished
+ * @priv:	For use by the driver while the request is in flight
+ */
+struct blk_req {
+	enum blk_req_op op;
+	lbaint_t start;
+	lbaint_t blkcnt;
+	void *buffer;
+	long result;
+	bool complete;
+	void *priv;
+};
+
 /* Operations on block devices */
 struct blk_ops {
 	/**
@@ -238,6 +320,24 @@ struct blk_ops {
 	unsigned long (*erase)(struct udevice *dev, lbaint_t start,
 			       lbaint_t blkcnt);
 
+	/**
+	 * write_zeroes() - set a section of a block device to zero
+	 *
+	 * This is optional. Devices which can zero blocks without the data
+	 * being sent, e.g. by erasing them, provide it so that large empty
+	 * regions are quick to write.
+	 *
+	 * @dev:	Device to update
+	 * @start:	Start block number to zero (0=first)
+	 * @blkcnt:	Number of blocks to zero
+	 * @return @blkcnt if all the blocks were zeroed, -EOPNOTSUPP if the
+	 * device cannot zero this region itself (the caller should write
+	 * zeroes instead), or other -ve error number (see the IS_ERR_VALUE()
+	 * macro)
+	 */
+	unsigned long (*write_zeroes)(struct udevice *dev, lbaint_t start,
+				      lbaint_t blkcnt);
+
 	/**
 	 * select_hwpart() - select a particular hardware partition
 	 *
@@ -256,6 +356,49 @@ struct blk_ops {
 	 * @return 0 if OK, -ve on error
 	 */
 	int (*select_hwpart)(struct udevice *dev, int hwpart);
+
+	/**
+	 * submit() - queue a request without waiting for it to finish
+	 *
+	 * This is optional. Devices which can have several commands
+	 * outstanding provide it, along with poll(), so that callers can keep
+	 * the device busy. Other devices are driven synchronously through
+	 * read() and write().
+	 *
+	 * The driver must set @req->result and @req->complete when the
+	 * request finishes, either here or in poll().
+	 *
+	 * @dev:	Device to use
+	 * @req:	Request to queue
+	 * @return 0 if queued, -EBUSY if the device queue is full (call poll()
+	 * and try again), other -ve error number on failure
+	 */
+	int (*submit)(struct udevice *dev, struct blk_req *req);
+
+	/**
+	 * poll() - check for requests which have finished
+	 *
+	 * This must be provided if submit() is.
+	 *
+	 * @dev:	Device to check
+	 * @return number of requests completed by this call, or -ve error
+	 * number
+	 */
+	int (*poll)(struct udevice *dev);
+
+	/**
+	 * cancel() - stop tracking a request which has not finished
+	 *
+	 * This must be provided if submit() is. Once it returns, the driver
+	 * must not access @req again, so the caller may free it. Hardware
+	 * which cannot abort a command may still transfer data to or from
+	 * @req->buffer, but its completion is dropped.
+	 *
+	 * @dev:	Device the request was submitted to
+	 * @req:	Request to cancel
+	 * @return 0 if OK, -ve error number on failure
+	 */
+	int (*cancel)(struct udevice *dev, struct blk_req *req);
 };
 
 #define blk_get_ops(dev)	((struct blk_ops *)(dev)->driver->ops)
@@ -272,6 +415,8 @@ unsigned long blk_dwrite(struct blk_desc *block_dev, lbaint_t start,
 			 lbaint_t blkcnt, const void *buffer);
 unsigned long blk_derase(struct blk_desc *block_dev, lbaint_t start,
 			 lbaint_t blkcnt);
+long blk_dwrite_zeroes(struct blk_desc *block_dev, lbaint_t start,
+		       lbaint_t blkcnt);
 
 /**
  * blk_read() - Read from a block device
@@ -310,6 +455,88 @@ long blk_write(struct udevice *dev, lbaint_t start, lbaint_t blkcnt,
  */
 long blk_erase(struct udevice *dev, lbaint_t start, lbaint_t blkcnt);
 
+/**
+ * blk_write_zeroes() - Set part of a block device to zero without writing it
+ *
+ * Either all of the blocks are zeroed or this fails. A device which zeroes
+ * only some of them is reported as failing with -EIO.
+ *
+ * @dev: Device to update
+ * @start: Start block to zero
+ * @blkcnt: Number of blocks to zero
+ * @return @blkcnt if the blocks were zeroed, -EOPNOTSUPP or -ENOSYS if the
+ * device cannot do this (write zeroes instead), or other -ve on error
+ */
+long blk_write_zeroes(struct udevice *dev, lbaint_t start, lbaint_t blkcnt);
+
+/**
+ * blk_submit() - Queue an asynchronous request on a block device
+ *
+ * If the device does not support queued requests, or a read can be served
+ * from the block cache, the request is carried out and completed before this
+ * returns.
+ *
+ * @dev: Device to use
+ * @req: Request to queue, see struct blk_req
+ * Return: 0 if the request was queued or completed, -EBUSY if the device
+ * queue is full (call blk_poll() and try again), other -ve error on failure
+ */
+int blk_submit(struct udevice *dev, struct blk_req *req);
+
+/**
+ * blk_poll() - Check for completed requests on a block device
+ *
+ * @dev: Device to check
+ * Return: number of requests completed by this call, or -ve error
+ */
+int blk_poll(struct udevice *dev);
+
+/**
+ * blk_wait() - Wait for an asynchronous request to finish
+ *
+ * If the request does not finish in time, or polling fails, it is cancelled
+ * with blk_cancel() before this returns.
+ *
+ * @dev: Device the request was submitted to
+ * @req: Request to wait for
+ * Return: number of blocks transferred, -ETIMEDOUT if the request did not
+ * finish in time, or other -ve error
+ */
+long blk_wait(struct udevice *dev, struct blk_req *req);
+
+/**
+ * blk_cancel() - Cancel an asynchronous request which has not finished
+ *
+ * Afterwards the device no longer refers to @req, which is marked complete
+ * with a result of -ECANCELED. This does nothing if @req is already complete.
+ *
+ * @dev: Device the request was submitted to
+ * @req: Request to cancel
+ * Return: 0 if OK, -ENOSYS if the device cannot cancel requests, or other
+ * -ve error
+ */
+int blk_cancel(struct udevice *dev, struct blk_req *req);
+
+/**
+ * blk_read_queued() - Read from a block device with several requests queued
+ *
+ * The read is split into chunks, with up to CONFIG_BLK_QUEUE_DEPTH of them
+ * in flight at a time. blk_read() uses this for large reads on devices
+ * which support queued requests. Requests still in flight when it gives up
+ * are cancelled before it returns. If the device will not take any requests,
+ * because its queue is full of requests from elsewhere, the remainder is read
+ * synchronously instead.
+ *
+ * @dev: Device to read from
+ * @start: Start block for the read
+ * @blkcnt: Number of blocks to read
+ * @buffer: Place to put the data
+ * Return: number of blocks read (which may be less than @blkcnt if a chunk
+ * fails), or -ve on error
+ */
+long blk_read_queued(struct udevice *dev, lbaint_t start, lbaint_t blkcnt,
+		     void *buffer);
+
 /**
  * blk_find_device() - Find a block device
  *
@@ -515,6 +742,12 @@ static inline ulong blk_derase(struct blk_desc *block_dev, lbaint_t start,
 	return block_dev->block_erase(block_dev, start, blkcnt);
 }
 
+static inline long blk_dwrite_zeroes(struct blk_desc *block_dev,
+				     lbaint_t start, lbaint_t blkcnt)
+{
+	return -ENOSYS;
+}
+
 /**
  * struct blk_driver - Driver for block interface types
  *
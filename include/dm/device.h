@@ -165,6 +165,8 @@ enum {
  *		automatically when the device is removed / unbound
  * @dma_offset: Offset between the physical address space (CPU's) and the
  *		device's bus address space
+ * @node_next: Next device in the same hash chain of the node index (do not
+ *	access outside driver model)
  */
 struct udevice {
 	const struct driver *driver;
@@ -194,6 +196,9 @@ struct udevice {
 #if CONFIG_IS_ENABLED(DM_DMA)
 	ulong dma_offset;
 #endif
+#if CONFIG_IS_ENABLED(DM_NODE_INDEX)
+	struct udevice *node_next;
+#endif
 };
 
 static inline int dm_udevice_size(void)
@@ -0,0 +1,127 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Index of devices and phandles in the control devicetree
+ *
+ * Looking up a device by its node, or a node by its phandle, otherwise means
+ * walking every device in a uclass or every node in the tree. With many
+ * phandle references (clocks, resets, pinctrl) that makes probing quadratic
+ * in the size of the tree.
+ */
+
+#ifndef _DM_NODE_INDEX_H
+#define _DM_NODE_INDEX_H
+
+#include <dm/ofnode.h>
+#include <dm/uclass-id.h>
+#include <linux/errno.h>
+
+struct udevice;
+
+#if CONFIG_IS_ENABLED(DM_NODE_INDEX)
+/**
+ * dm_node_index_init() - Set up an empty index
+ *
+ * This is called by dm_init(). Before relocation nothing is set up, to save
+ * pre-relocation malloc() space, and lookups fall back to a search.
+ *
+ * Return: 0 if OK, -ENOMEM if out of memory
+ */
+int dm_node_index_init(void);
+
+/**
+ * dm_node_index_uninit() - Free the index
+ */
+void dm_node_index_uninit(void);
+
+/**
+ * dm_node_index_add_dev() - Add a device to the index
+ *
+ * This is called when a device joins its uclass. Devices without a node are
+ * ignored.
+ *
+ * @dev:	Device to add
+ */
+void dm_node_index_add_dev(struct udevice *dev);
+
+/**
+ * dm_node_index_remove_dev() - Remove a device from the index
+ *
+ * @dev:	Device to remove
+ */
+void dm_node_index_remove_dev(struct udevice *dev);
+
+/**
+ * dm_node_index_move_dev() - Index a device under its current node
+ *
+ * This is for a device whose node has been changed since it was bound, so
+ * that it is found under the new node from now on.
+ *
+ * @dev:	Device to move, which must be bound
+ */
+void dm_node_index_move_dev(struct udevice *dev);
+
+/**
+ * dm_node_index_find_dev() - Find a device in a uclass by its node
+ *
+ * If several devices in the uclass use @node, the first one bound is
+ * returned, as with a search of the uclass.
+ *
+ * @id:		Uclass ID to look in
+ * @node:	Node to look for
+ * @devp:	Returns the device found
+ * Devices whose node was changed after binding are not found until
+ * dm_node_index_move_dev() is called for them, so callers must search the
+ * uclass when this fails.
+ *
+ * Return: 0 if found, -ENODEV if there is no such device in the index,
+ *	-ENOSYS if there is no index
+ */
+int dm_node_index_find_dev(enum uclass_id id, ofnode node,
+			   struct udevice **devp);
+
+/**
+ * dm_node_index_find_phandle() - Find a node in the control tree by phandle
+ *
+ * The phandle table is built on first use. Entries are checked before use,
+ * and the table is rebuilt if the tree has changed.
+ *
+ * @phandle:	Phandle to look for
+ * @nodep:	Returns the node found, or ofnode_null() if there is none
+ * Return: 0 if OK, -ENOSYS if there is no index, or it cannot be built
+ */
+int dm_node_index_find_phandle(uint phandle, ofnode *nodep);
+#else
+static inline int dm_node_index_init(void)
+{
+	return 0;
+}
+
+static inline void dm_node_index_uninit(void)
+{
+}
+
+static inline void dm_node_index_add_dev(struct udevice *dev)
+{
+}
+
+static inline void dm_node_index_remove_dev(struct udevice *dev)
+{
+}
+
+static inline void dm_node_index_move_dev(struct udevice *dev)
+{
+}
+
+static inline int dm_node_index_find_dev(enum uclass_id id, ofnode node,
+					 struct udevice **devp)
+{
+	return -ENOSYS;
+}
+
+static inline int dm_node_index_find_phandle(uint phandle, ofnode *nodep)
+{
+	return -ENOSYS;
+}
+#endif
+
+#endif
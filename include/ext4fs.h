@@ -119,6 +119,16 @@ struct ext_filesystem {
 	struct blk_desc *dev_desc;
 };
 
+/**
+ * struct ext_block_cache - view of one block held in the metadata cache
+ *
+ * The buffer is owned by the mount-wide metadata cache and only stays valid
+ * until the next metadata block is read.
+ *
+ * @buf:	block contents
+ * @block:	sector number of the block
+ * @size:	size of the block in bytes
+ */
 struct ext_block_cache {
 	char *buf;
 	lbaint_t block;
@@ -157,6 +167,8 @@ int ext4fs_devread(lbaint_t sector, int byte_offset, int byte_len, char *buf);
 void ext4fs_set_blk_dev(struct blk_desc *rbdd, struct disk_partition *info);
 long int read_allocated_block(struct ext2_inode *inode, int fileblock,
 			      struct ext_block_cache *cache);
+long int read_allocated_extent(struct ext2_inode *inode, lbaint_t fileblock,
+			       lbaint_t *count, struct ext_block_cache *cache);
 int ext4fs_probe(struct blk_desc *fs_dev_desc,
 		 struct disk_partition *fs_partition);
 int ext4_read_file(const char *filename, void *buf, loff_t offset, loff_t len,
@@ -166,4 +178,7 @@ int ext4fs_uuid(char *uuid_str);
 void ext_cache_init(struct ext_block_cache *cache);
 void ext_cache_fini(struct ext_block_cache *cache);
 int ext_cache_read(struct ext_block_cache *cache, lbaint_t block, int size);
+char *ext_meta_read(lbaint_t block, int size);
+void ext_meta_invalidate(void);
+void ext_meta_fini(void);
 #endif
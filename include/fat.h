@@ -31,6 +31,13 @@ struct disk_partition;
 #define FAT16BUFSIZE	(FATBUFSIZE/2)
 #define FAT32BUFSIZE	(FATBUFSIZE/4)
 
+/* Number of FATBUFBLOCKS windows of the FAT cached at once */
+#ifdef CONFIG_SPL_BUILD
+#define FATBUFWINDOWS	1
+#else
+#define FATBUFWINDOWS	CONFIG_FS_FAT_FATBUF_WINDOWS
+#endif
+
 /* Maximum number of entry for long file name according to spec */
 #define MAX_LFN_SLOT	20
 
@@ -161,6 +168,13 @@ typedef struct dir_slot {
 	__u8	name11_12[4];	/* Last 2 characters in name */
 } dir_slot;
 
+/* A window of FATBUFBLOCKS sectors of the FAT, held in fsdata.fatbuf */
+typedef struct {
+	int	num;		/* Window number, -1 if unused */
+	__u8	dirty;		/* Set if the window has been modified */
+	__u32	lru;		/* Last use, from fsdata.fatbuf_seq */
+} fat_window;
+
 /*
  * Private filesystem parameters
  *
@@ -168,16 +182,17 @@ typedef struct dir_slot {
  * (see FAT32 accesses)
  */
 typedef struct {
-	__u8	*fatbuf;	/* Current FAT buffer */
+	__u8	*fatbuf;	/* FAT window cache, fatbuf_windows windows */
 	int	fatsize;	/* Size of FAT in bits */
 	__u32	fatlength;	/* Length of FAT in sectors */
 	__u16	fat_sect;	/* Starting sector of the FAT */
-	__u8	fat_dirty;      /* Set if fatbuf has been modified */
+	fat_window fatwin[FATBUFWINDOWS]; /* Windows held in fatbuf */
+	int	fatbuf_windows;	/* Number of windows allocated in fatbuf */
+	__u32	fatbuf_seq;	/* Counter for fat_window.lru */
 	__u32	rootdir_sect;	/* Start sector of root directory */
 	__u16	sect_size;	/* Size of sectors in bytes */
 	__u16	clust_size;	/* Size of clusters in sectors */
 	int	data_begin;	/* The sector of the first cluster, can be negative */
-	int	fatbufnum;	/* Used by get_fatent, init to -1 */
 	int	rootdir_size;	/* Size of root dir for non-FAT32 */
 	__u32	root_cluster;	/* First cluster of root dir for FAT32 */
 	u32	total_sect;	/* Number of sectors */
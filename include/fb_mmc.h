@@ -32,6 +32,36 @@ int fastboot_mmc_get_part_info(const char *part_name,
  */
 void fastboot_mmc_flash_write(const char *cmd, void *download_buffer,
 			      u32 download_bytes, char *response);
+
+/**
+ * fastboot_mmc_stream_start() - Get ready to write a download as it arrives
+ *
+ * Images which need to be checked as a whole, such as a GPT, cannot be
+ * streamed.
+ *
+ * @cmd: Named partition to write the image to
+ * @response: Pointer to fastboot response buffer, written on error
+ * Return: 0 if OK, -ve on error
+ */
+int fastboot_mmc_stream_start(const char *cmd, char *response);
+
+/**
+ * fastboot_mmc_stream_write() - Write the next part of a download
+ *
+ * Raw images are written in whole blocks and sparse images a chunk at a time,
+ * so some bytes at the end of @data may be left over. These must be passed
+ * again, followed by more of the download. When @last is set, everything is
+ * written and the image is checked.
+ *
+ * @data: Next part of the download
+ * @len: Length of @data in bytes
+ * @last: true if @data runs to the end of the download
+ * @response: Pointer to fastboot response buffer, written on error
+ * Return: number of bytes used from the start of @data, or -ve on error
+ */
+int fastboot_mmc_stream_write(const void *data, u32 len, bool last,
+			      char *response);
+
 /**
  * fastboot_mmc_flash_erase() - Erase eMMC for fastboot
  *
@@ -9,6 +9,25 @@
 
 #define ROUNDUP(x, y)	(((x) + ((y) - 1)) & ~((y) - 1))
 
+/**
+ * struct sparse_stats - what was done to write a sparse image
+ *
+ * Counts are in storage blocks, see &struct sparse_storage.blksz
+ *
+ * @raw_blks: Blocks written from raw chunks
+ * @fill_blks: Blocks written from fill chunks
+ * @zero_blks: Blocks of zero fill which the storage zeroed itself
+ * @skip_blks: Blocks in don't-care chunks
+ * @writes: Number of calls to &struct sparse_storage.write
+ */
+struct sparse_stats {
+	lbaint_t	raw_blks;
+	lbaint_t	fill_blks;
+	lbaint_t	zero_blks;
+	lbaint_t	skip_blks;
+	unsigned int	writes;
+};
+
 struct sparse_storage {
 	lbaint_t	blksz;
 	lbaint_t	start;
@@ -24,7 +43,18 @@ struct sparse_storage {
 				 lbaint_t blk,
 				 lbaint_t blkcnt);
 
+	/*
+	 * Optional: zero blocks without writing them. Returns @blkcnt if they
+	 * were all zeroed, or -ve error, -EOPNOTSUPP if they must be written
+	 */
+	lbaint_t	(*zero)(struct sparse_storage *info,
+				lbaint_t blk,
+				lbaint_t blkcnt);
+
 	void		(*mssg)(const char *str, char *response);
+
+	/* Filled in as the image is written */
+	struct sparse_stats stats;
 };
 
 static inline int is_sparse_image(void *buf)
@@ -40,3 +70,65 @@ static inline int is_sparse_image(void *buf)
 
 int write_sparse_image(struct sparse_storage *info, const char *part_name,
 		       void *data, char *response);
+
+/**
+ * struct sparse_stream - a sparse image being written as it arrives
+ *
+ * @info: Storage to write to
+ * @header: Sparse image header, once @have_header is set
+ * @chunk: Header of the current chunk, while @in_chunk is set
+ * @have_header: true once the image header has been read
+ * @in_chunk: true while the data of @chunk is still to come
+ * @chunks_left: Number of chunk headers still to come
+ * @data_left: Bytes of data still to come in the current chunk
+ * @blk: Next block to write
+ * @bytes_written: Number of bytes written so far
+ * @total_blocks: Number of sparse blocks handled so far
+ */
+struct sparse_stream {
+	struct sparse_storage *info;
+	sparse_header_t header;
+	chunk_header_t chunk;
+	bool have_header;
+	bool in_chunk;
+	uint32_t chunks_left;
+	uint64_t data_left;
+	lbaint_t blk;
+	uint64_t bytes_written;
+	uint32_t total_blocks;
+};
+
+/**
+ * sparse_stream_init() - Get ready to write a sparse image as it arrives
+ *
+ * @ss: Stream to set up
+ * @info: Storage to write to, which must stay valid while the stream is used
+ */
+void sparse_stream_init(struct sparse_stream *ss, struct sparse_storage *info);
+
+/**
+ * sparse_stream_write() - Write the next part of a sparse image
+ *
+ * Headers are used once they have all arrived and raw data is written in
+ * whole blocks, so some bytes at the end of @data may be left over. These
+ * must be passed again, followed by the rest of the image.
+ *
+ * @ss: Stream to write to
+ * @data: Next part of the image
+ * @len: Length of @data in bytes
+ * @response: Response buffer, written on error
+ * Return: number of bytes used from the start of @data, or -ve on error
+ */
+long sparse_stream_write(struct sparse_stream *ss, const void *data,
+			 size_t len, char *response);
+
+/**
+ * sparse_stream_finish() - Check that the whole sparse image has been written
+ *
+ * @ss: Stream to check
+ * @part_name: Name of the partition written, for the message
+ * @response: Response buffer, written on error
+ * Return: 0 if OK, -ve on error
+ */
+int sparse_stream_finish(struct sparse_stream *ss, const char *part_name,
+			 char *response);
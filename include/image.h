@@ -935,6 +935,78 @@ int image_decomp(int comp, ulong load, ulong image_start, int type,
 		 void *load_buf, void *image_buf, ulong image_len,
 		 uint unc_len, ulong *load_end);
 
+/**
+ * struct image_decomp_stream - state for decompressing an image in chunks
+ *
+ * @comp:	Compression algorithm that is used (IH_COMP_...)
+ * @buf:	Place to decompress to
+ * @size:	Available space for decompression
+ * @len:	Number of bytes written to @buf so far
+ * @priv:	Private state of the decompressor
+ */
+struct image_decomp_stream {
+	int comp;
+	void *buf;
+	ulong size;
+	ulong len;
+	void *priv;
+};
+
+/**
+ * image_decomp_stream_supported() - Check if an algorithm can be streamed
+ *
+ * @comp:	Compression algorithm (IH_COMP_...)
+ * Return: true if image_decomp_stream_start() supports @comp
+ */
+bool image_decomp_stream_supported(int comp);
+
+/**
+ * image_decomp_stream_start() - Start decompressing an image in chunks
+ *
+ * This is an alternative to image_decomp() for callers which see the
+ * compressed data a piece at a time. Output is written straight to @load_buf
+ * and only a small amount of state is allocated, along with room for one
+ * compressed block if a block is split between two calls to
+ * image_decomp_stream_write().
+ *
+ * @ds:		Stream state to set up
+ * @comp:	Compression algorithm that is used (IH_COMP_...)
+ * @type:	Image type (IH_TYPE_...), used for the message
+ * @load_buf:	Place to decompress to
+ * @unc_len:	Available space for decompression
+ * Return: 0 if OK, -ENOSYS if @comp cannot be decompressed in chunks,
+ *	-ENOMEM if out of memory
+ */
+int image_decomp_stream_start(struct image_decomp_stream *ds, int comp,
+			      int type, void *load_buf, ulong unc_len);
+
+/**
+ * image_decomp_stream_write() - Decompress the next chunk of an image
+ *
+ * Chunks may be of any size. Data following the end of the compressed
+ * stream is ignored.
+ *
+ * @ds:		Stream state
+ * @data:	Compressed data
+ * @len:	Number of bytes in @data
+ * Return: 0 if OK, -ENOSPC if the output does not fit, other -ve if the
+ *	compressed data is invalid
+ */
+int image_decomp_stream_write(struct image_decomp_stream *ds,
+			      const void *data, ulong len);
+
+/**
+ * image_decomp_stream_finish() - Finish decompressing an image in chunks
+ *
+ * This frees the stream state, so must be called even if
+ * image_decomp_stream_write() failed. @ds->len holds the number of bytes
+ * that were decompressed.
+ *
+ * @ds:		Stream state
+ * Return: 0 if OK, -EINVAL if the compressed stream was incomplete
+ */
+int image_decomp_stream_finish(struct image_decomp_stream *ds);
+
 /**
  * Set up properties in the FDT
  *
@@ -1253,6 +1325,78 @@ int fit_image_verify_with_data(const void *fit, int image_noffset,
 			       size_t size);
 
 int fit_image_verify(const void *fit, int noffset);
+
+/* Maximum number of hash nodes which can be checked while loading an image */
+#define FIT_VERIFY_MAX_HASHES	4
+
+/**
+ * struct fit_verify_ctx - State for verifying an image while it is loaded
+ *
+ * This allows a loader to hash image data as each chunk arrives from
+ * storage, instead of walking the whole image again once it is in memory.
+ *
+ * @fit:	FIT containing the image
+ * @image_noffset: Offset in @fit of the image node
+ * @count:	Number of entries in @hashes
+ * @hashes:	Hash nodes being checked, with their progressive hash state
+ */
+struct fit_verify_ctx {
+	const void *fit;
+	int image_noffset;
+	int count;
+	struct {
+		int noffset;
+		struct hash_algo *algo;
+		void *ctx;
+	} hashes[FIT_VERIFY_MAX_HASHES];
+};
+
+/**
+ * fit_image_verify_start() - Start verifying an image progressively
+ *
+ * This sets up a progressive hash for each hash node of the image. It is
+ * not possible if the image must also have its signature checked, since
+ * that needs all the data at once; the caller should then load the image
+ * and use fit_image_verify_with_data() as before.
+ *
+ * @vctx:	Verification state to set up
+ * @fit:	Pointer to the FIT format image header
+ * @image_noffset: Offset in @fit of image to verify
+ * @key_blob:	FDT containing public keys
+ * Return: 0 if OK, -ENOSYS if the image cannot be verified progressively,
+ *	other -ve on error
+ */
+int fit_image_verify_start(struct fit_verify_ctx *vctx, const void *fit,
+			   int image_noffset, const void *key_blob);
+
+/**
+ * fit_image_verify_update() - Add more image data to a progressive check
+ *
+ * @vctx:	Verification state from fit_image_verify_start()
+ * @data:	Next chunk of image data
+ * @size:	Size of the chunk in bytes
+ */
+void fit_image_verify_update(struct fit_verify_ctx *vctx, const void *data,
+			     size_t size);
+
+/**
+ * fit_image_verify_finish() - Complete a progressive check
+ *
+ * This prints the result of each hash like fit_image_verify_with_data()
+ * does and releases the hash state.
+ *
+ * @vctx:	Verification state from fit_image_verify_start()
+ * Return: 1 if all hashes are valid, 0 otherwise
+ */
+int fit_image_verify_finish(struct fit_verify_ctx *vctx);
+
+/**
+ * fit_image_verify_abort() - Release a progressive check without a result
+ *
+ * @vctx:	Verification state from fit_image_verify_start()
+ */
+void fit_image_verify_abort(struct fit_verify_ctx *vctx);
+
 int fit_config_verify(const void *fit, int conf_noffset);
 int fit_all_image_verify(const void *fit);
 int fit_config_decrypt(const void *fit, int conf_noffset);
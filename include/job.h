@@ -0,0 +1,227 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * Running self-contained jobs on secondary CPUs
+ *
+ * U-Boot runs on the boot CPU, but work such as hashing a large image can be
+ * handed to otherwise-idle secondary CPUs. The boot CPU runs queued jobs too
+ * while it waits, so everything still works, just more slowly, when there are
+ * no secondary CPUs.
+ */
+
+#ifndef __JOB_H
+#define __JOB_H
+
+#include <linux/types.h>
+
+struct hash_algo;
+
+/**
+ * struct job - a piece of work which may run on another CPU
+ *
+ * A job runs alongside the boot CPU, so it must be self-contained. It must
+ * not use malloc(), the console, driver model, timers or anything else which
+ * is not safe to call from several CPUs at once.
+ *
+ * @func: Function to run, returning 0 if OK, other value on error
+ * @priv: Private data for @func
+ * @ret: Return value from @func, valid once the job is done
+ * @done: Non-zero once the job has finished
+ * @next: Next job in the queue
+ */
+struct job {
+	int (*func)(struct job *job);
+	void *priv;
+	int ret;
+	int done;
+	struct job *next;
+};
+
+/**
+ * struct job_hash - a job which hashes a region of memory
+ *
+ * @job: Job running the hash
+ * @algo: Hash algorithm to use
+ * @ctx: Hash context
+ * @data: Data to hash
+ * @len: Length of the data in bytes
+ */
+struct job_hash {
+	struct job job;
+	struct hash_algo *algo;
+	void *ctx;
+	const void *data;
+	size_t len;
+};
+
+/**
+ * struct job_lz4 - a job which decompresses an LZ4 block
+ *
+ * @job: Job running the decompression; its return value is the number of
+ *	bytes written, or -ve on error
+ * @src: Compressed block, without any frame or block header
+ * @src_len: Size of the compressed block
+ * @dst: Place to write the decompressed data
+ * @dst_len: Space available at @dst
+ */
+struct job_lz4 {
+	struct job job;
+	const void *src;
+	size_t src_len;
+	void *dst;
+	size_t dst_len;
+};
+
+#if CONFIG_IS_ENABLED(JOB)
+/**
+ * job_init() - Set up a job
+ *
+ * @job: Job to set up
+ * @func: Function to run
+ * @priv: Private data for @func
+ */
+void job_init(struct job *job, int (*func)(struct job *job), void *priv);
+
+/**
+ * job_workers() - Get the number of secondary CPUs which run jobs
+ *
+ * The secondary CPUs are started on first use. Nothing is started before
+ * relocation.
+ *
+ * Return: number of secondary CPUs, 0 if jobs only run on the boot CPU
+ */
+int job_workers(void);
+
+/**
+ * job_submit() - Queue a job to run
+ *
+ * If there are no secondary CPUs the job is run straight away.
+ *
+ * @job: Job to run, set up with job_init(). This must stay in place until
+ *	job_wait() returns
+ */
+void job_submit(struct job *job);
+
+/**
+ * job_wait() - Wait for a job to finish
+ *
+ * While waiting, the boot CPU runs queued jobs itself.
+ *
+ * @job: Job to wait for
+ * Return: return value of the job
+ */
+int job_wait(struct job *job);
+
+/**
+ * job_run_queue() - Run queued jobs until there are none left
+ *
+ * This is called on a secondary CPU when job_arch_kick() wakes it.
+ */
+void job_run_queue(void);
+
+/**
+ * job_stop() - Stop the secondary CPUs before the OS starts
+ *
+ * Any jobs still queued are run on the boot CPU. Later jobs also run on the
+ * boot CPU.
+ */
+void job_stop(void);
+
+/**
+ * job_memset() - Fill memory, using secondary CPUs for large regions
+ *
+ * @s: Region to fill
+ * @c: Byte value to fill with
+ * @n: Number of bytes to fill
+ */
+void job_memset(void *s, int c, size_t n);
+
+/**
+ * job_memcpy() - Copy memory, using secondary CPUs for large regions
+ *
+ * The regions must not overlap.
+ *
+ * @dst: Destination
+ * @src: Source
+ * @n: Number of bytes to copy
+ */
+void job_memcpy(void *dst, const void *src, size_t n);
+
+/**
+ * job_hash_start() - Start hashing a region of memory
+ *
+ * The hash context is allocated here, on the boot CPU. Call
+ * job_hash_finish() to get the result. Several hashes can run at once, one
+ * per CPU.
+ *
+ * @jh: Job to set up
+ * @algo_name: Name of hash algorithm, e.g. "sha256"
+ * @data: Data to hash
+ * @len: Length of the data in bytes
+ * Return: 0 if OK, -EPROTONOSUPPORT if the algorithm is not known, other -ve
+ *	on error
+ */
+int job_hash_start(struct job_hash *jh, const char *algo_name,
+		   const void *data, size_t len);
+
+/**
+ * job_hash_finish() - Wait for a hash and get its value
+ *
+ * @jh: Job started by job_hash_start()
+ * @output: Place to put the hash value
+ * @size: Size of @output in bytes
+ * Return: 0 if OK, -ve on error
+ */
+int job_hash_finish(struct job_hash *jh, void *output, int size);
+
+/**
+ * job_lz4_start() - Start decompressing an LZ4 block
+ *
+ * LZ4 frames made with independent blocks can be decompressed a block at a
+ * time on several CPUs. Use job_wait(&jl->job) to get the result.
+ *
+ * @jl: Job to set up
+ * @src: Compressed block
+ * @src_len: Size of the compressed block
+ * @dst: Place to write the decompressed data
+ * @dst_len: Space available at @dst
+ */
+void job_lz4_start(struct job_lz4 *jl, const void *src, size_t src_len,
+		   void *dst, size_t dst_len);
+
+/**
+ * job_arch_init() - Start the secondary CPUs which run jobs
+ *
+ * This is implemented by the architecture. The default has no secondary
+ * CPUs.
+ *
+ * Return: number of secondary CPUs which can run jobs, 0 if none
+ */
+int job_arch_init(void);
+
+/**
+ * job_arch_kick() - Tell secondary CPUs that there are jobs to run
+ *
+ * This is implemented by the architecture. Each secondary CPU that is not
+ * already running jobs should call job_run_queue().
+ */
+void job_arch_kick(void);
+
+/**
+ * job_arch_stop() - Stop the secondary CPUs which run jobs
+ *
+ * This is implemented by architectures whose secondary CPUs must be handed
+ * back before the OS starts. The default does nothing.
+ */
+void job_arch_stop(void);
+#else
+static inline int job_workers(void)
+{
+	return 0;
+}
+
+static inline void job_stop(void)
+{
+}
+#endif
+
+#endif
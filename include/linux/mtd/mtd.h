@@ -594,6 +594,25 @@ void mtd_get_len_incl_bad(struct mtd_info *mtd, uint64_t offset,
 			  int *truncated);
 bool mtd_dev_list_updated(void);
 
+/**
+ * mtd_write_gen() - get the write generation of MTD devices
+ *
+ * This changes with every erase, write and bad-block marking through the MTD
+ * layer, on any device. It lets a caller which keeps information about what
+ * is on a device tell whether that information may be out of date.
+ *
+ * Return: current write generation
+ */
+unsigned long mtd_write_gen(void);
+
+/**
+ * mtd_write_gen_bump() - note that an MTD device may have changed
+ *
+ * This is for code which writes or erases a device without going through
+ * mtd_write() or mtd_erase(), such as the SPI flash API.
+ */
+void mtd_write_gen_bump(void);
+
 /* drivers/mtd/mtd_uboot.c */
 int mtd_search_alternate_name(const char *mtdname, char *altname,
 			      unsigned int max_len);
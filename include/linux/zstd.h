@@ -1146,13 +1146,72 @@ size_t ZSTD_insertBlock(ZSTD_DCtx *dctx, const void *blockStart,
 
 struct abuf;
 
+/**
+ * struct zstd_dctx - a decompression context with its workspace
+ *
+ * @dctx: Decompression context, within @workspace
+ * @workspace: Memory holding the context
+ * @busy: true while the context is in use
+ * @temp: true if the context is freed when put, rather than kept
+ */
+struct zstd_dctx {
+	ZSTD_DCtx *dctx;
+	void *workspace;
+	bool busy;
+	bool temp;
+};
+
+/**
+ * zstd_get_dctx() - Get a decompression context
+ *
+ * One context is kept once allocated and handed out again, so a caller which
+ * decompresses many blocks does not need a new workspace each time. Other
+ * contexts, needed while that one is in use, are freed when put. The context
+ * can be used with ZSTD_decompressDCtx() straight away, or with
+ * ZSTD_decompressBegin() for block-by-block decompression.
+ *
+ * Return: context, or NULL if out of memory
+ */
+struct zstd_dctx *zstd_get_dctx(void);
+
+/**
+ * zstd_put_dctx() - Finish with a decompression context
+ *
+ * @zd: Context from zstd_get_dctx(), or NULL to do nothing
+ */
+void zstd_put_dctx(struct zstd_dctx *zd);
+
 /**
  * zstd_decompress() - Decompress Zstandard data
  *
+ * All frames in @in are decompressed, one after the other. Anything after the
+ * last frame, such as padding, is ignored. Frames which record their size are
+ * decompressed on several CPUs at once, if available.
+ *
  * @in: Input buffer to decompress
  * @out: Output buffer to hold the results (must be large enough)
- * Return: size of the decompressed data, or -ve on error
+ * Return: size of the decompressed data, -ENOSPC if @out is too small, other
+ *	-ve on error
  */
 int zstd_decompress(struct abuf *in, struct abuf *out);
 
+/**
+ * zstd_decompress_window() - Decompress Zstandard data a window at a time
+ *
+ * This is for callers which cannot hold all the decompressed data at once,
+ * e.g. when writing it to storage. The data is passed to @write in pieces
+ * no larger than @window, so only the largest window used by any frame must
+ * be held in memory. The stream workspace is freed before returning.
+ *
+ * @in: Input buffer to decompress
+ * @window: Buffer to decompress into, reused for each piece
+ * @write: Function to take each piece, returning 0 if OK, -ve on error
+ * @priv: Private data for @write
+ * Return: 0 if OK, -ve on error, including an error from @write
+ */
+int zstd_decompress_window(struct abuf *in, struct abuf *window,
+			   int (*write)(void *priv, const void *buf,
+					size_t len),
+			   void *priv);
+
 #endif  /* ZSTD_H */
@@ -40,16 +40,21 @@ struct lmb_property {
  *
  * @cnt: Number of regions.
  * @max: Size of the region array, max value of cnt.
- * @region: Array of the region properties
+ * @region: Array of the region properties, sorted by base address
+ * @allocated: @region was allocated when the array had to grow
  */
 struct lmb_region {
 	unsigned long cnt;
 	unsigned long max;
-#if IS_ENABLED(CONFIG_LMB_USE_MAX_REGIONS)
+#if IS_ENABLED(CONFIG_LMB_USE_MAX_REGIONS) && \
+	!IS_ENABLED(CONFIG_LMB_GROW_REGIONS)
 	struct lmb_property region[CONFIG_LMB_MAX_REGIONS];
 #else
 	struct lmb_property *region;
 #endif
+#if IS_ENABLED(CONFIG_LMB_GROW_REGIONS)
+	bool allocated;
+#endif
 };
 
 /**
@@ -59,6 +64,8 @@ struct lmb_region {
  * The content of the structure is managed by the lmb library.
  * A lmb struct is  initialized by lmb_init() functions.
  * The lmb struct is passed to all other lmb APIs.
+ * With CONFIG_LMB_GROW_REGIONS the region arrays may grow beyond the
+ * statically allocated ones, so lmb_uninit() must be called when done.
  *
  * @memory: Description of memory regions.
  * @reserved: Description of reserved regions.
@@ -68,13 +75,26 @@ struct lmb_region {
 struct lmb {
 	struct lmb_region memory;
 	struct lmb_region reserved;
-#ifdef CONFIG_LMB_MEMORY_REGIONS
+#if IS_ENABLED(CONFIG_LMB_USE_MAX_REGIONS) && \
+	IS_ENABLED(CONFIG_LMB_GROW_REGIONS)
+	struct lmb_property memory_regions[CONFIG_LMB_MAX_REGIONS];
+	struct lmb_property reserved_regions[CONFIG_LMB_MAX_REGIONS];
+#elif defined(CONFIG_LMB_MEMORY_REGIONS)
 	struct lmb_property memory_regions[CONFIG_LMB_MEMORY_REGIONS];
 	struct lmb_property reserved_regions[CONFIG_LMB_RESERVED_REGIONS];
 #endif
 };
 
 void lmb_init(struct lmb *lmb);
+/**
+ * lmb_uninit() - release the region arrays of a logical memory block struct
+ *
+ * This frees any region arrays which had to grow and leaves @lmb empty, as
+ * after lmb_init().
+ *
+ * @lmb:	the logical memory block struct
+ */
+void lmb_uninit(struct lmb *lmb);
 void lmb_init_and_reserve(struct lmb *lmb, struct bd_info *bd, void *fdt_blob);
 void lmb_init_and_reserve_range(struct lmb *lmb, phys_addr_t base,
 				phys_size_t size, void *fdt_blob);
@@ -140,6 +140,11 @@ enum eth_recv_flags {
  * free_pkt: Give the driver an opportunity to manage its packet buffer memory
  *	     when the network stack is finished processing it. This will only be
  *	     called when no error was returned from recv - optional
+ * recv_into: Copy the next received packet into the buffer given, which has
+ *	      room for @size bytes. This lets a protocol have its payload put
+ *	      straight into place (see net_rx_loan()). Return the packet
+ *	      length, 0 if there is none, or -ENOSPC if it is too large, in
+ *	      which case it is left for recv() - optional
  * stop: Stop the hardware from looking for packets - may be called even if
  *	 state == PASSIVE
  * mcast: Join or leave a multicast group (for TFTP) - optional
@@ -159,6 +164,7 @@ struct eth_ops {
 	int (*send)(struct udevice *dev, void *packet, int length);
 	int (*recv)(struct udevice *dev, int flags, uchar **packetp);
 	int (*free_pkt)(struct udevice *dev, uchar *packet, int length);
+	int (*recv_into)(struct udevice *dev, int flags, uchar *buf, int size);
 	void (*stop)(struct udevice *dev);
 	int (*mcast)(struct udevice *dev, const u8 *enetaddr, int join);
 	int (*write_hwaddr)(struct udevice *dev);
@@ -709,6 +715,43 @@ int net_send_udp_packet(uchar *ether, struct in_addr dest, int dport,
 /* Processes a received packet */
 void net_process_received_packet(uchar *in_packet, int len);
 
+/* Largest number of header bytes which can go before a lent buffer */
+#define NET_RX_LOAN_MAX_HDR	64
+
+/**
+ * net_rx_loan() - Lend a buffer for the next received packet
+ *
+ * A protocol which knows where its next payload is going can ask for the
+ * packet to be received there, so that the payload need not be copied again.
+ * The @hdr_len bytes before @dest hold the packet headers while the packet is
+ * processed and are then put back, so they must be memory which the protocol
+ * owns. Any other packet received meanwhile may be written to @dest too.
+ *
+ * This only has an effect with drivers which provide recv_into(), which so far
+ * is only the sandbox driver. The loan lasts until net_rx_loan_end() is called
+ * or net_loop() finishes.
+ *
+ * @dest: Place for the payload of the next packet
+ * @hdr_len: Number of bytes of headers before the payload
+ * @len: Largest payload to put at @dest; larger packets are received as usual
+ * Return: 0 if OK, -EINVAL if the buffer cannot be used
+ */
+int net_rx_loan(void *dest, int hdr_len, int len);
+
+/**
+ * net_rx_loan_end() - Stop receiving packets into a lent buffer
+ */
+void net_rx_loan_end(void);
+
+/**
+ * net_rx_get_loan() - Get the buffer lent for the next received packet
+ *
+ * @hdr_lenp: Returns the number of header bytes at the start of the buffer
+ * @sizep: Returns the size of the buffer, including the headers
+ * Return: buffer to receive into, or NULL if none
+ */
+uchar *net_rx_get_loan(int *hdr_lenp, int *sizep);
+
 #if defined(CONFIG_NETCONSOLE) && !defined(CONFIG_SPL_BUILD)
 void nc_start(void);
 int nc_input_packet(uchar *pkt, struct in_addr src_ip, unsigned dest_port,
@@ -30,10 +30,26 @@ int of_live_build(const void *fdt_blob, struct device_node **rootp);
  * tree of struct device_node. It also fills the "name" and "type"
  * pointers of the nodes so the normal device-tree walking functions
  * can be used.
+ * Property names and values point into @blob, so it must not be changed or
+ * freed while the tree is in use.
+ *
  * @blob: The blob to expand
  * @mynodes: The device_node tree created by the call
  * Return: 0 if OK, -ve on error
  */
 int unflatten_device_tree(const void *blob, struct device_node **mynodes);
 
+/**
+ * unflatten_device_tree_copy() - create a self-contained tree from flat blob
+ *
+ * This is like unflatten_device_tree() but copies property names and values
+ * into the tree's own block of memory, so @blob can be changed or freed
+ * afterwards. To free the tree, use free(*mynodes)
+ *
+ * @blob: The blob to expand
+ * @mynodes: The device_node tree created by the call
+ * Return: 0 if OK, -ve on error
+ */
+int unflatten_device_tree_copy(const void *blob, struct device_node **mynodes);
+
 #endif
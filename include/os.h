@@ -179,6 +179,40 @@ void *os_realloc(void *ptr, size_t length);
  */
 void os_usleep(unsigned long usec);
 
+/**
+ * os_thread_start() - start a host thread
+ *
+ * The thread runs alongside U-Boot, so @func must only call code which is
+ * safe to use from several threads at once. Signals are blocked in the
+ * thread.
+ *
+ * @func:	Function for the thread to run. This should not return
+ * @arg:	Argument to pass to @func
+ * Return:	0 if OK, -ve on error
+ */
+int os_thread_start(void (*func)(void *arg), void *arg);
+
+/**
+ * os_sem_create() - create a host semaphore, with a count of zero
+ *
+ * Return:	semaphore, or NULL if out of memory
+ */
+void *os_sem_create(void);
+
+/**
+ * os_sem_wait() - wait for a host semaphore and decrement its count
+ *
+ * @sem:	Semaphore to wait for
+ */
+void os_sem_wait(void *sem);
+
+/**
+ * os_sem_post() - increment the count of a host semaphore
+ *
+ * @sem:	Semaphore to post
+ */
+void os_sem_post(void *sem);
+
 /**
  * Gets a monotonic increasing number of nano seconds from the OS
  *
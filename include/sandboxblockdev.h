@@ -9,12 +9,21 @@
 /* Maximum number of host devices - see drivers/block/sandbox.c */
 #define SANDBOX_HOST_MAX_DEVICES	4
 
+/* Number of requests which can be queued with blk_submit() */
+#define SANDBOX_HOST_QUEUE_DEPTH	4
+
+struct blk_req;
+
 struct host_block_dev {
 #ifndef CONFIG_BLK
 	struct blk_desc blk_dev;
 #endif
 	char *filename;
 	int fd;
+#ifdef CONFIG_BLK
+	struct blk_req *queue[SANDBOX_HOST_QUEUE_DEPTH];
+	int queued;
+#endif
 };
 
 /**
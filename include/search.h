@@ -42,11 +42,25 @@ struct env_entry {
  * functions all work on a single internal hash table.
  */
 
-/* Data type for reentrant functions.  */
+/*
+ * Data type for reentrant functions.
+ *
+ * @table: Hash buckets, each a chain of entries
+ * @size: Number of buckets, a power of two
+ * @filled: Number of entries
+ * @sorted: Entries in key order; see lib/hashtable.c for details
+ * @sorted_size: Number of positions allocated in @sorted
+ * @used: Number of positions used in @sorted, including deleted entries
+ * @nsorted: Number of positions at the start of @sorted which are in order
+ */
 struct hsearch_data {
-	struct env_entry_node *table;
+	struct env_entry_node **table;
 	unsigned int size;
 	unsigned int filled;
+	struct env_entry_node **sorted;
+	unsigned int sorted_size;
+	unsigned int used;
+	unsigned int nsorted;
 /*
  * Callback function which will check whether the given change for variable
  * "item" to "newval" may be applied or not, and possibly apply such change.
@@ -58,7 +72,10 @@ struct hsearch_data {
 			 enum env_op, int flag);
 };
 
-/* Create a new hash table which will contain at most "nel" elements.  */
+/*
+ * Create a new hash table with room for "nel" elements. The table grows if
+ * more are added.
+ */
 int hcreate_r(size_t nel, struct hsearch_data *htab);
 
 /* Destroy current internal hash table.  */
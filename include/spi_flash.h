@@ -164,6 +164,8 @@ static inline int spi_flash_write(struct spi_flash *flash, u32 offset,
 
 	if (!len)
 		return 0;
+	if (CONFIG_IS_ENABLED(MTD))
+		mtd_write_gen_bump();
 
 	return mtd->_write(mtd, offset, len, &retlen, buf);
 }
@@ -185,6 +187,8 @@ static inline int spi_flash_erase(struct spi_flash *flash, u32 offset,
 	memset(&instr, 0, sizeof(instr));
 	instr.addr = offset;
 	instr.len = len;
+	if (CONFIG_IS_ENABLED(MTD))
+		mtd_write_gen_bump();
 
 	return mtd->_erase(mtd, &instr);
 }
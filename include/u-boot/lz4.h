@@ -6,6 +6,74 @@
 #ifndef __LZ4_H
 #define __LZ4_H
 
+#include <linux/types.h>
+
+/**
+ * enum lz4_frame_state - what the next unit of an LZ4 frame holds
+ *
+ * @LZ4_FRAME_HEADER: Magic number, flags and block descriptor
+ * @LZ4_FRAME_SKIP: Something to skip: content size, header checksum or block
+ *	checksum
+ * @LZ4_FRAME_BLOCK_HEADER: Size of the next block, or end mark
+ * @LZ4_FRAME_BLOCK: Block data
+ * @LZ4_FRAME_DONE: End of the frame; anything after is not used
+ */
+enum lz4_frame_state {
+	LZ4_FRAME_HEADER,
+	LZ4_FRAME_SKIP,
+	LZ4_FRAME_BLOCK_HEADER,
+	LZ4_FRAME_BLOCK,
+	LZ4_FRAME_DONE,
+};
+
+/**
+ * struct lz4_frame - state of an LZ4 frame decompressed a unit at a time
+ *
+ * An LZ4 frame is split into units: the frame header, then a header and data
+ * for each block. Each unit is handed over whole to lz4_frame_unit(), which
+ * makes it easy to decompress a frame which arrives in pieces, e.g. from a
+ * network or storage device, while keeping only one block in memory.
+ *
+ * @state: What the next unit holds
+ * @need: Size of the next unit in bytes, 0 once the frame is complete
+ * @max_block: Maximum size of a block, from the frame header
+ * @block_checksum: true if each block is followed by a checksum
+ * @uncompressed: true if the next block is stored uncompressed
+ */
+struct lz4_frame {
+	enum lz4_frame_state state;
+	ulong need;
+	ulong max_block;
+	bool block_checksum;
+	bool uncompressed;
+};
+
+/**
+ * lz4_frame_start() - Start decompressing an LZ4 frame a unit at a time
+ *
+ * @lf: Frame state to set up
+ */
+void lz4_frame_start(struct lz4_frame *lf);
+
+/**
+ * lz4_frame_unit() - Process the next unit of an LZ4 frame
+ *
+ * Only frames with independent blocks are supported, so earlier output does
+ * not need to be kept around. Checksums are not verified.
+ *
+ * @lf: Frame state
+ * @unit: Next unit, which is @lf->need bytes long
+ * @dst: Place to put any decompressed data
+ * @dst_len: Space available at @dst
+ * Return: number of bytes written to @dst, -EPROTONOSUPPORT if the magic
+ *	number or version number are not recognised or dependent blocks are
+ *	used, -EINVAL if reserved fields are non-zero or a block is too large,
+ *	-ENOBUFS if @dst is too small for an uncompressed block, -EPROTO if a
+ *	compressed block is corrupt or does not fit in @dst
+ */
+int lz4_frame_unit(struct lz4_frame *lf, const void *unit, void *dst,
+		   size_t dst_len);
+
 /**
  * ulz4fn() - Decompress LZ4 data
  *
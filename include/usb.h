@@ -671,6 +671,34 @@ struct usb_emul_plat {
 	int port1;	/* Port number (numbered from 1) */
 };
 
+/**
+ * struct usb_xfer - a bulk transfer queued without waiting for it
+ *
+ * The caller fills in @pipe, @buffer and @length, then passes the transfer to
+ * usb_bulk_submit(). The transfer and its buffer must stay valid until
+ * @complete is set, which happens inside usb_bulk_poll() or usb_bulk_wait().
+ * Transfers on the same endpoint (and stream) complete in the order they were
+ * submitted.
+ *
+ * @pipe:	Bulk pipe to use
+ * @stream:	Stream ID, if usb_alloc_streams() was used on the endpoint,
+ *		else 0
+ * @buffer:	Data buffer, the destination for IN, source for OUT
+ * @length:	Number of bytes to transfer
+ * @act_len:	Number of bytes transferred, valid once @complete is set
+ * @status:	USB_ST_... status, 0 if OK, valid once @complete is set
+ * @complete:	true once the transfer has finished
+ */
+struct usb_xfer {
+	unsigned long pipe;
+	unsigned int stream;
+	void *buffer;
+	int length;
+	int act_len;
+	unsigned long status;
+	bool complete;
+};
+
 /**
  * struct dm_usb_ops - USB controller operations
  *
@@ -803,6 +831,57 @@ struct dm_usb_ops {
 	 * driver to do just that.
 	 */
 	int (*lock_async)(struct udevice *udev, int lock);
+
+	/**
+	 * bulk_submit() - Queue a bulk transfer without waiting for it
+	 *
+	 * This is optional, along with bulk_poll() and bulk_cancel(). The
+	 * controller must set @xfer->act_len, @xfer->status and
+	 * @xfer->complete when the transfer finishes, in bulk_poll() or
+	 * bulk_cancel().
+	 *
+	 * @return 0 if queued, -EBUSY if the endpoint queue is full, other
+	 * -ve on error
+	 */
+	int (*bulk_submit)(struct udevice *bus, struct usb_device *udev,
+			   struct usb_xfer *xfer);
+
+	/**
+	 * bulk_poll() - Check for queued bulk transfers which have finished
+	 *
+	 * @return number of transfers completed, or -ve on error
+	 */
+	int (*bulk_poll)(struct udevice *bus, struct usb_device *udev);
+
+	/**
+	 * bulk_cancel() - Cancel all queued bulk transfers on an endpoint
+	 *
+	 * Each transfer which has not finished is completed with an error
+	 * status.
+	 *
+	 * @pipe: Pipe for the endpoint
+	 * @return 0 if OK, -ve on error
+	 */
+	int (*bulk_cancel)(struct udevice *bus, struct usb_device *udev,
+			   unsigned long pipe);
+
+	/**
+	 * alloc_streams() - Set up bulk streams on some endpoints
+	 *
+	 * This is optional. It is only called while nothing is queued on the
+	 * endpoints.
+	 *
+	 * @ifnum: Number of the interface which has the endpoints
+	 * @eps: Endpoint addresses (with the direction bit)
+	 * @num_eps: Number of endpoints in @eps
+	 * @num_streams: Number of streams wanted on each endpoint, with IDs
+	 *	starting from 1
+	 * @return number of streams set up, which may be fewer than
+	 * @num_streams, or -ve on error
+	 */
+	int (*alloc_streams)(struct udevice *bus, struct usb_device *udev,
+			     int ifnum, const u8 *eps, int num_eps,
+			     int num_streams);
 };
 
 #define usb_get_ops(dev)	((struct dm_usb_ops *)(dev)->driver->ops)
@@ -1007,6 +1086,76 @@ int usb_update_hub_device(struct usb_device *dev);
  */
 int usb_get_max_xfer_size(struct usb_device *dev, size_t *size);
 
+/**
+ * usb_bulk_submit() - Queue a bulk transfer without waiting for it
+ *
+ * This lets a class driver keep several transfers in flight, on one or more
+ * endpoints of a device, so that the controller does not sit idle between
+ * them.
+ *
+ * @dev:	USB device
+ * @xfer:	Transfer to queue, see struct usb_xfer
+ * Return: 0 if queued, -EBUSY if the endpoint queue is full (call
+ * usb_bulk_poll() and try again), -ENOSYS if the controller cannot queue
+ * transfers (use usb_bulk_msg() instead), other -ve on error
+ */
+int usb_bulk_submit(struct usb_device *dev, struct usb_xfer *xfer);
+
+/**
+ * usb_bulk_poll() - Check for queued bulk transfers which have finished
+ *
+ * @dev:	USB device
+ * Return: number of transfers completed by this call, or -ve on error
+ */
+int usb_bulk_poll(struct usb_device *dev);
+
+/**
+ * usb_bulk_wait() - Wait for a queued bulk transfer to finish
+ *
+ * If the transfer does not finish in time, it is cancelled along with any
+ * others queued after it on the same endpoint.
+ *
+ * @dev:	USB device
+ * @xfer:	Transfer to wait for
+ * @timeout:	Timeout in milliseconds
+ * Return: number of bytes transferred, -ETIMEDOUT if the transfer did not
+ * finish in time, -EIO if it failed (see @xfer->status)
+ */
+int usb_bulk_wait(struct usb_device *dev, struct usb_xfer *xfer, int timeout);
+
+/**
+ * usb_bulk_cancel() - Give up the bulk transfers queued on an endpoint
+ *
+ * Each one is marked complete with an error, without waiting for it.
+ *
+ * @dev:	USB device
+ * @pipe:	Pipe for the endpoint
+ * Return: 0 if OK, -ENOSYS if the controller cannot queue transfers, other
+ * -ve on error
+ */
+int usb_bulk_cancel(struct usb_device *dev, unsigned long pipe);
+
+/**
+ * usb_alloc_streams() - Set up bulk streams on some endpoints
+ *
+ * Streams let a device pick which of several transfers queued on an endpoint
+ * it services next. Each queued transfer gives its stream in
+ * &struct usb_xfer.stream and only one may be queued per stream. They are
+ * only available on SuperSpeed endpoints whose companion descriptor allows
+ * them, and only with some controllers.
+ *
+ * @dev:	USB device
+ * @ifnum:	Number of the interface which has the endpoints
+ *		(bInterfaceNumber)
+ * @eps:	Endpoint addresses (with the direction bit)
+ * @num_eps:	Number of endpoints in @eps
+ * @num_streams: Number of streams wanted on each endpoint
+ * Return: number of streams set up, which may be fewer than @num_streams,
+ * -ENOSYS if the controller does not support streams, other -ve on error
+ */
+int usb_alloc_streams(struct usb_device *dev, int ifnum, const u8 *eps,
+		      int num_eps, int num_streams);
+
 /**
  * usb_emul_setup_device() - Set up a new USB device emulation
  *
@@ -1047,6 +1196,23 @@ int usb_emul_control(struct udevice *emul, struct usb_device *udev,
 int usb_emul_bulk(struct udevice *emul, struct usb_device *udev,
 		  unsigned long pipe, void *buffer, int length);
 
+/**
+ * usb_emul_xfer() - Pass a queued bulk transfer to an emulator
+ *
+ * Emulators which provide bulk_submit() are given the whole transfer, so they
+ * can see its stream. They carry it out straight away, returning the number
+ * of bytes transferred, or -EAGAIN to hold it off (like a NAK) until the next
+ * try. Otherwise this is the same as usb_emul_bulk().
+ *
+ * @emul:	Emulator device
+ * @udev:	USB device (which the emulator is causing to appear)
+ * @xfer:	Transfer to carry out
+ * Return: number of bytes transferred, -EAGAIN to try again later, other -ve
+ * on error
+ */
+int usb_emul_xfer(struct udevice *emul, struct usb_device *udev,
+		  struct usb_xfer *xfer);
+
 /**
  * usb_emul_int() - Send an interrupt packet to an emulator
  *
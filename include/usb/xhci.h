@@ -625,6 +625,21 @@ struct xhci_ep_ctx {
 /* Endpoint is set up with a Linear Stream Array (vs. Secondary Stream Array) */
 #define	EP_HAS_LSA			(1 << 15)
 
+/**
+ * struct xhci_stream_ctx - Stream Context - section 6.2.4.1
+ *
+ * @stream_ring:	TR dequeue pointer, stream context type and cycle bit
+ */
+struct xhci_stream_ctx {
+	__le64	stream_ring;
+	__le32	reserved[2];
+};
+
+/* Stream Context Type - bits 3:1 of the stream ring dequeue pointer */
+#define	SCT_FOR_CTX(p)		(((p) << 1) & 0x7)
+/* Primary stream array entry, pointing to a transfer ring */
+#define	SCT_PRI_TR		1
+
 /* ep_info2 bitmasks */
 /*
  * Force Event - generate transfer events for all TRBs for this endpoint
@@ -1049,8 +1064,44 @@ struct xhci_scratchpad {
 #define XHCI_STOP_EP_CMD_TIMEOUT	5
 /* XXX: Make these module parameters */
 
+/* Number of bulk transfers which can be queued on an endpoint at once */
+#define XHCI_MAX_QUEUED_TDS	8
+
+/* Number of TRBs which can be in use on an endpoint ring at once */
+#define XHCI_MAX_RING_TRBS	(TRBS_PER_SEGMENT - 2)
+
+/* Number of streams per endpoint, each with one queued transfer at most */
+#define XHCI_MAX_STREAMS	XHCI_MAX_QUEUED_TDS
+
+/**
+ * struct xhci_td - a bulk transfer queued on an endpoint
+ *
+ * @xfer: Transfer being carried out
+ * @last_trb: Last TRB of the transfer, whose event says it has finished
+ * @num_trbs: Number of TRBs used by the transfer
+ * @avail: Length of the transfer, less any short TRBs seen so far
+ */
+struct xhci_td {
+	struct usb_xfer			*xfer;
+	void				*last_trb;
+	int				num_trbs;
+	int				avail;
+};
+
 struct xhci_virt_ep {
 	struct xhci_ring		*ring;
+	/*
+	 * Bulk transfers queued by xhci_bulk_submit(), oldest first, or by
+	 * stream ID less one if the endpoint has streams
+	 */
+	struct xhci_td			tds[XHCI_MAX_QUEUED_TDS];
+	unsigned int			td_first;
+	unsigned int			num_tds;
+	unsigned int			queued_trbs;
+	/* Stream context array and a ring for each stream ID, from 1 */
+	struct xhci_stream_ctx		*stream_ctx;
+	struct xhci_ring		*stream_rings[XHCI_MAX_STREAMS + 1];
+	unsigned int			num_streams;
 	unsigned int			ep_state;
 #define SET_DEQ_PENDING		(1 << 0)
 #define EP_HALTED		(1 << 1)	/* For stall handling */
@@ -1249,6 +1300,9 @@ void xhci_acknowledge_event(struct xhci_ctrl *ctrl);
 union xhci_trb *xhci_wait_for_event(struct xhci_ctrl *ctrl, trb_type expected);
 int xhci_bulk_tx(struct usb_device *udev, unsigned long pipe,
 		 int length, void *buffer);
+int xhci_bulk_submit(struct usb_device *udev, struct usb_xfer *xfer);
+int xhci_bulk_poll(struct xhci_ctrl *ctrl);
+int xhci_bulk_cancel(struct usb_device *udev, unsigned long pipe);
 int xhci_ctrl_tx(struct usb_device *udev, unsigned long pipe,
 		 struct devrequest *req, int length, void *buffer);
 int xhci_check_maxpacket(struct usb_device *udev);
@@ -1258,6 +1312,10 @@ void xhci_cleanup(struct xhci_ctrl *ctrl);
 struct xhci_ring *xhci_ring_alloc(struct xhci_ctrl *ctrl, unsigned int num_segs,
 				  bool link_trbs);
 int xhci_alloc_virt_device(struct xhci_ctrl *ctrl, unsigned int slot_id);
+void xhci_alloc_stream_rings(struct xhci_ctrl *ctrl,
+			     struct xhci_virt_ep *virt_ep, unsigned int num_ctxs,
+			     unsigned int num_streams);
+void xhci_free_stream_rings(struct xhci_virt_ep *virt_ep);
 int xhci_mem_init(struct xhci_ctrl *ctrl, struct xhci_hccr *hccr,
 		  struct xhci_hcor *hcor);
 
@@ -45,6 +45,7 @@
 #define US_PR_CB               1		/* Control/Bulk w/o interrupt */
 #define US_PR_CBI              0		/* Control/Bulk/Interrupt */
 #define US_PR_BULK             0x50		/* bulk only */
+#define US_PR_UAS              0x62		/* USB Attached SCSI */
 
 /* USB types */
 #define USB_TYPE_STANDARD   (0x00 << 5)
@@ -394,4 +395,58 @@ struct umass_bbb_csw {
 #define US_BBB_RESET		0xff
 #define US_BBB_GET_MAX_LUN	0xfe
 
+/*
+ * USB Attached SCSI
+ */
+
+/* Pipe Usage descriptor, which follows each endpoint of a UAS interface */
+#define USB_DT_PIPE_USAGE	0x24
+#define USB_DT_PIPE_USAGE_SIZE	4
+
+struct usb_pipe_usage_descriptor {
+	__u8		bLength;
+	__u8		bDescriptorType;
+	__u8		bPipeID;
+	__u8		Reserved;
+} __attribute__ ((packed));
+
+#define UAS_CMD_PIPE_ID		1
+#define UAS_STATUS_PIPE_ID	2
+#define UAS_DATA_IN_PIPE_ID	3
+#define UAS_DATA_OUT_PIPE_ID	4
+
+/* Information Unit IDs */
+#define UAS_IU_COMMAND		0x01
+#define UAS_IU_SENSE		0x03
+#define UAS_IU_RESPONSE		0x04
+#define UAS_IU_TASK_MGMT	0x05
+#define UAS_IU_READ_READY	0x06
+#define UAS_IU_WRITE_READY	0x07
+
+/* Command IU, with a CDB of up to 16 bytes */
+struct uas_command_iu {
+	__u8		iu_id;
+	__u8		rsvd1;
+	__be16		tag;
+	__u8		prio_attr;
+	__u8		rsvd5;
+	__u8		len;		/* additional CDB length, in words */
+	__u8		rsvd7;
+	__u8		lun[8];
+	__u8		cdb[16];
+} __attribute__ ((packed));
+
+/* Sense IU, also used for READ READY and WRITE READY, which have no status */
+struct uas_sense_iu {
+	__u8		iu_id;
+	__u8		rsvd1;
+	__be16		tag;
+	__be16		status_qual;
+	__u8		status;
+	__u8		rsvd7[7];
+	__be16		len;
+	__u8		sense[96];
+} __attribute__ ((packed));
+#define UAS_SENSE_IU_HDR_SIZE	16
+
 #endif /*_USB_DEFS_H_ */
@@ -185,10 +185,22 @@ const uint32_t * ZEXPORT get_crc_table()
 uint32_t __efi_runtime crc32_no_comp(uint32_t crc, const Bytef *buf, uInt len)
 {
 #ifdef CONFIG_ARM64_CRC32
-    crc = cpu_to_le32(crc);
+    /* Align, then feed the CRC unit a doubleword at a time */
+    while (len && ((uintptr_t)buf & 7)) {
+        crc = __builtin_aarch64_crc32b(crc, *buf++);
+        len--;
+    }
+    for (; len >= 32; len -= 32, buf += 32) {
+        crc = __builtin_aarch64_crc32x(crc, le64_to_cpup((uint64_t *)buf));
+        crc = __builtin_aarch64_crc32x(crc, le64_to_cpup((uint64_t *)buf + 1));
+        crc = __builtin_aarch64_crc32x(crc, le64_to_cpup((uint64_t *)buf + 2));
+        crc = __builtin_aarch64_crc32x(crc, le64_to_cpup((uint64_t *)buf + 3));
+    }
+    for (; len >= 8; len -= 8, buf += 8)
+        crc = __builtin_aarch64_crc32x(crc, le64_to_cpup((uint64_t *)buf));
     while (len--)
         crc = __builtin_aarch64_crc32b(crc, *buf++);
-    return le32_to_cpu(crc);
+    return crc;
 #else
     const uint32_t *tab = crc_table;
     const uint32_t *b =(const uint32_t *)buf;
@@ -13,9 +13,42 @@
 #include <common.h>
 #include <compiler.h>
 
+#ifdef CONFIG_ARM64_CRC32
+/* Bit-reflected CRC32C polynomial, as implemented by the crc32c instructions */
+#define CRC32C_POLY_LE	0x82f63b78
+
+static uint32_t crc32c_arm64(uint32_t crc, const u8 *data, int length)
+{
+	while (length && ((uintptr_t)data & 7)) {
+		crc = __builtin_aarch64_crc32cb(crc, *data++);
+		length--;
+	}
+	for (; length >= 32; length -= 32, data += 32) {
+		crc = __builtin_aarch64_crc32cx(crc, le64_to_cpup((u64 *)data));
+		crc = __builtin_aarch64_crc32cx(crc,
+						le64_to_cpup((u64 *)data + 1));
+		crc = __builtin_aarch64_crc32cx(crc,
+						le64_to_cpup((u64 *)data + 2));
+		crc = __builtin_aarch64_crc32cx(crc,
+						le64_to_cpup((u64 *)data + 3));
+	}
+	for (; length >= 8; length -= 8, data += 8)
+		crc = __builtin_aarch64_crc32cx(crc, le64_to_cpup((u64 *)data));
+	while (length--)
+		crc = __builtin_aarch64_crc32cb(crc, *data++);
+
+	return crc;
+}
+#endif
+
 uint32_t crc32c_cal(uint32_t crc, const char *data, int length,
 		    uint32_t *crc32c_table)
 {
+#ifdef CONFIG_ARM64_CRC32
+	/* entry 0x80 of a reflected table is the polynomial itself */
+	if (crc32c_table[0x80] == CRC32C_POLY_LE)
+		return crc32c_arm64(crc, (const u8 *)data, length);
+#endif
 	while (length--)
 		crc = crc32c_table[(u8)(crc ^ *data++)] ^ (crc >> 8);
 
@@ -23,6 +23,7 @@
 #include <serial.h>
 #include <asm/global_data.h>
 #include <asm/sections.h>
+#include <dm/node_index.h>
 #include <dm/ofnode.h>
 #include <dm/of_extra.h>
 #include <linux/ctype.h>
@@ -624,6 +625,22 @@ int fdtdec_prepare_fdt(void)
 	return 0;
 }
 
+/*
+ * Look up a phandle, using the driver-model index if this is the control FDT.
+ * A missing phandle gives -FDT_ERR_NOTFOUND either way.
+ */
+static int fdtdec_node_offset_by_phandle(const void *blob, uint32_t phandle)
+{
+	ofnode node;
+
+	if (blob == gd->fdt_blob && !of_live_active() &&
+	    !dm_node_index_find_phandle(phandle, &node))
+		return ofnode_valid(node) ? ofnode_to_offset(node) :
+			-FDT_ERR_NOTFOUND;
+
+	return fdt_node_offset_by_phandle(blob, phandle);
+}
+
 int fdtdec_lookup_phandle(const void *blob, int node, const char *prop_name)
 {
 	const u32 *phandle;
@@ -634,7 +651,7 @@ int fdtdec_lookup_phandle(const void *blob, int node, const char *prop_name)
 	if (!phandle)
 		return -FDT_ERR_NOTFOUND;
 
-	lookup = fdt_node_offset_by_phandle(blob, fdt32_to_cpu(*phandle));
+	lookup = fdtdec_node_offset_by_phandle(blob, fdt32_to_cpu(*phandle));
 	return lookup;
 }
 
@@ -765,8 +782,8 @@ int fdtdec_parse_phandle_with_args(const void *blob, int src_node,
 			 * below.
 			 */
 			if (cells_name || cur_index == index) {
-				node = fdt_node_offset_by_phandle(blob,
-								  phandle);
+				node = fdtdec_node_offset_by_phandle(blob,
+								     phandle);
 				if (node < 0) {
 					debug("%s: could not find phandle\n",
 					      fdt_get_name(blob, src_node,
@@ -1465,7 +1482,7 @@ int fdtdec_get_carveout(const void *blob, const char *node,
 
 	phandle = fdt32_to_cpu(prop[index]);
 
-	offset = fdt_node_offset_by_phandle(blob, phandle);
+	offset = fdtdec_node_offset_by_phandle(blob, phandle);
 	if (offset < 0) {
 		debug("failed to find node for phandle %u\n", phandle);
 		return offset;
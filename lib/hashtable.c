@@ -35,9 +35,6 @@
 # include <linux/ctype.h>
 #endif
 
-#define USED_FREE 0
-#define USED_DELETED -1
-
 #include <env_callback.h>
 #include <env_flags.h>
 #include <search.h>
@@ -54,48 +51,51 @@
  * which describes the current status.
  */
 
+/*
+ * Each entry is allocated separately, together with its key, and chained
+ * into a bucket. Entries never move, so the table can grow without
+ * invalidating pointers which callers hold to them.
+ *
+ * As well as the buckets, the table keeps an index of all entries in key
+ * order, so that exporting does not need to sort. The environment is
+ * nearly always imported in key order, so new entries are simply added to
+ * the end of the index. Entries which arrive out of order, and holes left
+ * by deleted entries, are dealt with in one go the next time the order is
+ * needed; see hsorted_update().
+ */
 struct env_entry_node {
-	int used;
 	struct env_entry entry;
+	struct env_entry_node *next;	/* next entry in the same bucket */
+	unsigned int hval;		/* hash of the key */
+	unsigned int pos;		/* position in htab->sorted */
+	char key[];
 };
 
+/* Smallest number of buckets; the table doubles as it fills */
+#define HTAB_MIN_SIZE	16
 
-static void _hdelete(const char *key, struct hsearch_data *htab,
-		     struct env_entry *ep, int idx);
+static void _hdelete(struct hsearch_data *htab, struct env_entry_node *node);
+
+static struct env_entry_node *to_node(struct env_entry *ep)
+{
+	return container_of(ep, struct env_entry_node, entry);
+}
 
 /*
  * hcreate()
  */
 
-/*
- * For the used double hash method the table size has to be a prime. To
- * correct the user given table size we need a prime test.  This trivial
- * algorithm is adequate because
- * a)  the code is (most probably) called a few times per program run and
- * b)  the number is small because the table must fit in the core
- * */
-static int isprime(unsigned int number)
-{
-	/* no even number will be passed */
-	unsigned int div = 3;
-
-	while (div * div < number && number % div != 0)
-		div += 2;
-
-	return number % div != 0;
-}
-
 /*
  * Before using the hash table we must allocate memory for it.
- * Test for an existing table are done. We allocate one element
- * more as the found prime number says. This is done for more effective
- * indexing as explained in the comment for the hsearch function.
- * The contents of the table is zeroed, especially the field used
- * becomes zero.
+ * Test for an existing table are done. The number of buckets is a
+ * power of two, no smaller than the number of elements asked for.
+ * The table grows later if more elements are added.
  */
 
 int hcreate_r(size_t nel, struct hsearch_data *htab)
 {
+	unsigned int size = HTAB_MIN_SIZE;
+
 	/* Test for correct arguments.  */
 	if (htab == NULL) {
 		__set_errno(EINVAL);
@@ -108,21 +108,25 @@ int hcreate_r(size_t nel, struct hsearch_data *htab)
 		return 0;
 	}
 
-	/* Change nel to the first prime number not smaller as nel. */
-	nel |= 1;		/* make odd */
-	while (!isprime(nel))
-		nel += 2;
-
-	htab->size = nel;
-	htab->filled = 0;
+	while (size < nel)
+		size <<= 1;
 
 	/* allocate memory and zero out */
-	htab->table = (struct env_entry_node *)calloc(htab->size + 1,
-						sizeof(struct env_entry_node));
-	if (htab->table == NULL) {
+	htab->table = calloc(size, sizeof(*htab->table));
+	htab->sorted = malloc(size * sizeof(*htab->sorted));
+	if (!htab->table || !htab->sorted) {
+		free(htab->table);
+		free(htab->sorted);
+		htab->table = NULL;
+		htab->sorted = NULL;
 		__set_errno(ENOMEM);
 		return 0;
 	}
+	htab->size = size;
+	htab->filled = 0;
+	htab->sorted_size = size;
+	htab->used = 0;
+	htab->nsorted = 0;
 
 	/* everything went alright */
 	return 1;
@@ -149,18 +153,156 @@ void hdestroy_r(struct hsearch_data *htab)
 	}
 
 	/* free used memory */
-	for (i = 1; i <= htab->size; ++i) {
-		if (htab->table[i].used > 0) {
-			struct env_entry *ep = &htab->table[i].entry;
+	for (i = 0; i < htab->used; ++i) {
+		struct env_entry_node *node = htab->sorted[i];
 
-			free((void *)ep->key);
-			free(ep->data);
+		if (node) {
+			free(node->entry.data);
+			free(node);
 		}
 	}
 	free(htab->table);
+	free(htab->sorted);
 
 	/* the sign for an existing table is an value != NULL in htable */
 	htab->table = NULL;
+	htab->sorted = NULL;
+	htab->size = 0;
+	htab->filled = 0;
+	htab->sorted_size = 0;
+	htab->used = 0;
+	htab->nsorted = 0;
+}
+
+/*
+ * Helpers for the index of entries in key order
+ */
+
+static int cmpnode(const void *p1, const void *p2)
+{
+	struct env_entry_node *n1 = *(struct env_entry_node **)p1;
+	struct env_entry_node *n2 = *(struct env_entry_node **)p2;
+
+	return strcmp(n1->entry.key, n2->entry.key);
+}
+
+/*
+ * Bring the index up to date: squeeze out deleted entries, then sort the
+ * entries which were added out of order and merge them with the rest.
+ * Afterwards the first htab->filled positions hold all entries in order.
+ */
+static void hsorted_update(struct hsearch_data *htab)
+{
+	struct env_entry_node **sorted = htab->sorted;
+	struct env_entry_node **merged;
+	unsigned int i, n, head, tail;
+
+	if (htab->nsorted == htab->used && htab->used == htab->filled)
+		return;
+
+	for (i = 0, n = 0, head = 0; i < htab->used; i++) {
+		if (!sorted[i])
+			continue;
+		if (i < htab->nsorted)
+			head++;
+		sorted[n++] = sorted[i];
+	}
+	tail = n - head;
+	debug("hsorted_update: %u in order, %u to merge\n", head, tail);
+	qsort(sorted + head, tail, sizeof(*sorted), cmpnode);
+
+	if (head && tail && cmpnode(&sorted[head - 1], &sorted[head]) > 0) {
+		merged = malloc(htab->sorted_size * sizeof(*merged));
+		if (merged) {
+			unsigned int a = 0, b = head;
+
+			for (i = 0; i < n; i++) {
+				if (b == n || (a < head &&
+					       cmpnode(&sorted[a], &sorted[b]) < 0))
+					merged[i] = sorted[a++];
+				else
+					merged[i] = sorted[b++];
+			}
+			free(sorted);
+			htab->sorted = merged;
+		} else {
+			qsort(sorted, n, sizeof(*sorted), cmpnode);
+		}
+	}
+
+	for (i = 0; i < n; i++)
+		htab->sorted[i]->pos = i;
+	htab->used = n;
+	htab->nsorted = n;
+}
+
+static int hsorted_add(struct hsearch_data *htab, struct env_entry_node *node)
+{
+	struct env_entry_node *last;
+
+	if (htab->used == htab->sorted_size) {
+		/* Reuse the space of deleted entries before growing */
+		hsorted_update(htab);
+		if (htab->used == htab->sorted_size) {
+			unsigned int size = htab->sorted_size * 2;
+			struct env_entry_node **sorted;
+
+			sorted = realloc(htab->sorted, size * sizeof(*sorted));
+			if (!sorted)
+				return -ENOMEM;
+			htab->sorted = sorted;
+			htab->sorted_size = size;
+		}
+	}
+
+	/* The last position is never a hole, see hsorted_remove() */
+	last = htab->used ? htab->sorted[htab->used - 1] : NULL;
+	if (htab->nsorted == htab->used &&
+	    (!last || strcmp(last->entry.key, node->entry.key) < 0))
+		htab->nsorted++;
+	node->pos = htab->used;
+	htab->sorted[htab->used++] = node;
+
+	return 0;
+}
+
+static void hsorted_remove(struct hsearch_data *htab,
+			   struct env_entry_node *node)
+{
+	htab->sorted[node->pos] = NULL;
+	while (htab->used && !htab->sorted[htab->used - 1])
+		htab->used--;
+	if (htab->nsorted > htab->used)
+		htab->nsorted = htab->used;
+}
+
+/*
+ * Double the number of buckets. This only relinks the entries, so takes
+ * time in proportion to the number of entries, which is amortised over
+ * the insertions which filled the table.
+ */
+static void hgrow(struct hsearch_data *htab)
+{
+	unsigned int size = htab->size * 2;
+	struct env_entry_node **table;
+	unsigned int i;
+
+	table = calloc(size, sizeof(*table));
+	if (!table)
+		return;		/* the chains just get longer */
+	for (i = 0; i < htab->size; i++) {
+		struct env_entry_node *node, *next;
+
+		for (node = htab->table[i]; node; node = next) {
+			next = node->next;
+			node->next = table[node->hval & (size - 1)];
+			table[node->hval & (size - 1)] = node;
+		}
+	}
+	free(htab->table);
+	htab->table = table;
+	htab->size = size;
+	debug("hgrow: %u buckets for %u entries\n", size, htab->filled);
 }
 
 /*
@@ -168,19 +310,12 @@ void hdestroy_r(struct hsearch_data *htab)
  */
 
 /*
- * This is the search function. It uses double hashing with open addressing.
- * The argument item.key has to be a pointer to an zero terminated, most
- * probably strings of chars. The function for generating a number of the
- * strings is simple but fast. It can be replaced by a more complex function
- * like ajw (see [Aho,Sethi,Ullman]) if the needs are shown.
- *
- * We use an trick to speed up the lookup. The table is created by hcreate
- * with one more element available. This enables us to use the index zero
- * special. This index will never be used because we store the first hash
- * index in the field used where zero means not used. Every other value
- * means used. The used field can be used as a first fast comparison for
- * equality of the stored and the parameter value. This helps to prevent
- * unnecessary expensive calls of strcmp.
+ * This is the search function. The argument item.key has to be a pointer
+ * to an zero terminated, most probably strings of chars. The key is hashed
+ * with FNV-1a and the low bits select the bucket. The full hash is stored
+ * with each entry, as a first fast comparison for equality of the stored
+ * and the parameter value. This helps to prevent unnecessary expensive
+ * calls of strcmp.
  *
  * This implementation differs from the standard library version of
  * this function in a number of ways:
@@ -194,10 +329,10 @@ void hdestroy_r(struct hsearch_data *htab)
  * - The standard implementation does not provide a way to update an
  *   existing entry.  This version will create a new entry or update an
  *   existing one when both "action == ENV_ENTER" and "item.data != NULL".
- * - Instead of returning 1 on success, we return the index into the
- *   internal hash table, which is also guaranteed to be positive.
- *   This allows us direct access to the found hash table slot for
- *   example for functions like hdelete().
+ * - Instead of returning 1 on success, we return the position of an
+ *   existing entry in the key-order index, plus one, which is also
+ *   guaranteed to be positive. This allows hmatch_r() to continue from
+ *   the found entry.
  */
 
 int hmatch_r(const char *match, int last_idx, struct env_entry **retval,
@@ -206,11 +341,17 @@ int hmatch_r(const char *match, int last_idx, struct env_entry **retval,
 	unsigned int idx;
 	size_t key_len = strlen(match);
 
-	for (idx = last_idx + 1; idx < htab->size; ++idx) {
-		if (htab->table[idx].used <= 0)
+	/* A new search goes through the entries in key order */
+	if (!last_idx)
+		hsorted_update(htab);
+
+	for (idx = last_idx + 1; idx <= htab->used; ++idx) {
+		struct env_entry_node *node = htab->sorted[idx - 1];
+
+		if (!node)
 			continue;
-		if (!strncmp(match, htab->table[idx].entry.key, key_len)) {
-			*retval = &htab->table[idx].entry;
+		if (!strncmp(match, node->entry.key, key_len)) {
+			*retval = &node->entry;
 			return idx;
 		}
 	}
@@ -231,196 +372,152 @@ do_callback(const struct env_entry *e, const char *name, const char *value,
 	return 0;
 }
 
-/*
- * Compare an existing entry with the desired key, and overwrite if the action
- * is ENV_ENTER.  This is simply a helper function for hsearch_r().
- */
-static inline int _compare_and_overwrite_entry(struct env_entry item,
-		enum env_action action, struct env_entry **retval,
-		struct hsearch_data *htab, int flag, unsigned int hval,
-		unsigned int idx)
+static unsigned int hash_key(const char *key)
 {
-	if (htab->table[idx].used == hval
-	    && strcmp(item.key, htab->table[idx].entry.key) == 0) {
-		/* Overwrite existing value? */
-		if (action == ENV_ENTER && item.data) {
-			/* check for permission */
-			if (htab->change_ok != NULL && htab->change_ok(
-			    &htab->table[idx].entry, item.data,
-			    env_op_overwrite, flag)) {
-				debug("change_ok() rejected setting variable "
-					"%s, skipping it!\n", item.key);
-				__set_errno(EPERM);
-				*retval = NULL;
-				return 0;
-			}
-
-			/* If there is a callback, call it */
-			if (do_callback(&htab->table[idx].entry, item.key,
-					item.data, env_op_overwrite, flag)) {
-				debug("callback() rejected setting variable "
-					"%s, skipping it!\n", item.key);
-				__set_errno(EINVAL);
-				*retval = NULL;
-				return 0;
-			}
+	unsigned int hval = 2166136261U;
 
-			free(htab->table[idx].entry.data);
-			htab->table[idx].entry.data = strdup(item.data);
-			if (!htab->table[idx].entry.data) {
-				__set_errno(ENOMEM);
-				*retval = NULL;
-				return 0;
-			}
-		}
-		/* return found entry */
-		*retval = &htab->table[idx].entry;
-		return idx;
+	while (*key) {
+		hval ^= (unsigned char)*key++;
+		hval *= 16777619;
 	}
-	/* keep searching */
-	return -1;
+
+	return hval;
 }
 
-int hsearch_r(struct env_entry item, enum env_action action,
-	      struct env_entry **retval, struct hsearch_data *htab, int flag)
+static struct env_entry_node *hfind(struct hsearch_data *htab,
+				    const char *key, unsigned int hval)
 {
-	unsigned int hval;
-	unsigned int count;
-	unsigned int len = strlen(item.key);
-	unsigned int idx;
-	unsigned int first_deleted = 0;
-	int ret;
-
-	/* Compute an value for the given string. Perhaps use a better method. */
-	hval = len;
-	count = len;
-	while (count-- > 0) {
-		hval <<= 4;
-		hval += item.key[count];
+	struct env_entry_node *node;
+
+	if (!htab->table)
+		return NULL;
+	node = htab->table[hval & (htab->size - 1)];
+	for (; node; node = node->next) {
+		if (node->hval == hval && !strcmp(key, node->entry.key))
+			return node;
 	}
 
-	/*
-	 * First hash function:
-	 * simply take the modul but prevent zero.
-	 */
-	hval %= htab->size;
-	if (hval == 0)
-		++hval;
-
-	/* The first index tried. */
-	idx = hval;
-
-	if (htab->table[idx].used) {
-		/*
-		 * Further action might be required according to the
-		 * action value.
-		 */
-		unsigned hval2;
+	return NULL;
+}
 
-		if (htab->table[idx].used == USED_DELETED)
-			first_deleted = idx;
+/*
+ * Overwrite an existing entry if the action is ENV_ENTER.  This is simply a
+ * helper function for hsearch_r().
+ */
+static int _overwrite_entry(struct env_entry item, enum env_action action,
+			    struct env_entry **retval,
+			    struct hsearch_data *htab, int flag,
+			    struct env_entry_node *node)
+{
+	struct env_entry *ep = &node->entry;
 
-		ret = _compare_and_overwrite_entry(item, action, retval, htab,
-			flag, hval, idx);
-		if (ret != -1)
-			return ret;
+	/* Overwrite existing value? */
+	if (action == ENV_ENTER && item.data) {
+		/* check for permission */
+		if (htab->change_ok != NULL && htab->change_ok(
+		    ep, item.data, env_op_overwrite, flag)) {
+			debug("change_ok() rejected setting variable "
+				"%s, skipping it!\n", item.key);
+			__set_errno(EPERM);
+			*retval = NULL;
+			return 0;
+		}
 
-		/*
-		 * Second hash function:
-		 * as suggested in [Knuth]
-		 */
-		hval2 = 1 + hval % (htab->size - 2);
-
-		do {
-			/*
-			 * Because SIZE is prime this guarantees to
-			 * step through all available indices.
-			 */
-			if (idx <= hval2)
-				idx = htab->size + idx - hval2;
-			else
-				idx -= hval2;
-
-			/*
-			 * If we visited all entries leave the loop
-			 * unsuccessfully.
-			 */
-			if (idx == hval)
-				break;
-
-			if (htab->table[idx].used == USED_DELETED
-			    && !first_deleted)
-				first_deleted = idx;
-
-			/* If entry is found use it. */
-			ret = _compare_and_overwrite_entry(item, action, retval,
-				htab, flag, hval, idx);
-			if (ret != -1)
-				return ret;
+		/* If there is a callback, call it */
+		if (do_callback(ep, item.key, item.data, env_op_overwrite,
+				flag)) {
+			debug("callback() rejected setting variable "
+				"%s, skipping it!\n", item.key);
+			__set_errno(EINVAL);
+			*retval = NULL;
+			return 0;
 		}
-		while (htab->table[idx].used != USED_FREE);
-	}
 
-	/* An empty bucket has been found. */
-	if (action == ENV_ENTER) {
-		/*
-		 * If table is full and another entry should be
-		 * entered return with error.
-		 */
-		if (htab->filled == htab->size) {
+		free(ep->data);
+		ep->data = strdup(item.data);
+		if (!ep->data) {
 			__set_errno(ENOMEM);
 			*retval = NULL;
 			return 0;
 		}
+	}
+	/* return found entry */
+	*retval = ep;
+	return node->pos + 1;
+}
 
+int hsearch_r(struct env_entry item, enum env_action action,
+	      struct env_entry **retval, struct hsearch_data *htab, int flag)
+{
+	unsigned int hval = hash_key(item.key);
+	struct env_entry_node *node;
+	unsigned int idx;
+	size_t len;
+
+	node = hfind(htab, item.key, hval);
+	if (node)
+		return _overwrite_entry(item, action, retval, htab, flag, node);
+
+	if (action == ENV_ENTER) {
 		/*
 		 * Create new entry;
 		 * create copies of item.key and item.data
 		 */
-		if (first_deleted)
-			idx = first_deleted;
-
-		htab->table[idx].used = hval;
-		htab->table[idx].entry.key = strdup(item.key);
-		htab->table[idx].entry.data = strdup(item.data);
-		if (!htab->table[idx].entry.key ||
-		    !htab->table[idx].entry.data) {
+		len = strlen(item.key);
+		node = htab->table ? malloc(sizeof(*node) + len + 1) : NULL;
+		if (!node) {
+			__set_errno(ENOMEM);
+			*retval = NULL;
+			return 0;
+		}
+		memset(node, '\0', sizeof(*node));
+		memcpy(node->key, item.key, len + 1);
+		node->entry.key = node->key;
+		node->entry.data = strdup(item.data);
+		node->hval = hval;
+		if (!node->entry.data || hsorted_add(htab, node)) {
+			free(node->entry.data);
+			free(node);
 			__set_errno(ENOMEM);
 			*retval = NULL;
 			return 0;
 		}
 
-		++htab->filled;
+		idx = hval & (htab->size - 1);
+		node->next = htab->table[idx];
+		htab->table[idx] = node;
+		if (++htab->filled > htab->size)
+			hgrow(htab);
 
 		/* This is a new entry, so look up a possible callback */
-		env_callback_init(&htab->table[idx].entry);
+		env_callback_init(&node->entry);
 		/* Also look for flags */
-		env_flags_init(&htab->table[idx].entry);
+		env_flags_init(&node->entry);
 
 		/* check for permission */
 		if (htab->change_ok != NULL && htab->change_ok(
-		    &htab->table[idx].entry, item.data, env_op_create, flag)) {
+		    &node->entry, item.data, env_op_create, flag)) {
 			debug("change_ok() rejected setting variable "
 				"%s, skipping it!\n", item.key);
-			_hdelete(item.key, htab, &htab->table[idx].entry, idx);
+			_hdelete(htab, node);
 			__set_errno(EPERM);
 			*retval = NULL;
 			return 0;
 		}
 
 		/* If there is a callback, call it */
-		if (do_callback(&htab->table[idx].entry, item.key, item.data,
+		if (do_callback(&node->entry, item.key, item.data,
 				env_op_create, flag)) {
 			debug("callback() rejected setting variable "
 				"%s, skipping it!\n", item.key);
-			_hdelete(item.key, htab, &htab->table[idx].entry, idx);
+			_hdelete(htab, node);
 			__set_errno(EINVAL);
 			*retval = NULL;
 			return 0;
 		}
 
 		/* return new entry */
-		*retval = &htab->table[idx].entry;
+		*retval = &node->entry;
 		return 1;
 	}
 
@@ -440,15 +537,19 @@ int hsearch_r(struct env_entry item, enum env_action action,
  * do that.
  */
 
-static void _hdelete(const char *key, struct hsearch_data *htab,
-		     struct env_entry *ep, int idx)
+static void _hdelete(struct hsearch_data *htab, struct env_entry_node *node)
 {
+	struct env_entry_node **linkp;
+
 	/* free used entry */
-	debug("hdelete: DELETING key \"%s\"\n", key);
-	free((void *)ep->key);
-	free(ep->data);
-	ep->flags = 0;
-	htab->table[idx].used = USED_DELETED;
+	debug("hdelete: DELETING key \"%s\"\n", node->entry.key);
+	linkp = &htab->table[node->hval & (htab->size - 1)];
+	while (*linkp != node)
+		linkp = &(*linkp)->next;
+	*linkp = node->next;
+	hsorted_remove(htab, node);
+	free(node->entry.data);
+	free(node);
 
 	--htab->filled;
 }
@@ -478,15 +579,14 @@ int hdelete_r(const char *key, struct hsearch_data *htab, int flag)
 	}
 
 	/* If there is a callback, call it */
-	if (do_callback(&htab->table[idx].entry, key, NULL,
-			env_op_delete, flag)) {
+	if (do_callback(ep, key, NULL, env_op_delete, flag)) {
 		debug("callback() rejected deleting variable "
 			"%s, skipping it!\n", key);
 		__set_errno(EINVAL);
 		return -EINVAL;
 	}
 
-	_hdelete(key, htab, ep, idx);
+	_hdelete(htab, to_node(ep));
 
 	return 0;
 }
@@ -509,7 +609,8 @@ int hdelete_r(const char *key, struct hsearch_data *htab, int flag)
  * for later re-import.
  *
  * The entries in the result list will be sorted by ascending key
- * values.
+ * values. The table keeps them in that order, so no sorting is needed
+ * here.
  *
  * If the separator character is different from NUL, then any
  * separator characters and backslash characters in the values will
@@ -534,14 +635,6 @@ int hdelete_r(const char *key, struct hsearch_data *htab, int flag)
  *		bytes in the string will be '\0'-padded.
  */
 
-static int cmpkey(const void *p1, const void *p2)
-{
-	struct env_entry *e1 = *(struct env_entry **)p1;
-	struct env_entry *e2 = *(struct env_entry **)p2;
-
-	return (strcmp(e1->key, e2->key));
-}
-
 static int match_string(int flag, const char *str, const char *pat, void *priv)
 {
 	switch (flag & H_MATCH_METHOD) {
@@ -604,7 +697,7 @@ ssize_t hexport_r(struct hsearch_data *htab, const char sep, int flag,
 		 char **resp, size_t size,
 		 int argc, char *const argv[])
 {
-	struct env_entry *list[htab->size];
+	struct env_entry **list;
 	char *res, *p;
 	size_t totlen;
 	int i, n;
@@ -617,61 +710,63 @@ ssize_t hexport_r(struct hsearch_data *htab, const char sep, int flag,
 
 	debug("EXPORT  table = %p, htab.size = %d, htab.filled = %d, size = %lu\n",
 	      htab, htab->size, htab->filled, (ulong)size);
+	hsorted_update(htab);
+	list = malloc((htab->filled + 1) * sizeof(*list));
+	if (!list) {
+		__set_errno(ENOMEM);
+		return (-1);
+	}
+
 	/*
 	 * Pass 1:
-	 * search used entries,
+	 * search used entries in key order,
 	 * save addresses and compute total length
 	 */
-	for (i = 1, n = 0, totlen = 0; i <= htab->size; ++i) {
+	for (i = 0, n = 0, totlen = 0; i < htab->filled; ++i) {
+		struct env_entry *ep = &htab->sorted[i]->entry;
+		int found = match_entry(ep, flag, argc, argv);
 
-		if (htab->table[i].used > 0) {
-			struct env_entry *ep = &htab->table[i].entry;
-			int found = match_entry(ep, flag, argc, argv);
-
-			if ((argc > 0) && (found == 0))
-				continue;
+		if ((argc > 0) && (found == 0))
+			continue;
 
-			if ((flag & H_HIDE_DOT) && ep->key[0] == '.')
-				continue;
+		if ((flag & H_HIDE_DOT) && ep->key[0] == '.')
+			continue;
 
-			list[n++] = ep;
+		list[n++] = ep;
 
-			totlen += strlen(ep->key);
+		totlen += strlen(ep->key);
 
-			if (sep == '\0') {
-				totlen += strlen(ep->data);
-			} else {	/* check if escapes are needed */
-				char *s = ep->data;
+		if (sep == '\0') {
+			totlen += strlen(ep->data);
+		} else {	/* check if escapes are needed */
+			char *s = ep->data;
 
-				while (*s) {
+			while (*s) {
+				++totlen;
+				/* add room for needed escape chars */
+				if ((*s == sep) || (*s == '\\'))
 					++totlen;
-					/* add room for needed escape chars */
-					if ((*s == sep) || (*s == '\\'))
-						++totlen;
-					++s;
-				}
+				++s;
 			}
-			totlen += 2;	/* for '=' and 'sep' char */
 		}
+		totlen += 2;	/* for '=' and 'sep' char */
 	}
 
 #ifdef DEBUG
-	/* Pass 1a: print unsorted list */
-	printf("Unsorted: n=%d\n", n);
+	/* Pass 1a: print list */
+	printf("Sorted: n=%d\n", n);
 	for (i = 0; i < n; ++i) {
 		printf("\t%3d: %p ==> %-10s => %s\n",
 		       i, list[i], list[i]->key, list[i]->data);
 	}
 #endif
 
-	/* Sort list by keys */
-	qsort(list, n, sizeof(struct env_entry *), cmpkey);
-
 	/* Check if the user supplied buffer size is sufficient */
 	if (size) {
 		if (size < totlen + 1) {	/* provided buffer too small */
 			printf("Env export buffer too small: %lu, but need %lu\n",
 			       (ulong)size, (ulong)totlen + 1);
+			free(list);
 			__set_errno(ENOMEM);
 			return (-1);
 		}
@@ -688,6 +783,7 @@ ssize_t hexport_r(struct hsearch_data *htab, const char sep, int flag,
 		/* no, allocate and clear one */
 		*resp = res = calloc(1, size);
 		if (res == NULL) {
+			free(list);
 			__set_errno(ENOMEM);
 			return (-1);
 		}
@@ -714,6 +810,7 @@ ssize_t hexport_r(struct hsearch_data *htab, const char sep, int flag,
 		*p++ = sep;
 	}
 	*p = '\0';		/* terminate result */
+	free(list);
 
 	return size;
 }
@@ -767,7 +864,9 @@ static int drop_var_from_set(const char *name, int nvars, char * vars[])
  * vars are passed, old data will be discarded and a new hash table
  * will be created. If vars are passed, passed vars that are not in
  * the linear list of "name=value" pairs will be removed from the
- * current hash table.
+ * current hash table. When the existing table is kept, variables which
+ * already have the imported value are left alone, without calling the
+ * change_ok() check or any callback.
  *
  * The separator character for the "name=value" pairs can be selected,
  * so we both support importing from externally stored environment
@@ -796,6 +895,7 @@ int himport_r(struct hsearch_data *htab,
 {
 	char *data, *sp, *dp, *name, *value;
 	char *localvars[nvars];
+	bool keep;
 	int i;
 
 	/* Test for correct arguments.  */
@@ -821,8 +921,9 @@ int himport_r(struct hsearch_data *htab,
 #if CONFIG_IS_ENABLED(ENV_APPEND)
 	flag |= H_NOCLEAR;
 #endif
+	keep = (flag & H_NOCLEAR) || nvars;
 
-	if ((flag & H_NOCLEAR) == 0 && !nvars) {
+	if (!keep) {
 		/* Destroy old hash table if one exists */
 		debug("Destroy Hash Table: %p table = %p\n", htab,
 		       htab->table);
@@ -845,7 +946,9 @@ int himport_r(struct hsearch_data *htab,
 	 * environment size), so we clip it to a reasonable value.
 	 * On the other hand we need to add some more entries for free
 	 * space when importing very small buffers. Both boundaries can
-	 * be overwritten in the board config file if needed.
+	 * be overwritten in the board config file if needed. The table
+	 * grows if more entries are added later, so this only sets the
+	 * starting size.
 	 */
 
 	if (!htab->table) {
@@ -937,6 +1040,18 @@ int himport_r(struct hsearch_data *htab,
 		if (!drop_var_from_set(name, nvars, localvars))
 			continue;
 
+		/*
+		 * When adding to an existing table, only apply changes, so
+		 * that checks and callbacks run just for those
+		 */
+		e.key = name;
+		e.data = NULL;
+		if (keep && hsearch_r(e, ENV_FIND, &rv, htab, 0) &&
+		    rv->data && !strcmp(rv->data, value)) {
+			debug("UNCHANGED: \"%s\"\n", name);
+			continue;
+		}
+
 		/* enter into hash table */
 		e.key = name;
 		e.data = value;
@@ -996,9 +1111,9 @@ int hwalk_r(struct hsearch_data *htab, int (*callback)(struct env_entry *entry))
 	int i;
 	int retval;
 
-	for (i = 1; i <= htab->size; ++i) {
-		if (htab->table[i].used > 0) {
-			retval = callback(&htab->table[i].entry);
+	for (i = 0; i < htab->used; ++i) {
+		if (htab->sorted[i]) {
+			retval = callback(&htab->sorted[i]->entry);
 			if (retval)
 				return retval;
 		}
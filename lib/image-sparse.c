@@ -50,60 +50,210 @@
 
 static void default_log(const char *ignored, char *response) {}
 
-static lbaint_t write_sparse_chunk_raw(struct sparse_storage *info,
-				       lbaint_t blk, lbaint_t blkcnt,
-				       void *data,
-				       char *response)
-{
-	lbaint_t n = blkcnt, write_blks, blks = 0, aligned_buf_blks = 100;
-	uint32_t *aligned_buf = NULL;
+/**
+ * struct sparse_batch - raw blocks gathered up to be written together
+ *
+ * @buf: DMA-aligned buffer for the blocks, NULL until it is needed
+ * @max: Number of blocks @buf holds
+ * @blk: Block where the first one in @buf is written
+ * @cnt: Number of blocks in @buf
+ */
+struct sparse_batch {
+	void *buf;
+	lbaint_t max;
+	lbaint_t blk;
+	lbaint_t cnt;
+};
 
-	if (CONFIG_IS_ENABLED(SYS_DCACHE_OFF)) {
-		write_blks = info->write(info, blk, n, data);
-		if (write_blks < n)
-			goto write_fail;
+/* Returns the number of blocks written, more if NAND bad-blocks are skipped */
+static lbaint_t sparse_write_blocks(struct sparse_storage *info,
+				    lbaint_t blk, lbaint_t blkcnt,
+				    const void *buf, char *response)
+{
+	lbaint_t write_blks;
 
+	info->stats.writes++;
+	write_blks = info->write(info, blk, blkcnt, buf);
+	if (IS_ERR_VALUE(write_blks)) {
+		printf("%s: Write failed, block #" LBAFU " [" LBAFU "] (%lld)\n",
+		       __func__, blk, blkcnt, (long long)write_blks);
+		info->mssg("flash write failure", response);
 		return write_blks;
 	}
-
-	aligned_buf = memalign(ARCH_DMA_MINALIGN, info->blksz * aligned_buf_blks);
-	if (!aligned_buf) {
-		info->mssg("Malloc failed for: CHUNK_TYPE_RAW", response);
-		return -ENOMEM;
+	if (write_blks < blkcnt) {
+		printf("%s: Write failed, block #" LBAFU " [" LBAFU "]\n",
+		       __func__, blk, blkcnt);
+		info->mssg("flash write failure(incomplete)", response);
+		return -1;
 	}
 
-	while (blkcnt > 0) {
-		n = min(aligned_buf_blks, blkcnt);
-		memcpy(aligned_buf, data, n * info->blksz);
+	return write_blks;
+}
+
+static void sparse_batch_init(struct sparse_storage *info,
+			      struct sparse_batch *sb)
+{
+	memset(sb, '\0', sizeof(*sb));
+	sb->max = max_t(lbaint_t, CONFIG_IMAGE_SPARSE_BATCH_SIZE / info->blksz,
+			1);
+}
 
-		/* write_blks might be > n due to NAND bad-blocks */
-		write_blks = info->write(info, blk + blks, n, aligned_buf);
-		if (write_blks < n) {
-			free(aligned_buf);
-			goto write_fail;
+/**
+ * sparse_batch_flush() - Write the blocks gathered so far
+ *
+ * @info: Storage to write to
+ * @sb: Batch to write
+ * @blkp: Block after the batch, updated if bad blocks were skipped
+ * @response: Response buffer, written on error
+ * Return: 0 if OK, -ve on error
+ */
+static int sparse_batch_flush(struct sparse_storage *info,
+			      struct sparse_batch *sb, lbaint_t *blkp,
+			      char *response)
+{
+	lbaint_t blks;
+
+	if (!sb->cnt)
+		return 0;
+	blks = sparse_write_blocks(info, sb->blk, sb->cnt, sb->buf, response);
+	if (IS_ERR_VALUE(blks))
+		return -EIO;
+	*blkp = sb->blk + blks;
+	sb->cnt = 0;
+
+	return 0;
+}
+
+/**
+ * sparse_batch_add() - Add raw data to be written, writing any full batch
+ *
+ * @info: Storage to write to
+ * @sb: Batch to add to
+ * @blkp: Block where @data goes, updated to the block after it
+ * @data: Data to write
+ * @blkcnt: Number of blocks in @data
+ * @response: Response buffer, written on error
+ * Return: 0 if OK, -ve on error
+ */
+static int sparse_batch_add(struct sparse_storage *info,
+			    struct sparse_batch *sb, lbaint_t *blkp,
+			    const void *data, lbaint_t blkcnt, char *response)
+{
+	lbaint_t n;
+	int ret;
+
+	info->stats.raw_blks += blkcnt;
+
+	/* Without a data cache, long runs are written from where they are */
+	if (CONFIG_IS_ENABLED(SYS_DCACHE_OFF) && !sb->cnt &&
+	    blkcnt >= sb->max) {
+		n = sparse_write_blocks(info, *blkp, blkcnt, data, response);
+		if (IS_ERR_VALUE(n))
+			return -EIO;
+		*blkp += n;
+		return 0;
+	}
+
+	if (!sb->buf) {
+		sb->buf = memalign(ARCH_DMA_MINALIGN, sb->max * info->blksz);
+		if (!sb->buf) {
+			info->mssg("Malloc failed for: CHUNK_TYPE_RAW",
+				   response);
+			return -ENOMEM;
 		}
+	}
 
-		blks += write_blks;
+	while (blkcnt) {
+		if (sb->cnt == sb->max) {
+			ret = sparse_batch_flush(info, sb, blkp, response);
+			if (ret)
+				return ret;
+		}
+		if (!sb->cnt)
+			sb->blk = *blkp;
+		n = min(sb->max - sb->cnt, blkcnt);
+		memcpy(sb->buf + sb->cnt * info->blksz, data, n * info->blksz);
+		sb->cnt += n;
+		*blkp += n;
 		data += n * info->blksz;
 		blkcnt -= n;
 	}
 
-	free(aligned_buf);
-	return blks;
+	return 0;
+}
 
-write_fail:
-	if (IS_ERR_VALUE(write_blks)) {
-		printf("%s: Write failed, block #" LBAFU " [" LBAFU "] (%lld)\n",
-		       __func__, blk + blks, n, (long long)write_blks);
-		info->mssg("flash write failure", response);
-		return write_blks;
+static void sparse_batch_free(struct sparse_batch *sb)
+{
+	free(sb->buf);
+	sb->buf = NULL;
+}
+
+static lbaint_t write_sparse_chunk_fill(struct sparse_storage *info,
+					lbaint_t blk, lbaint_t blkcnt,
+					uint32_t fill_val, char *response)
+{
+	int fill_buf_num_blks = CONFIG_IMAGE_SPARSE_FILLBUF_SIZE / info->blksz;
+	uint32_t *fill_buf;
+	lbaint_t blks = 0, n;
+	int i, j;
+
+	if (!fill_val && info->zero) {
+		n = info->zero(info, blk, blkcnt);
+		if (n == blkcnt) {
+			info->stats.zero_blks += blkcnt;
+			return n;
+		}
+		if (n != (lbaint_t)-EOPNOTSUPP && n != (lbaint_t)-ENOSYS) {
+			printf("%s: Zero failed, block #" LBAFU " [" LBAFU "]\n",
+			       __func__, blk, blkcnt);
+			info->mssg("flash write failure", response);
+			return -EIO;
+		}
+	}
+	info->stats.fill_blks += blkcnt;
+
+	fill_buf = (uint32_t *)
+		   memalign(ARCH_DMA_MINALIGN,
+			    ROUNDUP(info->blksz * fill_buf_num_blks,
+				    ARCH_DMA_MINALIGN));
+	if (!fill_buf) {
+		info->mssg("Malloc failed for: CHUNK_TYPE_FILL", response);
+		return -ENOMEM;
 	}
 
-	/* write_blks < n */
-	printf("%s: Write failed, block #" LBAFU " [" LBAFU "]\n",
-	       __func__, blk + blks, n);
-	info->mssg("flash write failure(incomplete)", response);
-	return -1;
+	for (i = 0; i < (info->blksz * fill_buf_num_blks / sizeof(fill_val));
+	     i++)
+		fill_buf[i] = fill_val;
+
+	for (i = 0; i < blkcnt;) {
+		j = blkcnt - i;
+		if (j > fill_buf_num_blks)
+			j = fill_buf_num_blks;
+		info->stats.writes++;
+		n = info->write(info, blk + blks, j, fill_buf);
+		/* n might be > j (eg. NAND bad-blocks) */
+		if (n < j) {
+			printf("%s: %s " LBAFU " [%d]\n", __func__,
+			       "Write failed, block #", blk + blks, j);
+			info->mssg("flash write failure", response);
+			free(fill_buf);
+			return -EIO;
+		}
+		blks += n;
+		i += j;
+	}
+	free(fill_buf);
+
+	return blks;
+}
+
+static void sparse_print_stats(struct sparse_storage *info)
+{
+	struct sparse_stats *st = &info->stats;
+
+	printf("........ raw " LBAFU ", fill " LBAFU ", zeroed " LBAFU
+	       ", skipped " LBAFU " blocks in %u writes\n", st->raw_blks,
+	       st->fill_blks, st->zero_blks, st->skip_blks, st->writes);
 }
 
 int write_sparse_image(struct sparse_storage *info,
@@ -116,16 +266,12 @@ int write_sparse_image(struct sparse_storage *info,
 	unsigned int chunk;
 	unsigned int offset;
 	uint64_t chunk_data_sz;
-	uint32_t *fill_buf = NULL;
 	uint32_t fill_val;
 	sparse_header_t *sparse_header;
 	chunk_header_t *chunk_header;
 	uint32_t total_blocks = 0;
-	int fill_buf_num_blks;
-	int i;
-	int j;
-
-	fill_buf_num_blks = CONFIG_IMAGE_SPARSE_FILLBUF_SIZE / info->blksz;
+	struct sparse_batch sb;
+	int ret = -1;
 
 	/* Read and skip over sparse image header */
 	sparse_header = (sparse_header_t *)data;
@@ -141,6 +287,7 @@ int write_sparse_image(struct sparse_storage *info,
 
 	if (!info->mssg)
 		info->mssg = default_log;
+	memset(&info->stats, '\0', sizeof(info->stats));
 
 	debug("=== Sparse Image Header ===\n");
 	debug("magic: 0x%x\n", sparse_header->magic);
@@ -166,6 +313,12 @@ int write_sparse_image(struct sparse_storage *info,
 
 	puts("Flashing Sparse Image\n");
 
+	/*
+	 * Raw chunks are gathered up and written together, until a chunk of
+	 * another type moves on to other blocks
+	 */
+	sparse_batch_init(info, &sb);
+
 	/* Start processing chunks */
 	blk = info->start;
 	for (chunk = 0; chunk < sparse_header->total_chunks; chunk++) {
@@ -197,7 +350,7 @@ int write_sparse_image(struct sparse_storage *info,
 			    (sparse_header->chunk_hdr_sz + chunk_data_sz)) {
 				info->mssg("Bogus chunk size for chunk type Raw",
 					   response);
-				return -1;
+				goto out;
 			}
 
 			if (blk + blkcnt > info->start + info->size) {
@@ -206,15 +359,13 @@ int write_sparse_image(struct sparse_storage *info,
 				    __func__);
 				info->mssg("Request would exceed partition size!",
 					   response);
-				return -1;
+				goto out;
 			}
 
-			blks = write_sparse_chunk_raw(info, blk, blkcnt,
-						      data, response);
-			if (blks < 0)
-				return -1;
+			if (sparse_batch_add(info, &sb, &blk, data, blkcnt,
+					     response))
+				goto out;
 
-			blk += blks;
 			bytes_written += ((u64)blkcnt) * info->blksz;
 			total_blocks += chunk_header->chunk_sz;
 			data += chunk_data_sz;
@@ -224,28 +375,14 @@ int write_sparse_image(struct sparse_storage *info,
 			if (chunk_header->total_sz !=
 			    (sparse_header->chunk_hdr_sz + sizeof(uint32_t))) {
 				info->mssg("Bogus chunk size for chunk type FILL", response);
-				return -1;
-			}
-
-			fill_buf = (uint32_t *)
-				   memalign(ARCH_DMA_MINALIGN,
-					    ROUNDUP(
-						info->blksz * fill_buf_num_blks,
-						ARCH_DMA_MINALIGN));
-			if (!fill_buf) {
-				info->mssg("Malloc failed for: CHUNK_TYPE_FILL",
-					   response);
-				return -1;
+				goto out;
 			}
 
 			fill_val = *(uint32_t *)data;
 			data = (char *)data + sizeof(uint32_t);
 
-			for (i = 0;
-			     i < (info->blksz * fill_buf_num_blks /
-				  sizeof(fill_val));
-			     i++)
-				fill_buf[i] = fill_val;
+			if (sparse_batch_flush(info, &sb, &blk, response))
+				goto out;
 
 			if (blk + blkcnt > info->start + info->size) {
 				printf(
@@ -253,36 +390,25 @@ int write_sparse_image(struct sparse_storage *info,
 				    __func__);
 				info->mssg("Request would exceed partition size!",
 					   response);
-				return -1;
+				goto out;
 			}
 
-			for (i = 0; i < blkcnt;) {
-				j = blkcnt - i;
-				if (j > fill_buf_num_blks)
-					j = fill_buf_num_blks;
-				blks = info->write(info, blk, j, fill_buf);
-				/* blks might be > j (eg. NAND bad-blocks) */
-				if (blks < j) {
-					printf("%s: %s " LBAFU " [%d]\n",
-					       __func__,
-					       "Write failed, block #",
-					       blk, j);
-					info->mssg("flash write failure",
-						   response);
-					free(fill_buf);
-					return -1;
-				}
-				blk += blks;
-				i += j;
-			}
+			blks = write_sparse_chunk_fill(info, blk, blkcnt,
+						       fill_val, response);
+			if (IS_ERR_VALUE(blks))
+				goto out;
+
+			blk += blks;
 			bytes_written += ((u64)blkcnt) * info->blksz;
 			total_blocks += DIV_ROUND_UP_ULL(chunk_data_sz,
 							 sparse_header->blk_sz);
-			free(fill_buf);
 			break;
 
 		case CHUNK_TYPE_DONT_CARE:
+			if (sparse_batch_flush(info, &sb, &blk, response))
+				goto out;
 			blk += info->reserve(info, blk, blkcnt);
+			info->stats.skip_blks += blkcnt;
 			total_blocks += chunk_header->chunk_sz;
 			break;
 
@@ -291,7 +417,7 @@ int write_sparse_image(struct sparse_storage *info,
 			    sparse_header->chunk_hdr_sz) {
 				info->mssg("Bogus chunk size for chunk type Dont Care",
 					   response);
-				return -1;
+				goto out;
 			}
 			total_blocks += chunk_header->chunk_sz;
 			data += chunk_data_sz;
@@ -301,17 +427,241 @@ int write_sparse_image(struct sparse_storage *info,
 			printf("%s: Unknown chunk type: %x\n", __func__,
 			       chunk_header->chunk_type);
 			info->mssg("Unknown chunk type", response);
-			return -1;
+			goto out;
 		}
 	}
+	if (sparse_batch_flush(info, &sb, &blk, response))
+		goto out;
 
 	debug("Wrote %d blocks, expected to write %d blocks\n",
 	      total_blocks, sparse_header->total_blks);
 	printf("........ wrote %llu bytes to '%s'\n", bytes_written, part_name);
+	sparse_print_stats(info);
 
 	if (total_blocks != sparse_header->total_blks) {
 		info->mssg("sparse image write failure", response);
-		return -1;
+		goto out;
+	}
+	ret = 0;
+out:
+	sparse_batch_free(&sb);
+
+	return ret;
+}
+
+void sparse_stream_init(struct sparse_stream *ss, struct sparse_storage *info)
+{
+	memset(ss, '\0', sizeof(*ss));
+	ss->info = info;
+	ss->blk = info->start;
+	if (!info->mssg)
+		info->mssg = default_log;
+	memset(&info->stats, '\0', sizeof(info->stats));
+}
+
+/* Check the sparse image header, once it has all arrived */
+static int sparse_stream_header(struct sparse_stream *ss, char *response)
+{
+	struct sparse_storage *info = ss->info;
+	sparse_header_t *hdr = &ss->header;
+	unsigned int offset;
+
+	if (!is_sparse_image(hdr) || hdr->file_hdr_sz < sizeof(*hdr) ||
+	    hdr->chunk_hdr_sz < sizeof(chunk_header_t)) {
+		info->mssg("invalid sparse image header", response);
+		return -EINVAL;
+	}
+
+	div_u64_rem(hdr->blk_sz, info->blksz, &offset);
+	if (offset) {
+		printf("%s: Sparse image block size issue [%u]\n",
+		       __func__, hdr->blk_sz);
+		info->mssg("sparse image block size issue", response);
+		return -EINVAL;
+	}
+	ss->chunks_left = hdr->total_chunks;
+
+	puts("Flashing Sparse Image\n");
+
+	return 0;
+}
+
+/* Check a chunk header, once it has all arrived, and skip an empty chunk */
+static int sparse_stream_chunk(struct sparse_stream *ss, char *response)
+{
+	struct sparse_storage *info = ss->info;
+	chunk_header_t *chunk = &ss->chunk;
+	uint32_t hdr_sz = ss->header.chunk_hdr_sz;
+	lbaint_t blkcnt;
+
+	ss->data_left = (u64)ss->header.blk_sz * chunk->chunk_sz;
+	blkcnt = DIV_ROUND_UP_ULL(ss->data_left, info->blksz);
+
+	switch (chunk->chunk_type) {
+	case CHUNK_TYPE_RAW:
+		if (chunk->total_sz != hdr_sz + ss->data_left) {
+			info->mssg("Bogus chunk size for chunk type Raw",
+				   response);
+			return -EINVAL;
+		}
+		break;
+	case CHUNK_TYPE_FILL:
+		if (chunk->total_sz != hdr_sz + sizeof(uint32_t)) {
+			info->mssg("Bogus chunk size for chunk type FILL",
+				   response);
+			return -EINVAL;
+		}
+		break;
+	case CHUNK_TYPE_DONT_CARE:
+		ss->blk += info->reserve(info, ss->blk, blkcnt);
+		info->stats.skip_blks += blkcnt;
+		ss->total_blocks += chunk->chunk_sz;
+		ss->data_left = 0;
+		return 0;
+	case CHUNK_TYPE_CRC32:
+		if (chunk->total_sz != hdr_sz) {
+			info->mssg("Bogus chunk size for chunk type Dont Care",
+				   response);
+			return -EINVAL;
+		}
+		ss->total_blocks += chunk->chunk_sz;
+		break;
+	default:
+		printf("%s: Unknown chunk type: %x\n", __func__,
+		       chunk->chunk_type);
+		info->mssg("Unknown chunk type", response);
+		return -EINVAL;
+	}
+
+	if (chunk->chunk_type != CHUNK_TYPE_CRC32 &&
+	    ss->blk + blkcnt > info->start + info->size) {
+		printf("%s: Request would exceed partition size!\n", __func__);
+		info->mssg("Request would exceed partition size!", response);
+		return -ENOSPC;
+	}
+	ss->in_chunk = ss->data_left || chunk->chunk_type == CHUNK_TYPE_FILL;
+
+	return 0;
+}
+
+long sparse_stream_write(struct sparse_stream *ss, const void *data,
+			 size_t len, char *response)
+{
+	struct sparse_storage *info = ss->info;
+	const char *p = data, *end = p + len;
+	struct sparse_batch sb;
+	lbaint_t blkcnt, blks;
+	uint32_t fill_val;
+	uint64_t n;
+	int ret = 0;
+
+	/* Raw data is gathered up over this call, then written */
+	sparse_batch_init(info, &sb);
+	while (p < end) {
+		if (!ss->have_header) {
+			if (end - p < sizeof(ss->header))
+				break;
+			memcpy(&ss->header, p, sizeof(ss->header));
+			if (end - p < ss->header.file_hdr_sz)
+				break;
+			ret = sparse_stream_header(ss, response);
+			if (ret)
+				goto out;
+			p += ss->header.file_hdr_sz;
+			ss->have_header = true;
+		} else if (!ss->in_chunk) {
+			/* Anything after the last chunk is ignored */
+			if (!ss->chunks_left) {
+				p = end;
+				break;
+			}
+			if (end - p < ss->header.chunk_hdr_sz)
+				break;
+			memcpy(&ss->chunk, p, sizeof(ss->chunk));
+			if (ss->chunk.chunk_type != CHUNK_TYPE_RAW &&
+			    ss->chunk.chunk_type != CHUNK_TYPE_CRC32) {
+				ret = sparse_batch_flush(info, &sb, &ss->blk,
+							 response);
+				if (ret)
+					goto out;
+			}
+			p += ss->header.chunk_hdr_sz;
+			ss->chunks_left--;
+			ret = sparse_stream_chunk(ss, response);
+			if (ret)
+				goto out;
+		} else if (ss->chunk.chunk_type == CHUNK_TYPE_RAW) {
+			/* Take whatever whole blocks have arrived */
+			n = min_t(uint64_t, ss->data_left, end - p);
+			blkcnt = lldiv(n, info->blksz);
+			if (!blkcnt)
+				break;
+			ret = sparse_batch_add(info, &sb, &ss->blk, p, blkcnt,
+					       response);
+			if (ret)
+				goto out;
+			n = (u64)blkcnt * info->blksz;
+			ss->bytes_written += n;
+			ss->data_left -= n;
+			p += n;
+			if (!ss->data_left) {
+				ss->total_blocks += ss->chunk.chunk_sz;
+				ss->in_chunk = false;
+			}
+		} else if (ss->chunk.chunk_type == CHUNK_TYPE_FILL) {
+			if (end - p < sizeof(fill_val))
+				break;
+			memcpy(&fill_val, p, sizeof(fill_val));
+			p += sizeof(fill_val);
+			blkcnt = DIV_ROUND_UP_ULL(ss->data_left, info->blksz);
+			blks = write_sparse_chunk_fill(info, ss->blk, blkcnt,
+						       fill_val, response);
+			if (IS_ERR_VALUE(blks)) {
+				ret = -EIO;
+				goto out;
+			}
+			ss->blk += blks;
+			ss->bytes_written += (u64)blkcnt * info->blksz;
+			ss->total_blocks += DIV_ROUND_UP_ULL(ss->data_left,
+							     ss->header.blk_sz);
+			ss->in_chunk = false;
+		} else {
+			/* CRC32 chunk data is skipped */
+			n = min_t(uint64_t, ss->data_left, end - p);
+			ss->data_left -= n;
+			p += n;
+			if (!ss->data_left)
+				ss->in_chunk = false;
+		}
+	}
+	ret = sparse_batch_flush(info, &sb, &ss->blk, response);
+out:
+	sparse_batch_free(&sb);
+	if (ret)
+		return ret;
+
+	return p - (const char *)data;
+}
+
+int sparse_stream_finish(struct sparse_stream *ss, const char *part_name,
+			 char *response)
+{
+	struct sparse_storage *info = ss->info;
+
+	if (!ss->have_header || ss->chunks_left || ss->in_chunk) {
+		info->mssg("sparse image is incomplete", response);
+		return -EINVAL;
+	}
+
+	debug("Wrote %d blocks, expected to write %d blocks\n",
+	      ss->total_blocks, ss->header.total_blks);
+	printf("........ wrote %llu bytes to '%s'\n", ss->bytes_written,
+	       part_name);
+	sparse_print_stats(info);
+
+	if (ss->total_blocks != ss->header.total_blks) {
+		info->mssg("sparse image write failure", response);
+		return -EINVAL;
 	}
 
 	return 0;
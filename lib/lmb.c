@@ -85,13 +85,8 @@ static long lmb_regions_adjacent(struct lmb_region *rgn, unsigned long r1,
 
 static void lmb_remove_region(struct lmb_region *rgn, unsigned long r)
 {
-	unsigned long i;
-
-	for (i = r; i < rgn->cnt - 1; i++) {
-		rgn->region[i].base = rgn->region[i + 1].base;
-		rgn->region[i].size = rgn->region[i + 1].size;
-		rgn->region[i].flags = rgn->region[i + 1].flags;
-	}
+	memmove(&rgn->region[r], &rgn->region[r + 1],
+		(rgn->cnt - r - 1) * sizeof(rgn->region[0]));
 	rgn->cnt--;
 }
 
@@ -103,6 +98,49 @@ static void lmb_coalesce_regions(struct lmb_region *rgn, unsigned long r1,
 	lmb_remove_region(rgn, r2);
 }
 
+/*
+ * Return the index of the first region whose base is above @addr. Regions do
+ * not overlap, so the one before it is the only one which may contain @addr.
+ */
+static unsigned long lmb_region_search(struct lmb_region *rgn,
+				       phys_addr_t addr)
+{
+	unsigned long lo = 0, hi = rgn->cnt, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (rgn->region[mid].base <= addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/* Make room for one more region, if the array is allowed to grow */
+static int lmb_grow_region(struct lmb_region *rgn)
+{
+#if IS_ENABLED(CONFIG_LMB_GROW_REGIONS)
+	struct lmb_property *region;
+
+	region = malloc(2 * rgn->max * sizeof(*region));
+	if (!region)
+		return -1;
+
+	memcpy(region, rgn->region, rgn->cnt * sizeof(*region));
+	if (rgn->allocated)
+		free(rgn->region);
+	rgn->region = region;
+	rgn->max *= 2;
+	rgn->allocated = true;
+
+	return 0;
+#else
+	return -1;
+#endif
+}
+
 void lmb_init(struct lmb *lmb)
 {
 #if IS_ENABLED(CONFIG_LMB_USE_MAX_REGIONS)
@@ -111,13 +149,31 @@ void lmb_init(struct lmb *lmb)
 #elif defined(CONFIG_LMB_MEMORY_REGIONS)
 	lmb->memory.max = CONFIG_LMB_MEMORY_REGIONS;
 	lmb->reserved.max = CONFIG_LMB_RESERVED_REGIONS;
+#endif
+#if !IS_ENABLED(CONFIG_LMB_USE_MAX_REGIONS) || \
+	IS_ENABLED(CONFIG_LMB_GROW_REGIONS)
 	lmb->memory.region = lmb->memory_regions;
 	lmb->reserved.region = lmb->reserved_regions;
+#endif
+#if IS_ENABLED(CONFIG_LMB_GROW_REGIONS)
+	lmb->memory.allocated = false;
+	lmb->reserved.allocated = false;
 #endif
 	lmb->memory.cnt = 0;
 	lmb->reserved.cnt = 0;
 }
 
+void lmb_uninit(struct lmb *lmb)
+{
+#if IS_ENABLED(CONFIG_LMB_GROW_REGIONS)
+	if (lmb->memory.allocated)
+		free(lmb->memory.region);
+	if (lmb->reserved.allocated)
+		free(lmb->reserved.region);
+#endif
+	lmb_init(lmb);
+}
+
 void arch_lmb_reserve_generic(struct lmb *lmb, ulong sp, ulong end, ulong align)
 {
 	ulong bank_end;
@@ -192,83 +248,58 @@ void lmb_init_and_reserve_range(struct lmb *lmb, phys_addr_t base,
 static long lmb_add_region_flags(struct lmb_region *rgn, phys_addr_t base,
 				 phys_size_t size, enum lmb_flags flags)
 {
+	struct lmb_property *prev = NULL, *next = NULL;
 	unsigned long coalesced = 0;
-	long adjacent, i;
+	unsigned long i;
 
-	if (rgn->cnt == 0) {
-		rgn->region[0].base = base;
-		rgn->region[0].size = size;
-		rgn->region[0].flags = flags;
-		rgn->cnt = 1;
-		return 0;
+	/* Only the neighbours of the new region can clash or merge with it */
+	i = lmb_region_search(rgn, base);
+	if (i > 0)
+		prev = &rgn->region[i - 1];
+	if (i < rgn->cnt)
+		next = &rgn->region[i];
+
+	if (prev && prev->base == base && prev->size == size) {
+		if (flags == prev->flags)
+			/* Already have this region, so we're done */
+			return 0;
+		else
+			return -1; /* regions with new flags */
 	}
 
-	/* First try and coalesce this LMB with another. */
-	for (i = 0; i < rgn->cnt; i++) {
-		phys_addr_t rgnbase = rgn->region[i].base;
-		phys_size_t rgnsize = rgn->region[i].size;
-		phys_size_t rgnflags = rgn->region[i].flags;
-
-		if (rgnbase == base && rgnsize == size) {
-			if (flags == rgnflags)
-				/* Already have this region, so we're done */
-				return 0;
-			else
-				return -1; /* regions with new flags */
-		}
-
-		adjacent = lmb_addrs_adjacent(base, size, rgnbase, rgnsize);
-		if (adjacent > 0) {
-			if (flags != rgnflags)
-				break;
-			rgn->region[i].base -= size;
-			rgn->region[i].size += size;
-			coalesced++;
-			break;
-		} else if (adjacent < 0) {
-			if (flags != rgnflags)
-				break;
-			rgn->region[i].size += size;
-			coalesced++;
-			break;
-		} else if (lmb_addrs_overlap(base, size, rgnbase, rgnsize)) {
-			/* regions overlap */
-			return -1;
-		}
-	}
+	if ((prev && lmb_addrs_overlap(base, size, prev->base, prev->size)) ||
+	    (next && lmb_addrs_overlap(base, size, next->base, next->size)))
+		/* regions overlap */
+		return -1;
 
-	if ((i < rgn->cnt - 1) && lmb_regions_adjacent(rgn, i, i + 1)) {
-		if (rgn->region[i].flags == rgn->region[i + 1].flags) {
-			lmb_coalesce_regions(rgn, i, i + 1);
+	/* First try and coalesce this LMB with another. */
+	if (prev && flags == prev->flags &&
+	    lmb_addrs_adjacent(base, size, prev->base, prev->size) < 0) {
+		prev->size += size;
+		coalesced++;
+		if (next && next->flags == prev->flags &&
+		    lmb_regions_adjacent(rgn, i - 1, i) > 0) {
+			lmb_coalesce_regions(rgn, i - 1, i);
 			coalesced++;
 		}
+	} else if (next && flags == next->flags &&
+		   lmb_addrs_adjacent(base, size, next->base, next->size) > 0) {
+		next->base -= size;
+		next->size += size;
+		coalesced++;
 	}
 
 	if (coalesced)
 		return coalesced;
-	if (rgn->cnt >= rgn->max)
+	if (rgn->cnt >= rgn->max && lmb_grow_region(rgn))
 		return -1;
 
 	/* Couldn't coalesce the LMB, so add it to the sorted table. */
-	for (i = rgn->cnt-1; i >= 0; i--) {
-		if (base < rgn->region[i].base) {
-			rgn->region[i + 1].base = rgn->region[i].base;
-			rgn->region[i + 1].size = rgn->region[i].size;
-			rgn->region[i + 1].flags = rgn->region[i].flags;
-		} else {
-			rgn->region[i + 1].base = base;
-			rgn->region[i + 1].size = size;
-			rgn->region[i + 1].flags = flags;
-			break;
-		}
-	}
-
-	if (base < rgn->region[0].base) {
-		rgn->region[0].base = base;
-		rgn->region[0].size = size;
-		rgn->region[0].flags = flags;
-	}
-
+	memmove(&rgn->region[i + 1], &rgn->region[i],
+		(rgn->cnt - i) * sizeof(rgn->region[0]));
+	rgn->region[i].base = base;
+	rgn->region[i].size = size;
+	rgn->region[i].flags = flags;
 	rgn->cnt++;
 
 	return 0;
@@ -293,21 +324,18 @@ long lmb_free(struct lmb *lmb, phys_addr_t base, phys_size_t size)
 	struct lmb_region *rgn = &(lmb->reserved);
 	phys_addr_t rgnbegin, rgnend;
 	phys_addr_t end = base + size - 1;
-	int i;
-
-	rgnbegin = rgnend = 0; /* supress gcc warnings */
+	unsigned long i;
 
 	/* Find the region where (base, size) belongs to */
-	for (i = 0; i < rgn->cnt; i++) {
-		rgnbegin = rgn->region[i].base;
-		rgnend = rgnbegin + rgn->region[i].size - 1;
-
-		if ((rgnbegin <= base) && (end <= rgnend))
-			break;
-	}
+	i = lmb_region_search(rgn, base);
+	if (!i)
+		return -1;
+	i--;
+	rgnbegin = rgn->region[i].base;
+	rgnend = rgnbegin + rgn->region[i].size - 1;
 
 	/* Didn't find the region */
-	if (i == rgn->cnt)
+	if (end > rgnend)
 		return -1;
 
 	/* Check to see if we are removing entire region */
@@ -351,19 +379,21 @@ long lmb_reserve(struct lmb *lmb, phys_addr_t base, phys_size_t size)
 	return lmb_reserve_flags(lmb, base, size, LMB_NONE);
 }
 
+/* Return the lowest region overlapping (base, size), or -1 if none does */
 static long lmb_overlaps_region(struct lmb_region *rgn, phys_addr_t base,
 				phys_size_t size)
 {
 	unsigned long i;
 
-	for (i = 0; i < rgn->cnt; i++) {
-		phys_addr_t rgnbase = rgn->region[i].base;
-		phys_size_t rgnsize = rgn->region[i].size;
-		if (lmb_addrs_overlap(base, size, rgnbase, rgnsize))
-			break;
-	}
+	i = lmb_region_search(rgn, base);
+	if (i > 0 && lmb_addrs_overlap(base, size, rgn->region[i - 1].base,
+				       rgn->region[i - 1].size))
+		return i - 1;
+	if (i < rgn->cnt && lmb_addrs_overlap(base, size, rgn->region[i].base,
+					      rgn->region[i].size))
+		return i;
 
-	return (i < rgn->cnt) ? i : -1;
+	return -1;
 }
 
 phys_addr_t lmb_alloc(struct lmb *lmb, phys_size_t size, ulong align)
@@ -459,22 +489,21 @@ phys_addr_t lmb_alloc_addr(struct lmb *lmb, phys_addr_t base, phys_size_t size)
 /* Return number of bytes from a given address that are free */
 phys_size_t lmb_get_free_size(struct lmb *lmb, phys_addr_t addr)
 {
-	int i;
+	unsigned long i;
 	long rgn;
 
 	/* check if the requested address is in the memory regions */
 	rgn = lmb_overlaps_region(&lmb->memory, addr, 1);
 	if (rgn >= 0) {
-		for (i = 0; i < lmb->reserved.cnt; i++) {
-			if (addr < lmb->reserved.region[i].base) {
-				/* first reserved range > requested address */
-				return lmb->reserved.region[i].base - addr;
-			}
-			if (lmb->reserved.region[i].base +
-			    lmb->reserved.region[i].size > addr) {
-				/* requested addr is in this reserved range */
-				return 0;
-			}
+		i = lmb_region_search(&lmb->reserved, addr);
+		if (i > 0 && lmb->reserved.region[i - 1].base +
+		    lmb->reserved.region[i - 1].size > addr) {
+			/* requested addr is in this reserved range */
+			return 0;
+		}
+		if (i < lmb->reserved.cnt) {
+			/* first reserved range > requested address */
+			return lmb->reserved.region[i].base - addr;
 		}
 		/* if we come here: no reserved ranges above requested addr */
 		return lmb->memory.region[lmb->memory.cnt - 1].base +
@@ -485,14 +514,17 @@ phys_size_t lmb_get_free_size(struct lmb *lmb, phys_addr_t addr)
 
 int lmb_is_reserved_flags(struct lmb *lmb, phys_addr_t addr, int flags)
 {
-	int i;
+	struct lmb_property *rsv;
+	unsigned long i;
+
+	i = lmb_region_search(&lmb->reserved, addr);
+	if (!i)
+		return 0;
+
+	rsv = &lmb->reserved.region[i - 1];
+	if (addr <= rsv->base + rsv->size - 1)
+		return (rsv->flags & flags) == flags;
 
-	for (i = 0; i < lmb->reserved.cnt; i++) {
-		phys_addr_t upper = lmb->reserved.region[i].base +
-			lmb->reserved.region[i].size - 1;
-		if ((addr >= lmb->reserved.region[i].base) && (addr <= upper))
-			return (lmb->reserved.region[i].flags & flags) == flags;
-	}
 	return 0;
 }
 
@@ -37,6 +37,12 @@
 
 #define FORCE_INLINE inline __attribute__((always_inline))
 
+/*
+ * U-Boot is built with -fno-builtin, so ask for small fixed-size copies to be
+ * expanded inline rather than calling memcpy()
+ */
+#define LZ4_memcpy(dst, src, size) __builtin_memcpy(dst, src, size)
+
 static FORCE_INLINE u16 LZ4_readLE16(const void *src)
 {
 	return get_unaligned_le16(src);
@@ -72,6 +78,26 @@ static void LZ4_wildCopy(void* dstPtr, const void* srcPtr, void* dstEnd)
     do { LZ4_copy8(d,s); d+=8; s+=8; } while (d<e);
 }
 
+/*
+ * customized version of memcpy, which may overwrite up to 31 bytes beyond
+ * dstEnd. It copies 16 bytes at a time so that it stays correct for
+ * overlapping copies with an offset of 16 or more.
+ */
+static FORCE_INLINE void LZ4_wildCopy32(void *dstPtr, const void *srcPtr,
+					void *dstEnd)
+{
+	BYTE *d = (BYTE *)dstPtr;
+	const BYTE *s = (const BYTE *)srcPtr;
+	BYTE * const e = (BYTE *)dstEnd;
+
+	do {
+		LZ4_memcpy(d, s, 16);
+		LZ4_memcpy(d + 16, s + 16, 16);
+		d += 32;
+		s += 32;
+	} while (d < e);
+}
+
 
 /**************************************
 *  Common Constants
@@ -88,6 +114,12 @@ static void LZ4_wildCopy(void* dstPtr, const void* srcPtr, void* dstEnd)
  */
 #define MATCH_SAFEGUARD_DISTANCE  ((2 * WILDCOPYLENGTH) - MINMATCH)
 
+/*
+ * the fast decoding loop runs while at least this much output space is left,
+ * so that it can use wild copies without checking each one
+ */
+#define FASTLOOP_SAFE_DISTANCE 64
+
 #define KB (1 <<10)
 
 #define MAXD_LOG 16
@@ -113,6 +145,63 @@ typedef enum { decode_full_block = 0, partial_decode = 1 } earlyEnd_directive;
 #define assert(condition) ((void)0)
 #endif
 
+static const unsigned int inc32table[8] = {0, 1, 2, 1, 0, 4, 4, 4};
+static const int dec64table[8] = {0, 0, 0, -1, -4, 1, 2, 3};
+
+/*
+ * LZ4_memcpy_using_offset() :
+ * Copy an overlapping match with an offset below 16, from srcPtr to dstPtr
+ * (= srcPtr + offset), up to dstEnd. Short repeating patterns are built up
+ * in a register first, so that they can be written 8 bytes at a time.
+ * Presumes dstEnd >= dstPtr + MINMATCH and that up to 8 bytes beyond dstEnd
+ * may be written.
+ */
+static FORCE_INLINE void LZ4_memcpy_using_offset(BYTE *dstPtr,
+						 const BYTE *srcPtr,
+						 BYTE *dstEnd,
+						 const size_t offset)
+{
+	BYTE v[8];
+
+	switch (offset) {
+	case 1:
+		__builtin_memset(v, *srcPtr, 8);
+		break;
+	case 2:
+		LZ4_memcpy(v, srcPtr, 2);
+		LZ4_memcpy(&v[2], srcPtr, 2);
+		LZ4_memcpy(&v[4], v, 4);
+		break;
+	case 4:
+		LZ4_memcpy(v, srcPtr, 4);
+		LZ4_memcpy(&v[4], srcPtr, 4);
+		break;
+	default:
+		if (offset < 8) {
+			dstPtr[0] = srcPtr[0];
+			dstPtr[1] = srcPtr[1];
+			dstPtr[2] = srcPtr[2];
+			dstPtr[3] = srcPtr[3];
+			srcPtr += inc32table[offset];
+			LZ4_memcpy(dstPtr + 4, srcPtr, 4);
+			srcPtr -= dec64table[offset];
+		} else {
+			LZ4_copy8(dstPtr, srcPtr);
+			srcPtr += 8;
+		}
+		dstPtr += 8;
+		/* the source is now at least 8 bytes behind */
+		if (dstPtr < dstEnd)
+			LZ4_wildCopy(dstPtr, srcPtr, dstEnd);
+		return;
+	}
+
+	do {
+		LZ4_memcpy(dstPtr, v, 8);
+		dstPtr += 8;
+	} while (dstPtr < dstEnd);
+}
+
 /*
  * LZ4_decompress_generic() :
  * This generic decompression function covers all use cases.
@@ -151,8 +240,10 @@ static FORCE_INLINE int LZ4_decompress_generic(
 	BYTE *cpy;
 
 	const BYTE * const dictEnd = (const BYTE *)dictStart + dictSize;
-	static const unsigned int inc32table[8] = {0, 1, 2, 1, 0, 4, 4, 4};
-	static const int dec64table[8] = {0, 0, 0, -1, -4, 1, 2, 3};
+	unsigned int token;
+	size_t length;
+	const BYTE *match;
+	size_t offset;
 
 	const int safeDecode = (endOnInput == endOnInputSize);
 	const int checkOffset = ((safeDecode) && (dictSize < (int)(64 * KB)));
@@ -180,14 +271,113 @@ static FORCE_INLINE int LZ4_decompress_generic(
 	if ((endOnInput) && unlikely(srcSize == 0))
 		return -1;
 
+	/*
+	 * Fast loop : decode sequences while there are at least
+	 * FASTLOOP_SAFE_DISTANCE bytes of output space left. Anything which
+	 * might come near the end of the input or output is handed over to
+	 * the main loop below, part-way through the sequence.
+	 */
+	if (endOnInput && oend - op >= FASTLOOP_SAFE_DISTANCE) {
+		while (1) {
+			token = *ip++;
+			length = token >> ML_BITS;
+
+			/* decode literal length */
+			if (length == RUN_MASK) {
+				unsigned int s;
+
+				if (unlikely(ip >= iend - RUN_MASK))
+					goto _output_error;
+				do {
+					s = *ip++;
+					length += s;
+				} while (likely(ip < iend - RUN_MASK) &
+					 (s == 255));
+				if (unlikely((uptrval)(op) + length <
+					     (uptrval)(op)))
+					goto _output_error;
+				if (unlikely((uptrval)(ip) + length <
+					     (uptrval)(ip)))
+					goto _output_error;
+
+				/* copy literals */
+				cpy = op + length;
+				if (cpy > oend - 32 || ip + length > iend - 32)
+					goto safe_literal_copy;
+				LZ4_wildCopy32(op, ip, cpy);
+			} else {
+				cpy = op + length;
+				/*
+				 * at most 14 literals, then the offset and
+				 * the next token; the output space was
+				 * checked at the end of the last sequence
+				 */
+				if (ip > iend - (16 + 1))
+					goto safe_literal_copy;
+				LZ4_memcpy(op, ip, 16);
+			}
+			ip += length;
+			op = cpy;
+
+			/* get offset */
+			offset = LZ4_readLE16(ip);
+			ip += 2;
+			match = op - offset;
+			if ((checkOffset) &&
+			    unlikely(match + dictSize < lowPrefix))
+				goto _output_error;
+
+			/* get matchlength */
+			length = token & ML_MASK;
+			if (length == ML_MASK) {
+				unsigned int s;
+
+				do {
+					s = *ip++;
+					if (ip > iend - LASTLITERALS)
+						goto _output_error;
+					length += s;
+				} while (s == 255);
+				if (unlikely((uptrval)(op) + length <
+					     (uptrval)op))
+					goto _output_error;
+				length += MINMATCH;
+				if (op + length >= oend - FASTLOOP_SAFE_DISTANCE)
+					goto safe_match_copy;
+			} else {
+				length += MINMATCH;
+				if (op + length >= oend - FASTLOOP_SAFE_DISTANCE)
+					goto safe_match_copy;
+
+				/* at most 18 bytes, not overlapping by 8 */
+				if ((dict == withPrefix64k ||
+				     match >= lowPrefix) && offset >= 8) {
+					LZ4_memcpy(op + 0, match + 0, 8);
+					LZ4_memcpy(op + 8, match + 8, 8);
+					LZ4_memcpy(op + 16, match + 16, 2);
+					op += length;
+					continue;
+				}
+			}
+
+			/* match starting within external dictionary */
+			if (dict == usingExtDict && match < lowPrefix)
+				goto safe_match_copy;
+
+			/* copy match within block */
+			cpy = op + length;
+			if (unlikely(offset < 16))
+				LZ4_memcpy_using_offset(op, match, cpy, offset);
+			else
+				LZ4_wildCopy32(op, match, cpy);
+			op = cpy;
+		}
+	}
+
 	/* Main Loop : decode sequences */
 	while (1) {
-		size_t length;
-		const BYTE *match;
-		size_t offset;
-
 		/* get literal length */
-		unsigned int const token = *ip++;
+		token = *ip++;
 		length = token>>ML_BITS;
 
 		/* ip < iend before the increment */
@@ -216,7 +406,7 @@ static FORCE_INLINE int LZ4_decompress_generic(
 		   && likely((endOnInput ? ip < shortiend : 1) &
 			     (op <= shortoend))) {
 			/* Copy the literals */
-			memcpy(op, ip, endOnInput ? 16 : 8);
+			LZ4_memcpy(op, ip, endOnInput ? 16 : 8);
 			op += length; ip += length;
 
 			/*
@@ -235,9 +425,9 @@ static FORCE_INLINE int LZ4_decompress_generic(
 			    (offset >= 8) &&
 			    (dict == withPrefix64k || match >= lowPrefix)) {
 				/* Copy the match. */
-				memcpy(op + 0, match + 0, 8);
-				memcpy(op + 8, match + 8, 8);
-				memcpy(op + 16, match + 16, 2);
+				LZ4_memcpy(op + 0, match + 0, 8);
+				LZ4_memcpy(op + 8, match + 8, 8);
+				LZ4_memcpy(op + 16, match + 16, 2);
 				op += length + MINMATCH;
 				/* Both stages worked, load the next token. */
 				continue;
@@ -282,6 +472,7 @@ static FORCE_INLINE int LZ4_decompress_generic(
 
 		/* copy literals */
 		cpy = op + length;
+safe_literal_copy:
 		LZ4_STATIC_ASSERT(MFLIMIT >= WILDCOPYLENGTH);
 
 		if (((endOnInput) && ((cpy > oend - MFLIMIT)
@@ -392,6 +583,7 @@ _copy_match:
 
 		length += MINMATCH;
 
+safe_match_copy:
 		/* match starting within external dictionary */
 		if ((dict == usingExtDict) && (match < lowPrefix)) {
 			if (unlikely(op + length > oend - LASTLITERALS)) {
@@ -467,7 +659,7 @@ _copy_match:
 			op[2] = match[2];
 			op[3] = match[3];
 			match += inc32table[offset];
-			memcpy(op + 4, match, 4);
+			LZ4_memcpy(op + 4, match, 4);
 			match -= dec64table[offset];
 		} else {
 			LZ4_copy8(op, match);
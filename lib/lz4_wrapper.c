@@ -11,97 +11,126 @@
 #include <asm/unaligned.h>
 #include <u-boot/lz4.h>
 
-/* lz4.c is unaltered (except removing unrelated code) from github.com/Cyan4973/lz4. */
+/*
+ * lz4.c comes from github.com/Cyan4973/lz4, with unrelated code removed and
+ * the fast decoding loop of later releases added.
+ */
 #include "lz4.c"	/* #include for inlining, do not link! */
 
 #define LZ4F_BLOCKUNCOMPRESSED_FLAG 0x80000000U
 
-int ulz4fn(const void *src, size_t srcn, void *dst, size_t *dstn)
+void lz4_frame_start(struct lz4_frame *lf)
 {
-	const void *end = dst + *dstn;
-	const void *in = src;
-	void *out = dst;
-	int has_block_checksum;
-	int ret;
-	*dstn = 0;
-
-	{ /* With in-place decompression the header may become invalid later. */
-		u32 magic;
-		u8 flags, version, independent_blocks, has_content_size;
-		u8 block_desc;
+	memset(lf, '\0', sizeof(*lf));
+	lf->state = LZ4_FRAME_HEADER;
+	lf->need = sizeof(u32) + 2 * sizeof(u8);
+}
 
-		if (srcn < sizeof(u32) + 3*sizeof(u8))
-			return -EINVAL;	/* input overrun */
+int lz4_frame_unit(struct lz4_frame *lf, const void *unit, void *dst,
+		   size_t dst_len)
+{
+	const u8 *in = unit;
+	int ret = 0;
 
-		magic = get_unaligned_le32(in);
-		in += sizeof(u32);
-		flags = *(u8 *)in;
-		in += sizeof(u8);
-		block_desc = *(u8 *)in;
-		in += sizeof(u8);
+	switch (lf->state) {
+	case LZ4_FRAME_HEADER: {
+		u8 flags = in[4], block_desc = in[5];
+		u8 version, independent_blocks, has_content_size;
+		uint block_max;
 
 		version = (flags >> 6) & 0x3;
 		independent_blocks = (flags >> 5) & 0x1;
-		has_block_checksum = (flags >> 4) & 0x1;
 		has_content_size = (flags >> 3) & 0x1;
+		block_max = (block_desc >> 4) & 0x7;
 
 		/* We assume there's always only a single, standard frame. */
-		if (magic != LZ4F_MAGIC || version != 1)
+		if (get_unaligned_le32(in) != LZ4F_MAGIC || version != 1)
 			return -EPROTONOSUPPORT;	/* unknown format */
-		if ((flags & 0x03) || (block_desc & 0x8f))
+		if ((flags & 0x03) || (block_desc & 0x8f) || block_max < 4)
 			return -EINVAL;	/* reserved bits must be zero */
 		if (!independent_blocks)
 			return -EPROTONOSUPPORT; /* we can't support this yet */
+		lf->block_checksum = (flags >> 4) & 0x1;
+		lf->max_block = 1UL << (8 + 2 * block_max);
 
-		if (has_content_size) {
-			if (srcn < sizeof(u32) + 3*sizeof(u8) + sizeof(u64))
-				return -EINVAL;	/* input overrun */
-			in += sizeof(u64);
+		/* Content size, if present, then the header checksum byte */
+		lf->state = LZ4_FRAME_SKIP;
+		lf->need = (has_content_size ? sizeof(u64) : 0) + sizeof(u8);
+		break;
+	}
+	case LZ4_FRAME_SKIP:
+		lf->state = LZ4_FRAME_BLOCK_HEADER;
+		lf->need = sizeof(u32);
+		break;
+	case LZ4_FRAME_BLOCK_HEADER: {
+		u32 block_header = get_unaligned_le32(in);
+
+		lf->need = block_header & ~LZ4F_BLOCKUNCOMPRESSED_FLAG;
+		if (!lf->need) {
+			/* The content checksum which may follow is not used */
+			lf->state = LZ4_FRAME_DONE;
+			break;
 		}
-		/* Header checksum byte */
-		in += sizeof(u8);
+		if (lf->need > lf->max_block)
+			return -EINVAL;
+		lf->uncompressed = block_header & LZ4F_BLOCKUNCOMPRESSED_FLAG;
+		lf->state = LZ4_FRAME_BLOCK;
+		break;
 	}
+	case LZ4_FRAME_BLOCK:
+		if (lf->uncompressed) {
+			if (lf->need > dst_len)
+				return -ENOBUFS;	/* output overrun */
+			memmove(dst, in, lf->need);
+			ret = lf->need;
+		} else {
+			/* constant folding essential, do not touch params! */
+			ret = LZ4_decompress_generic(unit, dst, lf->need,
+					min(dst_len, (size_t)INT_MAX),
+					endOnInputSize, decode_full_block,
+					noDict, dst, NULL, 0);
+			if (ret < 0)
+				return -EPROTO;	/* decompression error */
+		}
 
-	while (1) {
-		u32 block_header, block_size;
+		/* Skip the block checksum, if any */
+		lf->state = lf->block_checksum ? LZ4_FRAME_SKIP :
+			LZ4_FRAME_BLOCK_HEADER;
+		lf->need = sizeof(u32);
+		break;
+	default:
+		return -EINVAL;
+	}
 
-		block_header = get_unaligned_le32(in);
-		in += sizeof(u32);
-		block_size = block_header & ~LZ4F_BLOCKUNCOMPRESSED_FLAG;
+	return ret;
+}
 
-		if (in - src + block_size > srcn) {
+int ulz4fn(const void *src, size_t srcn, void *dst, size_t *dstn)
+{
+	const void *end = dst + *dstn;
+	const void *in = src;
+	struct lz4_frame lf;
+	void *out = dst;
+	int ret = 0;
+
+	/*
+	 * Each unit is read before any output is written over it, so
+	 * in-place decompression works as long as the output stays behind
+	 * the input
+	 */
+	lz4_frame_start(&lf);
+	while (lf.need) {
+		ulong need = lf.need;
+
+		if (need > srcn - (in - src)) {
 			ret = -EINVAL;		/* input overrun */
 			break;
 		}
-
-		if (!block_size) {
-			ret = 0;	/* decompression successful */
+		ret = lz4_frame_unit(&lf, in, out, end - out);
+		if (ret < 0)
 			break;
-		}
-
-		if (block_header & LZ4F_BLOCKUNCOMPRESSED_FLAG) {
-			size_t size = min((ptrdiff_t)block_size, (ptrdiff_t)(end - out));
-			memcpy(out, in, size);
-			out += size;
-			if (size < block_size) {
-				ret = -ENOBUFS;	/* output overrun */
-				break;
-			}
-		} else {
-			/* constant folding essential, do not touch params! */
-			ret = LZ4_decompress_generic(in, out, block_size,
-					end - out, endOnInputSize,
-					decode_full_block, noDict, out, NULL, 0);
-			if (ret < 0) {
-				ret = -EPROTO;	/* decompression error */
-				break;
-			}
-			out += ret;
-		}
-
-		in += block_size;
-		if (has_block_checksum)
-			in += sizeof(u32);
+		in += need;
+		out += ret;
 	}
 
 	*dstn = out - dst;
@@ -16,6 +16,37 @@
 #include <dm/of_access.h>
 #include <linux/err.h>
 
+/**
+ * struct unflatten_info - state while unflattening a flat tree
+ *
+ * The live tree is a single block of memory with the nodes first, in
+ * depth-first order, so that walking the tree does not have to skip over
+ * property data. The properties follow, then the node paths and, if
+ * requested, a copy of the flat tree's strings block for property names.
+ *
+ * In the first (dry-run) pass the pointers start at NULL and just advance, to
+ * work out the size of each region.
+ *
+ * @blob: Flat tree being unflattened
+ * @nodes: Next free space for a node
+ * @props: Next free space for a property and its value
+ * @paths: Next free space for a node path
+ * @names: Copy of the flat tree's strings block, or NULL to use the flat tree
+ * @depth: Depth of the current node in the flat tree
+ * @dryrun: true to calculate the space needed without writing anything
+ * @copy: true to copy property names and values out of the flat tree
+ */
+struct unflatten_info {
+	const void *blob;
+	void *nodes;
+	void *props;
+	char *paths;
+	char *names;
+	int depth;
+	bool dryrun;
+	bool copy;
+};
+
 static void *unflatten_dt_alloc(void **mem, unsigned long size,
 				unsigned long align)
 {
@@ -30,27 +61,27 @@ static void *unflatten_dt_alloc(void **mem, unsigned long size,
 
 /**
  * unflatten_dt_node() - Alloc and populate a device_node from the flat tree
- * @blob: The parent device tree blob
- * @mem: Memory chunk to use for allocating device nodes and properties
+ * @info: Unflattening state, including where to allocate the node
  * @poffset: pointer to node in flat tree
  * @dad: Parent struct device_node
  * @nodepp: The device_node tree created by the call
- * @fpsize: Size of the node path up at t05he current depth.
- * @dryrun: If true, do not allocate device nodes but still calculate needed
- * memory size
+ * @fpsize: Size of the node path up at the current depth.
+ * Return: 0 if OK, -ve on error
  */
-static void *unflatten_dt_node(const void *blob, void *mem, int *poffset,
-			       struct device_node *dad,
-			       struct device_node **nodepp,
-			       unsigned long fpsize, bool dryrun)
+static int unflatten_dt_node(struct unflatten_info *info, int *poffset,
+			     struct device_node *dad,
+			     struct device_node **nodepp,
+			     unsigned long fpsize)
 {
+	const void *blob = info->blob;
+	bool dryrun = info->dryrun;
 	const __be32 *p;
 	struct device_node *np;
 	struct property *pp, **prev_pp = NULL;
 	const char *pathp;
+	char *fn;
 	int l;
 	unsigned int allocl;
-	static int depth;
 	int old_depth;
 	int offset;
 	int has_name = 0;
@@ -58,7 +89,7 @@ static void *unflatten_dt_node(const void *blob, void *mem, int *poffset,
 
 	pathp = fdt_get_name(blob, *poffset, &l);
 	if (!pathp)
-		return mem;
+		return 0;
 
 	allocl = ++l;
 
@@ -91,16 +122,11 @@ static void *unflatten_dt_node(const void *blob, void *mem, int *poffset,
 		}
 	}
 
-	np = unflatten_dt_alloc(&mem, sizeof(struct device_node) + allocl,
+	np = unflatten_dt_alloc(&info->nodes, sizeof(struct device_node),
 				__alignof__(struct device_node));
+	fn = info->paths;
+	info->paths += allocl;
 	if (!dryrun) {
-		char *fn;
-
-		fn = (char *)np + sizeof(*np);
-		if (new_format) {
-			np->name = pathp;
-			has_name = 1;
-		}
 		np->full_name = fn;
 		if (new_format) {
 			/* rebuild full path for new format */
@@ -118,6 +144,11 @@ static void *unflatten_dt_node(const void *blob, void *mem, int *poffset,
 			*(fn++) = '/';
 		}
 		memcpy(fn, pathp, l);
+		if (new_format) {
+			/* The unit name is the last part of the path */
+			np->name = fn;
+			has_name = 1;
+		}
 
 		prev_pp = &np->properties;
 		if (dad != NULL) {
@@ -131,6 +162,7 @@ static void *unflatten_dt_node(const void *blob, void *mem, int *poffset,
 	     (offset >= 0);
 	     (offset = fdt_next_property_offset(blob, offset))) {
 		const char *pname;
+		void *value;
 		int sz;
 
 		p = fdt_getprop_by_offset(blob, offset, &pname, &sz);
@@ -145,8 +177,12 @@ static void *unflatten_dt_node(const void *blob, void *mem, int *poffset,
 		}
 		if (strcmp(pname, "name") == 0)
 			has_name = 1;
-		pp = unflatten_dt_alloc(&mem, sizeof(struct property),
+		pp = unflatten_dt_alloc(&info->props, sizeof(struct property),
 					__alignof__(struct property));
+		value = (void *)p;
+		if (info->copy)
+			value = unflatten_dt_alloc(&info->props, sz,
+						   sizeof(fdt32_t));
 		if (!dryrun) {
 			/*
 			 * We accept flattened tree phandles either in
@@ -165,9 +201,15 @@ static void *unflatten_dt_node(const void *blob, void *mem, int *poffset,
 			 * stuff */
 			if (strcmp(pname, "ibm,phandle") == 0)
 				np->phandle = be32_to_cpup(p);
+			if (info->names) {
+				/* Names are in the copy of the strings block */
+				pname = info->names + (pname - (const char *)blob -
+						       fdt_off_dt_strings(blob));
+				memcpy(value, p, sz);
+			}
 			pp->name = (char *)pname;
 			pp->length = sz;
-			pp->value = (__be32 *)p;
+			pp->value = value;
 			*prev_pp = pp;
 			prev_pp = &pp->next;
 		}
@@ -190,7 +232,8 @@ static void *unflatten_dt_node(const void *blob, void *mem, int *poffset,
 		if (pa < ps)
 			pa = p1;
 		sz = (pa - ps) + 1;
-		pp = unflatten_dt_alloc(&mem, sizeof(struct property) + sz,
+		pp = unflatten_dt_alloc(&info->props,
+					sizeof(struct property) + sz,
 					__alignof__(struct property));
 		if (!dryrun) {
 			pp->name = "name";
@@ -215,20 +258,21 @@ static void *unflatten_dt_node(const void *blob, void *mem, int *poffset,
 		if (!np->type)
 			np->type = "<NULL>";	}
 
-	old_depth = depth;
-	*poffset = fdt_next_node(blob, *poffset, &depth);
-	if (depth < 0)
-		depth = 0;
-	while (*poffset > 0 && depth > old_depth) {
-		mem = unflatten_dt_node(blob, mem, poffset, np, NULL,
-					fpsize, dryrun);
-		if (!mem)
-			return NULL;
+	old_depth = info->depth;
+	*poffset = fdt_next_node(blob, *poffset, &info->depth);
+	if (info->depth < 0)
+		info->depth = 0;
+	while (*poffset > 0 && info->depth > old_depth) {
+		int ret;
+
+		ret = unflatten_dt_node(info, poffset, np, NULL, fpsize);
+		if (ret)
+			return ret;
 	}
 
 	if (*poffset < 0 && *poffset != -FDT_ERR_NOTFOUND) {
 		debug("unflatten: error %d processing FDT\n", *poffset);
-		return NULL;
+		return -EINVAL;
 	}
 
 	/*
@@ -250,13 +294,15 @@ static void *unflatten_dt_node(const void *blob, void *mem, int *poffset,
 	if (nodepp)
 		*nodepp = np;
 
-	return mem;
+	return 0;
 }
 
-int unflatten_device_tree(const void *blob, struct device_node **mynodes)
+static int unflatten_tree(const void *blob, struct device_node **mynodes,
+			  bool copy)
 {
-	unsigned long size;
-	int start;
+	struct unflatten_info info;
+	ulong props_base, paths_base, names_base, size;
+	int start, ret;
 	void *mem;
 
 	debug(" -> unflatten_device_tree()\n");
@@ -276,18 +322,31 @@ int unflatten_device_tree(const void *blob, struct device_node **mynodes)
 		return -EINVAL;
 	}
 
-	/* First pass, scan for size */
+	/* First pass, scan for the size of each region */
+	memset(&info, '\0', sizeof(info));
+	info.blob = blob;
+	info.dryrun = true;
+	info.copy = copy;
 	start = 0;
-	size = (unsigned long)unflatten_dt_node(blob, NULL, &start, NULL, NULL,
-						0, true);
-	if (!size)
+	ret = unflatten_dt_node(&info, &start, NULL, NULL, 0);
+	if (ret)
+		return ret;
+	if (!info.nodes)
 		return -EFAULT;
+	props_base = ALIGN((ulong)info.nodes, __alignof__(struct property));
+	paths_base = props_base + (ulong)info.props;
+	names_base = paths_base + (ulong)info.paths;
+	size = names_base;
+	if (copy)
+		size += fdt_size_dt_strings(blob);
 	size = ALIGN(size, 4);
 
 	debug("  size is %lx, allocating...\n", size);
 
 	/* Allocate memory for the expanded device tree */
 	mem = malloc(size + 4);
+	if (!mem)
+		return -ENOMEM;
 	memset(mem, '\0', size);
 
 	*(__be32 *)(mem + size) = cpu_to_be32(0xdeadbeef);
@@ -295,11 +354,26 @@ int unflatten_device_tree(const void *blob, struct device_node **mynodes)
 	debug("  unflattening %p...\n", mem);
 
 	/* Second pass, do actual unflattening */
+	info.nodes = mem;
+	info.props = mem + props_base;
+	info.paths = mem + paths_base;
+	info.dryrun = false;
+	info.depth = 0;
+	if (copy) {
+		info.names = mem + names_base;
+		memcpy(info.names, blob + fdt_off_dt_strings(blob),
+		       fdt_size_dt_strings(blob));
+	}
 	start = 0;
-	unflatten_dt_node(blob, mem, &start, NULL, mynodes, 0, false);
+	ret = unflatten_dt_node(&info, &start, NULL, mynodes, 0);
+	if (ret) {
+		free(mem);
+		return ret;
+	}
 	if (be32_to_cpup(mem + size) != 0xdeadbeef) {
 		debug("End of tree marker overwritten: %08x\n",
 		      be32_to_cpup(mem + size));
+		free(mem);
 		return -ENOSPC;
 	}
 
@@ -308,12 +382,25 @@ int unflatten_device_tree(const void *blob, struct device_node **mynodes)
 	return 0;
 }
 
+int unflatten_device_tree(const void *blob, struct device_node **mynodes)
+{
+	return unflatten_tree(blob, mynodes, false);
+}
+
+int unflatten_device_tree_copy(const void *blob, struct device_node **mynodes)
+{
+	return unflatten_tree(blob, mynodes, true);
+}
+
 int of_live_build(const void *fdt_blob, struct device_node **rootp)
 {
 	int ret;
 
 	debug("%s: start\n", __func__);
-	ret = unflatten_device_tree(fdt_blob, rootp);
+	if (IS_ENABLED(CONFIG_OF_LIVE_COPY))
+		ret = unflatten_device_tree_copy(fdt_blob, rootp);
+	else
+		ret = unflatten_device_tree(fdt_blob, rootp);
 	if (ret) {
 		debug("Failed to create live tree: err=%d\n", ret);
 		return ret;
@@ -18,10 +18,31 @@
 #include <config.h>
 #include <linux/compiler.h>
 #include <linux/types.h>
+#include <linux/kernel.h>
 #include <linux/string.h>
 #include <linux/ctype.h>
 #include <malloc.h>
 
+/*
+ * The string and memory scanning routines below work a word at a time where
+ * they can. Only whole aligned words are read, so they never read from a page
+ * that the byte-at-a-time version would not touch.
+ */
+#define WORD_SIZE	sizeof(unsigned long)
+#define WORD_MASK	(WORD_SIZE - 1)
+
+#ifndef __HAVE_ARCH_WORD_HAS_ZERO
+/**
+ * word_has_zero() - Check whether a word contains a zero byte
+ *
+ * @val: Word to check
+ * Return: non-zero if any byte in @val is zero
+ */
+static inline unsigned long word_has_zero(unsigned long val)
+{
+	return (val - REPEAT_BYTE(0x01)) & ~val & REPEAT_BYTE(0x80);
+}
+#endif
 
 /**
  * strncasecmp - Case insensitive, length-limited string comparison
@@ -210,6 +231,21 @@ int strcmp(const char *cs, const char *ct)
 {
 	int ret;
 
+	/* Skip equal words, if the strings are aligned the same way */
+	if (!(((ulong)cs ^ (ulong)ct) & WORD_MASK)) {
+		for (; (ulong)cs & WORD_MASK; cs++, ct++) {
+			ret = (unsigned char)*cs - (unsigned char)*ct;
+			if (ret || !*ct)
+				return ret;
+		}
+		for (;; cs += WORD_SIZE, ct += WORD_SIZE) {
+			unsigned long a = *(const unsigned long *)cs;
+
+			if (a != *(const unsigned long *)ct || word_has_zero(a))
+				break;
+		}
+	}
+
 	while (1) {
 		unsigned char a = *cs++;
 		unsigned char b = *ct++;
@@ -295,8 +331,15 @@ char * strrchr(const char * s, int c)
 size_t strlen(const char * s)
 {
 	const char *sc;
+	const unsigned long *wp;
 
-	for (sc = s; *sc != '\0'; ++sc)
+	for (sc = s; (ulong)sc & WORD_MASK; ++sc) {
+		if (*sc == '\0')
+			return sc - s;
+	}
+	for (wp = (const unsigned long *)sc; !word_has_zero(*wp); ++wp)
+		/* nothing */;
+	for (sc = (const char *)wp; *sc != '\0'; ++sc)
 		/* nothing */;
 	return sc - s;
 }
@@ -312,7 +355,15 @@ size_t strnlen(const char * s, size_t count)
 {
 	const char *sc;
 
-	for (sc = s; count-- && *sc != '\0'; ++sc)
+	for (sc = s; count && ((ulong)sc & WORD_MASK); ++sc, count--) {
+		if (*sc == '\0')
+			return sc - s;
+	}
+	for (; count >= WORD_SIZE; sc += WORD_SIZE, count -= WORD_SIZE) {
+		if (word_has_zero(*(const unsigned long *)sc))
+			break;
+	}
+	for (; count-- && *sc != '\0'; ++sc)
 		/* nothing */;
 	return sc - s;
 }
@@ -632,10 +683,24 @@ __used void * memmove(void * dest,const void *src,size_t count)
  */
 __used int memcmp(const void * cs,const void * ct,size_t count)
 {
-	const unsigned char *su1, *su2;
+	const unsigned char *su1 = cs, *su2 = ct;
 	int res = 0;
 
-	for( su1 = cs, su2 = ct; 0 < count; ++su1, ++su2, count--)
+	/* Skip equal words, if the areas are aligned the same way */
+	if (!(((ulong)su1 ^ (ulong)su2) & WORD_MASK)) {
+		for (; count && ((ulong)su1 & WORD_MASK); ++su1, ++su2, count--) {
+			if ((res = *su1 - *su2) != 0)
+				return res;
+		}
+		for (; count >= WORD_SIZE; su1 += WORD_SIZE, su2 += WORD_SIZE,
+		     count -= WORD_SIZE) {
+			if (*(const unsigned long *)su1 !=
+			    *(const unsigned long *)su2)
+				break;
+		}
+	}
+
+	for (; 0 < count; ++su1, ++su2, count--)
 		if ((res = *su1 - *su2) != 0)
 			break;
 	return res;
@@ -716,6 +781,17 @@ char * strstr(const char * s1,const char * s2)
 void *memchr(const void *s, int c, size_t n)
 {
 	const unsigned char *p = s;
+	unsigned long pattern = REPEAT_BYTE((unsigned char)c);
+
+	for (; n && ((ulong)p & WORD_MASK); p++, n--) {
+		if ((unsigned char)c == *p)
+			return (void *)p;
+	}
+	/* A word holding @c has a zero byte once xor'ed with the pattern */
+	for (; n >= WORD_SIZE; p += WORD_SIZE, n -= WORD_SIZE) {
+		if (word_has_zero(*(const unsigned long *)p ^ pattern))
+			break;
+	}
 	while (n-- != 0) {
 		if ((unsigned char)c == *p++) {
 			return (void *)(p-1);
@@ -1,34 +1,287 @@
 // SPDX-License-Identifier: GPL-2.0+
 /*
  * Copyright 2021 Google LLC
+ *
+ * One decompression context is kept once allocated, so that filesystems and
+ * image loading do not allocate a new workspace for every block or image.
+ * Independent frames are decompressed at the same time on secondary CPUs,
+ * where there are some, using contexts which are freed afterwards.
  */
 
 #define LOG_CATEGORY	LOGC_BOOT
 
 #include <common.h>
 #include <abuf.h>
+#include <job.h>
 #include <log.h>
 #include <malloc.h>
+#include <asm/global_data.h>
+#include <linux/kernel.h>
+#include <linux/sizes.h>
 #include <linux/zstd.h>
 
+DECLARE_GLOBAL_DATA_PTR;
+
+#if CONFIG_IS_ENABLED(JOB)
+/* Number of frames decompressed at once, one per CPU */
+#define ZSTD_MAX_FRAMES		(CONFIG_JOB_MAX_WORKERS + 1)
+#else
+#define ZSTD_MAX_FRAMES		1
+#endif
+
+/* Smallest window to allow for when streaming */
+#define ZSTD_MIN_WINDOW		SZ_1K
+
+/**
+ * struct zstd_frame - a frame to decompress, perhaps on another CPU
+ *
+ * @job: Job doing the decompression
+ * @zd: Context to use
+ * @src: Compressed frame
+ * @src_len: Size of the compressed frame
+ * @dst: Place to write the decompressed data
+ * @dst_len: Space available at @dst
+ * @sized: true if the frame header gives the decompressed size, which is
+ *	then @dst_len
+ * @res: Result from ZSTD_decompressDCtx()
+ */
+struct zstd_frame {
+#if CONFIG_IS_ENABLED(JOB)
+	struct job job;
+#endif
+	struct zstd_dctx *zd;
+	const void *src;
+	size_t src_len;
+	void *dst;
+	size_t dst_len;
+	bool sized;
+	size_t res;
+};
+
+/* Context kept between users, about 150KB once allocated */
+static struct zstd_dctx zstd_kept;
+
+/* Before relocation U-Boot proper cannot write to BSS */
+static bool zstd_can_keep(void)
+{
+	return IS_ENABLED(CONFIG_SPL_BUILD) || (gd->flags & GD_FLG_RELOC);
+}
+
+struct zstd_dctx *zstd_get_dctx(void)
+{
+	size_t wsize = ZSTD_DCtxWorkspaceBound();
+	struct zstd_dctx *zd = NULL;
+
+	if (zstd_can_keep() && !zstd_kept.busy)
+		zd = &zstd_kept;
+	if (!zd) {
+		zd = calloc(1, sizeof(*zd));
+		if (!zd)
+			return NULL;
+		zd->temp = true;
+	}
+
+	if (!zd->workspace) {
+		zd->workspace = malloc(wsize);
+		if (!zd->workspace)
+			goto err;
+		zd->dctx = ZSTD_initDCtx(zd->workspace, wsize);
+		if (!zd->dctx) {
+			free(zd->workspace);
+			zd->workspace = NULL;
+			goto err;
+		}
+	}
+	zd->busy = true;
+
+	return zd;
+err:
+	log_debug("Cannot allocate workspace of size %zu\n", wsize);
+	if (zd->temp)
+		free(zd);
+
+	return NULL;
+}
+
+void zstd_put_dctx(struct zstd_dctx *zd)
+{
+	if (!zd)
+		return;
+	if (zd->temp) {
+		free(zd->workspace);
+		free(zd);
+		return;
+	}
+	zd->busy = false;
+}
+
+static void zstd_frame_decompress(struct zstd_frame *zf)
+{
+	zf->res = ZSTD_decompressDCtx(zf->zd->dctx, zf->dst, zf->dst_len,
+				      zf->src, zf->src_len);
+}
+
+#if CONFIG_IS_ENABLED(JOB)
+static int zstd_frame_run(struct job *job)
+{
+	zstd_frame_decompress(container_of(job, struct zstd_frame, job));
+
+	return 0;
+}
+
+static void zstd_run_frames(struct zstd_frame *frames, int count)
+{
+	int i;
+
+	if (count == 1) {
+		zstd_frame_decompress(&frames[0]);
+		return;
+	}
+	for (i = 0; i < count; i++) {
+		job_init(&frames[i].job, zstd_frame_run, NULL);
+		job_submit(&frames[i].job);
+	}
+	for (i = 0; i < count; i++)
+		job_wait(&frames[i].job);
+}
+#else
+static void zstd_run_frames(struct zstd_frame *frames, int count)
+{
+	zstd_frame_decompress(&frames[0]);
+}
+#endif
+
 int zstd_decompress(struct abuf *in, struct abuf *out)
 {
-	ZSTD_DStream *dstream;
-	ZSTD_inBuffer in_buf;
+	struct zstd_frame frames[ZSTD_MAX_FRAMES];
+	const u8 *src = abuf_data(in);
+	size_t left = abuf_size(in);
+	u8 *dst = abuf_data(out);
+	size_t space = abuf_size(out);
+	int batch, count, i, ret;
+
+	if (!ZSTD_isFrame(src, left)) {
+		log_err("Not a zstd frame\n");
+		return -EINVAL;
+	}
+
+	/* Anything after the last frame, such as padding, is ignored */
+	batch = min(job_workers(), ZSTD_MAX_FRAMES - 1) + 1;
+	ret = 0;
+	while (!ret && ZSTD_isFrame(src, left)) {
+		bool sized = true;
+
+		/*
+		 * Frames which give their size can be decompressed together. A
+		 * frame without a size may fill the rest of the output, so it
+		 * ends the set.
+		 */
+		for (count = 0; count < batch && sized && ZSTD_isFrame(src, left);
+		     count++) {
+			struct zstd_frame *zf = &frames[count];
+			unsigned long long size;
+
+			zf->src_len = ZSTD_findFrameCompressedSize(src, left);
+			if (ZSTD_isError(zf->src_len)) {
+				log_err("Invalid zstd frame\n");
+				ret = -EINVAL;
+				break;
+			}
+			size = ZSTD_getFrameContentSize(src, left);
+			sized = size < ZSTD_CONTENTSIZE_ERROR;
+			if (sized && size > space) {
+				ret = -ENOSPC;
+				break;
+			}
+			zf->zd = zstd_get_dctx();
+			if (!zf->zd) {
+				ret = -ENOMEM;
+				break;
+			}
+			zf->src = src;
+			zf->dst = dst;
+			zf->dst_len = sized ? size : space;
+			zf->sized = sized;
+			src += zf->src_len;
+			left -= zf->src_len;
+			dst += sized ? size : 0;
+			space -= sized ? size : 0;
+		}
+		if (count && !ret)
+			zstd_run_frames(frames, count);
+
+		for (i = 0; i < count; i++) {
+			struct zstd_frame *zf = &frames[i];
+
+			zstd_put_dctx(zf->zd);
+			if (ret)
+				continue;
+			if (ZSTD_isError(zf->res)) {
+				log_err("ZSTD_decompressDCtx error %d\n",
+					ZSTD_getErrorCode(zf->res));
+				ret = ZSTD_getErrorCode(zf->res) ==
+					ZSTD_error_dstSize_tooSmall ? -ENOSPC :
+					-EINVAL;
+			} else if (!zf->sized) {
+				dst += zf->res;
+				space -= zf->res;
+			} else if (zf->res != zf->dst_len) {
+				log_err("zstd frame size mismatch\n");
+				ret = -EINVAL;
+			}
+		}
+	}
+	if (ret)
+		return ret;
+
+	return dst - (u8 *)abuf_data(out);
+}
+
+int zstd_decompress_window(struct abuf *in, struct abuf *window,
+			   int (*write)(void *priv, const void *buf,
+					size_t len),
+			   void *priv)
+{
+	const u8 *src = abuf_data(in);
+	size_t left = abuf_size(in);
+	size_t max_window = ZSTD_MIN_WINDOW;
 	ZSTD_outBuffer out_buf;
+	ZSTD_inBuffer in_buf;
+	ZSTD_DStream *dstream;
 	void *workspace;
 	size_t wsize;
+	size_t res;
 	int ret;
 
-	wsize = ZSTD_DStreamWorkspaceBound(abuf_size(in));
+	if (!abuf_size(window))
+		return -EINVAL;
+
+	/* The stream must hold the largest window of any frame */
+	while (ZSTD_isFrame(src, left)) {
+		ZSTD_frameParams params;
+		size_t len;
+
+		len = ZSTD_findFrameCompressedSize(src, left);
+		if (ZSTD_isError(len) || ZSTD_getFrameParams(&params, src, left)) {
+			log_err("Invalid zstd frame\n");
+			return -EINVAL;
+		}
+		max_window = max_t(size_t, max_window, params.windowSize);
+		src += len;
+		left -= len;
+	}
+	if (src == abuf_data(in)) {
+		log_err("Not a zstd frame\n");
+		return -EINVAL;
+	}
+
+	wsize = ZSTD_DStreamWorkspaceBound(max_window);
 	workspace = malloc(wsize);
 	if (!workspace) {
-		debug("%s: cannot allocate workspace of size %zu\n", __func__,
-			wsize);
+		log_debug("Cannot allocate workspace of size %zu\n", wsize);
 		return -ENOMEM;
 	}
-
-	dstream = ZSTD_initDStream(abuf_size(in), workspace, wsize);
+	dstream = ZSTD_initDStream(max_window, workspace, wsize);
 	if (!dstream) {
 		log_err("%s: ZSTD_initDStream failed\n", __func__);
 		ret = -EPERM;
@@ -37,28 +290,31 @@ int zstd_decompress(struct abuf *in, struct abuf *out)
 
 	in_buf.src = abuf_data(in);
 	in_buf.pos = 0;
-	in_buf.size = abuf_size(in);
-
-	out_buf.dst = abuf_data(out);
-	out_buf.pos = 0;
-	out_buf.size = abuf_size(out);
-
-	while (1) {
-		size_t res;
+	in_buf.size = src - (u8 *)abuf_data(in);
+	out_buf.dst = abuf_data(window);
+	out_buf.size = abuf_size(window);
 
+	/* A full window may mean that there is more to come */
+	do {
+		out_buf.pos = 0;
 		res = ZSTD_decompressStream(dstream, &out_buf, &in_buf);
 		if (ZSTD_isError(res)) {
-			ret = ZSTD_getErrorCode(res);
-			log_err("ZSTD_decompressStream error %d\n", ret);
+			log_err("ZSTD_decompressStream error %d\n",
+				ZSTD_getErrorCode(res));
+			ret = -EINVAL;
 			goto do_free;
 		}
+		if (out_buf.pos) {
+			ret = write(priv, out_buf.dst, out_buf.pos);
+			if (ret)
+				goto do_free;
+		}
+	} while (in_buf.pos < in_buf.size || out_buf.pos == out_buf.size);
 
-		if (in_buf.pos >= abuf_size(in) || !res)
-			break;
-	}
-
-	ret = out_buf.pos;
+	/* Otherwise the last frame is cut short */
+	ret = res ? -EINVAL : 0;
 do_free:
 	free(workspace);
+
 	return ret;
 }
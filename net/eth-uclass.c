@@ -382,10 +382,31 @@ int eth_send(void *packet, int length)
 	return ret;
 }
 
+/*
+ * Receive a packet into a buffer lent by the protocol, putting back the bytes
+ * which the headers cover afterwards. Returns -ENOSPC if the packet does not
+ * fit, so it must be received as usual
+ */
+static int eth_rx_loaned(struct udevice *dev, int flags, uchar *buf,
+			 int hdr_len, int size)
+{
+	uchar hdr[NET_RX_LOAN_MAX_HDR];
+	int ret;
+
+	memcpy(hdr, buf, hdr_len);
+	ret = eth_get_ops(dev)->recv_into(dev, flags, buf, size);
+	if (ret > 0)
+		net_process_received_packet(buf, ret);
+	memcpy(buf, hdr, hdr_len);
+
+	return ret;
+}
+
 int eth_rx(void)
 {
 	struct udevice *current;
-	uchar *packet;
+	uchar *packet, *buf;
+	int hdr_len, size;
 	int flags;
 	int ret;
 	int i;
@@ -400,6 +421,18 @@ int eth_rx(void)
 	/* Process up to 32 packets at one time */
 	flags = ETH_RECV_CHECK_DEVICE;
 	for (i = 0; i < ETH_PACKETS_BATCH_RECV; i++) {
+		buf = NULL;
+		if (eth_get_ops(current)->recv_into)
+			buf = net_rx_get_loan(&hdr_len, &size);
+		if (buf) {
+			ret = eth_rx_loaned(current, flags, buf, hdr_len, size);
+			if (ret != -ENOSPC) {
+				flags = 0;
+				if (ret <= 0)
+					break;
+				continue;
+			}
+		}
 		ret = eth_get_ops(current)->recv(current, flags, &packet);
 		flags = 0;
 		if (ret > 0)
@@ -550,6 +583,8 @@ static int eth_post_probe(struct udevice *dev)
 			ops->recv += gd->reloc_off;
 		if (ops->free_pkt)
 			ops->free_pkt += gd->reloc_off;
+		if (ops->recv_into)
+			ops->recv_into += gd->reloc_off;
 		if (ops->stop)
 			ops->stop += gd->reloc_off;
 		if (ops->mcast)
@@ -106,6 +106,27 @@ static void fastboot_timed_send_info(const char *msg)
 }
 #endif
 
+/**
+ * fastboot_lend_data() - Have the next download data received in place
+ *
+ * Only data inside the download and inside the buffer is lent, so nothing past
+ * the end of either is written, and only once the part of the buffer where the
+ * headers go holds downloaded data.
+ */
+static void fastboot_lend_data(void)
+{
+	int hdr_len = net_eth_hdr_size() + IP_UDP_HDR_SIZE +
+		sizeof(struct fastboot_header);
+	u32 remaining = fastboot_data_remaining();
+	u32 used, space;
+	void *next;
+
+	next = fastboot_data_next(&used, &space);
+	remaining = min(remaining, space);
+	if (remaining && used >= hdr_len)
+		net_rx_loan(next, hdr_len, min_t(u32, remaining, DATA_SIZE));
+}
+
 /**
  * fastboot_send() - Sends a packet in response to received fastboot packet
  *
@@ -114,7 +135,8 @@ static void fastboot_timed_send_info(const char *msg)
  * @fastboot_data_len: Length of received fastboot data
  * @retransmit: Nonzero if sending last sent packet
  */
-static void fastboot_send(struct fastboot_header header, char *fastboot_data,
+static void fastboot_send(struct fastboot_header header,
+			  const char *fastboot_data,
 			  unsigned int fastboot_data_len, uchar retransmit)
 {
 	uchar *packet;
@@ -127,6 +149,7 @@ static void fastboot_send(struct fastboot_header header, char *fastboot_data,
 	static int cmd = -1;
 	static bool pending_command;
 	char response[FASTBOOT_RESPONSE_LEN] = {0};
+	size_t cmd_len;
 
 	/*
 	 * We will always be sending some sort of packet, so
@@ -174,11 +197,16 @@ static void fastboot_send(struct fastboot_header header, char *fastboot_data,
 				fastboot_data_download(fastboot_data,
 						       fastboot_data_len,
 						       response);
+				net_rx_loan_end();
+				if (!*response)
+					fastboot_lend_data();
 			}
 		} else if (!pending_command) {
-			strlcpy(command, fastboot_data,
-				min((size_t)fastboot_data_len + 1,
-				    sizeof(command)));
+			/* The data is not terminated */
+			cmd_len = min((size_t)fastboot_data_len,
+				      sizeof(command) - 1);
+			memcpy(command, fastboot_data, cmd_len);
+			command[cmd_len] = '\0';
 			pending_command = true;
 		} else {
 			cmd = fastboot_handle_command(command, response);
@@ -258,7 +286,6 @@ static void fastboot_handler(uchar *packet, unsigned int dport,
 			     unsigned int len)
 {
 	struct fastboot_header header;
-	char fastboot_data[DATA_SIZE] = {0};
 	unsigned int fastboot_data_len = 0;
 
 	if (dport != fastboot_our_port)
@@ -277,27 +304,26 @@ static void fastboot_handler(uchar *packet, unsigned int dport,
 
 	switch (header.id) {
 	case FASTBOOT_QUERY:
-		fastboot_send(header, fastboot_data, 0, 0);
+		fastboot_send(header, NULL, 0, 0);
 		break;
 	case FASTBOOT_INIT:
 	case FASTBOOT_FASTBOOT:
+		/* Downloaded data is copied straight from the packet */
 		fastboot_data_len = len;
-		if (len > 0)
-			memcpy(fastboot_data, packet, len);
 		if (header.seq == sequence_number) {
-			fastboot_send(header, fastboot_data,
+			fastboot_send(header, (char *)packet,
 				      fastboot_data_len, 0);
 			sequence_number++;
 		} else if (header.seq == sequence_number - 1) {
 			/* Retransmit last sent packet */
-			fastboot_send(header, fastboot_data,
+			fastboot_send(header, (char *)packet,
 				      fastboot_data_len, 1);
 		}
 		break;
 	default:
 		pr_err("ID %d not implemented.\n", header.id);
 		header.id = FASTBOOT_ERROR;
-		fastboot_send(header, fastboot_data, 0, 0);
+		fastboot_send(header, NULL, 0, 0);
 		break;
 	}
 }
@@ -354,8 +354,44 @@ static int net_init_loop(void)
 	return 0;
 }
 
+/* Buffer lent for the next received packet, if any */
+static uchar *net_rx_loan_buf;
+static int net_rx_loan_hdr_len;
+static int net_rx_loan_size;
+
+int net_rx_loan(void *dest, int hdr_len, int len)
+{
+	uchar *buf = dest - hdr_len;
+
+	net_rx_loan_end();
+
+	/* The IP header must be aligned as it is in net_rx_packets[] */
+	if (hdr_len < 0 || hdr_len > NET_RX_LOAN_MAX_HDR || len <= 0 ||
+	    ((ulong)buf & 1))
+		return -EINVAL;
+	net_rx_loan_buf = buf;
+	net_rx_loan_hdr_len = hdr_len;
+	net_rx_loan_size = hdr_len + len;
+
+	return 0;
+}
+
+void net_rx_loan_end(void)
+{
+	net_rx_loan_buf = NULL;
+}
+
+uchar *net_rx_get_loan(int *hdr_lenp, int *sizep)
+{
+	*hdr_lenp = net_rx_loan_hdr_len;
+	*sizep = net_rx_loan_size;
+
+	return net_rx_loan_buf;
+}
+
 static void net_clear_handlers(void)
 {
+	net_rx_loan_end();
 	net_set_udp_handler(NULL);
 	net_set_arp_handler(NULL);
 	net_set_timeout_handler(0, NULL);
@@ -150,10 +150,38 @@ static unsigned short tftp_block_size = TFTP_BLOCK_SIZE;
 static unsigned short tftp_block_size_option = CONFIG_TFTP_BLOCKSIZE;
 static unsigned short tftp_window_size_option = TFTP_WINDOWSIZE;
 
+/* Largest block which fits in one Ethernet frame: less IP, UDP, TFTP hdrs */
+#define TFTP_MTU_BLOCK_SIZE	(ETH_DATA_LEN - IP_UDP_HDR_SIZE - 4)
+/* Shortest time to wait before asking for a lost window tail again */
+#define TFTP_RTO_MIN_MS		50
+
+#ifndef CONFIG_TFTP_WINDOWSIZE_MAX
+#define CONFIG_TFTP_WINDOWSIZE_MAX	TFTP_WINDOWSIZE
+#endif
+
+/* Window size to ask for next time, or 0 before the first transfer */
+static ushort	tftp_adaptive_window;
+/* Smoothed round-trip time and its mean deviation, in microseconds */
+static long	tftp_srtt_us;
+static long	tftp_rttvar_us;
+/* When the round trip being timed started (us), 0 if none */
+static ulong	tftp_ack_time_us;
+/* Time to wait for data before sending the ack again, in ms */
+static ulong	tftp_rto_ms;
+/* Number of packets sent again, and how many of those were full timeouts */
+static ulong	tftp_retransmits;
+static ulong	tftp_timeouts;
+
+/* Offset in the file of a block */
+static inline ulong tftp_block_offset(int block)
+{
+	return block * tftp_block_size + tftp_block_wrap_offset -
+		tftp_block_size;
+}
+
 static inline int store_block(int block, uchar *src, unsigned int len)
 {
-	ulong offset = block * tftp_block_size + tftp_block_wrap_offset -
-			tftp_block_size;
+	ulong offset = tftp_block_offset(block);
 	ulong newsize = offset + len;
 	ulong store_addr = tftp_load_addr + offset;
 	void *ptr;
@@ -172,7 +200,9 @@ static inline int store_block(int block, uchar *src, unsigned int len)
 	}
 #endif
 	ptr = map_sysmem(store_addr, len);
-	memcpy(ptr, src, len);
+	/* The block may have been received in place, see tftp_lend_block() */
+	if (ptr != src)
+		memmove(ptr, src, len);
 	unmap_sysmem(ptr);
 
 	if (net_boot_file_size < newsize)
@@ -181,6 +211,32 @@ static inline int store_block(int block, uchar *src, unsigned int len)
 	return 0;
 }
 
+/*
+ * Ask for the block at @offset to be received straight into place. Only blocks
+ * inside the file are lent, so nothing past its end is written, and only once
+ * the part of the file where the headers go has been received.
+ */
+static void tftp_lend_block(ulong offset)
+{
+#ifdef CONFIG_TFTP_TSIZE
+	int hdr_len = net_eth_hdr_size() + IP_UDP_HDR_SIZE + 4;
+	ulong len;
+	void *ptr;
+
+	net_rx_loan_end();
+	if (!tftp_tsize || offset < hdr_len || offset >= tftp_tsize)
+		return;
+	len = min_t(ulong, tftp_block_size, tftp_tsize - offset);
+#ifdef CONFIG_LMB
+	if (tftp_load_size && offset + len > tftp_load_size)
+		return;
+#endif
+	ptr = map_sysmem(tftp_load_addr + offset, len);
+	net_rx_loan(ptr, hdr_len, len);
+	unmap_sysmem(ptr);
+#endif
+}
+
 /* Clear our state ready for a new transfer */
 static void new_transfer(void)
 {
@@ -248,6 +304,47 @@ static void show_block_marker(void)
 	}
 }
 
+/* Update the round-trip estimate and retransmit timeout from a new sample */
+static void tftp_rtt_sample(long rtt_us)
+{
+	long delta;
+
+	if (!tftp_srtt_us) {
+		tftp_srtt_us = rtt_us;
+		tftp_rttvar_us = rtt_us / 2;
+	} else {
+		delta = rtt_us - tftp_srtt_us;
+		tftp_srtt_us += delta / 8;
+		tftp_rttvar_us += (abs(delta) - tftp_rttvar_us) / 4;
+	}
+	tftp_rto_ms = DIV_ROUND_UP(tftp_srtt_us + 4 * tftp_rttvar_us, 1000);
+	tftp_rto_ms = clamp_t(ulong, tftp_rto_ms, TFTP_RTO_MIN_MS, timeout_ms);
+}
+
+/* How long to wait for the next data block before acking again */
+static ulong tftp_data_timeout_ms(void)
+{
+	if (IS_ENABLED(CONFIG_TFTP_WINDOWSIZE_ADAPTIVE) && !tftp_put_active)
+		return tftp_rto_ms;
+
+	return timeout_ms;
+}
+
+/*
+ * Choose the window for the next transfer: grow it after a clean transfer
+ * (as long as the server agreed to what we asked for), shrink it after loss
+ */
+static void tftp_adapt_window(void)
+{
+	if (tftp_retransmits)
+		tftp_adaptive_window = max(tftp_windowsize / 2, 1);
+	else if (tftp_windowsize == tftp_window_size_option)
+		tftp_adaptive_window = min(tftp_windowsize * 2,
+					   CONFIG_TFTP_WINDOWSIZE_MAX);
+	else
+		tftp_adaptive_window = tftp_windowsize;
+}
+
 /**
  * restart the current transfer due to an error
  *
@@ -298,6 +395,13 @@ static void tftp_complete(void)
 		print_size(net_boot_file_size /
 			time_start * 1000, "/s");
 	}
+	if (IS_ENABLED(CONFIG_TFTP_WINDOWSIZE_ADAPTIVE)) {
+		printf("\n\t window %d, block size %d, %lu retransmits (%lu timeouts)",
+		       tftp_windowsize, tftp_block_size, tftp_retransmits,
+		       tftp_timeouts);
+		if (!tftp_put_active)
+			tftp_adapt_window();
+	}
 	puts("\ndone\n");
 	if (IS_ENABLED(CONFIG_CMD_BOOTEFI)) {
 		if (!tftp_put_active)
@@ -587,6 +691,8 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 			 */
 			if (tftp_last_nack != tftp_cur_block) {
 				tftp_send();
+				tftp_retransmits++;
+				tftp_ack_time_us = 0;
 				tftp_last_nack = tftp_cur_block;
 				tftp_next_ack = (ushort)(tftp_cur_block +
 							 tftp_windowsize);
@@ -627,13 +733,20 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		update_block_number();
 		tftp_prev_block = tftp_cur_block;
 		timeout_count_max = tftp_timeout_count_max;
-		net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
+		if (IS_ENABLED(CONFIG_TFTP_WINDOWSIZE_ADAPTIVE) &&
+		    tftp_ack_time_us) {
+			tftp_rtt_sample(timer_get_us() - tftp_ack_time_us);
+			tftp_ack_time_us = 0;
+		}
+		net_set_timeout_handler(tftp_data_timeout_ms(),
+					tftp_timeout_handler);
 
 		if (store_block(tftp_cur_block, pkt + 2, len)) {
 			eth_halt();
 			net_set_state(NETLOOP_FAIL);
 			break;
 		}
+		tftp_lend_block(tftp_block_offset(tftp_cur_block) + len);
 
 		if (len < tftp_block_size) {
 			tftp_send();
@@ -648,6 +761,7 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 		if (tftp_cur_block == tftp_next_ack) {
 			tftp_send();
 			tftp_next_ack += tftp_windowsize;
+			tftp_ack_time_us = timer_get_us();
 		}
 		break;
 
@@ -679,13 +793,33 @@ static void tftp_handler(uchar *pkt, unsigned dest, struct in_addr sip,
 
 static void tftp_timeout_handler(void)
 {
+	/*
+	 * While downloading, a quiet spell of a few round trips most likely
+	 * means the tail of a window was lost. Ack the last block we have so
+	 * the server sends the rest again, backing off towards the full
+	 * timeout. Karn's rule: don't time the round trip of a repeated ack.
+	 */
+	if (IS_ENABLED(CONFIG_TFTP_WINDOWSIZE_ADAPTIVE) && !tftp_put_active &&
+	    tftp_state == STATE_DATA && tftp_rto_ms < timeout_ms) {
+		tftp_rto_ms = min(tftp_rto_ms * 2, timeout_ms);
+		tftp_ack_time_us = 0;
+		tftp_retransmits++;
+		tftp_next_ack = (ushort)(tftp_cur_block + tftp_windowsize);
+		net_set_timeout_handler(tftp_rto_ms, tftp_timeout_handler);
+		tftp_send();
+		return;
+	}
+
 	if (++timeout_count > timeout_count_max) {
 		restart("Retry count exceeded");
 	} else {
 		puts("T ");
+		tftp_timeouts++;
 		net_set_timeout_handler(timeout_ms, tftp_timeout_handler);
-		if (tftp_state != STATE_RECV_WRQ)
+		if (tftp_state != STATE_RECV_WRQ) {
+			tftp_retransmits++;
 			tftp_send();
+		}
 	}
 }
 
@@ -699,6 +833,7 @@ static int tftp_init_load_addr(void)
 	lmb_init_and_reserve(&lmb, gd->bd, (void *)gd->fdt_blob);
 
 	max_size = lmb_get_free_size(&lmb, image_load_addr);
+	lmb_uninit(&lmb);
 	if (!max_size)
 		return -1;
 
@@ -747,6 +882,16 @@ void tftp_start(enum proto_t protocol)
 	}
 #endif
 
+	if (IS_ENABLED(CONFIG_TFTP_WINDOWSIZE_ADAPTIVE)) {
+		/* Blocks which need fragmenting can't be received */
+		if (!IS_ENABLED(CONFIG_IP_DEFRAG))
+			tftp_block_size_option = min_t(ushort,
+						       tftp_block_size_option,
+						       TFTP_MTU_BLOCK_SIZE);
+		if (tftp_adaptive_window)
+			tftp_window_size_option = tftp_adaptive_window;
+	}
+
 	debug("TFTP blocksize = %i, TFTP windowsize = %d timeout = %ld ms\n",
 	      tftp_block_size_option, tftp_window_size_option, timeout_ms);
 
@@ -843,6 +988,11 @@ void tftp_start(enum proto_t protocol)
 	tftp_cur_block = 0;
 	tftp_windowsize = 1;
 	tftp_last_nack = 0;
+	tftp_srtt_us = 0;
+	tftp_ack_time_us = 0;
+	tftp_rto_ms = timeout_ms;
+	tftp_retransmits = 0;
+	tftp_timeouts = 0;
 	/* zero out server ether in case the server ip has changed */
 	memset(net_server_ethaddr, 0, 6);
 	/* Revert tftp_block_size to dflt */
@@ -850,6 +1000,7 @@ void tftp_start(enum proto_t protocol)
 #ifdef CONFIG_TFTP_TSIZE
 	tftp_tsize = 0;
 	tftp_tsize_num_hash = 0;
+	net_rx_loan_end();
 #endif
 
 	tftp_send();
@@ -883,6 +1034,9 @@ void tftp_start_server(void)
 	tftp_our_port = WELL_KNOWN_PORT;
 	tftp_windowsize = 1;
 	tftp_next_ack = tftp_windowsize;
+	tftp_rto_ms = timeout_ms;
+	tftp_retransmits = 0;
+	tftp_timeouts = 0;
 
 #ifdef CONFIG_TFTP_TSIZE
 	tftp_tsize = 0;
@@ -7,11 +7,16 @@
  */
 
 #include <common.h>
+#include <hash.h>
 #include <image.h>
+#include <malloc.h>
+#include <asm/global_data.h>
 #include <test/suites.h>
 #include <test/ut.h>
 #include "bootstd_common.h"
 
+DECLARE_GLOBAL_DATA_PTR;
+
 /* Test of image phase */
 static int test_image_phase(struct unit_test_state *uts)
 {
@@ -34,3 +39,112 @@ static int test_image_phase(struct unit_test_state *uts)
 	return 0;
 }
 BOOTSTD_TEST(test_image_phase, 0);
+
+/* Build a FIT holding @data, with sha256 and crc32 hashes and maybe a sig */
+static int build_stream_fit(struct unit_test_state *uts, void *fit, int size,
+			    const u8 *data, int len, bool sig)
+{
+	u8 value[FIT_MAX_HASH_LEN];
+	int value_len;
+
+	ut_assertok(fdt_create(fit, size));
+	ut_assertok(fdt_finish_reservemap(fit));
+	ut_assertok(fdt_begin_node(fit, ""));
+	ut_assertok(fdt_begin_node(fit, FIT_IMAGES_PATH + 1));
+	ut_assertok(fdt_begin_node(fit, "kernel-1"));
+	ut_assertok(fdt_property(fit, FIT_DATA_PROP, data, len));
+
+	ut_assertok(fdt_begin_node(fit, "hash-1"));
+	ut_assertok(fdt_property_string(fit, FIT_ALGO_PROP, "sha256"));
+	value_len = sizeof(value);
+	ut_assertok(hash_block("sha256", data, len, value, &value_len));
+	ut_assertok(fdt_property(fit, FIT_VALUE_PROP, value, value_len));
+	ut_assertok(fdt_end_node(fit));
+
+	ut_assertok(fdt_begin_node(fit, "hash-2"));
+	ut_assertok(fdt_property_string(fit, FIT_ALGO_PROP, "crc32"));
+	value_len = sizeof(value);
+	ut_assertok(hash_block("crc32", data, len, value, &value_len));
+	ut_assertok(fdt_property(fit, FIT_VALUE_PROP, value, value_len));
+	ut_assertok(fdt_end_node(fit));
+
+	if (sig) {
+		ut_assertok(fdt_begin_node(fit, "signature-1"));
+		ut_assertok(fdt_property_string(fit, FIT_ALGO_PROP,
+						"sha256,rsa2048"));
+		ut_assertok(fdt_end_node(fit));
+	}
+
+	ut_assertok(fdt_end_node(fit));
+	ut_assertok(fdt_end_node(fit));
+	ut_assertok(fdt_end_node(fit));
+	ut_assertok(fdt_finish(fit));
+
+	return 0;
+}
+
+/* Feed @data to a progressive check in uneven chunks */
+static int stream_verify(struct unit_test_state *uts, const void *fit,
+			 const u8 *data, int len)
+{
+	struct fit_verify_ctx vctx;
+	int node, pos, chunk;
+
+	node = fit_image_get_node(fit, "kernel-1");
+	ut_assert(node >= 0);
+	ut_assertok(fit_image_verify_start(&vctx, fit, node, NULL));
+	ut_asserteq(2, vctx.count);
+	for (pos = 0; pos < len; pos += chunk) {
+		chunk = min(len - pos, 777);
+		fit_image_verify_update(&vctx, data + pos, chunk);
+	}
+
+	return fit_image_verify_finish(&vctx);
+}
+
+/* Test verifying an image progressively, as a loader would */
+static int test_image_verify_stream(struct unit_test_state *uts)
+{
+	const int len = 10000, size = len + 1024;
+	struct fit_verify_ctx vctx;
+	void *fit;
+	int node;
+	u8 *data;
+	int i;
+
+	data = malloc(len);
+	fit = malloc(size);
+	ut_assertnonnull(data);
+	ut_assertnonnull(fit);
+	for (i = 0; i < len; i++)
+		data[i] = i * 7 + (i >> 8);
+
+	ut_assertok(build_stream_fit(uts, fit, size, data, len, false));
+	node = fit_image_get_node(fit, "kernel-1");
+	ut_asserteq(1, fit_image_verify(fit, node));
+	ut_asserteq(1, stream_verify(uts, fit, data, len));
+
+	/* a single bad byte must be caught */
+	data[len / 2] ^= 1;
+	ut_asserteq(0, stream_verify(uts, fit, data, len));
+	ut_asserteq(0, fit_image_verify_with_data(fit, node, gd_fdt_blob(),
+						  data, len));
+	data[len / 2] ^= 1;
+	ut_asserteq(1, fit_image_verify_with_data(fit, node, gd_fdt_blob(),
+						  data, len));
+
+	/* signed images are left to fit_image_verify_with_data() */
+	if (IS_ENABLED(CONFIG_FIT_SIGNATURE)) {
+		ut_assertok(build_stream_fit(uts, fit, size, data, len, true));
+		node = fit_image_get_node(fit, "kernel-1");
+		ut_asserteq(-ENOSYS,
+			    fit_image_verify_start(&vctx, fit, node, NULL));
+		ut_asserteq(0, vctx.count);
+	}
+
+	free(fit);
+	free(data);
+
+	return 0;
+}
+BOOTSTD_TEST(test_image_verify_stream, 0);
@@ -4,6 +4,7 @@
  */
 
 #include <common.h>
+#include <abuf.h>
 #include <bootm.h>
 #include <command.h>
 #include <gzip.h>
@@ -11,7 +12,10 @@
 #include <log.h>
 #include <malloc.h>
 #include <mapmem.h>
+#include <time.h>
 #include <asm/io.h>
+#include <asm/unaligned.h>
+#include <linux/sizes.h>
 
 #include <u-boot/lz4.h>
 #include <u-boot/zlib.h>
@@ -22,6 +26,7 @@
 #include <lzma/LzmaTools.h>
 
 #include <linux/lzo.h>
+#include <linux/zstd.h>
 #include <test/compression.h>
 #include <test/suites.h>
 #include <test/ut.h>
@@ -121,6 +126,23 @@ static const char lz4_compressed[] =
 	"\x9d\x12\x8c\x9d";
 static const unsigned long lz4_compressed_size = 276;
 
+/* zstd -19 /tmp/plain.txt -o /tmp/plain.zst */
+static const char zstd_compressed[] =
+	"\x28\xb5\x2f\xfd\x64\x5e\x00\xad\x05\x00\x42\x4e\x26\x17\x90\x3b"
+	"\x07\x04\x5a\x13\x8b\xa7\x65\x34\x12\x21\x6d\xb0\x39\xbb\xae\xe8"
+	"\xba\xc9\xcd\x5e\x02\x49\xd0\x2b\xa9\xfa\x96\x92\xe7\x1f\x19\x19"
+	"\x7c\x8f\xf1\x9d\x54\x37\xfc\xd6\x0a\xf3\x0c\x93\x56\xc7\x52\x4f"
+	"\x0a\x62\x3e\xd1\xa5\x83\x17\x31\xab\x5d\x8f\x57\xf3\xcc\x3b\x58"
+	"\xf8\x91\x8c\xf1\x2a\x5c\x89\xdd\xf2\x9b\x15\xb7\x92\x5b\xbe\xba"
+	"\xab\xd5\xd1\x34\xdf\xf0\x02\x0e\x61\xcd\x7b\xd6\x01\xfc\xc2\xa7"
+	"\xd4\xd1\x3d\x26\x9c\x10\x49\xb8\x5b\xcd\xba\x7c\xf7\xac\x4b\xad"
+	"\xb7\x31\x1c\xbc\xf9\xcb\x62\x8e\x2e\x9b\x0f\xd3\x87\x57\x45\x12"
+	"\x16\xfa\x3a\x79\xde\x65\xf8\xcc\x48\xd5\x43\xa6\xbd\xc3\x91\x29"
+	"\x65\x29\xa7\x5b\x9a\x08\x08\x00\x60\x13\x00\x63\xa3\x8e\x28\x94"
+	"\x79\x41\x2a\x78\xc2\x91\x70\x9f\xaa\x6a\x21\x7a\xa1\xaa\x0c\xe4"
+	"\xf4\x6e\xfa";
+static const unsigned long zstd_compressed_size = 195;
+
 
 #define TEST_BUFFER_SIZE	512
 
@@ -296,6 +318,25 @@ static int uncompress_using_lz4(struct unit_test_state *uts,
 	return (ret != 0);
 }
 
+static int compress_using_zstd(struct unit_test_state *uts,
+			       void *in, unsigned long in_size,
+			       void *out, unsigned long out_max,
+			       unsigned long *out_size)
+{
+	/* There is no zstd compression in u-boot, so fake it. */
+	ut_asserteq(in_size, strlen(plain));
+	ut_asserteq_mem(plain, in, in_size);
+
+	if (zstd_compressed_size > out_max)
+		return -1;
+
+	memcpy(out, zstd_compressed, zstd_compressed_size);
+	if (out_size)
+		*out_size = zstd_compressed_size;
+
+	return 0;
+}
+
 #define errcheck(statement) if (!(statement)) { \
 	fprintf(stderr, "\tFailed: %s\n", #statement); \
 	ret = 1; \
@@ -536,6 +577,630 @@ static int compression_test_bootm_none(struct unit_test_state *uts)
 }
 COMPRESSION_TEST(compression_test_bootm_none, 0);
 
+/**
+ * run_stream_test() - Run tests on decompressing an image in chunks
+ *
+ * @comp_type:	Compression type to test
+ * @compress:	Our function to compress data
+ * Return: 0 if OK, non-zero on failure
+ */
+static int run_stream_test(struct unit_test_state *uts, int comp_type,
+			   mutate_func compress)
+{
+	static const ulong chunk_sizes[] = { 1, 7, 64, TEST_BUFFER_SIZE };
+	ulong compress_size = TEST_BUFFER_SIZE;
+	struct image_decomp_stream ds;
+	void *compress_buff, *out;
+	ulong pos, chunk;
+	int unc_len;
+	int i;
+
+	if (!CONFIG_IS_ENABLED(BOOTM_DECOMP_STREAM))
+		return -EAGAIN;
+
+	printf("Testing: %s\n", genimg_get_comp_name(comp_type));
+	compress_buff = malloc(TEST_BUFFER_SIZE);
+	ut_assertnonnull(compress_buff);
+	out = malloc(TEST_BUFFER_SIZE);
+	ut_assertnonnull(out);
+	unc_len = strlen(plain);
+	ut_assertok(compress(uts, (void *)plain, unc_len, compress_buff,
+			     compress_size, &compress_size));
+
+	/* Units of each format end up split across chunks in various ways */
+	for (i = 0; i < ARRAY_SIZE(chunk_sizes); i++) {
+		memset(out, 'A', TEST_BUFFER_SIZE);
+		ut_assertok(image_decomp_stream_start(&ds, comp_type,
+						      IH_TYPE_KERNEL, out,
+						      unc_len));
+		for (pos = 0; pos < compress_size; pos += chunk) {
+			chunk = min(compress_size - pos, chunk_sizes[i]);
+			ut_assertok(image_decomp_stream_write(&ds,
+							      compress_buff + pos,
+							      chunk));
+		}
+		ut_assertok(image_decomp_stream_finish(&ds));
+		ut_asserteq(unc_len, ds.len);
+		ut_asserteq_mem(plain, out, unc_len);
+		ut_asserteq('A', ((char *)out)[unc_len]);
+	}
+
+	/* Output does not fit */
+	memset(out, 'A', TEST_BUFFER_SIZE);
+	ut_assertok(image_decomp_stream_start(&ds, comp_type, IH_TYPE_KERNEL,
+					      out, unc_len - 1));
+	ut_assert(image_decomp_stream_write(&ds, compress_buff,
+					    compress_size));
+	image_decomp_stream_finish(&ds);
+	ut_asserteq('A', ((char *)out)[unc_len - 1]);
+
+	/* Input is cut short */
+	ut_assertok(image_decomp_stream_start(&ds, comp_type, IH_TYPE_KERNEL,
+					      out, unc_len));
+	ut_assertok(image_decomp_stream_write(&ds, compress_buff,
+					      compress_size / 2));
+	ut_asserteq(-EINVAL, image_decomp_stream_finish(&ds));
+
+	free(out);
+	free(compress_buff);
+
+	return 0;
+}
+
+static int compression_test_stream_gzip(struct unit_test_state *uts)
+{
+	return run_stream_test(uts, IH_COMP_GZIP, compress_using_gzip);
+}
+COMPRESSION_TEST(compression_test_stream_gzip, 0);
+
+static int compression_test_stream_lz4(struct unit_test_state *uts)
+{
+	return run_stream_test(uts, IH_COMP_LZ4, compress_using_lz4);
+}
+COMPRESSION_TEST(compression_test_stream_lz4, 0);
+
+static int compression_test_stream_zstd(struct unit_test_state *uts)
+{
+	return run_stream_test(uts, IH_COMP_ZSTD, compress_using_zstd);
+}
+COMPRESSION_TEST(compression_test_stream_zstd, 0);
+
+/* Size of the data used to test LZ4 frames block by block */
+#define LZ4_TEST_SIZE		SZ_1M
+
+/* Size of each block in the LZ4 frame, matching the lz4 tool's -B4 */
+#define LZ4_TEST_BLOCK		SZ_64K
+
+/* Number of times the data is decompressed when measuring the speed */
+#define LZ4_SPEED_LOOPS		20
+
+/**
+ * lz4_make_data() - Fill a buffer with data which compresses a little
+ *
+ * This mixes text, runs of one byte, short repeating patterns and repeats of
+ * earlier data, to exercise all of the match-copying paths.
+ *
+ * @buf: Buffer to fill
+ * @size: Size of buffer
+ */
+static void lz4_make_data(u8 *buf, ulong size)
+{
+	static const char *const words[] = {
+		"the ", "image ", "U-Boot ", "loads ", "a ", "kernel\n",
+	};
+	u32 seed = 1;
+	ulong pos = 0;
+
+	while (pos < size) {
+		uint len, i;
+
+		seed = seed * 1103515245 + 12345;
+		len = (seed >> 8) % 64 + 1;
+		len = min_t(ulong, len, size - pos);
+		switch ((seed >> 16) % 5) {
+		case 0:
+			memset(buf + pos, seed >> 24, len);
+			break;
+		case 1: {
+			uint period = (seed >> 4) % 16 + 1;
+
+			for (i = 0; i < len; i++)
+				buf[pos + i] = i < period ? seed >> (i % 24) :
+					buf[pos + i - period];
+			break;
+		}
+		case 2:
+			for (i = 0; i < len; i++)
+				buf[pos + i] = (seed >> (i % 24)) + i * 7;
+			break;
+		case 3:
+			if (pos > 1000) {
+				ulong from = pos - (seed >> 12) % min(pos, 65535UL);
+
+				for (i = 0; i < len; i++)
+					buf[pos + i] = buf[from + i];
+				break;
+			}
+			fallthrough;
+		default:
+			for (i = 0; i < len; i++)
+				buf[pos + i] = words[(seed >> 20) % 6][i % 4];
+			break;
+		}
+		pos += len;
+	}
+}
+
+/* Write an LZ4 length of at least 15, after the four bits in the token */
+static u8 *lz4_put_len(u8 *op, ulong len)
+{
+	for (len -= 15; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = len;
+
+	return op;
+}
+
+/* Write a sequence of literals, then an optional match */
+static u8 *lz4_put_seq(u8 *op, const u8 *lit, ulong lit_len, uint offset,
+		       ulong match_len)
+{
+	u8 *token = op++;
+
+	*token = min(lit_len, 15UL) << 4;
+	if (lit_len >= 15)
+		op = lz4_put_len(op, lit_len);
+	memcpy(op, lit, lit_len);
+	op += lit_len;
+	if (!offset)
+		return op;
+
+	put_unaligned_le16(offset, op);
+	op += 2;
+	match_len -= 4;
+	*token |= min(match_len, 15UL);
+	if (match_len >= 15)
+		op = lz4_put_len(op, match_len);
+
+	return op;
+}
+
+/**
+ * lz4_compress_block() - Compress a block with a simple greedy LZ4 encoder
+ *
+ * There is no LZ4 compressor in U-Boot, so this makes test data. It follows
+ * the end-of-block rules: the last match starts at least 12 bytes before the
+ * end and the last five bytes are literals.
+ *
+ * @src: Data to compress
+ * @len: Length of data
+ * @dst: Place to put compressed block, with space for len + len / 255 + 16
+ * @table: Hash table of 4096 entries, for use by this function
+ * Return: size of compressed block
+ */
+static ulong lz4_compress_block(const u8 *src, ulong len, u8 *dst,
+				long *table)
+{
+	const u8 *ip = src, *anchor = src, *end = src + len;
+	u8 *op = dst;
+	int i;
+
+	for (i = 0; i < 4096; i++)
+		table[i] = -1;
+	while (len >= 13 && ip < end - 12) {
+		u32 seq = get_unaligned_le32(ip);
+		uint hash = (seq * 2654435761U) >> 20;
+		long prev = table[hash];
+		const u8 *ref = src + prev;
+		const u8 *mp;
+
+		table[hash] = ip - src;
+		if (prev < 0 || ip - ref > 65535 ||
+		    get_unaligned_le32(ref) != seq) {
+			ip++;
+			continue;
+		}
+		for (mp = ip + 4; mp < end - 5 && *mp == ref[mp - ip]; mp++)
+			;
+		op = lz4_put_seq(op, anchor, ip - anchor, ip - ref, mp - ip);
+		ip = mp;
+		anchor = ip;
+	}
+
+	return lz4_put_seq(op, anchor, end - anchor, 0, 0) - dst;
+}
+
+/**
+ * lz4_make_frame() - Compress data into an LZ4 frame of independent blocks
+ *
+ * @src: Data to compress
+ * @len: Length of data
+ * @dst: Place to put frame
+ * @block_checksum: true to add a (dummy) checksum after each block
+ * Return: size of frame, or 0 if out of memory
+ */
+static ulong lz4_make_frame(const u8 *src, ulong len, u8 *dst,
+			    bool block_checksum)
+{
+	u8 *op = dst;
+	long *table;
+	ulong pos;
+
+	table = malloc(4096 * sizeof(*table));
+	if (!table)
+		return 0;
+	put_unaligned_le32(LZ4F_MAGIC, op);
+	op[4] = 0x60 | (block_checksum ? 0x10 : 0);
+	op[5] = 0x40;
+	op[6] = 0;	/* header checksum, not checked */
+	op += 7;
+	for (pos = 0; pos < len; pos += LZ4_TEST_BLOCK) {
+		ulong size = min_t(ulong, len - pos, LZ4_TEST_BLOCK);
+		ulong csize;
+
+		csize = lz4_compress_block(src + pos, size, op + 4, table);
+		if (csize >= size) {
+			memcpy(op + 4, src + pos, size);
+			csize = size | 0x80000000;
+		}
+		put_unaligned_le32(csize, op);
+		op += 4 + (csize & ~0x80000000);
+		if (block_checksum) {
+			put_unaligned_le32(0, op);
+			op += 4;
+		}
+	}
+	put_unaligned_le32(0, op);
+	op += 4;
+	free(table);
+
+	return op - dst;
+}
+
+/* Decompress an LZ4 frame one unit at a time with lz4_frame_unit() */
+static int lz4_frame_units(const u8 *in, ulong in_len, u8 *out,
+			   ulong out_len)
+{
+	struct lz4_frame lf;
+	ulong done = 0;
+	const u8 *end = in + in_len;
+
+	lz4_frame_start(&lf);
+	while (lf.need) {
+		ulong need = lf.need;
+		int ret;
+
+		if (need > end - in)
+			return -EINVAL;
+		ret = lz4_frame_unit(&lf, in, out + done, out_len - done);
+		if (ret < 0)
+			return ret;
+		in += need;
+		done += ret;
+	}
+
+	return done;
+}
+
+/* Test decompressing LZ4 frames in one go, unit by unit and as a stream */
+static int compression_test_lz4_frame(struct unit_test_state *uts)
+{
+	u8 *plain_buf, *frame, *out;
+	struct image_decomp_stream ds;
+	ulong frame_len, pos;
+	size_t out_len;
+	int i;
+
+	plain_buf = malloc(LZ4_TEST_SIZE);
+	frame = malloc(LZ4_TEST_SIZE * 2);
+	out = malloc(LZ4_TEST_SIZE + 1);
+	ut_assertnonnull(plain_buf);
+	ut_assertnonnull(frame);
+	ut_assertnonnull(out);
+	lz4_make_data(plain_buf, LZ4_TEST_SIZE);
+
+	for (i = 0; i < 2; i++) {
+		frame_len = lz4_make_frame(plain_buf, LZ4_TEST_SIZE, frame, i);
+		ut_assert(frame_len);
+		ut_assert(frame_len < LZ4_TEST_SIZE);
+
+		memset(out, 'A', LZ4_TEST_SIZE + 1);
+		out_len = LZ4_TEST_SIZE;
+		ut_assertok(ulz4fn(frame, frame_len, out, &out_len));
+		ut_asserteq(LZ4_TEST_SIZE, out_len);
+		ut_asserteq_mem(plain_buf, out, LZ4_TEST_SIZE);
+		ut_asserteq('A', out[LZ4_TEST_SIZE]);
+
+		memset(out, 'A', LZ4_TEST_SIZE + 1);
+		ut_asserteq(LZ4_TEST_SIZE,
+			    lz4_frame_units(frame, frame_len, out,
+					    LZ4_TEST_SIZE));
+		ut_asserteq_mem(plain_buf, out, LZ4_TEST_SIZE);
+		ut_asserteq('A', out[LZ4_TEST_SIZE]);
+
+		/* The output must not overrun, even by a wild copy */
+		memset(out, 'A', LZ4_TEST_SIZE + 1);
+		ut_assert(lz4_frame_units(frame, frame_len, out,
+					  LZ4_TEST_SIZE - 1) < 0);
+		ut_asserteq('A', out[LZ4_TEST_SIZE - 1]);
+
+		/* A cut-off frame is not accepted */
+		out_len = LZ4_TEST_SIZE;
+		ut_asserteq(-EINVAL, ulz4fn(frame, frame_len - 5, out,
+					    &out_len));
+	}
+
+	if (CONFIG_IS_ENABLED(BOOTM_DECOMP_STREAM)) {
+		memset(out, 'A', LZ4_TEST_SIZE + 1);
+		ut_assertok(image_decomp_stream_start(&ds, IH_COMP_LZ4,
+						      IH_TYPE_KERNEL, out,
+						      LZ4_TEST_SIZE));
+		for (pos = 0; pos < frame_len; pos += SZ_4K + 1)
+			ut_assertok(image_decomp_stream_write(&ds,
+				frame + pos,
+				min_t(ulong, frame_len - pos, SZ_4K + 1)));
+		ut_assertok(image_decomp_stream_finish(&ds));
+		ut_asserteq(LZ4_TEST_SIZE, ds.len);
+		ut_asserteq_mem(plain_buf, out, LZ4_TEST_SIZE);
+		ut_asserteq('A', out[LZ4_TEST_SIZE]);
+	}
+
+	free(out);
+	free(frame);
+	free(plain_buf);
+
+	return 0;
+}
+COMPRESSION_TEST(compression_test_lz4_frame, 0);
+
+/* Measure how fast LZ4 frames are decompressed */
+static int compression_test_lz4_speed(struct unit_test_state *uts)
+{
+	u8 *plain_buf, *frame, *out;
+	ulong frame_len, start, us;
+	size_t out_len;
+	int i;
+
+	plain_buf = malloc(LZ4_TEST_SIZE);
+	frame = malloc(LZ4_TEST_SIZE * 2);
+	out = malloc(LZ4_TEST_SIZE);
+	ut_assertnonnull(plain_buf);
+	ut_assertnonnull(frame);
+	ut_assertnonnull(out);
+	lz4_make_data(plain_buf, LZ4_TEST_SIZE);
+	frame_len = lz4_make_frame(plain_buf, LZ4_TEST_SIZE, frame, false);
+	ut_assert(frame_len);
+
+	start = timer_get_us();
+	for (i = 0; i < LZ4_SPEED_LOOPS; i++) {
+		out_len = LZ4_TEST_SIZE;
+		ut_assertok(ulz4fn(frame, frame_len, out, &out_len));
+	}
+	us = max(timer_get_us() - start, 1UL);
+	ut_asserteq_mem(plain_buf, out, LZ4_TEST_SIZE);
+
+	printf("lz4: %d KiB from %lu KiB: %lu MB/s\n", LZ4_TEST_SIZE / SZ_1K,
+	       frame_len / SZ_1K, (ulong)LZ4_TEST_SIZE * LZ4_SPEED_LOOPS / us);
+
+	free(out);
+	free(frame);
+	free(plain_buf);
+
+	return 0;
+}
+COMPRESSION_TEST(compression_test_lz4_speed, 0);
+
+/*
+ * zstd -19 --no-content-size --zstd=wlog=10, with 1KiB window and no size in
+ * the header, of the data from zstd_window_data()
+ */
+static const char zstd_window_compressed[] =
+	"\x28\xb5\x2f\xfd\x04\x00\x74\x01\x00\xd0\x61\x62\x63\x64\x65\x66"
+	"\x67\x68\x69\x6a\x6b\x6c\x6d\x6e\x6f\x70\x71\x72\x73\x74\x75\x76"
+	"\x77\x78\x79\x7a\x1b\xa8\x20\x7e\xe0\xb7\x03\x10\xc6\xef\xff\xff"
+	"\x7f\x06\x2d\xa7\xa3\xb4\x06\x64\x00\x00\x08\x79\x02\xc0\x44\x97"
+	"\x0a\x35\x77\x56\x02\x04\x5c\x00\x00\x08\x78\x02\xc0\x44\x97\x0a"
+	"\x35\x2b\x00\x02\x5c\x00\x00\x08\x77\x02\xc0\x44\x97\x0a\x35\x2b"
+	"\x00\x02\x5c\x00\x00\x08\x76\x02\xc0\x44\x97\x0a\x35\x2b\x00\x02"
+	"\x5c\x00\x00\x08\x75\x02\xc0\x44\x97\x0a\x35\x2b\x00\x02\x5c\x00"
+	"\x00\x08\x74\x02\xc0\x44\x97\x0a\x35\x2b\x00\x02\x5d\x00\x00\x08"
+	"\x73\x02\xc0\x44\x97\x0a\x35\x2b\x00\x02\xfc\xe4\x7b\xcf";
+static const unsigned long zstd_window_compressed_size = 158;
+
+/* Size of the data in zstd_window_compressed */
+#define ZSTD_WINDOW_SIZE	SZ_8K
+
+/* Window used when streaming, deliberately not a power of two */
+#define ZSTD_TEST_WINDOW	100
+
+static void zstd_window_data(u8 *buf)
+{
+	int i;
+
+	for (i = 0; i < ZSTD_WINDOW_SIZE; i++)
+		buf[i] = 'a' + ((i >> 3) + (i >> 10)) % 26;
+}
+
+/**
+ * zstd_make_frames() - Put several frames one after the other
+ *
+ * This has two frames which record their size, one which does not, another
+ * which does, then some padding.
+ *
+ * @in: Place to put the frames
+ * @expect: Place to put the data which the frames decompress to
+ * @in_lenp: Returns the size of the frames, including the padding
+ * Return: size of the decompressed data
+ */
+static ulong zstd_make_frames(u8 *in, u8 *expect, ulong *in_lenp)
+{
+	ulong plain_len = strlen(plain);
+	u8 *ip = in, *op = expect;
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		if (i == 2) {
+			memcpy(ip, zstd_window_compressed,
+			       zstd_window_compressed_size);
+			ip += zstd_window_compressed_size;
+			zstd_window_data(op);
+			op += ZSTD_WINDOW_SIZE;
+		} else {
+			memcpy(ip, zstd_compressed, zstd_compressed_size);
+			ip += zstd_compressed_size;
+			memcpy(op, plain, plain_len);
+			op += plain_len;
+		}
+	}
+	memset(ip, '\0', 16);
+	*in_lenp = ip + 16 - in;
+
+	return op - expect;
+}
+
+/* Test decompressing several frames, reusing the contexts */
+static int compression_test_zstd_frames(struct unit_test_state *uts)
+{
+	struct zstd_dctx *zd, *again;
+	u8 *in, *expect, *out;
+	ulong in_len, len;
+	struct abuf ib, ob;
+	int i;
+
+	in = malloc(SZ_4K);
+	expect = malloc(SZ_16K);
+	out = malloc(SZ_16K);
+	ut_assertnonnull(in);
+	ut_assertnonnull(expect);
+	ut_assertnonnull(out);
+	len = zstd_make_frames(in, expect, &in_len);
+
+	abuf_init_set(&ib, in, in_len);
+	for (i = 0; i < 2; i++) {
+		memset(out, '\xff', SZ_16K);
+		abuf_init_set(&ob, out, SZ_16K);
+		ut_asserteq(len, zstd_decompress(&ib, &ob));
+		ut_asserteq_mem(expect, out, len);
+	}
+
+	/* There is not enough space for the last frame */
+	abuf_init_set(&ob, out, len - 1);
+	ut_asserteq(-ENOSPC, zstd_decompress(&ib, &ob));
+
+	/* Nor for the one without a size */
+	abuf_init_set(&ob, out, strlen(plain) * 2 + 10);
+	ut_asserteq(-ENOSPC, zstd_decompress(&ib, &ob));
+
+	/* The padding alone is not valid */
+	abuf_init_set(&ib, in + in_len - 16, 16);
+	ut_asserteq(-EINVAL, zstd_decompress(&ib, &ob));
+
+	/* A context is handed out again once it is put */
+	zd = zstd_get_dctx();
+	ut_assertnonnull(zd);
+	ut_assert(!zd->temp);
+
+	/* Only one is kept; others are freed when put */
+	again = zstd_get_dctx();
+	ut_assertnonnull(again);
+	ut_assert(again->temp);
+	zstd_put_dctx(again);
+
+	zstd_put_dctx(zd);
+	again = zstd_get_dctx();
+	ut_asserteq_ptr(zd, again);
+	zstd_put_dctx(again);
+
+	free(out);
+	free(expect);
+	free(in);
+
+	return 0;
+}
+COMPRESSION_TEST(compression_test_zstd_frames, 0);
+
+/**
+ * struct zstd_window_priv - collects the output of zstd_decompress_window()
+ *
+ * @buf: Buffer to collect into
+ * @len: Number of bytes collected
+ * @size: Size of @buf
+ * @pieces: Number of pieces written
+ * @fail_at: Piece number to fail at, or -1 for none
+ */
+struct zstd_window_priv {
+	u8 *buf;
+	ulong len;
+	ulong size;
+	int pieces;
+	int fail_at;
+};
+
+static int zstd_window_write(void *priv, const void *buf, size_t len)
+{
+	struct zstd_window_priv *wp = priv;
+
+	if (len > ZSTD_TEST_WINDOW || wp->len + len > wp->size)
+		return -E2BIG;
+	if (wp->pieces++ == wp->fail_at)
+		return -EIO;
+	memcpy(wp->buf + wp->len, buf, len);
+	wp->len += len;
+
+	return 0;
+}
+
+/* Test decompressing a window at a time */
+static int compression_test_zstd_window(struct unit_test_state *uts)
+{
+	struct zstd_window_priv wp;
+	u8 window[ZSTD_TEST_WINDOW];
+	struct abuf ib, wb;
+	u8 *in, *expect;
+	ulong in_len, len;
+
+	in = malloc(SZ_4K);
+	expect = malloc(SZ_16K);
+	ut_assertnonnull(in);
+	ut_assertnonnull(expect);
+	len = zstd_make_frames(in, expect, &in_len);
+
+	memset(&wp, '\0', sizeof(wp));
+	wp.size = SZ_16K;
+	wp.buf = malloc(wp.size);
+	ut_assertnonnull(wp.buf);
+	wp.fail_at = -1;
+	abuf_init_set(&ib, in, in_len);
+	abuf_init_set(&wb, window, sizeof(window));
+	ut_assertok(zstd_decompress_window(&ib, &wb, zstd_window_write, &wp));
+	ut_asserteq(len, wp.len);
+	ut_asserteq_mem(expect, wp.buf, len);
+	ut_assert(wp.pieces >= DIV_ROUND_UP(len, ZSTD_TEST_WINDOW));
+
+	/* An error from the write function stops it */
+	wp.len = 0;
+	wp.pieces = 0;
+	wp.fail_at = 5;
+	ut_asserteq(-EIO, zstd_decompress_window(&ib, &wb, zstd_window_write,
+						 &wp));
+	ut_asserteq(6, wp.pieces);
+
+	/* A frame which is cut short is an error */
+	wp.len = 0;
+	wp.pieces = 0;
+	wp.fail_at = -1;
+	abuf_init_set(&ib, in, zstd_compressed_size - 1);
+	ut_asserteq(-EINVAL, zstd_decompress_window(&ib, &wb,
+						    zstd_window_write, &wp));
+
+	free(wp.buf);
+	free(expect);
+	free(in);
+
+	return 0;
+}
+COMPRESSION_TEST(compression_test_zstd_window, 0);
+
 int do_ut_compression(struct cmd_tbl *cmdtp, int flag, int argc,
 		      char *const argv[])
 {
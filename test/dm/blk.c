@@ -5,11 +5,16 @@
 
 #include <common.h>
 #include <dm.h>
+#include <mapmem.h>
+#include <os.h>
 #include <part.h>
+#include <sandboxblockdev.h>
 #include <usb.h>
 #include <asm/global_data.h>
 #include <asm/state.h>
+#include <dm/device-internal.h>
 #include <dm/test.h>
+#include <linux/sizes.h>
 #include <test/test.h>
 #include <test/ut.h>
 
@@ -334,3 +339,181 @@ static int dm_test_blk_foreach(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_blk_foreach, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+#if CONFIG_IS_ENABLED(BLOCK_CACHE)
+/* Test the block cache with reads spanning several entries */
+static int dm_test_blk_cache(struct unit_test_state *uts)
+{
+	const int devnum = 99, blksz = 512;
+	struct block_cache_stats stats;
+	char data[40 * 512], buf[16 * 512];
+	lbaint_t cnt;
+	int i;
+
+	for (i = 0; i < sizeof(data); i++)
+		data[i] = i * 7;
+
+	/* four entries of eight blocks; reads of up to 16 blocks are cached */
+	blkcache_configure(8, 4);
+	blkcache_configure_readahead(16);
+	blkcache_stats(&stats);
+
+	/* blocks 4-15 land in two entries */
+	blkcache_fill(UCLASS_ROOT, devnum, 4, 12, blksz, data + 4 * blksz);
+	ut_asserteq(1, blkcache_read(UCLASS_ROOT, devnum, 6, 8, blksz, buf));
+	ut_asserteq_mem(data + 6 * blksz, buf, 8 * blksz);
+	ut_asserteq(0, blkcache_read(UCLASS_ROOT, devnum, 2, 4, blksz, buf));
+	ut_asserteq(0, blkcache_read(UCLASS_ROOT, devnum + 1, 6, 1, blksz,
+				     buf));
+
+	/* extending the valid part of an entry */
+	blkcache_fill(UCLASS_ROOT, devnum, 0, 4, blksz, data);
+	ut_asserteq(1, blkcache_read(UCLASS_ROOT, devnum, 2, 4, blksz, buf));
+	ut_asserteq_mem(data + 2 * blksz, buf, 4 * blksz);
+
+	blkcache_stats(&stats);
+	ut_asserteq(2, stats.hits);
+	ut_asserteq(2, stats.misses);
+	ut_asserteq(2, stats.entries);
+
+	/* the least recently used entry (blocks 8-15) is recycled */
+	blkcache_fill(UCLASS_ROOT, devnum, 16, 16, blksz, data + 16 * blksz);
+	blkcache_fill(UCLASS_ROOT, devnum, 32, 8, blksz, data + 32 * blksz);
+	ut_asserteq(4, stats.max_entries);
+	ut_asserteq(0, blkcache_read(UCLASS_ROOT, devnum, 8, 1, blksz, buf));
+	ut_asserteq(1, blkcache_read(UCLASS_ROOT, devnum, 0, 8, blksz, buf));
+	ut_asserteq_mem(data, buf, 8 * blksz);
+	ut_asserteq(1, blkcache_read(UCLASS_ROOT, devnum, 30, 10, blksz, buf));
+	ut_asserteq_mem(data + 30 * blksz, buf, 10 * blksz);
+
+	/* writes drop everything for the device */
+	blkcache_invalidate(UCLASS_ROOT, devnum);
+	ut_asserteq(0, blkcache_read(UCLASS_ROOT, devnum, 0, 1, blksz, buf));
+
+	/* read-ahead starts after a few sequential reads, then doubles */
+	ut_assertnull(blkcache_readahead(UCLASS_ROOT, devnum, 100, 1, blksz,
+					 &cnt));
+	ut_assertnull(blkcache_readahead(UCLASS_ROOT, devnum, 101, 1, blksz,
+					 &cnt));
+	ut_assertnonnull(blkcache_readahead(UCLASS_ROOT, devnum, 102, 1,
+					    blksz, &cnt));
+	ut_asserteq(8, cnt);
+	ut_assertnonnull(blkcache_readahead(UCLASS_ROOT, devnum, 103, 1,
+					    blksz, &cnt));
+	ut_asserteq(16, cnt);
+
+	/* a seek resets it */
+	ut_assertnull(blkcache_readahead(UCLASS_ROOT, devnum, 10, 1, blksz,
+					 &cnt));
+	blkcache_stats(&stats);
+	ut_asserteq(2, stats.readaheads);
+	ut_asserteq(7 + 15, stats.readahead_blocks);
+
+	/* configuring the cache again puts read-ahead back to its default */
+	blkcache_invalidate(UCLASS_ROOT, devnum);
+	blkcache_configure_readahead(0);
+	blkcache_configure(CONFIG_BLOCK_CACHE_BLOCKS,
+			   CONFIG_BLOCK_CACHE_ENTRIES);
+	blkcache_stats(&stats);
+	ut_asserteq(min(CONFIG_BLOCK_CACHE_READAHEAD,
+			CONFIG_BLOCK_CACHE_BLOCKS * CONFIG_BLOCK_CACHE_ENTRIES / 2),
+		    stats.max_readahead);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_cache, 0);
+#endif
+
+/* Test queued requests and large reads which use them */
+static int dm_test_blk_queued(struct unit_test_state *uts)
+{
+	const char *fname = "blk_queued.img";
+	const lbaint_t blkcnt = SZ_1M * 6 / 512;
+	struct blk_req req, *reqs;
+	struct udevice *dev;
+	char *wbuf, *rbuf;
+	int fd, i;
+
+	fd = os_open(fname, OS_O_RDWR | OS_O_CREAT | OS_O_TRUNC);
+	ut_assert(fd >= 0);
+	ut_asserteq(blkcnt * 512, os_lseek(fd, blkcnt * 512 - 1, OS_SEEK_SET) +
+		    os_write(fd, "", 1));
+	os_close(fd);
+	ut_assertok(host_dev_bind(0, (char *)fname, false));
+	ut_assertok(blk_get_device(UCLASS_ROOT, 0, &dev));
+
+	wbuf = map_sysmem(0x1000000, blkcnt * 512);
+	rbuf = map_sysmem(0x2000000, blkcnt * 512);
+	for (i = 0; i < blkcnt * 512; i++)
+		wbuf[i] = i * 7 + i / 512;
+
+	/* a single request completes on the next poll */
+	req.op = BLK_REQ_WRITE;
+	req.start = 0;
+	req.blkcnt = blkcnt;
+	req.buffer = wbuf;
+	ut_assertok(blk_submit(dev, &req));
+	ut_assert(!req.complete);
+	ut_asserteq(blkcnt, blk_wait(dev, &req));
+	ut_assert(req.complete);
+
+	/* the device queue fills up */
+	reqs = calloc(SANDBOX_HOST_QUEUE_DEPTH + 1, sizeof(*reqs));
+	ut_assertnonnull(reqs);
+	for (i = 0; i <= SANDBOX_HOST_QUEUE_DEPTH; i++) {
+		reqs[i].op = BLK_REQ_READ;
+		reqs[i].start = i;
+		reqs[i].blkcnt = 1;
+		reqs[i].buffer = rbuf + i * 512;
+	}
+	for (i = 0; i < SANDBOX_HOST_QUEUE_DEPTH; i++)
+		ut_assertok(blk_submit(dev, &reqs[i]));
+	ut_asserteq(-EBUSY, blk_submit(dev, &reqs[i]));
+	ut_asserteq(SANDBOX_HOST_QUEUE_DEPTH, blk_poll(dev));
+	ut_assertok(blk_submit(dev, &reqs[i]));
+	ut_asserteq(1, blk_wait(dev, &reqs[i]));
+	ut_asserteq_mem(wbuf, rbuf, (SANDBOX_HOST_QUEUE_DEPTH + 1) * 512);
+
+	/* a cancelled request is dropped by the device */
+	memset(rbuf, '\0', 2 * 512);
+	ut_assertok(blk_submit(dev, &reqs[0]));
+	ut_assertok(blk_submit(dev, &reqs[1]));
+	ut_assertok(blk_cancel(dev, &reqs[0]));
+	ut_assert(reqs[0].complete);
+	ut_asserteq(-ECANCELED, reqs[0].result);
+	ut_assertok(blk_cancel(dev, &reqs[0]));
+
+	/* the device cannot go away with a request queued */
+	ut_assertok(device_remove(dev, DM_REMOVE_NORMAL));
+	ut_asserteq(-EBUSY, device_unbind(dev));
+	ut_asserteq(1, blk_poll(dev));
+	ut_asserteq(1, reqs[1].result);
+	ut_asserteq_mem(wbuf + 512, rbuf + 512, 512);
+	ut_assert(!rbuf[0]);
+
+	/* with the device queue full, a large read falls back to blocking */
+	for (i = 0; i < SANDBOX_HOST_QUEUE_DEPTH; i++)
+		ut_assertok(blk_submit(dev, &reqs[i]));
+	memset(rbuf + 512, '\0', (blkcnt - 1) * 512);
+	ut_asserteq(blkcnt - 1, blk_read_queued(dev, 1, blkcnt - 1,
+						rbuf + 512));
+	ut_asserteq_mem(wbuf + 512, rbuf + 512, (blkcnt - 1) * 512);
+	ut_asserteq(SANDBOX_HOST_QUEUE_DEPTH, blk_poll(dev));
+	free(reqs);
+
+	/* a large read is split into queued chunks */
+	memset(rbuf, '\0', blkcnt * 512);
+	ut_asserteq(blkcnt - 1, blk_read(dev, 1, blkcnt - 1, rbuf));
+	ut_asserteq_mem(wbuf + 512, rbuf, (blkcnt - 1) * 512);
+
+	/* reads past the end come up short */
+	ut_asserteq(blkcnt - 2, blk_read_queued(dev, 2, blkcnt, rbuf));
+
+	unmap_sysmem(rbuf);
+	unmap_sysmem(wbuf);
+	ut_assertok(host_dev_bind(0, NULL, false));
+	os_unlink(fname);
+
+	return 0;
+}
+DM_TEST(dm_test_blk_queued, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
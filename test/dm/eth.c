@@ -7,16 +7,21 @@
  */
 
 #include <common.h>
+#include <command.h>
 #include <dm.h>
 #include <env.h>
+#include <fastboot.h>
 #include <fdtdec.h>
 #include <log.h>
 #include <malloc.h>
+#include <mapmem.h>
 #include <net.h>
+#include <net/fastboot.h>
 #include <asm/eth.h>
 #include <dm/test.h>
 #include <dm/device-internal.h>
 #include <dm/uclass-internal.h>
+#include <linux/sizes.h>
 #include <test/test.h>
 #include <test/ut.h>
 
@@ -460,3 +465,306 @@ static int dm_test_eth_async_ping_reply(struct unit_test_state *uts)
 }
 
 DM_TEST(dm_test_eth_async_ping_reply, UT_TESTF_SCAN_FDT);
+
+/* Where the last UDP packet was received */
+static uchar *rx_loan_pkt;
+static unsigned int rx_loan_len;
+
+static void sb_rx_loan_handler(uchar *pkt, unsigned int dport,
+			       struct in_addr sip, unsigned int sport,
+			       unsigned int len)
+{
+	rx_loan_pkt = pkt;
+	rx_loan_len = len;
+}
+
+/* Inject a UDP packet with @len bytes of data */
+static void sb_inject_udp(struct eth_sandbox_priv *priv, int len)
+{
+	uchar *pkt = priv->recv_packet_buffer[priv->recv_packets];
+	int i;
+
+	net_set_ether(pkt, net_ethaddr, PROT_IP);
+	net_set_udp_header(pkt + ETHER_HDR_SIZE, net_ip, 1234, 5678, len);
+	for (i = 0; i < len; i++)
+		pkt[ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + i] = i;
+	priv->recv_packet_length[priv->recv_packets++] =
+		ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + len;
+}
+
+/* Test receiving a packet straight into a lent buffer */
+static int dm_test_eth_rx_loan(struct unit_test_state *uts)
+{
+	const int hdr_len = ETHER_HDR_SIZE + IP_UDP_HDR_SIZE;
+	struct in_addr old_ip = net_ip;
+	struct eth_sandbox_priv *priv;
+	uchar *buf, *dest;
+	int i;
+
+	env_set("ethact", "eth@10002000");
+	ut_assertok(net_init());
+	ut_assertok(eth_init());
+	priv = dev_get_priv(eth_get_dev());
+	net_ip = string_to_ip("1.1.2.2");
+	net_set_udp_handler(sb_rx_loan_handler);
+
+	buf = malloc(SZ_1K);
+	ut_assertnonnull(buf);
+	memset(buf, 0xa5, SZ_1K);
+	dest = buf + 64;
+	ut_assertok(net_rx_loan(dest, hdr_len, 100));
+	ut_asserteq(-EINVAL, net_rx_loan(dest + 1, hdr_len, 100));
+	ut_assertok(net_rx_loan(dest, hdr_len, 100));
+
+	/* The data lands in place and the bytes before it are put back */
+	sb_inject_udp(priv, 100);
+	ut_asserteq(0, eth_rx());
+	ut_asserteq_ptr(dest, rx_loan_pkt);
+	ut_asserteq(100, rx_loan_len);
+	ut_asserteq(1, priv->recv_into_count);
+	for (i = 0; i < 64; i++)
+		ut_asserteq(0xa5, buf[i]);
+	for (i = 0; i < 100; i++)
+		ut_asserteq(i, dest[i]);
+	ut_asserteq(0xa5, dest[100]);
+
+	/* A packet which does not fit is received as usual */
+	sb_inject_udp(priv, 101);
+	ut_asserteq(0, eth_rx());
+	ut_assert(rx_loan_pkt != dest);
+	ut_asserteq(101, rx_loan_len);
+	ut_asserteq(1, priv->recv_into_count);
+	ut_asserteq(0xa5, dest[100]);
+
+	/* Nothing is lent once the loan ends */
+	net_rx_loan_end();
+	sb_inject_udp(priv, 10);
+	ut_asserteq(0, eth_rx());
+	ut_assert(rx_loan_pkt != dest);
+	ut_asserteq(1, priv->recv_into_count);
+
+	net_set_udp_handler(NULL);
+	net_ip = old_ip;
+	eth_halt();
+	free(buf);
+
+	return 0;
+}
+DM_TEST(dm_test_eth_rx_loan, UT_TESTF_SCAN_FDT);
+
+/* A file served by sb_tftp_handler() */
+#define SB_TFTP_SIZE		5000
+#define SB_TFTP_BLKSIZE		512
+#define SB_TFTP_PORT		3000
+
+static uchar *sb_tftp_data;
+
+/* Act as a TFTP server which gives the file size and uses small blocks */
+static int sb_tftp_handler(struct udevice *dev, void *packet,
+			   unsigned int len)
+{
+	struct eth_sandbox_priv *priv = dev_get_priv(dev);
+	struct ethernet_hdr *eth = packet;
+	struct ip_udp_hdr *ip = packet + ETHER_HDR_SIZE;
+	__be16 *req = packet + ETHER_HDR_SIZE + IP_UDP_HDR_SIZE;
+	uchar *pkt, *data;
+	int block, size, data_len;
+
+	if (!sandbox_eth_arp_req_to_reply(dev, packet, len))
+		return 0;
+	if (ntohs(eth->et_protlen) != PROT_IP || ip->ip_p != IPPROTO_UDP ||
+	    priv->recv_packets >= PKTBUFSRX)
+		return 0;
+
+	pkt = priv->recv_packet_buffer[priv->recv_packets];
+	data = pkt + ETHER_HDR_SIZE + IP_UDP_HDR_SIZE;
+	switch (ntohs(req[0])) {
+	case 1:		/* RRQ: reply with OACK */
+		*(__be16 *)data = htons(6);
+		data_len = 2 + sprintf((char *)data + 2,
+				       "blksize%c%d%ctsize%c%d%c", 0,
+				       SB_TFTP_BLKSIZE, 0, 0, SB_TFTP_SIZE, 0);
+		break;
+	case 4:		/* ACK: send the next block, if any */
+		block = ntohs(req[1]);
+		if (block * SB_TFTP_BLKSIZE > SB_TFTP_SIZE)
+			return 0;
+		size = min(SB_TFTP_BLKSIZE,
+			   SB_TFTP_SIZE - block * SB_TFTP_BLKSIZE);
+		*(__be16 *)data = htons(3);
+		*(__be16 *)(data + 2) = htons(block + 1);
+		memcpy(data + 4, sb_tftp_data + block * SB_TFTP_BLKSIZE, size);
+		data_len = 4 + size;
+		break;
+	default:
+		return 0;
+	}
+	net_set_ether(pkt, eth->et_src, PROT_IP);
+	net_set_udp_header(pkt + ETHER_HDR_SIZE, net_ip, ntohs(ip->udp_src),
+			   SB_TFTP_PORT, data_len);
+	priv->recv_packet_length[priv->recv_packets++] =
+		ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + data_len;
+
+	return 0;
+}
+
+/* Test that TFTP has its blocks received straight into place */
+static int dm_test_eth_tftp_loan(struct unit_test_state *uts)
+{
+	struct eth_sandbox_priv *priv;
+	struct udevice *dev;
+	uchar *buf;
+	int i;
+
+	if (!IS_ENABLED(CONFIG_TFTP_TSIZE))
+		return -EAGAIN;
+
+	sb_tftp_data = malloc(SB_TFTP_SIZE);
+	ut_assertnonnull(sb_tftp_data);
+	for (i = 0; i < SB_TFTP_SIZE; i++)
+		sb_tftp_data[i] = i * 7 + (i >> 8);
+
+	ut_assertok(uclass_get_device_by_name(UCLASS_ETH, "eth@10002000",
+					      &dev));
+	priv = dev_get_priv(dev);
+	priv->recv_into_count = 0;
+	sandbox_eth_set_tx_handler(0, sb_tftp_handler);
+	env_set("ethact", "eth@10002000");
+
+	buf = map_sysmem(0x1000000, SB_TFTP_SIZE + SZ_1K);
+	memset(buf, 0xa5, SB_TFTP_SIZE + SZ_1K);
+	ut_assertok(run_command("tftpboot 1000000 1.1.2.3:test.bin", 0));
+	ut_asserteq(SB_TFTP_SIZE, env_get_hex("filesize", 0));
+	ut_asserteq_mem(sb_tftp_data, buf, SB_TFTP_SIZE);
+
+	/* Nothing past the end of the file is touched */
+	for (i = SB_TFTP_SIZE; i < SB_TFTP_SIZE + SZ_1K; i++)
+		ut_asserteq(0xa5, buf[i]);
+
+	/*
+	 * The first block is received as usual, since the headers of the
+	 * second would go before the file
+	 */
+	ut_asserteq(DIV_ROUND_UP(SB_TFTP_SIZE, SB_TFTP_BLKSIZE) - 1,
+		    priv->recv_into_count);
+
+	unmap_sysmem(buf);
+	sandbox_eth_set_tx_handler(0, NULL);
+	free(sb_tftp_data);
+
+	return 0;
+}
+DM_TEST(dm_test_eth_tftp_loan, UT_TESTF_SCAN_FDT);
+
+/* Fastboot packet IDs and the largest data in a packet */
+#define SB_FB_QUERY		1
+#define SB_FB_FASTBOOT		3
+#define SB_FB_DATA_SIZE		1020
+
+/* Last reply sent by fastboot, after its header */
+static char sb_fb_reply[64];
+static int sb_fb_reply_len;
+
+static int sb_fastboot_handler(struct udevice *dev, void *packet,
+			       unsigned int len)
+{
+	struct ethernet_hdr *eth = packet;
+	int hdr_len = ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + 4;
+
+	if (ntohs(eth->et_protlen) != PROT_IP || len < hdr_len)
+		return 0;
+	sb_fb_reply_len = min_t(int, len - hdr_len, sizeof(sb_fb_reply) - 1);
+	memcpy(sb_fb_reply, packet + hdr_len, sb_fb_reply_len);
+	sb_fb_reply[sb_fb_reply_len] = '\0';
+
+	return 0;
+}
+
+/* Send a fastboot packet from the host and process it */
+static int sb_fastboot_send(struct eth_sandbox_priv *priv, int id, int seq,
+			    const void *data, int len)
+{
+	uchar *pkt = priv->recv_packet_buffer[priv->recv_packets];
+	uchar *hdr = pkt + ETHER_HDR_SIZE + IP_UDP_HDR_SIZE;
+
+	net_set_ether(pkt, net_ethaddr, PROT_IP);
+	net_set_udp_header(pkt + ETHER_HDR_SIZE, net_ip,
+			   CONFIG_UDP_FUNCTION_FASTBOOT_PORT, 1234, 4 + len);
+	hdr[0] = id;
+	hdr[1] = 0;
+	hdr[2] = seq >> 8;
+	hdr[3] = seq;
+	memcpy(hdr + 4, data, len);
+	priv->recv_packet_length[priv->recv_packets++] =
+		ETHER_HDR_SIZE + IP_UDP_HDR_SIZE + 4 + len;
+	sb_fb_reply_len = -1;
+
+	return eth_rx();
+}
+
+/* Test that fastboot over UDP has download data received straight into place */
+static int dm_test_eth_fastboot_loan(struct unit_test_state *uts)
+{
+	const char cmd[] = "download:00001000";
+	struct in_addr old_ip = net_ip;
+	struct eth_sandbox_priv *priv;
+	uchar *buf, *data;
+	int i, seq, len;
+
+	if (!IS_ENABLED(CONFIG_UDP_FUNCTION_FASTBOOT))
+		return -EAGAIN;
+
+	data = malloc(SZ_4K);
+	ut_assertnonnull(data);
+	for (i = 0; i < SZ_4K; i++)
+		data[i] = i * 3 + (i >> 8);
+	buf = calloc(1, SZ_8K);
+	ut_assertnonnull(buf);
+
+	env_set("ethact", "eth@10002000");
+	ut_assertok(net_init());
+	ut_assertok(eth_init());
+	priv = dev_get_priv(eth_get_dev());
+	priv->recv_into_count = 0;
+	net_ip = string_to_ip("1.1.2.2");
+	sandbox_eth_set_tx_handler(0, sb_fastboot_handler);
+	fastboot_init(buf, SZ_8K);
+	fastboot_start_server();
+	/* Avoid an ARP request for the host */
+	memcpy(net_server_ethaddr, priv->fake_host_hwaddr, ARP_HLEN);
+
+	ut_assertok(sb_fastboot_send(priv, SB_FB_QUERY, 0, NULL, 0));
+	ut_asserteq(2, sb_fb_reply_len);
+	seq = (u8)sb_fb_reply[0] << 8 | (u8)sb_fb_reply[1];
+
+	/* A command is sent, then an empty packet to get the response */
+	ut_assertok(sb_fastboot_send(priv, SB_FB_FASTBOOT, seq++, cmd,
+				     strlen(cmd)));
+	ut_asserteq(0, sb_fb_reply_len);
+	ut_assertok(sb_fastboot_send(priv, SB_FB_FASTBOOT, seq++, NULL, 0));
+	ut_asserteq_str("DATA00001000", sb_fb_reply);
+
+	for (i = 0; i < SZ_4K; i += len) {
+		len = min(SZ_4K - i, SB_FB_DATA_SIZE);
+		ut_assertok(sb_fastboot_send(priv, SB_FB_FASTBOOT, seq++,
+					     data + i, len));
+		ut_asserteq(0, sb_fb_reply_len);
+	}
+	ut_assertok(sb_fastboot_send(priv, SB_FB_FASTBOOT, seq++, NULL, 0));
+	ut_asserteq_str("OKAY", sb_fb_reply);
+	ut_asserteq_mem(data, buf, SZ_4K);
+
+	/* Only the first data packet is received as usual */
+	ut_asserteq(DIV_ROUND_UP(SZ_4K, SB_FB_DATA_SIZE) - 1,
+		    priv->recv_into_count);
+
+	net_set_udp_handler(NULL);
+	sandbox_eth_set_tx_handler(0, NULL);
+	net_ip = old_ip;
+	eth_halt();
+	free(buf);
+	free(data);
+
+	return 0;
+}
+DM_TEST(dm_test_eth_fastboot_loan, UT_TESTF_SCAN_FDT);
@@ -4,14 +4,21 @@
  */
 
 #include <common.h>
+#include <blk.h>
+#include <console.h>
 #include <dm.h>
 #include <fastboot.h>
+#include <fastboot-internal.h>
 #include <fb_mmc.h>
+#include <malloc.h>
 #include <mmc.h>
 #include <part.h>
 #include <part_efi.h>
+#include <sparse_format.h>
+#include <asm/cache.h>
 #include <dm/test.h>
 #include <test/ut.h>
+#include <linux/sizes.h>
 #include <linux/stringify.h>
 
 #define FB_ALIAS_PREFIX "fastboot_partition_alias_"
@@ -93,3 +100,255 @@ static int dm_test_fastboot_mmc_part(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_fastboot_mmc_part, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+/* Add a chunk to a sparse image, returning the place for the next one */
+static u8 *fastboot_test_chunk(u8 *p, u16 type, u32 blocks, int fill_byte,
+			       u32 data_sz)
+{
+	chunk_header_t *chdr = (chunk_header_t *)p;
+
+	chdr->chunk_type = type;
+	chdr->chunk_sz = blocks;
+	chdr->total_sz = sizeof(*chdr) + data_sz;
+	memset(p + sizeof(*chdr), fill_byte, data_sz);
+
+	return p + chdr->total_sz;
+}
+
+static int dm_test_fastboot_mmc_sparse(struct unit_test_state *uts)
+{
+	char response[FASTBOOT_RESPONSE_LEN] = {0};
+	const int blksz = 512;
+	struct disk_partition parts[1] = {
+		{
+			.start = 48,
+			.size = 64,
+			.name = "test1",
+		},
+	};
+	char str_disk_guid[UUID_STR_LEN + 1];
+	struct blk_desc *mmc_dev_desc;
+	sparse_header_t *shdr;
+	u8 *sparse, *buf, *p;
+	int i;
+
+	ut_assertok(blk_get_device_by_str("mmc", "0", &mmc_dev_desc));
+	if (CONFIG_IS_ENABLED(RANDOM_UUID)) {
+		gen_rand_uuid_str(parts[0].uuid, UUID_STR_FORMAT_STD);
+		gen_rand_uuid_str(str_disk_guid, UUID_STR_FORMAT_STD);
+	}
+	ut_assertok(gpt_restore(mmc_dev_desc, str_disk_guid, parts,
+				ARRAY_SIZE(parts)));
+	buf = malloc(16 * blksz);
+	ut_assertnonnull(buf);
+	memset(buf, 0xff, 16 * blksz);
+	ut_asserteq(16, blk_dwrite(mmc_dev_desc, 48, 16, buf));
+
+	/*
+	 * Raw chunks either side of a CRC32 chunk, zero fill, don't care and
+	 * another raw chunk
+	 */
+	sparse = calloc(1, SZ_8K);
+	ut_assertnonnull(sparse);
+	shdr = (sparse_header_t *)sparse;
+	shdr->magic = SPARSE_HEADER_MAGIC;
+	shdr->major_version = 1;
+	shdr->file_hdr_sz = sizeof(*shdr);
+	shdr->chunk_hdr_sz = sizeof(chunk_header_t);
+	shdr->blk_sz = blksz;
+	shdr->total_blks = 16;
+	shdr->total_chunks = 6;
+	p = sparse + sizeof(*shdr);
+	p = fastboot_test_chunk(p, CHUNK_TYPE_RAW, 3, 0x11, 3 * blksz);
+	p = fastboot_test_chunk(p, CHUNK_TYPE_CRC32, 0, 0, 0);
+	p = fastboot_test_chunk(p, CHUNK_TYPE_RAW, 2, 0x22, 2 * blksz);
+	p = fastboot_test_chunk(p, CHUNK_TYPE_FILL, 8, 0, sizeof(u32));
+	p = fastboot_test_chunk(p, CHUNK_TYPE_DONT_CARE, 2, 0, 0);
+	p = fastboot_test_chunk(p, CHUNK_TYPE_RAW, 1, 0x33, blksz);
+
+	/* The first two raw chunks are written together */
+	console_record_reset_enable();
+	fastboot_mmc_flash_write("test1", sparse, p - sparse, response);
+	ut_asserteq_str("OKAY", response);
+	ut_assert_skip_to_line("........ raw 6, fill 0, zeroed 8, skipped 2 blocks in 2 writes");
+	ut_assert_console_end();
+
+	ut_asserteq(16, blk_dread(mmc_dev_desc, 48, 16, buf));
+	for (i = 0; i < 3 * blksz; i++)
+		ut_asserteq(0x11, buf[i]);
+	for (; i < 5 * blksz; i++)
+		ut_asserteq(0x22, buf[i]);
+	for (; i < 13 * blksz; i++)
+		ut_asserteq(0, buf[i]);
+	for (; i < 15 * blksz; i++)
+		ut_asserteq(0xff, buf[i]);
+	for (; i < 16 * blksz; i++)
+		ut_asserteq(0x33, buf[i]);
+
+	free(sparse);
+	free(buf);
+
+	return 0;
+}
+DM_TEST(dm_test_fastboot_mmc_sparse, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT |
+	UT_TESTF_CONSOLE_REC);
+
+#if CONFIG_IS_ENABLED(FASTBOOT_CMD_OEM_STREAM)
+/* Run a fastboot command and check that the response starts with @expect */
+static int fastboot_test_cmd(struct unit_test_state *uts, const char *cmd,
+			     const char *expect)
+{
+	char response[FASTBOOT_RESPONSE_LEN] = {0};
+	char cmd_string[FASTBOOT_COMMAND_LEN];
+
+	strlcpy(cmd_string, cmd, sizeof(cmd_string));
+	fastboot_handle_command(cmd_string, response);
+	ut_asserteq_strn(expect, response);
+
+	return 0;
+}
+
+/* Download @data in pieces of @piece bytes, streaming it to "test1" */
+static int fastboot_test_stream(struct unit_test_state *uts, const u8 *data,
+				int size, int piece)
+{
+	char response[FASTBOOT_RESPONSE_LEN] = {0};
+	char cmd[32];
+	int i;
+
+	snprintf(cmd, sizeof(cmd), "download:%08x", size);
+	ut_assertok(fastboot_test_cmd(uts, cmd, "DATA"));
+	for (i = 0; i < size; i += piece) {
+		fastboot_data_download(data + i, min(piece, size - i),
+				       response);
+		ut_asserteq_str("", response);
+	}
+	ut_asserteq(0, fastboot_data_remaining());
+	fastboot_data_complete(response);
+	ut_asserteq_str("OKAY", response);
+
+	return 0;
+}
+
+static int dm_test_fastboot_mmc_stream(struct unit_test_state *uts)
+{
+	const int blksz = 512, size = 20000;
+	struct disk_partition parts[1] = {
+		{
+			.start = 48,
+			.size = 64,
+			.name = "test1",
+		},
+	};
+	char str_disk_guid[UUID_STR_LEN + 1];
+	struct blk_desc *mmc_dev_desc;
+	char response[FASTBOOT_RESPONSE_LEN];
+	sparse_header_t *shdr;
+	chunk_header_t *chdr;
+	u8 *data, *sparse, *buf, *p;
+	int i;
+
+	ut_assertok(blk_get_device_by_str("mmc", "0", &mmc_dev_desc));
+	if (CONFIG_IS_ENABLED(RANDOM_UUID)) {
+		gen_rand_uuid_str(parts[0].uuid, UUID_STR_FORMAT_STD);
+		gen_rand_uuid_str(str_disk_guid, UUID_STR_FORMAT_STD);
+	}
+	ut_assertok(gpt_restore(mmc_dev_desc, str_disk_guid, parts,
+				ARRAY_SIZE(parts)));
+
+	data = malloc(size);
+	ut_assertnonnull(data);
+	for (i = 0; i < size; i++)
+		data[i] = i * 13 + (i >> 9);
+	buf = malloc(64 * blksz);
+	ut_assertnonnull(buf);
+
+	/* Use a small buffer, so it is refilled many times */
+	fastboot_init(memalign(ARCH_DMA_MINALIGN, SZ_4K), SZ_4K);
+	ut_assertnonnull(fastboot_buf_addr);
+
+	/* Flashing another partition is refused before anything is written */
+	memset(buf, 0xff, 64 * blksz);
+	ut_asserteq(64, blk_dwrite(mmc_dev_desc, 48, 64, buf));
+	ut_assertok(fastboot_test_cmd(uts, "oem stream:test1", "OKAY"));
+	ut_assertok(fastboot_test_cmd(uts, "flash:test2", "FAIL"));
+	ut_assertok(fastboot_test_cmd(uts, "download:00004e20", "FAIL"));
+	ut_asserteq(64, blk_dread(mmc_dev_desc, 48, 64, buf));
+	for (i = 0; i < 64 * blksz; i++)
+		ut_asserteq(0xff, buf[i]);
+
+	/* A raw image larger than the buffer, ending part way into a block */
+	ut_assertok(fastboot_test_cmd(uts, "oem stream:test1", "OKAY"));
+	ut_assertok(fastboot_test_stream(uts, data, size, 1000));
+	ut_assertok(fastboot_test_cmd(uts, "flash:test1", "OKAY"));
+	ut_asserteq(40, blk_dread(mmc_dev_desc, 48, 40, buf));
+	ut_asserteq_mem(data, buf, size);
+	for (i = size; i < 40 * blksz; i++)
+		ut_asserteq(0, buf[i]);
+
+	/* Only one download is streamed */
+	ut_assertok(fastboot_test_cmd(uts, "download:00004e20", "FAIL"));
+
+	/* A sparse image: raw, fill, don't care and raw chunks */
+	sparse = calloc(1, SZ_4K);
+	ut_assertnonnull(sparse);
+	shdr = (sparse_header_t *)sparse;
+	shdr->magic = SPARSE_HEADER_MAGIC;
+	shdr->major_version = 1;
+	shdr->file_hdr_sz = sizeof(*shdr);
+	shdr->chunk_hdr_sz = sizeof(chunk_header_t);
+	shdr->blk_sz = blksz;
+	shdr->total_blks = 7;
+	shdr->total_chunks = 4;
+	p = sparse + sizeof(*shdr);
+	p = fastboot_test_chunk(p, CHUNK_TYPE_RAW, 2, 0x11, 2 * blksz);
+	p = fastboot_test_chunk(p, CHUNK_TYPE_FILL, 3, 0x5a, sizeof(u32));
+	p = fastboot_test_chunk(p, CHUNK_TYPE_DONT_CARE, 1, 0, 0);
+	p = fastboot_test_chunk(p, CHUNK_TYPE_RAW, 1, 0x22, blksz);
+
+	ut_assertok(fastboot_test_cmd(uts, "oem stream:test1", "OKAY"));
+	ut_assertok(fastboot_test_stream(uts, sparse, p - sparse, 100));
+	ut_assertok(fastboot_test_cmd(uts, "flash:test1", "OKAY"));
+	ut_asserteq(7, blk_dread(mmc_dev_desc, 48, 7, buf));
+	for (i = 0; i < 2 * blksz; i++)
+		ut_asserteq(0x11, buf[i]);
+	for (; i < 5 * blksz; i++)
+		ut_asserteq(0x5a, buf[i]);
+	ut_asserteq_mem(data + 5 * blksz, buf + 5 * blksz, blksz);
+	for (i = 6 * blksz; i < 7 * blksz; i++)
+		ut_asserteq(0x22, buf[i]);
+
+	/*
+	 * A sparse image which does not fit the partition fails, but the rest
+	 * of the download is still taken and only then is the failure reported
+	 */
+	chdr = (chunk_header_t *)(sparse + sizeof(*shdr));
+	chdr->chunk_sz = 65;
+	chdr->total_sz = sizeof(*chdr) + 65 * blksz;
+	shdr->total_blks = 70;
+	ut_assertok(fastboot_test_cmd(uts, "oem stream:test1", "OKAY"));
+	ut_assertok(fastboot_test_cmd(uts, "download:00001000", "DATA"));
+	for (i = 0; i < SZ_4K; i += SZ_1K) {
+		fastboot_data_download(sparse + i, SZ_1K, response);
+		ut_asserteq_str("", response);
+	}
+	ut_asserteq(0, fastboot_data_remaining());
+	fastboot_data_complete(response);
+	ut_asserteq_strn("FAIL", response);
+	ut_assertok(fastboot_test_cmd(uts, "download:00004e20", "FAIL"));
+
+	/* Without streaming, a download must fit in the buffer */
+	ut_assertok(fastboot_test_cmd(uts, "oem stream:test1", "OKAY"));
+	ut_assertok(fastboot_test_cmd(uts, "oem stream", "OKAY"));
+	ut_assertok(fastboot_test_cmd(uts, "download:00004e20", "FAIL"));
+
+	free(fastboot_buf_addr);
+	fastboot_init(NULL, 0);
+	free(sparse);
+	free(buf);
+	free(data);
+
+	return 0;
+}
+DM_TEST(dm_test_fastboot_mmc_stream, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+#endif
@@ -0,0 +1,160 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for the devicetree node index
+ */
+
+#include <common.h>
+#include <dm.h>
+#include <malloc.h>
+#include <time.h>
+#include <asm/global_data.h>
+#include <dm/device-internal.h>
+#include <dm/node_index.h>
+#include <dm/root.h>
+#include <dm/test.h>
+#include <dm/uclass-internal.h>
+#include <linux/libfdt.h>
+#include <linux/sizes.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+DECLARE_GLOBAL_DATA_PTR;
+
+/* Number of nodes in the benchmark tree */
+#define NODE_COUNT	5000
+
+/* Every n'th node is looked up without the index, since that is slow */
+#define SLOW_STRIDE	10
+
+/* Create a tree with NODE_COUNT nodes under the root, each with a phandle */
+static int make_tree(struct unit_test_state *uts, void *fdt, int size)
+{
+	char name[20];
+	int i;
+
+	ut_assertok(fdt_create(fdt, size));
+	ut_assertok(fdt_finish_reservemap(fdt));
+	ut_assertok(fdt_begin_node(fdt, ""));
+	ut_assertok(fdt_property_u32(fdt, "#address-cells", 1));
+	ut_assertok(fdt_property_u32(fdt, "#size-cells", 0));
+	for (i = 0; i < NODE_COUNT; i++) {
+		snprintf(name, sizeof(name), "node@%x", i);
+		ut_assertok(fdt_begin_node(fdt, name));
+		ut_assertok(fdt_property_u32(fdt, "reg", i));
+		ut_assertok(fdt_property_u32(fdt, "phandle", i + 1));
+		ut_assertok(fdt_end_node(fdt));
+	}
+	ut_assertok(fdt_end_node(fdt));
+	ut_assertok(fdt_finish(fdt));
+
+	return 0;
+}
+
+/* Look up every @stride'th node by phandle, then its device by node */
+static int lookup_nodes(struct unit_test_state *uts, struct udevice **devs,
+			int stride, ulong *usp)
+{
+	ulong start = timer_get_us();
+	int i;
+
+	for (i = 0; i < NODE_COUNT; i += stride) {
+		struct udevice *dev;
+		ofnode node;
+
+		node = ofnode_get_by_phandle(i + 1);
+		ut_assert(ofnode_equal(node, dev_ofnode(devs[i])));
+		ut_assertok(uclass_find_device_by_ofnode(UCLASS_TEST_DUMMY,
+							 node, &dev));
+		ut_asserteq_ptr(devs[i], dev);
+	}
+	*usp = timer_get_us() - start;
+
+	return 0;
+}
+
+/* Check lookups in the tree, with and without the index */
+static int check_lookups(struct unit_test_state *uts, struct udevice **devs)
+{
+	struct dm_node_index *idx;
+	ulong fast_us, slow_us;
+	struct udevice *dev;
+	ofnode node;
+	int ret;
+
+	ut_assertok(lookup_nodes(uts, devs, 1, &fast_us));
+
+	/* Hide the index to measure the search */
+	idx = gd->dm_node_index;
+	gd->dm_node_index = NULL;
+	ret = lookup_nodes(uts, devs, SLOW_STRIDE, &slow_us);
+	gd->dm_node_index = idx;
+	ut_assertok(ret);
+
+	printf("%d nodes: indexed %lu ns, search %lu ns per lookup\n",
+	       NODE_COUNT, fast_us * 1000 / NODE_COUNT,
+	       slow_us * 1000 * SLOW_STRIDE / NODE_COUNT);
+
+	/* Unknown phandles and unbound devices are not found */
+	ut_assert(!ofnode_valid(ofnode_get_by_phandle(NODE_COUNT + 1)));
+	node = dev_ofnode(devs[0]);
+	ut_assertok(device_unbind(devs[0]));
+	devs[0] = NULL;
+	ut_asserteq(-ENODEV, uclass_find_device_by_ofnode(UCLASS_TEST_DUMMY,
+							  node, &dev));
+
+	/* A device given a new node after binding is found under it */
+	dev_set_ofnode(devs[1], node);
+	ut_assertok(uclass_find_device_by_ofnode(UCLASS_TEST_DUMMY, node,
+						 &dev));
+	ut_asserteq_ptr(devs[1], dev);
+	ut_assertok(dm_node_index_find_dev(UCLASS_TEST_DUMMY, node, &dev));
+	ut_asserteq_ptr(devs[1], dev);
+
+	return 0;
+}
+
+/* Test looking up nodes and devices in a large tree */
+static int dm_test_node_index(struct unit_test_state *uts)
+{
+	const void *old_blob = gd->fdt_blob;
+	struct udevice **devs;
+	int size = SZ_512K;
+	ofnode node;
+	void *fdt;
+	int i, ret;
+
+	ut_assertnonnull(gd->dm_node_index);
+	fdt = malloc(size);
+	ut_assertnonnull(fdt);
+	ut_assertok(make_tree(uts, fdt, size));
+	devs = calloc(NODE_COUNT, sizeof(*devs));
+	ut_assertnonnull(devs);
+
+	/* The tree replaces the control FDT, so clean up before checking */
+	gd->fdt_blob = fdt;
+	oftree_reset();
+	i = 0;
+	ret = 0;
+	ofnode_for_each_subnode(node, ofnode_root()) {
+		ret = device_bind(dm_root(), DM_DRIVER_GET(fdt_dummy_drv),
+				  ofnode_get_name(node), NULL, node, &devs[i]);
+		if (ret)
+			break;
+		i++;
+	}
+	if (!ret)
+		ret = check_lookups(uts, devs);
+
+	for (i = 0; i < NODE_COUNT; i++) {
+		if (devs[i])
+			device_unbind(devs[i]);
+	}
+	gd->fdt_blob = old_blob;
+	oftree_reset();
+	free(devs);
+	free(fdt);
+	ut_assertok(ret);
+
+	return 0;
+}
+DM_TEST(dm_test_node_index, UT_TESTF_FLAT_TREE);
@@ -1240,3 +1240,52 @@ static int dm_test_ofnode_copy_props_ot(struct unit_test_state *uts)
 	return 0;
 }
 DM_TEST(dm_test_ofnode_copy_props_ot, UT_TESTF_SCAN_FDT | UT_TESTF_OTHER_FDT);
+
+/* check a live tree copied out of a flat tree */
+static int dm_test_ofnode_live_copy(struct unit_test_state *uts)
+{
+	struct device_node *root, *np, *prev;
+	int node, child, count;
+	char fdt[1024];
+
+	ut_assertok(fdt_create_empty_tree(fdt, sizeof(fdt)));
+	node = fdt_add_subnode(fdt, 0, "other");
+	ut_assert(node > 0);
+	node = fdt_add_subnode(fdt, 0, "bus@1000");
+	ut_assert(node > 0);
+	ut_assertok(fdt_setprop_string(fdt, node, "compatible", "simple-bus"));
+	ut_assertok(fdt_setprop_u32(fdt, node, "phandle", 42));
+	child = fdt_add_subnode(fdt, node, "dev@0");
+	ut_assert(child > 0);
+	ut_assertok(fdt_setprop_string(fdt, child, "compatible", "denx,dev"));
+	ut_assertok(fdt_setprop_u32(fdt, child, "reg", 0));
+
+	ut_assertok(unflatten_device_tree_copy(fdt, &root));
+
+	/* Nothing may refer to the flat tree any more */
+	memset(fdt, '\0', sizeof(fdt));
+
+	np = of_find_node_opts_by_path(root, "/bus@1000/dev@0", NULL);
+	ut_assertnonnull(np);
+	ut_asserteq_str("/bus@1000/dev@0", np->full_name);
+	ut_asserteq_str("dev@0", np->name);
+	ut_asserteq_str("denx,dev", of_get_property(np, "compatible", NULL));
+	ut_asserteq_str("simple-bus",
+			of_get_property(np->parent, "compatible", NULL));
+	ut_asserteq(42, np->parent->phandle);
+	ut_asserteq_ptr(np->parent, of_find_node_by_phandle(root, 42));
+
+	/* The nodes are next to each other, in depth-first order */
+	count = 0;
+	prev = root;
+	for (np = of_find_all_nodes(root); np; np = of_find_all_nodes(np)) {
+		ut_asserteq_ptr(prev + 1, np);
+		prev = np;
+		count++;
+	}
+	ut_asserteq(3, count);
+	free(root);
+
+	return 0;
+}
+DM_TEST(dm_test_ofnode_live_copy, 0);
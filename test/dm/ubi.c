@@ -0,0 +1,167 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for UBI attaching, using sandbox SPI flash
+ */
+
+#include <common.h>
+#include <console.h>
+#include <dm.h>
+#include <malloc.h>
+#include <os.h>
+#include <spi_flash.h>
+#include <ubi_uboot.h>
+#include <asm/state.h>
+#include <asm/test.h>
+#include <dm/test.h>
+#include <linux/mtd/partitions.h>
+#include <linux/sizes.h>
+#include <test/test.h>
+#include <test/ut.h>
+
+#define UBI_TEST_FLASH_SIZE	SZ_2M
+
+static const struct mtd_partition ubi_test_parts[] = {
+	{
+		.name = "ubi-a",
+		.offset = 0,
+		.size = SZ_1M,
+	},
+	{
+		.name = "ubi-b",
+		.offset = MTDPART_OFS_APPEND,
+		.size = MTDPART_SIZ_FULL,
+	},
+};
+
+/* Attach UBI to an MTD partition, checking whether any headers were kept */
+static int ubi_test_attach(struct unit_test_state *uts, const char *name,
+			   bool cached)
+{
+	char line[CONFIG_SYS_CBSIZE];
+	bool found = false;
+
+	if (ubi_devices[0])
+		ubi_exit();
+	console_record_reset_enable();
+	ut_assertok(ubi_mtd_param_parse(name, NULL));
+	ut_assertok(ubi_init());
+	ut_assertnonnull(ubi_devices[0]);
+	ut_asserteq_str(name, ubi_devices[0]->mtd->name);
+
+	while (console_record_readline(line, sizeof(line)) > 0) {
+		if (strstr(line, "using headers found by the last scan"))
+			found = true;
+	}
+	ut_asserteq(cached, found);
+
+	return 0;
+}
+
+/* Check that reading both headers at once gives the same as one at a time */
+static int ubi_test_read_hdrs(struct unit_test_state *uts,
+			      struct ubi_device *ubi)
+{
+	struct ubi_vid_hdr *vid_hdr, *vid_hdr2;
+	struct ubi_ec_hdr *ec_hdr, *ec_hdr2;
+	int pnum, err, vid_err, used = 0;
+
+	ec_hdr = kzalloc(ubi->ec_hdr_alsize, GFP_KERNEL);
+	ec_hdr2 = kzalloc(ubi->ec_hdr_alsize, GFP_KERNEL);
+	vid_hdr = ubi_zalloc_vid_hdr(ubi, GFP_KERNEL);
+	vid_hdr2 = ubi_zalloc_vid_hdr(ubi, GFP_KERNEL);
+	ut_assertnonnull(ec_hdr);
+	ut_assertnonnull(ec_hdr2);
+	ut_assertnonnull(vid_hdr);
+	ut_assertnonnull(vid_hdr2);
+
+	for (pnum = 0; pnum < ubi->peb_count; pnum++) {
+		vid_err = -1;
+		err = ubi_io_read_hdrs(ubi, pnum, ec_hdr, vid_hdr, &vid_err,
+				       0);
+		ut_asserteq(ubi_io_read_ec_hdr(ubi, pnum, ec_hdr2, 0), err);
+		ut_asserteq(0, err);
+		ut_asserteq_mem(ec_hdr2, ec_hdr, UBI_EC_HDR_SIZE);
+
+		ut_asserteq(ubi_io_read_vid_hdr(ubi, pnum, vid_hdr2, 0),
+			    vid_err);
+		if (!vid_err) {
+			ut_asserteq_mem(vid_hdr2, vid_hdr, UBI_VID_HDR_SIZE);
+			used++;
+		} else {
+			ut_asserteq(UBI_IO_FF, vid_err);
+		}
+	}
+
+	/* The layout volume at least is there */
+	ut_assert(used >= UBI_LAYOUT_VOLUME_EBS);
+
+	ubi_free_vid_hdr(ubi, vid_hdr2);
+	ubi_free_vid_hdr(ubi, vid_hdr);
+	kfree(ec_hdr2);
+	kfree(ec_hdr);
+
+	return 0;
+}
+
+/* Test attaching UBI and keeping the headers found by scanning */
+static int dm_test_ubi_scan_cache(struct unit_test_state *uts)
+{
+	struct spi_flash *flash;
+	struct mtd_info *mtd;
+	struct udevice *dev;
+	size_t retlen;
+	u8 *buf;
+
+	buf = malloc(UBI_TEST_FLASH_SIZE);
+	ut_assertnonnull(buf);
+	memset(buf, 0xff, UBI_TEST_FLASH_SIZE);
+	ut_assertok(os_write_file("spi.bin", buf, UBI_TEST_FLASH_SIZE));
+	free(buf);
+
+	ut_assertok(uclass_first_device_err(UCLASS_SPI_FLASH, &dev));
+	flash = dev_get_uclass_priv(dev);
+	ut_assertok(add_mtd_partitions(&flash->mtd, ubi_test_parts,
+				       ARRAY_SIZE(ubi_test_parts)));
+
+	/* Formatting writes to the flash, so nothing is kept */
+	ut_assertok(ubi_test_attach(uts, "ubi-a", false));
+	ut_assertok(ubi_test_attach(uts, "ubi-b", false));
+
+	/* Now the headers are read and kept for each partition */
+	ut_assertok(ubi_test_attach(uts, "ubi-a", false));
+	ut_assertok(ubi_test_read_hdrs(uts, ubi_devices[0]));
+	ut_assertok(ubi_test_attach(uts, "ubi-b", false));
+
+	/* Switching back and forth uses the kept headers */
+	ut_assertok(ubi_test_attach(uts, "ubi-a", true));
+	ut_assertok(ubi_test_attach(uts, "ubi-b", true));
+	ut_assertok(ubi_test_attach(uts, "ubi-a", true));
+
+	/* Writing with the SPI flash API drops all of them */
+	ut_assertok(spi_flash_erase_dm(dev, UBI_TEST_FLASH_SIZE - SZ_64K,
+				       SZ_64K));
+	ut_assertok(ubi_test_attach(uts, "ubi-b", false));
+	ut_assertok(ubi_test_attach(uts, "ubi-a", false));
+	ut_assertok(ubi_test_attach(uts, "ubi-a", true));
+
+	/* So does writing through the MTD layer */
+	mtd = get_mtd_device_nm("ubi-b");
+	ut_assertok_ptr(mtd);
+	ut_assertok(mtd_write(mtd, mtd->size - 4, 4, &retlen,
+			      (const u_char *)"test"));
+	put_mtd_device(mtd);
+	ut_assertok(ubi_test_attach(uts, "ubi-a", false));
+
+	ubi_exit();
+	ut_assertok(del_mtd_partitions(&flash->mtd));
+
+	/*
+	 * Since we are about to destroy all devices, we must tell sandbox
+	 * to forget the emulation device
+	 */
+	sandbox_sf_unbind_emul(state_get_current(), 0, 0);
+
+	return 0;
+}
+DM_TEST(dm_test_ubi_scan_cache, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT |
+	UT_TESTF_CONSOLE_REC);
@@ -6,7 +6,9 @@
 #include <common.h>
 #include <console.h>
 #include <dm.h>
+#include <malloc.h>
 #include <part.h>
+#include <scsi.h>
 #include <usb.h>
 #include <asm/io.h>
 #include <asm/state.h>
@@ -85,6 +87,147 @@ static int dm_test_usb_flash(struct unit_test_state *uts)
 }
 DM_TEST(dm_test_usb_flash, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
 
+/* Test a UAS flash stick, with several commands outstanding on streams */
+static int dm_test_usb_flash_uas(struct unit_test_state *uts)
+{
+	const int count = 2000;
+	const u8 eps[] = { USB_DIR_IN | 2 };
+	struct usb_device *udev;
+	struct udevice *dev, *blk;
+	char *buf, *cmp;
+	int i;
+
+	state_set_skip_delays(true);
+	ut_assertok(usb_init());
+	ut_assertok(uclass_get_device(UCLASS_MASS_STORAGE, 1, &dev));
+	udev = dev_get_parent_priv(dev);
+	ut_asserteq(1, udev->config.if_desc[0].act_altsetting);
+	ut_assertok(device_find_first_child_by_uclass(dev, UCLASS_BLK, &blk));
+
+	/* Streams are only set up on endpoints of an existing interface */
+	ut_asserteq(-ENOENT, usb_alloc_streams(udev, 5, eps, 1, 4));
+	ut_asserteq(4, usb_alloc_streams(udev, 0, eps, 1, 4));
+
+	buf = malloc(count * 512);
+	cmp = malloc(count * 512);
+	ut_assertnonnull(buf);
+	ut_assertnonnull(cmp);
+	for (i = 0; i < count * 512; i++)
+		buf[i] = i * 13 + (i >> 9);
+
+	/* This is more than one command, so several are queued */
+	ut_asserteq(count, blk_write(blk, 10, count, buf));
+	memset(cmp, '\0', count * 512);
+	ut_asserteq(count, blk_read(blk, 10, count, cmp));
+	ut_asserteq_mem(buf, cmp, count * 512);
+
+	/* A single block, with one command */
+	memset(cmp, '\0', 512);
+	ut_asserteq(1, blk_read(blk, 11, 1, cmp));
+	ut_asserteq_mem(buf + 512, cmp, 512);
+
+	free(cmp);
+	free(buf);
+	ut_assertok(usb_stop());
+
+	return 0;
+}
+DM_TEST(dm_test_usb_flash_uas, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+/* Test queueing the phases of a mass-storage command without waiting */
+static int dm_test_usb_bulk_queue(struct unit_test_state *uts)
+{
+	struct umass_bbb_cbw cbw;
+	struct umass_bbb_csw csw;
+	struct usb_xfer xfer[3];
+	struct usb_device *udev;
+	struct udevice *dev;
+	char data[36];
+
+	state_set_skip_delays(true);
+	ut_assertok(usb_init());
+	ut_assertok(uclass_get_device(UCLASS_MASS_STORAGE, 0, &dev));
+	udev = dev_get_parent_priv(dev);
+
+	/* INQUIRY: command, data and status all queued up front */
+	memset(&cbw, '\0', sizeof(cbw));
+	cbw.dCBWSignature = CBWSIGNATURE;
+	cbw.dCBWTag = 0x1234;
+	cbw.dCBWDataTransferLength = sizeof(data);
+	cbw.bCBWFlags = CBWFLAGS_IN;
+	cbw.bCDBLength = 6;
+	cbw.CBWCDB[0] = SCSI_INQUIRY;
+	cbw.CBWCDB[4] = sizeof(data);
+
+	xfer[0].pipe = usb_sndbulkpipe(udev, 1);
+	xfer[0].buffer = &cbw;
+	xfer[0].length = UMASS_BBB_CBW_SIZE;
+	xfer[1].pipe = usb_rcvbulkpipe(udev, 2);
+	xfer[1].buffer = data;
+	xfer[1].length = sizeof(data);
+	xfer[2].pipe = usb_rcvbulkpipe(udev, 2);
+	xfer[2].buffer = &csw;
+	xfer[2].length = UMASS_BBB_CSW_SIZE;
+	ut_assertok(usb_bulk_submit(udev, &xfer[0]));
+	ut_assertok(usb_bulk_submit(udev, &xfer[1]));
+	ut_assertok(usb_bulk_submit(udev, &xfer[2]));
+	ut_assert(!xfer[2].complete);
+
+	/* Waiting for the last one finishes the others too */
+	ut_asserteq(UMASS_BBB_CSW_SIZE, usb_bulk_wait(udev, &xfer[2], 1000));
+	ut_assert(xfer[0].complete);
+	ut_asserteq(0, xfer[0].status);
+	ut_asserteq(sizeof(data), usb_bulk_wait(udev, &xfer[1], 1000));
+	ut_asserteq_mem("sandbox", data + 8, 7);
+	ut_asserteq(CSWSIGNATURE, csw.dCSWSignature);
+	ut_asserteq(0x1234, csw.dCSWTag);
+	ut_asserteq(CSWSTATUS_GOOD, csw.bCSWStatus);
+
+	/*
+	 * A failed transfer gives up the rest on its endpoint, but not those
+	 * on other endpoints. Device address 127 has no emulator, so the first
+	 * transfer fails.
+	 */
+	xfer[0].pipe = usb_rcvbulkpipe(udev, 2) | 0x7f << 8;
+	xfer[0].buffer = data;
+	xfer[0].length = sizeof(data);
+	xfer[1].pipe = usb_rcvbulkpipe(udev, 2);
+	xfer[1].buffer = data;
+	xfer[1].length = sizeof(data);
+	xfer[2].pipe = usb_sndbulkpipe(udev, 1);
+	xfer[2].buffer = &cbw;
+	xfer[2].length = UMASS_BBB_CBW_SIZE;
+	ut_assertok(usb_bulk_submit(udev, &xfer[0]));
+	ut_assertok(usb_bulk_submit(udev, &xfer[1]));
+	ut_assertok(usb_bulk_submit(udev, &xfer[2]));
+	ut_asserteq(3, usb_bulk_poll(udev));
+	ut_asserteq(-EIO, usb_bulk_wait(udev, &xfer[0], 1000));
+	ut_asserteq(-EIO, usb_bulk_wait(udev, &xfer[1], 1000));
+	ut_asserteq(USB_ST_NOT_PROC, xfer[1].status);
+	ut_assert(usb_bulk_wait(udev, &xfer[2], 1000) >= 0);
+
+	/* The device never saw the transfer given up, so the command works */
+	xfer[0].pipe = usb_rcvbulkpipe(udev, 2);
+	xfer[1].buffer = &csw;
+	xfer[1].length = UMASS_BBB_CSW_SIZE;
+	memset(data, '\0', sizeof(data));
+	ut_assertok(usb_bulk_submit(udev, &xfer[0]));
+	ut_assertok(usb_bulk_submit(udev, &xfer[1]));
+	ut_asserteq(UMASS_BBB_CSW_SIZE, usb_bulk_wait(udev, &xfer[1], 1000));
+	ut_asserteq(sizeof(data), usb_bulk_wait(udev, &xfer[0], 1000));
+	ut_asserteq_mem("sandbox", data + 8, 7);
+	ut_asserteq(CSWSTATUS_GOOD, csw.bCSWStatus);
+
+	/* Only bulk pipes can be queued */
+	xfer[0].pipe = usb_rcvctrlpipe(udev, 0);
+	ut_asserteq(-EINVAL, usb_bulk_submit(udev, &xfer[0]));
+
+	ut_assertok(usb_stop());
+
+	return 0;
+}
+DM_TEST(dm_test_usb_bulk_queue, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
 /* test that we can handle multiple storage devices */
 static int dm_test_usb_multi(struct unit_test_state *uts)
 {
@@ -130,6 +130,7 @@ static int dm_test_virtio_ring(struct unit_test_state *uts)
 	struct virtqueue *vq;
 	struct virtio_sg sg[2];
 	struct virtio_sg *sgs[2];
+	struct vring_desc *indir;
 	unsigned int len;
 	u8 buffer[2][32];
 
@@ -190,6 +191,28 @@ static int dm_test_virtio_ring(struct unit_test_state *uts)
 	ut_asserteq(6, len);
 	ut_assertok(virtio_del_vqs(dev));
 
+	/* requests with several buffers use one indirect descriptor */
+	ut_assertok(virtio_find_vqs(dev, 1, &vq));
+	vq->indirect = true;
+	ut_assertok(virtqueue_add(vq, sgs, 1, 1));
+	ut_asserteq(virtqueue_get_vring_size(vq) - 1, vq->num_free);
+	ut_asserteq(VRING_DESC_F_INDIRECT,
+		    virtio16_to_cpu(dev, vq->vring.desc[0].flags));
+	ut_asserteq(2 * sizeof(struct vring_desc),
+		    virtio32_to_cpu(dev, vq->vring.desc[0].len));
+	indir = (void *)(uintptr_t)virtio64_to_cpu(dev, vq->vring.desc[0].addr);
+	ut_asserteq_ptr(buffer[1],
+			(void *)(uintptr_t)virtio64_to_cpu(dev, indir[1].addr));
+	ut_asserteq(VRING_DESC_F_NEXT, virtio16_to_cpu(dev, indir[0].flags));
+	ut_asserteq(VRING_DESC_F_WRITE, virtio16_to_cpu(dev, indir[1].flags));
+	vq->vring.used->idx = 1;
+	vq->vring.used->ring[0].id = 0;
+	vq->vring.used->ring[0].len = 32;
+	ut_asserteq_ptr(buffer, virtqueue_get_buf(vq, &len));
+	ut_asserteq(32, len);
+	ut_asserteq(virtqueue_get_vring_size(vq), vq->num_free);
+	ut_assertok(virtio_del_vqs(dev));
+
 	return 0;
 }
 DM_TEST(dm_test_virtio_ring, UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
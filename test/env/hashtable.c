@@ -7,6 +7,7 @@
 #include <common.h>
 #include <command.h>
 #include <log.h>
+#include <malloc.h>
 #include <search.h>
 #include <stdio.h>
 #include <test/env.h>
@@ -15,6 +16,9 @@
 #define SIZE 32
 #define ITERATIONS 10000
 
+/* Number of variables in the large table, like a big production env */
+#define BIG_SIZE 3000
+
 static int htab_fill(struct unit_test_state *uts,
 		     struct hsearch_data *htab, size_t size)
 {
@@ -124,3 +128,140 @@ static int env_test_htab_deletes(struct unit_test_state *uts)
 }
 
 ENV_TEST(env_test_htab_deletes, 0);
+
+/* Check that an export has @count "key=value" lines in key order */
+static int htab_check_export(struct unit_test_state *uts,
+			     struct hsearch_data *htab, int count)
+{
+	char *res = NULL, *p, *line, *prev = "";
+	int n = 0;
+
+	ut_assert(hexport_r(htab, '\n', 0, &res, 0, 0, NULL) > 0);
+	for (p = res; *p; prev = line) {
+		line = p;
+		p = strchr(p, '\n');
+		ut_assertnonnull(p);
+		*p++ = '\0';
+		ut_assert(strcmp(prev, line) < 0);
+		n++;
+	}
+	free(res);
+	ut_asserteq(count, n);
+
+	return 0;
+}
+
+/* Grow a small table to a large one, adding keys out of order */
+static int env_test_htab_grow(struct unit_test_state *uts)
+{
+	struct hsearch_data htab;
+	struct env_entry item, *ritem;
+	char key[20], *res;
+	int i, idx, count;
+
+	memset(&htab, 0, sizeof(htab));
+	ut_asserteq(1, hcreate_r(8, &htab));
+
+	for (i = 0; i < BIG_SIZE; i++) {
+		/* 1999 is coprime with BIG_SIZE, so this visits each once */
+		sprintf(key, "var%04d", i * 1999 % BIG_SIZE);
+		item.callback = NULL;
+		item.flags = 0;
+		item.key = key;
+		item.data = key;
+		ut_asserteq(1, hsearch_r(item, ENV_ENTER, &ritem, &htab, 0));
+	}
+	ut_asserteq(BIG_SIZE, htab.filled);
+	ut_assert(htab.size >= BIG_SIZE);
+
+	/* Entries stay where they are as the table grows */
+	item.key = "var0000";
+	ut_assert(hsearch_r(item, ENV_FIND, &ritem, &htab, 0) > 0);
+	ut_asserteq_str("var0000", ritem->data);
+
+	res = NULL;
+	ut_assert(hexport_r(&htab, '\0', 0, &res, 0, 0, NULL) > 0);
+	free(res);
+	ut_assertok(htab_check_export(uts, &htab, BIG_SIZE));
+
+	/* Delete some and add others out of order */
+	for (i = 0; i < BIG_SIZE; i += 3) {
+		sprintf(key, "var%04d", i);
+		ut_assertok(hdelete_r(key, &htab, 0));
+	}
+	count = BIG_SIZE - DIV_ROUND_UP(BIG_SIZE, 3);
+	for (i = 0; i < 10; i++) {
+		sprintf(key, "new%d", 9 - i);
+		item.key = key;
+		item.data = key;
+		ut_asserteq(1, hsearch_r(item, ENV_ENTER, &ritem, &htab, 0));
+	}
+	count += 10;
+	ut_asserteq(count, htab.filled);
+	ut_assertok(htab_check_export(uts, &htab, count));
+
+	/* Matching goes through the keys in order */
+	idx = 0;
+	i = 0;
+	key[0] = '\0';
+	while ((idx = hmatch_r("new", idx, &ritem, &htab))) {
+		ut_assert(strcmp(key, ritem->key) < 0);
+		strcpy(key, ritem->key);
+		i++;
+	}
+	ut_asserteq(10, i);
+
+	hdestroy_r(&htab);
+
+	return 0;
+}
+
+ENV_TEST(env_test_htab_grow, 0);
+
+static int change_count;
+
+static int count_change_ok(const struct env_entry *item, const char *newval,
+			   enum env_op op, int flag)
+{
+	change_count++;
+
+	return 0;
+}
+
+/* Importing on top of a table only applies the changes */
+static int env_test_htab_import_delta(struct unit_test_state *uts)
+{
+	static const char first[] = "a=1\0b=2\0c=3\0";
+	static const char second[] = "a=1\0b=5\0c=3\0d=4\0";
+	struct hsearch_data htab;
+	struct env_entry item, *ritem;
+
+	memset(&htab, 0, sizeof(htab));
+	htab.change_ok = count_change_ok;
+	change_count = 0;
+	ut_asserteq(1, himport_r(&htab, first, sizeof(first), '\0', 0, 0, 0,
+				 NULL));
+	ut_asserteq(3, change_count);
+
+	/* Only 'b' changes and 'd' is new */
+	change_count = 0;
+	ut_asserteq(1, himport_r(&htab, second, sizeof(second), '\0',
+				 H_NOCLEAR, 0, 0, NULL));
+	ut_asserteq(2, change_count);
+	ut_asserteq(4, htab.filled);
+	item.key = "b";
+	ut_assert(hsearch_r(item, ENV_FIND, &ritem, &htab, 0) > 0);
+	ut_asserteq_str("5", ritem->data);
+
+	/* Without H_NOCLEAR, everything is imported again */
+	change_count = 0;
+	ut_asserteq(1, himport_r(&htab, first, sizeof(first), '\0', 0, 0, 0,
+				 NULL));
+	ut_asserteq(3, change_count);
+	ut_asserteq(3, htab.filled);
+	hdestroy_r(&htab);
+
+	return 0;
+}
+
+ENV_TEST(env_test_htab_import_delta, 0);
@@ -0,0 +1,163 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Tests for running jobs on secondary CPUs
+ */
+
+#include <common.h>
+#include <hash.h>
+#include <job.h>
+#include <malloc.h>
+#include <time.h>
+#include <linux/sizes.h>
+#include <test/lib.h>
+#include <test/test.h>
+#include <test/ut.h>
+#include <u-boot/sha256.h>
+
+/* Number of regions hashed at once, one per CPU */
+#define HASH_COUNT	(CONFIG_JOB_MAX_WORKERS + 1)
+
+/* Size of each region hashed */
+#define HASH_SIZE	SZ_8M
+
+static int job_square(struct job *job)
+{
+	int *val = job->priv;
+
+	*val *= *val;
+
+	return *val == 49 ? -EINVAL : 0;
+}
+
+/* Test running lots of small jobs */
+static int lib_test_job_run(struct unit_test_state *uts)
+{
+	struct job jobs[20];
+	int vals[20];
+	int i;
+
+	ut_asserteq(CONFIG_JOB_MAX_WORKERS, job_workers());
+	for (i = 0; i < ARRAY_SIZE(jobs); i++) {
+		vals[i] = i;
+		job_init(&jobs[i], job_square, &vals[i]);
+		job_submit(&jobs[i]);
+	}
+	for (i = 0; i < ARRAY_SIZE(jobs); i++) {
+		ut_asserteq(i == 7 ? -EINVAL : 0, job_wait(&jobs[i]));
+		ut_asserteq(i * i, vals[i]);
+	}
+
+	return 0;
+}
+LIB_TEST(lib_test_job_run, 0);
+
+/* Test filling and copying memory in parts */
+static int lib_test_job_mem(struct unit_test_state *uts)
+{
+	const size_t sizes[] = { 0, 1, SZ_4K + 3, SZ_1M + 13 };
+	const size_t size = SZ_1M + 13;
+	u8 *src, *dst;
+	int i, j;
+
+	src = malloc(size + 1);
+	dst = malloc(size + 1);
+	ut_assertnonnull(src);
+	ut_assertnonnull(dst);
+	for (i = 0; i < size; i++)
+		src[i] = i * 7 + (i >> 11);
+
+	for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+		size_t len = sizes[i];
+
+		memset(dst, '\0', size + 1);
+		job_memset(dst, 0xa5, len);
+		for (j = 0; j < len; j++)
+			ut_asserteq(0xa5, dst[j]);
+		ut_asserteq(0, dst[len]);
+
+		job_memcpy(dst, src, len);
+		ut_asserteq_mem(src, dst, len);
+		ut_asserteq(0, dst[len]);
+	}
+	free(dst);
+	free(src);
+
+	return 0;
+}
+LIB_TEST(lib_test_job_mem, 0);
+
+/* Test hashing several regions at once, against hashing them one by one */
+static int lib_test_job_hash(struct unit_test_state *uts)
+{
+	u8 expect[HASH_COUNT][SHA256_SUM_LEN];
+	u8 output[HASH_COUNT][SHA256_SUM_LEN];
+	struct job_hash jobs[HASH_COUNT];
+	ulong start, serial_us, job_us;
+	struct hash_algo *algo;
+	u8 *buf;
+	int i;
+
+	buf = malloc(HASH_COUNT * HASH_SIZE);
+	ut_assertnonnull(buf);
+	for (i = 0; i < HASH_COUNT * HASH_SIZE; i += sizeof(u32))
+		*(u32 *)(buf + i) = i * 0x9e3779b9;
+
+	ut_assertok(hash_lookup_algo("sha256", &algo));
+	start = timer_get_us();
+	for (i = 0; i < HASH_COUNT; i++)
+		algo->hash_func_ws(buf + i * HASH_SIZE, HASH_SIZE, expect[i],
+				   algo->chunk_size);
+	serial_us = timer_get_us() - start;
+
+	start = timer_get_us();
+	for (i = 0; i < HASH_COUNT; i++)
+		ut_assertok(job_hash_start(&jobs[i], "sha256",
+					   buf + i * HASH_SIZE, HASH_SIZE));
+	for (i = 0; i < HASH_COUNT; i++)
+		ut_assertok(job_hash_finish(&jobs[i], output[i],
+					    SHA256_SUM_LEN));
+	job_us = timer_get_us() - start;
+	free(buf);
+
+	for (i = 0; i < HASH_COUNT; i++)
+		ut_asserteq_mem(expect[i], output[i], SHA256_SUM_LEN);
+	ut_asserteq(-EPROTONOSUPPORT,
+		    job_hash_start(&jobs[0], "nonsense", NULL, 0));
+
+	printf("sha256 of %d x %d MiB: one CPU %lu us, %d CPUs %lu us\n",
+	       HASH_COUNT, HASH_SIZE / SZ_1M, serial_us, job_workers() + 1,
+	       job_us);
+
+	return 0;
+}
+LIB_TEST(lib_test_job_hash, 0);
+
+#if CONFIG_IS_ENABLED(LZ4)
+/* Test decompressing an LZ4 block on several CPUs at once */
+static int lib_test_job_lz4(struct unit_test_state *uts)
+{
+	/* "abcd", a 16-byte match four bytes back, then the final literals */
+	static const u8 block[] = {
+		0x4c, 'a', 'b', 'c', 'd', 0x04, 0x00,
+		0x50, 'w', 'x', 'y', 'z', '!',
+	};
+	const char *expect = "abcdabcdabcdabcdabcdwxyz!";
+	struct job_lz4 jobs[4];
+	char out[4][32];
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(jobs); i++)
+		job_lz4_start(&jobs[i], block, sizeof(block), out[i],
+			      i == 3 ? 10 : sizeof(out[i]));
+	for (i = 0; i < 3; i++) {
+		ut_asserteq(strlen(expect), job_wait(&jobs[i].job));
+		ut_asserteq_mem(expect, out[i], strlen(expect));
+	}
+
+	/* There is not enough space for the last one */
+	ut_assert(job_wait(&jobs[3].job) < 0);
+
+	return 0;
+}
+LIB_TEST(lib_test_job_lz4, 0);
+#endif
@@ -8,6 +8,7 @@
 #include <lmb.h>
 #include <log.h>
 #include <malloc.h>
+#include <time.h>
 #include <dm/test.h>
 #include <test/test.h>
 #include <test/ut.h>
@@ -670,6 +671,8 @@ static int lib_test_lmb_max_regions(struct unit_test_state *uts)
 	const phys_addr_t ram = 0x00000000;
 	const phys_size_t ram_size = 0x8000000;
 	const phys_size_t blk_size = 0x10000;
+	const bool grow = IS_ENABLED(CONFIG_LMB_GROW_REGIONS);
+	const int nr = grow ? 9 : 8;
 	phys_addr_t offset;
 	struct lmb lmb;
 	int ret, i;
@@ -690,12 +693,13 @@ static int lib_test_lmb_max_regions(struct unit_test_state *uts)
 	ut_asserteq(lmb.memory.cnt, 8);
 	ut_asserteq(lmb.reserved.cnt, 0);
 
-	/*  error for the 9th memory regions */
+	/*  error for the 9th memory regions, unless the array can grow */
 	offset = ram + 2 * 8 * ram_size;
 	ret = lmb_add(&lmb, offset, ram_size);
-	ut_asserteq(ret, -1);
+	ut_asserteq(ret, grow ? 0 : -1);
 
-	ut_asserteq(lmb.memory.cnt, 8);
+	ut_asserteq(lmb.memory.cnt, nr);
+	ut_asserteq(lmb.memory.max, grow ? 16 : 8);
 	ut_asserteq(lmb.reserved.cnt, 0);
 
 	/*  reserve 8 regions */
@@ -705,24 +709,26 @@ static int lib_test_lmb_max_regions(struct unit_test_state *uts)
 		ut_asserteq(ret, 0);
 	}
 
-	ut_asserteq(lmb.memory.cnt, 8);
+	ut_asserteq(lmb.memory.cnt, nr);
 	ut_asserteq(lmb.reserved.cnt, 8);
 
-	/*  error for the 9th reserved blocks */
+	/*  error for the 9th reserved blocks, unless the array can grow */
 	offset = ram + 2 * 8 * blk_size;
 	ret = lmb_reserve(&lmb, offset, blk_size);
-	ut_asserteq(ret, -1);
+	ut_asserteq(ret, grow ? 0 : -1);
 
-	ut_asserteq(lmb.memory.cnt, 8);
-	ut_asserteq(lmb.reserved.cnt, 8);
+	ut_asserteq(lmb.memory.cnt, nr);
+	ut_asserteq(lmb.reserved.cnt, nr);
 
 	/*  check each regions */
-	for (i = 0; i < 8; i++)
+	for (i = 0; i < nr; i++)
 		ut_asserteq(lmb.memory.region[i].base, ram + 2 * i * ram_size);
 
-	for (i = 0; i < 8; i++)
+	for (i = 0; i < nr; i++)
 		ut_asserteq(lmb.reserved.region[i].base, ram + 2 * i * blk_size);
 
+	lmb_uninit(&lmb);
+
 	return 0;
 }
 
@@ -817,3 +823,80 @@ static int lib_test_lmb_flags(struct unit_test_state *uts)
 
 DM_TEST(lib_test_lmb_flags,
 	UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
+
+/* Check lookups stay correct and fast with thousands of reserved regions */
+static int lib_test_lmb_many_regions(struct unit_test_state *uts)
+{
+	const phys_addr_t ram = 0x40000000;
+	const phys_size_t ram_size = 0x40000000;
+	const phys_size_t blk_size = 0x1000;
+	const int count = 4096;
+	phys_addr_t base, alloc;
+	ulong start, reserve_us, lookup_us;
+	struct lmb lmb;
+	int ret, i, j;
+
+	if (!IS_ENABLED(CONFIG_LMB_GROW_REGIONS))
+		return -EAGAIN;
+
+	lmb_init(&lmb);
+	ret = lmb_add(&lmb, ram, ram_size);
+	ut_asserteq(ret, 0);
+
+	/*
+	 * Reserve every other block in a scrambled order (count is a power of
+	 * two and 1237 is odd, so each slot is visited once) so that the
+	 * regions can neither merge nor simply be appended
+	 */
+	start = timer_get_us();
+	for (i = 0; i < count; i++) {
+		j = (i * 1237) % count;
+		base = ram + 2 * j * blk_size;
+		ret = lmb_reserve(&lmb, base, blk_size);
+		ut_asserteq(ret, 0);
+	}
+	reserve_us = timer_get_us() - start;
+	ut_asserteq(lmb.reserved.cnt, count);
+	ut_assert(lmb.reserved.max >= count);
+
+	for (i = 0; i < count; i++)
+		ut_asserteq(lmb.reserved.region[i].base,
+			    ram + 2 * i * blk_size);
+
+	start = timer_get_us();
+	for (i = 0; i < count; i++) {
+		base = ram + 2 * i * blk_size;
+		ut_asserteq(lmb_is_reserved(&lmb, base + blk_size - 1), 1);
+		ut_asserteq(lmb_is_reserved(&lmb, base + blk_size), 0);
+		if (i < count - 1)
+			ut_asserteq(lmb_get_free_size(&lmb, base + blk_size),
+				    blk_size);
+	}
+	lookup_us = timer_get_us() - start;
+
+	/* the top-down allocator takes the highest gap, then fills a hole */
+	alloc = lmb_alloc(&lmb, blk_size, blk_size);
+	ut_asserteq(alloc, ram + ram_size - blk_size);
+	alloc = lmb_alloc_addr(&lmb, ram + blk_size, blk_size);
+	ut_asserteq(alloc, ram + blk_size);
+	ut_asserteq(lmb.reserved.cnt, count);
+
+	/* splitting a region in the middle of the table */
+	ret = lmb_free(&lmb, ram + blk_size / 2, blk_size);
+	ut_asserteq(ret, 0);
+	ut_asserteq(lmb.reserved.cnt, count + 1);
+	ut_asserteq(lmb_is_reserved(&lmb, ram + blk_size), 0);
+	ut_asserteq(lmb_is_reserved(&lmb, ram + 3 * blk_size / 2), 1);
+
+	printf("%d regions: reserve %lu us, lookup %lu us\n", count,
+	       reserve_us, lookup_us);
+
+	lmb_uninit(&lmb);
+	ut_asserteq(lmb.reserved.cnt, 0);
+	ut_asserteq(lmb.reserved.max, CONFIG_LMB_MAX_REGIONS);
+
+	return 0;
+}
+
+DM_TEST(lib_test_lmb_many_regions,
+	UT_TESTF_SCAN_PDATA | UT_TESTF_SCAN_FDT);
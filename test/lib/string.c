@@ -12,6 +12,9 @@
 #include <common.h>
 #include <command.h>
 #include <log.h>
+#include <malloc.h>
+#include <time.h>
+#include <linux/sizes.h>
 #include <test/lib.h>
 #include <test/test.h>
 #include <test/ut.h>
@@ -225,3 +228,139 @@ static int lib_memdup(struct unit_test_state *uts)
 	return 0;
 }
 LIB_TEST(lib_memdup, 0);
+
+/**
+ * test_str_bytes() - check the string functions at one alignment and length
+ *
+ * @uts:	unit test state
+ * @buf:	buffer, filled with non-zero bytes except the terminator
+ * @other:	copy of @buf at the same or a different alignment
+ * @len:	length of the string in @buf
+ * Return:	0 = success, 1 = failure
+ */
+static int test_str_bytes(struct unit_test_state *uts, char *buf, char *other,
+			  int len)
+{
+	int i;
+
+	ut_asserteq(len, strlen(buf));
+	for (i = 0; i <= len + 1; i++)
+		ut_asserteq(min(i, len), strnlen(buf, i));
+	ut_asserteq(0, strcmp(buf, other));
+	ut_asserteq(0, memcmp(buf, other, len + 1));
+	ut_asserteq_ptr(buf + len, memchr(buf, '\0', len + 1));
+	ut_assertnull(memchr(buf, '\0', len));
+
+	/* Make each byte in turn differ, in both directions */
+	for (i = 0; i < len; i++) {
+		char old = other[i];
+
+		other[i] = buf[i] + 1;
+		ut_assert(strcmp(buf, other) < 0);
+		ut_assert(strcmp(other, buf) > 0);
+		ut_assert(memcmp(buf, other, len) < 0);
+		ut_assert(memcmp(other, buf, len) > 0);
+		ut_asserteq(0, memcmp(buf, other, i));
+		ut_asserteq_ptr(other + i, memchr(other, buf[i] + 1, len));
+		other[i] = old;
+	}
+
+	/* A shorter string compares less */
+	if (len) {
+		other[len - 1] = '\0';
+		ut_assert(strcmp(other, buf) < 0);
+		ut_assert(strcmp(buf, other) > 0);
+		other[len - 1] = buf[len - 1];
+	}
+
+	return 0;
+}
+
+/** lib_string_words() - unit test for strlen(), strcmp(), memcmp(), etc. */
+static int lib_string_words(struct unit_test_state *uts)
+{
+	char buf[BUFLEN], other[BUFLEN];
+	int offset, offset2, len, i;
+
+	/* Use bytes with the top bit set to catch signed comparisons */
+	for (offset = 0; offset < SWEEP; offset++) {
+		for (offset2 = 0; offset2 < SWEEP; offset2 += 3) {
+			for (len = 0; len < BUFLEN - SWEEP; len++) {
+				for (i = 0; i < len; i++) {
+					buf[offset + i] = 0x7e + i;
+					other[offset2 + i] = 0x7e + i;
+				}
+				buf[offset + len] = '\0';
+				other[offset2 + len] = '\0';
+				ut_assertok(test_str_bytes(uts, buf + offset,
+							   other + offset2,
+							   len));
+			}
+		}
+	}
+
+	return 0;
+}
+LIB_TEST(lib_string_words, 0);
+
+/* Size of the buffer scanned by the benchmark */
+#define SPEED_LEN	SZ_1M
+
+/* Number of times each function is run in the benchmark */
+#define SPEED_LOOPS	20
+
+/* Print the speed of a function which scanned SPEED_LEN bytes, in bytes/us */
+static void show_speed(const char *name, ulong start)
+{
+	ulong us = max(timer_get_us() - start, 1UL);
+
+	printf("%-8s %6lu bytes/us\n", name,
+	       (ulong)SPEED_LEN * SPEED_LOOPS / us);
+}
+
+/** lib_string_speed() - measure the speed of the string functions */
+static int lib_string_speed(struct unit_test_state *uts)
+{
+	char *buf, *other;
+	ulong start;
+	int i;
+
+	buf = malloc(SPEED_LEN + 1);
+	other = malloc(SPEED_LEN + 1);
+	ut_assertnonnull(buf);
+	ut_assertnonnull(other);
+	memset(buf, 'x', SPEED_LEN);
+	buf[SPEED_LEN] = '\0';
+	memcpy(other, buf, SPEED_LEN + 1);
+
+	start = timer_get_us();
+	for (i = 0; i < SPEED_LOOPS; i++)
+		ut_asserteq(SPEED_LEN, strlen(buf));
+	show_speed("strlen", start);
+
+	start = timer_get_us();
+	for (i = 0; i < SPEED_LOOPS; i++)
+		ut_asserteq(SPEED_LEN, strnlen(buf, SPEED_LEN + 1));
+	show_speed("strnlen", start);
+
+	start = timer_get_us();
+	for (i = 0; i < SPEED_LOOPS; i++)
+		ut_asserteq(0, strcmp(buf, other));
+	show_speed("strcmp", start);
+
+	start = timer_get_us();
+	for (i = 0; i < SPEED_LOOPS; i++)
+		ut_asserteq(0, memcmp(buf, other, SPEED_LEN));
+	show_speed("memcmp", start);
+
+	start = timer_get_us();
+	for (i = 0; i < SPEED_LOOPS; i++)
+		ut_asserteq_ptr(buf + SPEED_LEN, memchr(buf, '\0', SPEED_LEN + 1));
+	show_speed("memchr", start);
+
+	free(other);
+	free(buf);
+
+	return 0;
+}
+LIB_TEST(lib_string_speed, 0);
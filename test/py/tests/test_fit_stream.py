@@ -0,0 +1,84 @@
+# SPDX-License-Identifier: GPL-2.0+
+
+"""Check that bootm verifies a FIT kernel before it decompresses it in chunks
+(CONFIG_BOOTM_DECOMP_STREAM)
+"""
+
+import pytest
+import fit_util
+import u_boot_utils as util
+
+# A gzipped kernel protected by a hash only
+BASE_ITS = '''
+/dts-v1/;
+
+/ {
+        description = "FIT with a compressed, hashed kernel";
+        #address-cells = <1>;
+
+        images {
+                kernel-1 {
+                        data = /incbin/("%(kernel)s");
+                        type = "kernel";
+                        arch = "sandbox";
+                        os = "linux";
+                        compression = "gzip";
+                        load = <0x40000>;
+                        entry = <0x40000>;
+                        hash-1 {
+                                algo = "sha256";
+                        };
+                };
+        };
+        configurations {
+                default = "conf-1";
+                conf-1 {
+                        kernel = "kernel-1";
+                };
+        };
+};
+'''
+
+@pytest.mark.boardspec('sandbox')
+@pytest.mark.buildconfigspec('bootm_decomp_stream')
+@pytest.mark.requiredtool('dtc')
+@pytest.mark.requiredtool('gzip')
+def test_fit_stream_hash(u_boot_console):
+    """Test that a corrupted kernel is rejected before it is decompressed"""
+    cons = u_boot_console
+    mkimage = cons.config.build_dir + '/tools/mkimage'
+    kernel = fit_util.make_kernel(cons, 'stream-kernel.bin', 'kernel')
+    util.run_and_log(cons, ['gzip', '-f', '-k', kernel])
+    with open(kernel + '.gz', 'rb') as inf:
+        kernel_gz = inf.read()
+    fit = fit_util.make_fit(cons, mkimage, BASE_ITS,
+                            {'kernel': kernel + '.gz'}, 'stream.fit')
+    with open(fit, 'rb') as inf:
+        good = inf.read()
+
+    # Flip a bit in the middle of the compressed data
+    pos = good.find(kernel_gz)
+    assert pos != -1, 'Kernel data not found in FIT'
+    pos += len(kernel_gz) // 2
+    bad = bytearray(good)
+    bad[pos] ^= 1
+    bad_fit = fit_util.make_fname(cons, 'stream-bad.fit')
+    with open(bad_fit, 'wb') as outf:
+        outf.write(bad)
+
+    def run_bootm(fname, cmds):
+        cons.restart_uboot()
+        output = cons.run_command(f'host load hostfs 0 1000000 {fname}')
+        assert 'bytes read' in output
+        return '\n'.join(cons.run_command_list(['bootm start 1000000'] +
+                                                cmds))
+
+    with cons.log.section('Good kernel'):
+        output = run_bootm(fit, ['bootm loados', 'bootm go'])
+        assert 'Verifying Hash Integrity ... sha256+ OK' in output
+        assert 'Transferring control' in output
+
+    with cons.log.section('Bad kernel'):
+        output = run_bootm(bad_fit, ['bootm loados', 'bootm go'])
+        assert 'Bad Data Hash' in output
+        assert 'Transferring control' not in output